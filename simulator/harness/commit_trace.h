@@ -0,0 +1,324 @@
+#ifndef ION_COMMIT_TRACE_H
+#define ION_COMMIT_TRACE_H
+
+// Binary commit trace written by the Verilator harness (ION_COMMIT_TRACE) and
+// read back by commit_trace_decode.
+//
+// File layout: the 8-byte magic, then blocks of `u32 payload bytes, u32
+// record count, payload` (little endian). Every block starts from a fresh
+// encoder state, so a trace cut short by a killed simulation still decodes up
+// to its last complete block.
+//
+// A record is a flags byte followed by LEB128 varints: the sim_time delta to
+// the previous record, the signed PC delta from the fall-through address (only
+// with kPcJump), the privilege mode (only with kPriv, when it changed), the
+// instruction, then rd/wdata, the memory address/store data and the trap
+// cause when their flags are set. A straight-line ALU instruction costs five
+// to a dozen bytes.
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char kCommitTraceMagic[8] = {'I', 'O', 'N', 'C', 'T', 'R', '0', '1'};
+
+struct CommitRecord
+{
+	enum Flags : uint8_t
+	{
+		kWen = 1 << 0,
+		kPriv = 1 << 1,
+		kSkip = 1 << 2,
+		kLoad = 1 << 3,
+		kStore = 1 << 4,
+		kTrap = 1 << 5,
+		kInterrupt = 1 << 6,
+		kPcJump = 1 << 7,
+	};
+
+	uint64_t cycle = 0;
+	uint64_t pc = 0;
+	uint64_t wdata = 0;
+	uint64_t mem_addr = 0;
+	uint64_t mem_data = 0;
+	uint64_t cause = 0;
+	uint32_t instr = 0;
+	uint8_t rd = 0;
+	uint8_t flags = 0;
+	uint8_t priv = 3;
+
+	bool rvc() const { return (instr & 3) != 3; }
+	uint64_t next_pc() const { return pc + (rvc() ? 2 : 4); }
+};
+
+class CommitTraceEncoder
+{
+  public:
+	// Starts a new block; the decoder resets at the same point.
+	void reset()
+	{
+		cycle_ = 0;
+		pc_ = 0;
+		priv_ = 0xff;
+	}
+
+	void encode(const CommitRecord &r, std::string &out)
+	{
+		uint8_t flags = r.flags & (uint8_t) ~(CommitRecord::kPriv | CommitRecord::kPcJump);
+		if (r.priv != priv_)
+			flags |= CommitRecord::kPriv;
+		if (r.pc != pc_)
+			flags |= CommitRecord::kPcJump;
+		out.push_back((char)flags);
+		put(out, r.cycle - cycle_);
+		if (flags & CommitRecord::kPcJump)
+			put(out, zigzag(r.pc - pc_));
+		if (flags & CommitRecord::kPriv)
+			out.push_back((char)r.priv);
+		put(out, r.instr);
+		if (flags & CommitRecord::kWen)
+		{
+			out.push_back((char)r.rd);
+			put(out, r.wdata);
+		}
+		if (flags & (CommitRecord::kLoad | CommitRecord::kStore))
+			put(out, r.mem_addr);
+		if (flags & CommitRecord::kStore)
+			put(out, r.mem_data);
+		if (flags & CommitRecord::kTrap)
+			put(out, r.cause);
+		cycle_ = r.cycle;
+		pc_ = (flags & CommitRecord::kTrap) ? r.pc : r.next_pc();
+		priv_ = r.priv;
+	}
+
+  private:
+	static uint64_t zigzag(uint64_t delta) { return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63); }
+
+	static void put(std::string &out, uint64_t v)
+	{
+		while (v >= 0x80)
+		{
+			out.push_back((char)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((char)v);
+	}
+
+	uint64_t cycle_ = 0;
+	uint64_t pc_ = 0;
+	uint8_t priv_ = 0xff;
+};
+
+class CommitTraceDecoder
+{
+  public:
+	void reset(const uint8_t *data, size_t len)
+	{
+		p_ = data;
+		end_ = data + len;
+		cycle_ = 0;
+		pc_ = 0;
+		priv_ = 3;
+	}
+
+	// False at the end of the block or on a malformed record.
+	bool next(CommitRecord &r)
+	{
+		if (p_ >= end_)
+			return false;
+		r = CommitRecord();
+		r.flags = *p_++;
+		uint64_t v = 0;
+		if (!get(v))
+			return false;
+		r.cycle = cycle_ + v;
+		r.pc = pc_;
+		if (r.flags & CommitRecord::kPcJump)
+		{
+			if (!get(v))
+				return false;
+			r.pc = pc_ + ((v >> 1) ^ (0 - (v & 1)));
+		}
+		r.priv = priv_;
+		if (r.flags & CommitRecord::kPriv)
+		{
+			if (p_ >= end_)
+				return false;
+			r.priv = *p_++;
+		}
+		if (!get(v))
+			return false;
+		r.instr = (uint32_t)v;
+		if (r.flags & CommitRecord::kWen)
+		{
+			if (p_ >= end_)
+				return false;
+			r.rd = *p_++;
+			if (!get(r.wdata))
+				return false;
+		}
+		if ((r.flags & (CommitRecord::kLoad | CommitRecord::kStore)) && !get(r.mem_addr))
+			return false;
+		if ((r.flags & CommitRecord::kStore) && !get(r.mem_data))
+			return false;
+		if ((r.flags & CommitRecord::kTrap) && !get(r.cause))
+			return false;
+		cycle_ = r.cycle;
+		pc_ = (r.flags & CommitRecord::kTrap) ? r.pc : r.next_pc();
+		priv_ = r.priv;
+		return true;
+	}
+
+  private:
+	bool get(uint64_t &v)
+	{
+		v = 0;
+		for (unsigned shift = 0; shift < 64 && p_ < end_; shift += 7)
+		{
+			uint8_t b = *p_++;
+			v |= (uint64_t)(b & 0x7f) << shift;
+			if ((b & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	const uint8_t *p_ = nullptr;
+	const uint8_t *end_ = nullptr;
+	uint64_t cycle_ = 0;
+	uint64_t pc_ = 0;
+	uint8_t priv_ = 3;
+};
+
+// Encodes `count` records as one framed block (header included) into `block`.
+static inline void commit_trace_block(const CommitRecord *recs, size_t count, std::string &block)
+{
+	CommitTraceEncoder enc;
+	block.assign(8, '\0');
+	for (size_t i = 0; i < count; ++i)
+		enc.encode(recs[i], block);
+	uint32_t len = (uint32_t)(block.size() - 8);
+	for (unsigned i = 0; i < 4; ++i)
+	{
+		block[i] = (char)(len >> (8 * i));
+		block[4 + i] = (char)((uint32_t)count >> (8 * i));
+	}
+}
+
+// Walks the blocks of a trace file.
+class CommitTraceReader
+{
+  public:
+	enum Status
+	{
+		kBlock,
+		kEnd,
+		kTruncated,
+	};
+
+	explicit CommitTraceReader(FILE *f) : f_(f) {}
+
+	// False unless the file starts with kCommitTraceMagic.
+	bool check_magic()
+	{
+		char magic[sizeof(kCommitTraceMagic)];
+		return fread(magic, 1, sizeof(magic), f_) == sizeof(magic) &&
+		       memcmp(magic, kCommitTraceMagic, sizeof(magic)) == 0;
+	}
+
+	// Loads the next block into `dec`; `count` is the number of records the
+	// writer put in it. A block cut short by a killed run is kTruncated.
+	Status next(CommitTraceDecoder &dec, uint32_t &count)
+	{
+		uint8_t head[8];
+		size_t got = fread(head, 1, sizeof(head), f_);
+		if (got == 0)
+			return kEnd;
+		uint32_t len = 0;
+		count = 0;
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			len |= (uint32_t)head[i] << (8 * i);
+			count |= (uint32_t)head[4 + i] << (8 * i);
+		}
+		block_.resize(len);
+		if (got != sizeof(head) || fread(block_.data(), 1, len, f_) != len)
+			return kTruncated;
+		dec.reset(block_.data(), block_.size());
+		return kBlock;
+	}
+
+  private:
+	FILE *f_;
+	std::vector<uint8_t> block_;
+};
+
+static inline const char *commit_exception_name(uint64_t cause)
+{
+	static const char *const kNames[] = {
+		"trap_instruction_address_misaligned",
+		"trap_instruction_access_fault",
+		"trap_illegal_instruction",
+		"trap_breakpoint",
+		"trap_load_address_misaligned",
+		"trap_load_access_fault",
+		"trap_store_address_misaligned",
+		"trap_store_access_fault",
+		"trap_user_ecall",
+		"trap_supervisor_ecall",
+		"trap_virtual_supervisor_ecall",
+		"trap_machine_ecall",
+		"trap_instruction_page_fault",
+		"trap_load_page_fault",
+		nullptr,
+		"trap_store_page_fault",
+	};
+	if (cause < sizeof(kNames) / sizeof(kNames[0]))
+		return kNames[cause];
+	return nullptr;
+}
+
+// Access size in bytes of a load/store/AMO instruction.
+static inline unsigned commit_mem_bytes(uint32_t instr)
+{
+	unsigned funct3 = (instr & 3) != 3 ? (instr >> 13) & 7 : (instr >> 12) & 7;
+	if ((instr & 3) != 3)
+		return (funct3 & 1) ? 8 : 4;
+	return 1u << (funct3 & 3);
+}
+
+// One line in the layout of spike --log-commits; traps use spike's
+// exception/interrupt lines.
+static inline void print_commit_record(FILE *out, const CommitRecord &r)
+{
+	if (r.flags & CommitRecord::kTrap)
+	{
+		uint64_t code = r.cause & ~(1ull << 63);
+		const char *name = commit_exception_name(code);
+		if (r.flags & CommitRecord::kInterrupt)
+			fprintf(out, "core   0: interrupt #%" PRIu64 ", epc 0x%016" PRIx64 "\n", code, r.pc);
+		else if (name != nullptr)
+			fprintf(out, "core   0: exception %s, epc 0x%016" PRIx64 "\n", name, r.pc);
+		else
+			fprintf(out, "core   0: exception #%" PRIu64 ", epc 0x%016" PRIx64 "\n", code, r.pc);
+		return;
+	}
+	fprintf(out, "core   0: %u 0x%016" PRIx64, (unsigned)r.priv, r.pc);
+	if (r.rvc())
+		fprintf(out, " (0x%04x)", r.instr & 0xffff);
+	else
+		fprintf(out, " (0x%08x)", r.instr);
+	if (r.flags & CommitRecord::kWen)
+		fprintf(out, " x%-2u 0x%016" PRIx64, (unsigned)r.rd, r.wdata);
+	if (r.flags & (CommitRecord::kLoad | CommitRecord::kStore))
+		fprintf(out, " mem 0x%016" PRIx64, r.mem_addr);
+	if (r.flags & CommitRecord::kStore)
+		fprintf(out, " 0x%0*" PRIx64, (int)(2 * commit_mem_bytes(r.instr)), r.mem_data);
+	fputc('\n', out);
+}
+
+#endif
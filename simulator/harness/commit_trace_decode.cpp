@@ -0,0 +1,85 @@
+// Prints an ION_COMMIT_TRACE file in the layout of spike --log-commits, so the
+// two logs can be diffed directly:
+//
+//   core   0: 3 0x0000000080000004 (0x00000297) x5  0x0000000080000004
+//   core   0: 3 0x0000000080000010 (0x0002b503) x10 0x0000000000000000 mem 0x0000000080001000
+//   core   0: exception trap_illegal_instruction, epc 0x0000000080000020
+//
+// -c prefixes each line with the sim_time of the record. A trace cut short by
+// a killed simulation decodes up to its last complete block.
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "commit_trace.h"
+
+int main(int argc, char **argv)
+{
+	bool show_cycle = false;
+	const char *path = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-c") == 0)
+			show_cycle = true;
+		else if (path == nullptr)
+			path = argv[i];
+		else
+		{
+			path = nullptr;
+			break;
+		}
+	}
+	if (path == nullptr)
+	{
+		fprintf(stderr, "usage: %s [-c] <commit-trace>\n", argv[0]);
+		return 2;
+	}
+	FILE *f = fopen(path, "rb");
+	if (f == nullptr)
+	{
+		perror(path);
+		return 1;
+	}
+	CommitTraceReader reader(f);
+	if (!reader.check_magic())
+	{
+		fprintf(stderr, "%s: not a commit trace\n", path);
+		fclose(f);
+		return 1;
+	}
+
+	CommitTraceDecoder dec;
+	CommitRecord rec;
+	uint64_t records = 0;
+	uint32_t count = 0;
+	int status = 0;
+	for (;;)
+	{
+		CommitTraceReader::Status st = reader.next(dec, count);
+		if (st == CommitTraceReader::kEnd)
+			break;
+		if (st == CommitTraceReader::kTruncated)
+		{
+			fprintf(stderr, "%s: truncated block after %" PRIu64 " records\n", path, records);
+			break;
+		}
+		uint32_t n = 0;
+		while (dec.next(rec))
+		{
+			if (show_cycle)
+				printf("%12" PRIu64 " ", rec.cycle);
+			print_commit_record(stdout, rec);
+			n++;
+		}
+		records += n;
+		if (n != count)
+		{
+			fprintf(stderr, "%s: corrupt block: %u of %u records decoded\n", path, n, count);
+			status = 1;
+			break;
+		}
+	}
+	fclose(f);
+	return status;
+}
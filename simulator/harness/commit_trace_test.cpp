@@ -0,0 +1,214 @@
+// Round-trip check for commit_trace.h: encodes a hand-written record stream
+// into framed blocks, reads it back through CommitTraceReader and
+// CommitTraceDecoder the way commit_trace_decode does, and compares every
+// field. Also cuts the final block short, in its header and in its payload,
+// and checks that the blocks before it still decode.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "commit_trace.h"
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	if (ok)
+		return;
+	printf("[commit-trace-test]: %s\n", what);
+	++failures;
+}
+
+static CommitRecord rec(uint64_t cycle, uint8_t priv, uint64_t pc, uint32_t instr, uint8_t flags = 0)
+{
+	CommitRecord r;
+	r.cycle = cycle;
+	r.priv = priv;
+	r.pc = pc;
+	r.instr = instr;
+	r.flags = flags;
+	return r;
+}
+
+static CommitRecord wen(CommitRecord r, uint8_t rd, uint64_t wdata)
+{
+	r.flags |= CommitRecord::kWen;
+	r.rd = rd;
+	r.wdata = wdata;
+	return r;
+}
+
+static std::vector<CommitRecord> sample_records()
+{
+	std::vector<CommitRecord> v;
+	// Straight-line code, including RVC instructions that advance pc by 2.
+	v.push_back(wen(rec(10, 3, 0x80000000, 0x00500093), 1, 5));        // addi x1, x0, 5
+	v.push_back(wen(rec(12, 3, 0x80000004, 0x0505), 10, 0x11));         // c.addi a0, 1
+	v.push_back(wen(rec(13, 3, 0x80000006, 0x4501), 10, 0));            // c.li a0, 0
+	CommitRecord sd = rec(15, 3, 0x80000008, 0x00113423, CommitRecord::kStore); // sd x1, 8(x2)
+	sd.mem_addr = 0x80001008;
+	sd.mem_data = 0xfedcba9876543210ULL;
+	v.push_back(sd);
+	CommitRecord csd = rec(16, 3, 0x8000000c, 0xe406, CommitRecord::kStore); // c.sdsp ra, 8(sp)
+	csd.mem_addr = 0x80001ff8;
+	csd.mem_data = 0x80000010;
+	v.push_back(csd);
+	CommitRecord ld = wen(rec(19, 3, 0x8000000e, 0x00013183, CommitRecord::kLoad), 3, 0x1234); // ld x3, 0(x2)
+	ld.mem_addr = 0x80001000;
+	v.push_back(ld);
+	// PC jumps forward and backward, and a long sim_time gap.
+	v.push_back(wen(rec(25, 3, 0x80201000, 0x000000ef), 1, 0x80000016)); // jal (landing far ahead)
+	v.push_back(rec(1ULL << 40, 3, 0x80000020, 0x00000013));             // nop, back below
+	// MRET into S-mode: a privilege change together with a jump.
+	v.push_back(rec((1ULL << 40) + 1, 3, 0x80000024, 0x30200073));
+	v.push_back(wen(rec((1ULL << 40) + 3, 1, 0x80400000, 0x00100513), 10, 1)); // li a0, 1
+	// An exception traps without advancing; the handler runs in M-mode.
+	CommitRecord ecall = rec((1ULL << 40) + 4, 1, 0x80400004, 0x00000073, CommitRecord::kTrap);
+	ecall.cause = 9;
+	v.push_back(ecall);
+	v.push_back(rec((1ULL << 40) + 6, 3, 0x80000100, 0x34202573)); // csrr a0, mcause
+	// An interrupt taken at a pc whose instruction then retires at that same
+	// pc: the trap leaves the expected pc unchanged, so no kPcJump is needed.
+	CommitRecord irq = rec((1ULL << 40) + 8, 3, 0x80000104, 0x00000013, CommitRecord::kTrap | CommitRecord::kInterrupt);
+	irq.cause = (1ULL << 63) | 7;
+	v.push_back(irq);
+	v.push_back(rec((1ULL << 40) + 9, 3, 0x80000104, 0x00000013));
+	v.push_back(wen(rec((1ULL << 40) + 10, 3, 0x80000108, 0x0141), 2, 0x80001ff0)); // c.addi sp, 16
+	return v;
+}
+
+static bool same(const CommitRecord &a, const CommitRecord &b)
+{
+	// kPriv and kPcJump are the encoder's business, not the record's.
+	const uint8_t derived = CommitRecord::kPriv | CommitRecord::kPcJump;
+	return a.cycle == b.cycle && a.pc == b.pc && a.priv == b.priv && a.instr == b.instr &&
+	       (a.flags & ~derived) == (b.flags & ~derived) && a.rd == b.rd && a.wdata == b.wdata &&
+	       a.mem_addr == b.mem_addr && a.mem_data == b.mem_data && a.cause == b.cause;
+}
+
+// The magic, then `recs` framed into blocks of at most `per_block` records.
+static std::string encode_file(const std::vector<CommitRecord> &recs, size_t per_block)
+{
+	std::string file(kCommitTraceMagic, sizeof(kCommitTraceMagic));
+	std::string block;
+	for (size_t i = 0; i < recs.size(); i += per_block)
+	{
+		commit_trace_block(&recs[i], std::min(per_block, recs.size() - i), block);
+		file += block;
+	}
+	return file;
+}
+
+// Decodes `file` as commit_trace_decode does. Returns the status that ended
+// the walk; `out` gets every record of the complete blocks.
+static CommitTraceReader::Status decode_file(std::string file, std::vector<CommitRecord> &out)
+{
+	out.clear();
+	FILE *f = fmemopen(&file[0], file.size(), "rb");
+	if (f == nullptr)
+	{
+		perror("fmemopen");
+		++failures;
+		return CommitTraceReader::kTruncated;
+	}
+	CommitTraceReader reader(f);
+	check(reader.check_magic(), "magic not recognised");
+	CommitTraceDecoder dec;
+	CommitRecord r;
+	uint32_t count = 0;
+	CommitTraceReader::Status st;
+	while ((st = reader.next(dec, count)) == CommitTraceReader::kBlock)
+	{
+		uint32_t n = 0;
+		while (dec.next(r))
+		{
+			out.push_back(r);
+			n++;
+		}
+		check(n == count, "block record count does not match its header");
+	}
+	fclose(f);
+	return st;
+}
+
+static void check_prefix(const std::vector<CommitRecord> &got, const std::vector<CommitRecord> &want, size_t n,
+                         const char *what)
+{
+	bool ok = got.size() == n;
+	for (size_t i = 0; ok && i < n; ++i)
+		ok = same(got[i], want[i]);
+	check(ok, what);
+}
+
+int main()
+{
+	const std::vector<CommitRecord> recs = sample_records();
+	const size_t per_block = 6;
+	std::vector<CommitRecord> got;
+
+	// One block per record, a few records per block and a single block all
+	// have to reproduce the stream exactly.
+	for (size_t n : {(size_t)1, per_block, recs.size()})
+	{
+		std::string file = encode_file(recs, n);
+		check(decode_file(file, got) == CommitTraceReader::kEnd, "complete file did not end cleanly");
+		check_prefix(got, recs, recs.size(), "decoded records differ from the encoded ones");
+	}
+
+	// Flags the encoder derives: a trap that leaves pc unchanged needs no
+	// kPcJump, the jumps and the privilege changes do.
+	{
+		std::string block;
+		commit_trace_block(recs.data(), recs.size(), block);
+		CommitTraceDecoder dec;
+		dec.reset((const uint8_t *)block.data() + 8, block.size() - 8);
+		CommitRecord r;
+		std::vector<CommitRecord> flags;
+		while (dec.next(r))
+			flags.push_back(r);
+		check(flags.size() == recs.size(), "single block did not decode completely");
+		if (flags.size() == recs.size())
+		{
+			check((flags[0].flags & CommitRecord::kPriv) != 0, "first record lacks kPriv");
+			check((flags[1].flags & (CommitRecord::kPcJump | CommitRecord::kPriv)) == 0, "RVC fall-through flagged");
+			check((flags[6].flags & CommitRecord::kPcJump) != 0, "forward jump not flagged");
+			check((flags[7].flags & CommitRecord::kPcJump) != 0, "backward jump not flagged");
+			check((flags[9].flags & CommitRecord::kPriv) != 0, "MRET privilege change not flagged");
+			check((flags[11].flags & CommitRecord::kPriv) != 0, "trap privilege change not flagged");
+			check((flags[13].flags & CommitRecord::kPcJump) == 0, "pc after a pc-preserving trap flagged as a jump");
+		}
+		// A payload cut inside its last record yields the records before it.
+		dec.reset((const uint8_t *)block.data() + 8, block.size() - 9);
+		size_t n = 0;
+		while (dec.next(r))
+			n++;
+		check(n == recs.size() - 1, "payload cut in its last record");
+	}
+
+	// A killed run leaves the final block short, in its payload or even in
+	// its header; every complete block before it still decodes.
+	{
+		std::string file = encode_file(recs, per_block);
+		size_t full_blocks = (recs.size() - 1) / per_block;
+		std::string last;
+		size_t tail = recs.size() - full_blocks * per_block;
+		commit_trace_block(&recs[full_blocks * per_block], tail, last);
+		for (size_t cut : {(size_t)1, last.size() - 8, last.size() - 5})
+		{
+			std::string shortened = file.substr(0, file.size() - cut);
+			check(decode_file(shortened, got) == CommitTraceReader::kTruncated, "short final block not reported");
+			check_prefix(got, recs, full_blocks * per_block, "blocks before a short final block differ");
+		}
+	}
+
+	if (failures != 0)
+	{
+		printf("[commit-trace-test]: %d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("[commit-trace-test]: %zu records round-tripped\n", recs.size());
+	return 0;
+}
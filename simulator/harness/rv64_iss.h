@@ -0,0 +1,1443 @@
+#ifndef ION_RV64_ISS_H
+#define ION_RV64_ISS_H
+
+// Functional RV64IMAC + Zicsr + Zba/Zbb/Zbs + Sv39 interpreter used to
+// fast-forward boot code before handing the architectural state to the RTL.
+//
+// The model follows IonSoC's CSRFile, Sv39 translator and platform devices
+// rather than the full privileged spec: the CSR set, WARL legalisation, trap
+// delegation, xRET behaviour and hardware-A/D-less page faults match the RTL
+// so the transplanted state is one the core could have reached itself. It
+// executes one instruction per tick of mtime/time/mcycle and never takes
+// external interrupts (the PLIC has no live sources here). Instructions it
+// does not model (F/D, ebreak, mnret, ...) stop the run *before* executing,
+// so the RTL picks up exactly there.
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+class Rv64Iss
+{
+  public:
+	enum StopReason
+	{
+		kStopBudget,
+		kStopPc,
+		kStopRequested,
+		kStopUnsupported,
+		kStopFetchFault,
+	};
+
+	struct Region
+	{
+		uint8_t *mem = nullptr;
+		uint64_t base = 0;
+		uint64_t size = 0;
+	};
+
+	struct Csrs
+	{
+		uint64_t mstatus = 0, medeleg = 0, mideleg = 0, mie = 0, mtvec = 0;
+		uint64_t mepc = 0, mcause = 0, mtval = 0, mscratch = 0;
+		uint64_t stvec = 0, sepc = 0, scause = 0, stval = 0, sscratch = 0, satp = 0;
+		uint64_t mcounteren = 0, scounteren = 0, menvcfg = 0, mcountinhibit = 0;
+		uint64_t mcycle = 0, minstret = 0, time = 0;
+		uint64_t pmpcfg0 = 0, pmpaddr[8] = {};
+		uint64_t mhpmcounter[29] = {}, mhpmevent[29] = {};
+		uint64_t mnscratch = 0, mnepc = 0, mncause = 0, mnstatus = 0;
+		bool ssip_sw = false;
+	};
+
+	struct Clint
+	{
+		uint64_t mtime = 0;
+		uint64_t mtimecmp = 0;
+		bool msip = false;
+	};
+
+	struct Uart
+	{
+		uint8_t ier = 0, fcr = 0, lcr = 0, mcr = 0, scr = 0, dll = 0, dlm = 0;
+	};
+
+	struct Plic
+	{
+		uint8_t priority[32] = {};
+		uint32_t enable[2] = {};
+		uint8_t threshold[2] = {};
+	};
+
+	static const uint64_t kUartBase = 0x10010000ULL;
+	static const uint64_t kUartSize = 0x1000ULL;
+	static const uint64_t kClintBase = 0x02000000ULL;
+	static const uint64_t kClintSize = 0x10000ULL;
+	static const uint64_t kPlicBase = 0x0c000000ULL;
+	static const uint64_t kPlicSize = 0x04000000ULL;
+
+	uint64_t x[32] = {};
+	uint64_t pc = 0;
+	unsigned priv = 3;
+	Csrs csr;
+	Clint clint;
+	Uart uart;
+	Plic plic;
+	uint64_t insns = 0;
+
+	Region sram;
+	Region rom;
+	std::function<void(uint8_t)> on_uart_tx;
+
+	// Called with the target of every control transfer (jumps, taken
+	// branches, traps, xRET); boot code only changes region this way.
+	std::function<void(uint64_t)> on_jump;
+
+	void request_stop() { stop_requested_ = true; }
+
+	StopReason run(uint64_t max_insns, uint64_t until_pc)
+	{
+		stop_requested_ = false;
+		flush_tlb();
+		const uint64_t limit = insns + max_insns;
+		while (insns < limit)
+		{
+			if (pc == until_pc)
+				return kStopPc;
+			if (take_interrupt())
+				continue;
+			Exec r = step();
+			if (r == kUnsupported)
+				return kStopUnsupported;
+			if (r == kFetchLoop)
+				return kStopFetchFault;
+			if (stop_requested_)
+				return kStopRequested;
+		}
+		return kStopBudget;
+	}
+
+	static const char *stop_name(StopReason r)
+	{
+		switch (r)
+		{
+		case kStopBudget:
+			return "budget";
+		case kStopPc:
+			return "pc";
+		case kStopRequested:
+			return "uart";
+		case kStopUnsupported:
+			return "unsupported-instruction";
+		case kStopFetchFault:
+			return "fetch-fault-loop";
+		}
+		return "?";
+	}
+
+	uint32_t last_insn() const { return last_insn_; }
+
+  private:
+	enum Exec
+	{
+		kOk,
+		kRetired, // counters already advanced by the instruction itself
+		kTrapped,
+		kUnsupported,
+		kFetchLoop,
+	};
+	enum Access
+	{
+		kFetch = 0,
+		kLoad = 1,
+		kStore = 2,
+	};
+	enum Cause : uint64_t
+	{
+		kInstrAccessFault = 1,
+		kIllegalInstr = 2,
+		kLoadMisaligned = 4,
+		kLoadAccessFault = 5,
+		kStoreMisaligned = 6,
+		kStoreAccessFault = 7,
+		kEcallU = 8,
+		kInstrPageFault = 12,
+		kLoadPageFault = 13,
+		kStorePageFault = 15,
+	};
+	static const uint64_t kMIE = 1ULL << 3;
+	static const uint64_t kMPIE = 1ULL << 7;
+	static const uint64_t kSIE = 1ULL << 1;
+	static const uint64_t kSPIE = 1ULL << 5;
+	static const uint64_t kSPP = 1ULL << 8;
+	static const uint64_t kMPRV = 1ULL << 17;
+	static const uint64_t kSUM = 1ULL << 18;
+	static const uint64_t kMXR = 1ULL << 19;
+	// Matches CSRFile.writableMstatusMask: FS/XS/SD and TVM/TW/TSR are
+	// read-only zero. SXL/UXL (CSRFile.mstatusXlenFields) are not stored and
+	// read as 2, so csr.mstatus transplants into the RTL register unchanged.
+	static const uint64_t kWritableMstatusMask = kMIE | kMPIE | (3ULL << 11) | kSIE | kSPIE | kSPP | kMPRV | kSUM | kMXR;
+	static const uint64_t kMstatusXlenFields = (2ULL << 34) | (2ULL << 32);
+	static const uint64_t kSupervisorIrqMask = (1ULL << 1) | (1ULL << 5) | (1ULL << 9);
+	static const uint64_t kWritableMieMask = kSupervisorIrqMask | (1ULL << 3) | (1ULL << 7) | (1ULL << 11);
+	static const uint64_t kMisa = (2ULL << 62) | (1ULL << ('i' - 'a')) | (1ULL << ('m' - 'a')) |
+	                              (1ULL << ('a' - 'a')) | (1ULL << ('c' - 'a')) | (1ULL << ('s' - 'a'));
+
+	struct TlbEntry
+	{
+		uint64_t tag = 0; // vpage | 1 when valid
+		uint64_t ppage = 0;
+	};
+	static const unsigned kTlbEntries = 256;
+
+	bool stop_requested_ = false;
+	uint32_t last_insn_ = 0;
+	uint64_t fault_pc_ = UINT64_MAX;
+	unsigned fault_repeats_ = 0;
+	bool reservation_valid_ = false;
+	uint64_t reservation_addr_ = 0;
+	TlbEntry tlb_[3][kTlbEntries];
+
+	static int64_t sext(uint64_t v, unsigned bits) { return (int64_t)(v << (64 - bits)) >> (64 - bits); }
+	static uint64_t bits(uint32_t v, unsigned hi, unsigned lo) { return (v >> lo) & ((1ULL << (hi - lo + 1)) - 1); }
+
+	void set_rd(unsigned rd, uint64_t v)
+	{
+		if (rd != 0)
+			x[rd] = v;
+	}
+
+	void flush_tlb() { memset(tlb_, 0, sizeof(tlb_)); }
+
+	void set_priv(unsigned p)
+	{
+		if (p != priv)
+			flush_tlb();
+		priv = p;
+	}
+
+	void jump(uint64_t target)
+	{
+		pc = target;
+		if (on_jump)
+			on_jump(target);
+	}
+
+	// ---- physical memory -------------------------------------------------
+
+	uint8_t *ram_ptr(uint64_t pa, unsigned size, bool write)
+	{
+		if (pa - sram.base < sram.size && pa - sram.base + size <= sram.size)
+			return sram.mem + (pa - sram.base);
+		if (!write && pa - rom.base < rom.size && pa - rom.base + size <= rom.size)
+			return rom.mem + (pa - rom.base);
+		return nullptr;
+	}
+
+	static bool is_mmio(uint64_t pa)
+	{
+		return (pa - kUartBase < kUartSize) || (pa - kClintBase < kClintSize) || (pa - kPlicBase < kPlicSize);
+	}
+
+	static uint64_t lane_mask(unsigned size) { return size == 8 ? ~0ULL : ((1ULL << (size * 8)) - 1); }
+
+	bool mmio_read(uint64_t pa, unsigned size, uint64_t &out)
+	{
+		if (pa - kUartBase < kUartSize)
+		{
+			uint8_t b = 0;
+			switch (pa & 7)
+			{
+			case 0:
+				b = (uart.lcr & 0x80) ? uart.dll : 0;
+				break;
+			case 1:
+				b = (uart.lcr & 0x80) ? uart.dlm : uart.ier;
+				break;
+			case 2:
+				b = 0x01 | ((uart.fcr & 1) ? 0xc0 : 0);
+				break;
+			case 3:
+				b = uart.lcr;
+				break;
+			case 4:
+				b = uart.mcr;
+				break;
+			case 5:
+				b = 0x60; // THRE | TEMT: the RTL accepts a THR write every cycle
+				break;
+			case 7:
+				b = uart.scr;
+				break;
+			}
+			out = b;
+			return true;
+		}
+		if (pa - kClintBase < kClintSize)
+		{
+			uint64_t off = pa - kClintBase;
+			uint64_t beat = 0;
+			if ((off & ~7ULL) == 0x0000)
+				beat = clint.msip ? 1 : 0;
+			else if ((off & ~7ULL) == 0x4000)
+				beat = clint.mtimecmp;
+			else if ((off & ~7ULL) == 0xbff8)
+				beat = clint.mtime;
+			out = (beat >> ((off & 7) * 8)) & lane_mask(size);
+			return true;
+		}
+		uint64_t off = pa - kPlicBase;
+		uint32_t word = 0;
+		uint64_t woff = off & ~3ULL;
+		if (woff < 32 * 4)
+			word = plic.priority[woff / 4];
+		else if (woff == 0x2000 || woff == 0x2080)
+			word = plic.enable[(woff - 0x2000) / 0x80];
+		else if (woff == 0x200000 || woff == 0x201000)
+			word = plic.threshold[(woff - 0x200000) / 0x1000];
+		out = ((uint64_t)word >> ((off & 3) * 8)) & lane_mask(size);
+		return true;
+	}
+
+	bool mmio_write(uint64_t pa, unsigned size, uint64_t v)
+	{
+		if (pa - kUartBase < kUartSize)
+		{
+			uint8_t b = (uint8_t)v;
+			bool dlab = uart.lcr & 0x80;
+			switch (pa & 7)
+			{
+			case 0:
+				if (dlab)
+					uart.dll = b;
+				else if (on_uart_tx)
+					on_uart_tx(b);
+				break;
+			case 1:
+				if (dlab)
+					uart.dlm = b;
+				else
+					uart.ier = b;
+				break;
+			case 2:
+				uart.fcr = b;
+				break;
+			case 3:
+				uart.lcr = b;
+				break;
+			case 4:
+				uart.mcr = b;
+				break;
+			case 7:
+				uart.scr = b;
+				break;
+			}
+			return true;
+		}
+		if (pa - kClintBase < kClintSize)
+		{
+			uint64_t off = pa - kClintBase;
+			unsigned shift = (unsigned)(off & 7) * 8;
+			uint64_t mask = lane_mask(size) << shift;
+			uint64_t data = v << shift;
+			if ((off & ~7ULL) == 0x0000)
+				clint.msip = ((((clint.msip ? 1ULL : 0ULL) & ~mask) | (data & mask)) & 1) != 0;
+			else if ((off & ~7ULL) == 0x4000)
+				clint.mtimecmp = (clint.mtimecmp & ~mask) | (data & mask);
+			return true;
+		}
+		uint64_t off = pa - kPlicBase;
+		uint64_t woff = off & ~3ULL;
+		uint32_t word = (uint32_t)(v << ((off & 3) * 8));
+		if (woff >= 4 && woff < 32 * 4)
+			plic.priority[woff / 4] = word & 7;
+		else if (woff == 0x2000 || woff == 0x2080)
+			plic.enable[(woff - 0x2000) / 0x80] = word & ~1u;
+		else if (woff == 0x200000 || woff == 0x201000)
+			plic.threshold[(woff - 0x200000) / 0x1000] = word & 7;
+		return true;
+	}
+
+	bool phys_read(uint64_t pa, unsigned size, uint64_t &out)
+	{
+		if (uint8_t *p = ram_ptr(pa, size, false))
+		{
+			out = 0;
+			memcpy(&out, p, size);
+			return true;
+		}
+		return is_mmio(pa) && mmio_read(pa, size, out);
+	}
+
+	bool phys_write(uint64_t pa, unsigned size, uint64_t v)
+	{
+		if (uint8_t *p = ram_ptr(pa, size, true))
+		{
+			memcpy(p, &v, size);
+			if (reservation_valid_ && (pa & ~7ULL) == (reservation_addr_ & ~7ULL))
+				reservation_valid_ = false;
+			return true;
+		}
+		return is_mmio(pa) && mmio_write(pa, size, v);
+	}
+
+	// ---- Sv39 --------------------------------------------------------------
+
+	// Returns 0 on success or the trap cause.
+	uint64_t translate(uint64_t va, Access acc, uint64_t &pa)
+	{
+		unsigned eff = priv;
+		if (acc != kFetch && priv == 3 && (csr.mstatus & kMPRV))
+			eff = (unsigned)((csr.mstatus >> 11) & 3);
+		if (eff == 3 || (csr.satp >> 60) != 8)
+		{
+			pa = va;
+			return 0;
+		}
+		uint64_t vpage = va >> 12;
+		TlbEntry &e = tlb_[acc][vpage % kTlbEntries];
+		if (e.tag == ((vpage << 1) | 1))
+		{
+			pa = e.ppage | (va & 0xfff);
+			return 0;
+		}
+		const uint64_t page_fault = acc == kFetch ? kInstrPageFault : acc == kLoad ? kLoadPageFault : kStorePageFault;
+		if ((uint64_t)sext(va, 39) != va)
+			return page_fault;
+		uint64_t table = (csr.satp & ((1ULL << 44) - 1)) << 12;
+		for (int level = 2; level >= 0; --level)
+		{
+			uint64_t pte = 0;
+			uint64_t vpn = (va >> (12 + 9 * level)) & 0x1ff;
+			if (!phys_read(table + vpn * 8, 8, pte))
+				return acc == kFetch ? kInstrAccessFault : acc == kLoad ? kLoadAccessFault : kStoreAccessFault;
+			bool v = pte & 1, r = pte & 2, w = pte & 4, xp = pte & 8, u = pte & 16, a = pte & 64, d = pte & 128;
+			if (!v || (pte >> 54) != 0 || (w && !r))
+				return page_fault;
+			if (!r && !xp)
+			{
+				if (level == 0)
+					return page_fault;
+				table = ((pte >> 10) & ((1ULL << 44) - 1)) << 12;
+				continue;
+			}
+			uint64_t ppn = (pte >> 10) & ((1ULL << 44) - 1);
+			if ((level == 1 && (ppn & 0x1ff)) || (level == 2 && (ppn & 0x3ffff)))
+				return page_fault;
+			bool allowed = acc == kLoad ? (r || ((csr.mstatus & kMXR) && xp)) : acc == kStore ? w : xp;
+			bool priv_ok = eff == 0 ? u : (u ? ((csr.mstatus & kSUM) && acc != kFetch) : true);
+			if (!allowed || !priv_ok || !a || (acc == kStore && !d))
+				return page_fault;
+			uint64_t page_mask = (1ULL << (12 + 9 * level)) - 1;
+			pa = ((ppn << 12) & ~page_mask) | (va & page_mask);
+			e.tag = (vpage << 1) | 1;
+			e.ppage = pa & ~0xfffULL;
+			return 0;
+		}
+		return page_fault;
+	}
+
+	// ---- traps ---------------------------------------------------------------
+
+	void trap(uint64_t cause, uint64_t tval)
+	{
+		bool interrupt = cause >> 63;
+		uint64_t bit = 1ULL << (cause & 63);
+		bool to_s = priv != 3 && ((interrupt ? csr.mideleg : csr.medeleg) & bit);
+		uint64_t epc = pc;
+		if (to_s)
+		{
+			uint64_t s = csr.mstatus;
+			s = (s & ~kSPIE) | ((s & kSIE) ? kSPIE : 0);
+			s &= ~kSIE;
+			s = (s & ~kSPP) | ((uint64_t)(priv & 1) << 8);
+			csr.mstatus = s;
+			csr.sepc = epc;
+			csr.scause = cause;
+			csr.stval = tval;
+			set_priv(1);
+			jump(vector(csr.stvec, cause));
+		}
+		else
+		{
+			uint64_t s = csr.mstatus;
+			s = (s & ~kMPIE) | ((s & kMIE) ? kMPIE : 0);
+			s &= ~kMIE;
+			s = (s & ~(3ULL << 11)) | ((uint64_t)priv << 11);
+			csr.mstatus = s;
+			csr.mepc = epc;
+			csr.mcause = cause;
+			csr.mtval = tval;
+			set_priv(3);
+			jump(vector(csr.mtvec, cause));
+		}
+	}
+
+	static uint64_t vector(uint64_t tvec, uint64_t cause)
+	{
+		uint64_t base = tvec & ~3ULL;
+		if ((cause >> 63) && (tvec & 3) == 1)
+			return base + ((cause & ~(1ULL << 63)) << 2);
+		return base;
+	}
+
+	uint64_t mip() const
+	{
+		uint64_t v = 0;
+		if (csr.ssip_sw)
+			v |= 1ULL << 1;
+		if (clint.msip)
+			v |= 1ULL << 3;
+		if (clint.mtimecmp != 0 && clint.mtime >= clint.mtimecmp)
+			v |= 1ULL << 7;
+		return v;
+	}
+
+	bool take_interrupt()
+	{
+		uint64_t pending = csr.mie & mip();
+		if (pending == 0)
+			return false;
+		static const unsigned m_order[] = {11, 3, 7, 9, 1, 5};
+		static const unsigned s_order[] = {9, 1, 5};
+		uint64_t m_pending = pending & ~csr.mideleg;
+		if (m_pending && (priv < 3 || (csr.mstatus & kMIE)))
+		{
+			for (unsigned code : m_order)
+				if (m_pending & (1ULL << code))
+				{
+					trap((1ULL << 63) | code, 0);
+					return true;
+				}
+		}
+		uint64_t s_pending = pending & csr.mideleg & kSupervisorIrqMask;
+		if (s_pending && (priv < 1 || (priv == 1 && (csr.mstatus & kSIE))))
+		{
+			for (unsigned code : s_order)
+				if (s_pending & (1ULL << code))
+				{
+					trap((1ULL << 63) | code, 0);
+					return true;
+				}
+		}
+		return false;
+	}
+
+	// ---- CSRs ----------------------------------------------------------------
+
+	bool counter_ok(unsigned bit) const
+	{
+		if (priv == 3)
+			return true;
+		if (priv == 1)
+			return (csr.mcounteren >> bit) & 1;
+		return ((csr.mcounteren & csr.scounteren) >> bit) & 1;
+	}
+
+	bool csr_read(unsigned addr, uint64_t &v)
+	{
+		if (addr >= 0x3b0 && addr <= 0x3b7)
+		{
+			v = csr.pmpaddr[addr - 0x3b0];
+			return true;
+		}
+		if (addr >= 0xb03 && addr <= 0xb1f)
+		{
+			v = csr.mhpmcounter[addr - 0xb03];
+			return true;
+		}
+		if (addr >= 0x323 && addr <= 0x33f)
+		{
+			v = csr.mhpmevent[addr - 0x323];
+			return true;
+		}
+		switch (addr)
+		{
+		case 0x100:
+			v = (csr.mstatus & (kSIE | kSPIE | kSPP | (7ULL << 13) | kSUM | kMXR | (1ULL << 63))) |
+			    (kMstatusXlenFields & (3ULL << 32));
+			return true;
+		case 0x104:
+			v = csr.mie & csr.mideleg & kSupervisorIrqMask;
+			return true;
+		case 0x105: v = csr.stvec; return true;
+		case 0x106: v = csr.scounteren; return true;
+		case 0x140: v = csr.sscratch; return true;
+		case 0x141: v = csr.sepc; return true;
+		case 0x142: v = csr.scause; return true;
+		case 0x143: v = csr.stval; return true;
+		case 0x144:
+			v = mip() & csr.mideleg & kSupervisorIrqMask;
+			return true;
+		case 0x180: v = csr.satp; return true;
+		case 0xf11:
+		case 0xf12:
+		case 0xf13:
+		case 0xf14:
+			v = 0;
+			return true;
+		case 0x300: v = csr.mstatus | kMstatusXlenFields; return true;
+		case 0x301: v = kMisa; return true;
+		case 0x302: v = csr.medeleg; return true;
+		case 0x303: v = csr.mideleg; return true;
+		case 0x304: v = csr.mie; return true;
+		case 0x305: v = csr.mtvec; return true;
+		case 0x306: v = csr.mcounteren; return true;
+		case 0x30a: v = csr.menvcfg; return true;
+		case 0x320: v = csr.mcountinhibit; return true;
+		case 0x340: v = csr.mscratch; return true;
+		case 0x341: v = csr.mepc; return true;
+		case 0x342: v = csr.mcause; return true;
+		case 0x343: v = csr.mtval; return true;
+		case 0x344: v = mip(); return true;
+		case 0x3a0: v = csr.pmpcfg0; return true;
+		case 0xb00:
+		case 0xc00:
+			v = csr.mcycle;
+			return true;
+		case 0xc01: v = csr.time; return true;
+		case 0xb02:
+		case 0xc02:
+			v = csr.minstret;
+			return true;
+		case 0x740: v = csr.mnscratch; return true;
+		case 0x741: v = csr.mnepc; return true;
+		case 0x742: v = csr.mncause; return true;
+		case 0x744: v = csr.mnstatus; return true;
+		}
+		return false;
+	}
+
+	void csr_write(unsigned addr, uint64_t v)
+	{
+		if (addr >= 0x3b0 && addr <= 0x3b7)
+		{
+			csr.pmpaddr[addr - 0x3b0] = v;
+			return;
+		}
+		if (addr >= 0xb03 && addr <= 0xb1f)
+		{
+			csr.mhpmcounter[addr - 0xb03] = v;
+			return;
+		}
+		if (addr >= 0x323 && addr <= 0x33f)
+		{
+			csr.mhpmevent[addr - 0x323] = v;
+			return;
+		}
+		switch (addr)
+		{
+		case 0x300:
+			csr.mstatus = v & kWritableMstatusMask;
+			flush_tlb();
+			break;
+		case 0x100:
+		{
+			uint64_t mask = kSIE | kSPIE | kSPP | kSUM | kMXR;
+			csr.mstatus = (csr.mstatus & ~mask) | (v & mask);
+			flush_tlb();
+			break;
+		}
+		case 0x302: csr.medeleg = v; break;
+		case 0x303: csr.mideleg = v & kSupervisorIrqMask; break;
+		case 0x304: csr.mie = v & kWritableMieMask; break;
+		case 0x104:
+		{
+			uint64_t mask = csr.mideleg & kSupervisorIrqMask;
+			csr.mie = (csr.mie & ~mask) | (v & mask);
+			break;
+		}
+		case 0x305: csr.mtvec = (v & ~3ULL) | ((v & 3) == 1 ? 1 : 0); break;
+		case 0x105: csr.stvec = (v & ~3ULL) | ((v & 3) == 1 ? 1 : 0); break;
+		case 0x306: csr.mcounteren = v; break;
+		case 0x106: csr.scounteren = v; break;
+		case 0x30a: csr.menvcfg = v; break;
+		case 0x320: csr.mcountinhibit = v; break;
+		case 0xb00: csr.mcycle = v; break;
+		case 0xb02: csr.minstret = v; break;
+		case 0x341: csr.mepc = v; break;
+		case 0x141: csr.sepc = v; break;
+		case 0x342: csr.mcause = v; break;
+		case 0x142: csr.scause = v; break;
+		case 0x343: csr.mtval = v; break;
+		case 0x143: csr.stval = v; break;
+		case 0x340: csr.mscratch = v; break;
+		case 0x140: csr.sscratch = v; break;
+		case 0x144:
+			if (csr.mideleg & (1ULL << 1))
+				csr.ssip_sw = (v >> 1) & 1;
+			break;
+		case 0x3a0: csr.pmpcfg0 = v; break;
+		case 0x740: csr.mnscratch = v; break;
+		case 0x744: csr.mnstatus = v; break;
+		case 0x180:
+		{
+			uint64_t mode = v >> 60;
+			if (mode == 0 || mode == 8)
+				csr.satp = v;
+			flush_tlb();
+			break;
+		}
+		}
+	}
+
+	// ---- virtual memory access -------------------------------------------------
+
+	bool load(uint64_t va, unsigned size, uint64_t &out)
+	{
+		uint64_t pa = 0;
+		if ((va & 0xfff) + size > 0x1000)
+		{
+			// Page-crossing misaligned access: go byte by byte.
+			uint64_t v = 0;
+			for (unsigned i = 0; i < size; ++i)
+			{
+				uint64_t b = 0;
+				if (!load(va + i, 1, b))
+					return false;
+				v |= b << (8 * i);
+			}
+			out = v;
+			return true;
+		}
+		if (uint64_t cause = translate(va, kLoad, pa))
+		{
+			trap(cause, va);
+			return false;
+		}
+		if ((va & (size - 1)) && is_mmio(pa))
+		{
+			trap(kLoadMisaligned, va);
+			return false;
+		}
+		if (!phys_read(pa, size, out))
+		{
+			trap(kLoadAccessFault, va);
+			return false;
+		}
+		return true;
+	}
+
+	bool store(uint64_t va, unsigned size, uint64_t v)
+	{
+		uint64_t pa = 0;
+		if ((va & 0xfff) + size > 0x1000)
+		{
+			uint64_t pa_hi = 0;
+			uint64_t first = 0x1000 - (va & 0xfff);
+			if (uint64_t cause = translate(va, kStore, pa))
+			{
+				trap(cause, va);
+				return false;
+			}
+			if (uint64_t cause = translate(va + first, kStore, pa_hi))
+			{
+				trap(cause, va);
+				return false;
+			}
+			for (unsigned i = 0; i < size; ++i)
+			{
+				uint64_t byte_pa = i < first ? pa + i : pa_hi + (i - first);
+				if (!phys_write(byte_pa, 1, (v >> (8 * i)) & 0xff))
+				{
+					trap(kStoreAccessFault, va);
+					return false;
+				}
+			}
+			return true;
+		}
+		if (uint64_t cause = translate(va, kStore, pa))
+		{
+			trap(cause, va);
+			return false;
+		}
+		if ((va & (size - 1)) && is_mmio(pa))
+		{
+			trap(kStoreMisaligned, va);
+			return false;
+		}
+		if (!phys_write(pa, size, v))
+		{
+			trap(kStoreAccessFault, va);
+			return false;
+		}
+		return true;
+	}
+
+	bool fetch16(uint64_t va, uint16_t &out)
+	{
+		uint64_t pa = 0;
+		if (uint64_t cause = translate(va, kFetch, pa))
+		{
+			trap(cause, va);
+			return false;
+		}
+		uint8_t *p = ram_ptr(pa, 2, false);
+		if (p == nullptr)
+		{
+			trap(kInstrAccessFault, va);
+			return false;
+		}
+		memcpy(&out, p, 2);
+		return true;
+	}
+
+	// ---- RVC -------------------------------------------------------------------
+
+	static uint32_t enc_r(unsigned f7, unsigned rs2, unsigned rs1, unsigned f3, unsigned rd, unsigned op)
+	{
+		return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+	}
+	static uint32_t enc_i(int64_t imm, unsigned rs1, unsigned f3, unsigned rd, unsigned op)
+	{
+		return ((uint32_t)(imm & 0xfff) << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+	}
+	static uint32_t enc_s(int64_t imm, unsigned rs2, unsigned rs1, unsigned f3, unsigned op)
+	{
+		return ((uint32_t)((imm >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) |
+		       ((uint32_t)(imm & 0x1f) << 7) | op;
+	}
+	static uint32_t enc_b(int64_t imm, unsigned rs2, unsigned rs1, unsigned f3)
+	{
+		return ((uint32_t)((imm >> 12) & 1) << 31) | ((uint32_t)((imm >> 5) & 0x3f) << 25) | (rs2 << 20) |
+		       (rs1 << 15) | (f3 << 12) | ((uint32_t)((imm >> 1) & 0xf) << 8) | ((uint32_t)((imm >> 11) & 1) << 7) | 0x63;
+	}
+	static uint32_t enc_j(int64_t imm, unsigned rd)
+	{
+		return ((uint32_t)((imm >> 20) & 1) << 31) | ((uint32_t)((imm >> 1) & 0x3ff) << 21) |
+		       ((uint32_t)((imm >> 11) & 1) << 20) | ((uint32_t)((imm >> 12) & 0xff) << 12) | (rd << 7) | 0x6f;
+	}
+
+	// Expands a compressed instruction to its 32-bit form; 0 means illegal
+	// (or an F/D form this core does not implement).
+	static uint32_t expand_rvc(uint16_t c)
+	{
+		unsigned op = c & 3, f3 = c >> 13;
+		unsigned rd = bits(c, 11, 7), rs2 = bits(c, 6, 2);
+		unsigned rdp = bits(c, 4, 2) + 8, rs1p = bits(c, 9, 7) + 8;
+		int64_t imm6 = sext((bits(c, 12, 12) << 5) | bits(c, 6, 2), 6);
+		if (op == 0)
+		{
+			switch (f3)
+			{
+			case 0:
+			{
+				uint64_t nz = (bits(c, 12, 11) << 4) | (bits(c, 10, 7) << 6) | (bits(c, 6, 6) << 2) | (bits(c, 5, 5) << 3);
+				return nz ? enc_i((int64_t)nz, 2, 0, rdp, 0x13) : 0;
+			}
+			case 2:
+				return enc_i((int64_t)((bits(c, 12, 10) << 3) | (bits(c, 6, 6) << 2) | (bits(c, 5, 5) << 6)), rs1p, 2, rdp, 0x03);
+			case 3:
+				return enc_i((int64_t)((bits(c, 12, 10) << 3) | (bits(c, 6, 5) << 6)), rs1p, 3, rdp, 0x03);
+			case 6:
+				return enc_s((int64_t)((bits(c, 12, 10) << 3) | (bits(c, 6, 6) << 2) | (bits(c, 5, 5) << 6)), rdp, rs1p, 2, 0x23);
+			case 7:
+				return enc_s((int64_t)((bits(c, 12, 10) << 3) | (bits(c, 6, 5) << 6)), rdp, rs1p, 3, 0x23);
+			}
+			return 0;
+		}
+		if (op == 1)
+		{
+			switch (f3)
+			{
+			case 0:
+				return enc_i(imm6, rd, 0, rd, 0x13);
+			case 1:
+				return rd ? enc_i(imm6, rd, 0, rd, 0x1b) : 0;
+			case 2:
+				return enc_i(imm6, 0, 0, rd, 0x13);
+			case 3:
+				if (rd == 2)
+				{
+					int64_t nz = sext((bits(c, 12, 12) << 9) | (bits(c, 6, 6) << 4) | (bits(c, 5, 5) << 6) |
+					                      (bits(c, 4, 3) << 7) | (bits(c, 2, 2) << 5),
+					                  10);
+					return nz ? enc_i(nz, 2, 0, 2, 0x13) : 0;
+				}
+				if (imm6 == 0)
+					return 0;
+				return ((uint32_t)(imm6 & 0xfffff) << 12) | (rd << 7) | 0x37;
+			case 4:
+			{
+				unsigned f2 = bits(c, 11, 10);
+				unsigned shamt = (unsigned)((bits(c, 12, 12) << 5) | bits(c, 6, 2));
+				if (f2 == 0)
+					return enc_i(shamt, rs1p, 5, rs1p, 0x13);
+				if (f2 == 1)
+					return enc_i(0x400 | shamt, rs1p, 5, rs1p, 0x13);
+				if (f2 == 2)
+					return enc_i(imm6, rs1p, 7, rs1p, 0x13);
+				unsigned sub = bits(c, 6, 5);
+				if (!bits(c, 12, 12))
+				{
+					static const unsigned f3s[] = {0, 4, 6, 7};
+					return enc_r(sub == 0 ? 0x20 : 0, rdp, rs1p, f3s[sub], rs1p, 0x33);
+				}
+				if (sub == 0)
+					return enc_r(0x20, rdp, rs1p, 0, rs1p, 0x3b);
+				if (sub == 1)
+					return enc_r(0, rdp, rs1p, 0, rs1p, 0x3b);
+				return 0;
+			}
+			case 5:
+			{
+				int64_t off = sext((bits(c, 12, 12) << 11) | (bits(c, 11, 11) << 4) | (bits(c, 10, 9) << 8) |
+				                       (bits(c, 8, 8) << 10) | (bits(c, 7, 7) << 6) | (bits(c, 6, 6) << 7) |
+				                       (bits(c, 5, 3) << 1) | (bits(c, 2, 2) << 5),
+				                   12);
+				return enc_j(off, 0);
+			}
+			case 6:
+			case 7:
+			{
+				int64_t off = sext((bits(c, 12, 12) << 8) | (bits(c, 11, 10) << 3) | (bits(c, 6, 5) << 6) |
+				                       (bits(c, 4, 3) << 1) | (bits(c, 2, 2) << 5),
+				                   9);
+				return enc_b(off, 0, rs1p, f3 == 6 ? 0 : 1);
+			}
+			}
+			return 0;
+		}
+		if (op == 2)
+		{
+			switch (f3)
+			{
+			case 0:
+				return enc_i((bits(c, 12, 12) << 5) | bits(c, 6, 2), rd, 1, rd, 0x13);
+			case 2:
+				return rd ? enc_i((int64_t)((bits(c, 12, 12) << 5) | (bits(c, 6, 4) << 2) | (bits(c, 3, 2) << 6)), 2, 2, rd, 0x03) : 0;
+			case 3:
+				return rd ? enc_i((int64_t)((bits(c, 12, 12) << 5) | (bits(c, 6, 5) << 3) | (bits(c, 4, 2) << 6)), 2, 3, rd, 0x03) : 0;
+			case 4:
+				if (!bits(c, 12, 12))
+				{
+					if (rs2 == 0)
+						return rd ? enc_i(0, rd, 0, 0, 0x67) : 0;
+					return enc_r(0, rs2, 0, 0, rd, 0x33);
+				}
+				if (rs2 == 0)
+					return rd ? enc_i(0, rd, 0, 1, 0x67) : 0x00100073;
+				return enc_r(0, rs2, rd, 0, rd, 0x33);
+			case 6:
+				return enc_s((int64_t)((bits(c, 12, 9) << 2) | (bits(c, 8, 7) << 6)), rs2, 2, 2, 0x23);
+			case 7:
+				return enc_s((int64_t)((bits(c, 12, 10) << 3) | (bits(c, 9, 7) << 6)), rs2, 2, 3, 0x23);
+			}
+		}
+		return 0;
+	}
+
+	// ---- execute -------------------------------------------------------------------
+
+	void retire(uint64_t ticks = 1)
+	{
+		++insns;
+		clint.mtime += ticks;
+		csr.time += ticks;
+		if (!(csr.mcountinhibit & 1))
+			csr.mcycle += ticks;
+		if (!(csr.mcountinhibit & 4))
+			++csr.minstret;
+	}
+
+	Exec illegal(uint32_t insn)
+	{
+		trap(kIllegalInstr, insn);
+		return kTrapped;
+	}
+
+	Exec step()
+	{
+		uint16_t lo = 0;
+		uint64_t start_pc = pc;
+		if (!fetch16(pc, lo))
+			return fetch_trapped(start_pc);
+		uint32_t insn = lo;
+		unsigned len = 2;
+		if ((lo & 3) == 3)
+		{
+			uint16_t hi = 0;
+			if (!fetch16(pc + 2, hi))
+				return fetch_trapped(start_pc);
+			insn |= (uint32_t)hi << 16;
+			len = 4;
+		}
+		fault_repeats_ = 0;
+		last_insn_ = insn;
+		uint32_t full = insn;
+		if (len == 2)
+		{
+			full = expand_rvc((uint16_t)insn);
+			if (full == 0)
+				return illegal(insn);
+		}
+		Exec r = exec(full, len, insn);
+		if (r == kOk)
+			retire();
+		return r == kRetired ? kOk : r;
+	}
+
+	Exec fetch_trapped(uint64_t start_pc)
+	{
+		// A fetch fault whose handler faults again spins forever; give up
+		// instead of burning the budget.
+		if (start_pc == fault_pc_ && ++fault_repeats_ > 16)
+			return kFetchLoop;
+		fault_pc_ = start_pc;
+		return kTrapped;
+	}
+
+	static uint64_t mulhu(uint64_t a, uint64_t b) { return (uint64_t)(((unsigned __int128)a * b) >> 64); }
+	static uint64_t mulh(int64_t a, int64_t b) { return (uint64_t)(((__int128)a * b) >> 64); }
+	static uint64_t mulhsu(int64_t a, uint64_t b) { return (uint64_t)(((__int128)a * (__int128)(unsigned __int128)b) >> 64); }
+	static uint64_t rol(uint64_t v, unsigned s) { s &= 63; return s ? (v << s) | (v >> (64 - s)) : v; }
+	static uint64_t ror(uint64_t v, unsigned s) { s &= 63; return s ? (v >> s) | (v << (64 - s)) : v; }
+	static uint32_t rol32(uint32_t v, unsigned s) { s &= 31; return s ? (v << s) | (v >> (32 - s)) : v; }
+	static uint32_t ror32(uint32_t v, unsigned s) { s &= 31; return s ? (v >> s) | (v << (32 - s)) : v; }
+	static uint64_t sx32(uint64_t v) { return (uint64_t)(int64_t)(int32_t)v; }
+
+	static uint64_t orc_b(uint64_t v)
+	{
+		uint64_t r = 0;
+		for (unsigned i = 0; i < 8; ++i)
+			if ((v >> (8 * i)) & 0xff)
+				r |= 0xffULL << (8 * i);
+		return r;
+	}
+
+	Exec exec(uint32_t insn, unsigned len, uint32_t raw)
+	{
+		unsigned opcode = insn & 0x7f;
+		unsigned rd = bits(insn, 11, 7), f3 = bits(insn, 14, 12), rs1 = bits(insn, 19, 15), rs2 = bits(insn, 24, 20);
+		unsigned f7 = bits(insn, 31, 25);
+		uint64_t a = x[rs1], b = x[rs2];
+		int64_t imm_i = sext(insn >> 20, 12);
+		uint64_t next = pc + len;
+
+		switch (opcode)
+		{
+		case 0x37:
+			set_rd(rd, sx32(insn & 0xfffff000));
+			break;
+		case 0x17:
+			set_rd(rd, pc + sx32(insn & 0xfffff000));
+			break;
+		case 0x6f:
+		{
+			int64_t off = sext((bits(insn, 31, 31) << 20) | (bits(insn, 19, 12) << 12) | (bits(insn, 20, 20) << 11) |
+			                       (bits(insn, 30, 21) << 1),
+			                   21);
+			set_rd(rd, next);
+			jump(pc + off);
+			return kOk;
+		}
+		case 0x67:
+		{
+			if (f3 != 0)
+				return illegal(raw);
+			uint64_t target = (a + imm_i) & ~1ULL;
+			set_rd(rd, next);
+			jump(target);
+			return kOk;
+		}
+		case 0x63:
+		{
+			bool take;
+			switch (f3)
+			{
+			case 0: take = a == b; break;
+			case 1: take = a != b; break;
+			case 4: take = (int64_t)a < (int64_t)b; break;
+			case 5: take = (int64_t)a >= (int64_t)b; break;
+			case 6: take = a < b; break;
+			case 7: take = a >= b; break;
+			default: return illegal(raw);
+			}
+			if (take)
+			{
+				int64_t off = sext((bits(insn, 31, 31) << 12) | (bits(insn, 7, 7) << 11) | (bits(insn, 30, 25) << 5) |
+				                       (bits(insn, 11, 8) << 1),
+				                   13);
+				jump(pc + off);
+				return kOk;
+			}
+			break;
+		}
+		case 0x03:
+		{
+			static const unsigned sizes[] = {1, 2, 4, 8, 1, 2, 4, 0};
+			unsigned size = sizes[f3];
+			if (size == 0)
+				return illegal(raw);
+			uint64_t v = 0;
+			if (!load(a + imm_i, size, v))
+				return kTrapped;
+			if (f3 < 3)
+				v = (uint64_t)sext(v, size * 8);
+			set_rd(rd, v);
+			break;
+		}
+		case 0x23:
+		{
+			if (f3 > 3)
+				return illegal(raw);
+			int64_t off = sext((bits(insn, 31, 25) << 5) | bits(insn, 11, 7), 12);
+			if (!store(a + off, 1u << f3, b))
+				return kTrapped;
+			break;
+		}
+		case 0x13:
+		{
+			unsigned shamt = bits(insn, 25, 20);
+			unsigned f6 = bits(insn, 31, 26);
+			uint64_t r;
+			switch (f3)
+			{
+			case 0: r = a + imm_i; break;
+			case 2: r = (int64_t)a < imm_i; break;
+			case 3: r = a < (uint64_t)imm_i; break;
+			case 4: r = a ^ imm_i; break;
+			case 6: r = a | imm_i; break;
+			case 7: r = a & imm_i; break;
+			case 1:
+				if (f6 == 0)
+					r = a << shamt;
+				else if (f6 == 0x0a)
+					r = a | (1ULL << shamt);
+				else if (f6 == 0x12)
+					r = a & ~(1ULL << shamt);
+				else if (f6 == 0x1a)
+					r = a ^ (1ULL << shamt);
+				else if ((insn >> 20) == 0x600)
+					r = a ? __builtin_clzll(a) : 64;
+				else if ((insn >> 20) == 0x601)
+					r = a ? __builtin_ctzll(a) : 64;
+				else if ((insn >> 20) == 0x602)
+					r = __builtin_popcountll(a);
+				else if ((insn >> 20) == 0x604)
+					r = (uint64_t)(int64_t)(int8_t)a;
+				else if ((insn >> 20) == 0x605)
+					r = (uint64_t)(int64_t)(int16_t)a;
+				else
+					return kUnsupported;
+				break;
+			case 5:
+				if (f6 == 0)
+					r = a >> shamt;
+				else if (f6 == 0x10)
+					r = (uint64_t)((int64_t)a >> shamt);
+				else if (f6 == 0x18)
+					r = ror(a, shamt);
+				else if (f6 == 0x12)
+					r = (a >> shamt) & 1;
+				else if ((insn >> 20) == 0x287)
+					r = orc_b(a);
+				else if ((insn >> 20) == 0x6b8)
+					r = __builtin_bswap64(a);
+				else
+					return kUnsupported;
+				break;
+			default:
+				return kUnsupported;
+			}
+			set_rd(rd, r);
+			break;
+		}
+		case 0x1b:
+		{
+			unsigned shamt = rs2;
+			uint64_t r;
+			if (f3 == 0)
+				r = sx32(a + imm_i);
+			else if (f3 == 1 && f7 == 0)
+				r = sx32((uint32_t)a << shamt);
+			else if (f3 == 1 && (f7 >> 1) == 0x02)
+				r = (a & 0xffffffffULL) << bits(insn, 25, 20);
+			else if (f3 == 1 && f7 == 0x30 && rs2 == 0)
+				r = (uint32_t)a ? __builtin_clz((uint32_t)a) : 32;
+			else if (f3 == 1 && f7 == 0x30 && rs2 == 1)
+				r = (uint32_t)a ? __builtin_ctz((uint32_t)a) : 32;
+			else if (f3 == 1 && f7 == 0x30 && rs2 == 2)
+				r = __builtin_popcount((uint32_t)a);
+			else if (f3 == 5 && f7 == 0)
+				r = sx32((uint32_t)a >> shamt);
+			else if (f3 == 5 && f7 == 0x20)
+				r = sx32((uint64_t)((int32_t)a >> shamt));
+			else if (f3 == 5 && f7 == 0x30)
+				r = sx32(ror32((uint32_t)a, shamt));
+			else
+				return kUnsupported;
+			set_rd(rd, r);
+			break;
+		}
+		case 0x33:
+		{
+			uint64_t r;
+			switch ((f7 << 3) | f3)
+			{
+			case (0x00 << 3) | 0: r = a + b; break;
+			case (0x20 << 3) | 0: r = a - b; break;
+			case (0x00 << 3) | 1: r = a << (b & 63); break;
+			case (0x00 << 3) | 2: r = (int64_t)a < (int64_t)b; break;
+			case (0x00 << 3) | 3: r = a < b; break;
+			case (0x00 << 3) | 4: r = a ^ b; break;
+			case (0x00 << 3) | 5: r = a >> (b & 63); break;
+			case (0x20 << 3) | 5: r = (uint64_t)((int64_t)a >> (b & 63)); break;
+			case (0x00 << 3) | 6: r = a | b; break;
+			case (0x00 << 3) | 7: r = a & b; break;
+			case (0x01 << 3) | 0: r = a * b; break;
+			case (0x01 << 3) | 1: r = mulh((int64_t)a, (int64_t)b); break;
+			case (0x01 << 3) | 2: r = mulhsu((int64_t)a, b); break;
+			case (0x01 << 3) | 3: r = mulhu(a, b); break;
+			case (0x01 << 3) | 4:
+				r = b == 0 ? ~0ULL : ((int64_t)a == INT64_MIN && (int64_t)b == -1) ? a : (uint64_t)((int64_t)a / (int64_t)b);
+				break;
+			case (0x01 << 3) | 5: r = b == 0 ? ~0ULL : a / b; break;
+			case (0x01 << 3) | 6:
+				r = b == 0 ? a : ((int64_t)a == INT64_MIN && (int64_t)b == -1) ? 0 : (uint64_t)((int64_t)a % (int64_t)b);
+				break;
+			case (0x01 << 3) | 7: r = b == 0 ? a : a % b; break;
+			case (0x20 << 3) | 7: r = a & ~b; break;
+			case (0x20 << 3) | 6: r = a | ~b; break;
+			case (0x20 << 3) | 4: r = ~(a ^ b); break;
+			case (0x30 << 3) | 1: r = rol(a, (unsigned)b); break;
+			case (0x30 << 3) | 5: r = ror(a, (unsigned)b); break;
+			case (0x05 << 3) | 4: r = (int64_t)a < (int64_t)b ? a : b; break;
+			case (0x05 << 3) | 5: r = a < b ? a : b; break;
+			case (0x05 << 3) | 6: r = (int64_t)a > (int64_t)b ? a : b; break;
+			case (0x05 << 3) | 7: r = a > b ? a : b; break;
+			case (0x10 << 3) | 2: r = (a << 1) + b; break;
+			case (0x10 << 3) | 4: r = (a << 2) + b; break;
+			case (0x10 << 3) | 6: r = (a << 3) + b; break;
+			case (0x24 << 3) | 1: r = a & ~(1ULL << (b & 63)); break;
+			case (0x24 << 3) | 5: r = (a >> (b & 63)) & 1; break;
+			case (0x34 << 3) | 1: r = a ^ (1ULL << (b & 63)); break;
+			case (0x14 << 3) | 1: r = a | (1ULL << (b & 63)); break;
+			default: return kUnsupported;
+			}
+			set_rd(rd, r);
+			break;
+		}
+		case 0x3b:
+		{
+			uint32_t a32 = (uint32_t)a, b32 = (uint32_t)b;
+			uint64_t r;
+			switch ((f7 << 3) | f3)
+			{
+			case (0x00 << 3) | 0: r = sx32(a32 + b32); break;
+			case (0x20 << 3) | 0: r = sx32(a32 - b32); break;
+			case (0x00 << 3) | 1: r = sx32(a32 << (b & 31)); break;
+			case (0x00 << 3) | 5: r = sx32(a32 >> (b & 31)); break;
+			case (0x20 << 3) | 5: r = sx32((uint32_t)((int32_t)a32 >> (b & 31))); break;
+			case (0x01 << 3) | 0: r = sx32(a32 * b32); break;
+			case (0x01 << 3) | 4:
+				r = b32 == 0 ? ~0ULL : ((int32_t)a32 == INT32_MIN && (int32_t)b32 == -1) ? sx32(a32) : sx32((uint32_t)((int32_t)a32 / (int32_t)b32));
+				break;
+			case (0x01 << 3) | 5: r = b32 == 0 ? ~0ULL : sx32(a32 / b32); break;
+			case (0x01 << 3) | 6:
+				r = b32 == 0 ? sx32(a32) : ((int32_t)a32 == INT32_MIN && (int32_t)b32 == -1) ? 0 : sx32((uint32_t)((int32_t)a32 % (int32_t)b32));
+				break;
+			case (0x01 << 3) | 7: r = b32 == 0 ? sx32(a32) : sx32(a32 % b32); break;
+			case (0x04 << 3) | 0: r = (uint64_t)a32 + b; break;
+			case (0x04 << 3) | 4:
+				if (rs2 != 0)
+					return kUnsupported;
+				r = a & 0xffff;
+				break;
+			case (0x30 << 3) | 1: r = sx32(rol32(a32, (unsigned)b)); break;
+			case (0x30 << 3) | 5: r = sx32(ror32(a32, (unsigned)b)); break;
+			case (0x10 << 3) | 2: r = ((uint64_t)a32 << 1) + b; break;
+			case (0x10 << 3) | 4: r = ((uint64_t)a32 << 2) + b; break;
+			case (0x10 << 3) | 6: r = ((uint64_t)a32 << 3) + b; break;
+			default: return kUnsupported;
+			}
+			set_rd(rd, r);
+			break;
+		}
+		case 0x0f:
+			if (f3 > 1)
+				return kUnsupported;
+			break;
+		case 0x2f:
+			return exec_amo(insn);
+		case 0x73:
+			return exec_system(insn, raw, next);
+		default:
+			return kUnsupported;
+		}
+		pc = next;
+		return kOk;
+	}
+
+	Exec exec_amo(uint32_t insn)
+	{
+		unsigned rd = bits(insn, 11, 7), f3 = bits(insn, 14, 12), rs1 = bits(insn, 19, 15), rs2 = bits(insn, 24, 20);
+		unsigned f5 = insn >> 27;
+		if (f3 != 2 && f3 != 3)
+			return kUnsupported;
+		unsigned size = f3 == 2 ? 4 : 8;
+		uint64_t va = x[rs1];
+		uint64_t src = x[rs2];
+		auto ext = [&](uint64_t v) { return size == 4 ? sx32(v) : v; };
+		uint64_t pa = 0;
+		if (f5 == 0x02)
+		{
+			if (rs2 != 0)
+				return kUnsupported;
+			if (va & (size - 1))
+			{
+				trap(kLoadMisaligned, va);
+				return kTrapped;
+			}
+			if (uint64_t cause = translate(va, kLoad, pa))
+			{
+				trap(cause, va);
+				return kTrapped;
+			}
+			uint64_t v = 0;
+			if (!phys_read(pa, size, v))
+			{
+				trap(kLoadAccessFault, va);
+				return kTrapped;
+			}
+			reservation_valid_ = true;
+			reservation_addr_ = pa;
+			set_rd(rd, ext(v));
+			pc += 4;
+			return kOk;
+		}
+		if (va & (size - 1))
+		{
+			trap(kStoreMisaligned, va);
+			return kTrapped;
+		}
+		if (uint64_t cause = translate(va, kStore, pa))
+		{
+			trap(cause, va);
+			return kTrapped;
+		}
+		if (f5 == 0x03)
+		{
+			bool ok = reservation_valid_ && reservation_addr_ == pa;
+			reservation_valid_ = false;
+			if (ok && !phys_write(pa, size, src))
+			{
+				trap(kStoreAccessFault, va);
+				return kTrapped;
+			}
+			set_rd(rd, ok ? 0 : 1);
+			pc += 4;
+			return kOk;
+		}
+		uint64_t old = 0;
+		if (!phys_read(pa, size, old))
+		{
+			trap(kStoreAccessFault, va);
+			return kTrapped;
+		}
+		uint64_t o = ext(old), s = ext(src), r;
+		switch (f5)
+		{
+		case 0x01: r = src; break;
+		case 0x00: r = o + s; break;
+		case 0x04: r = o ^ s; break;
+		case 0x0c: r = o & s; break;
+		case 0x08: r = o | s; break;
+		case 0x10: r = (int64_t)o < (int64_t)s ? o : s; break;
+		case 0x14: r = (int64_t)o > (int64_t)s ? o : s; break;
+		case 0x18: r = (size == 4 ? (uint32_t)o < (uint32_t)s : o < s) ? o : s; break;
+		case 0x1c: r = (size == 4 ? (uint32_t)o > (uint32_t)s : o > s) ? o : s; break;
+		default: return kUnsupported;
+		}
+		if (!phys_write(pa, size, r))
+		{
+			trap(kStoreAccessFault, va);
+			return kTrapped;
+		}
+		set_rd(rd, o);
+		pc += 4;
+		return kOk;
+	}
+
+	Exec exec_system(uint32_t insn, uint32_t raw, uint64_t next)
+	{
+		unsigned rd = bits(insn, 11, 7), f3 = bits(insn, 14, 12), rs1 = bits(insn, 19, 15);
+		if (f3 == 0)
+		{
+			if (insn == 0x00000073)
+			{
+				trap(kEcallU + priv, 0);
+				return kTrapped;
+			}
+			if (insn == 0x30200073)
+			{
+				if (priv != 3)
+					return illegal(raw);
+				uint64_t s = csr.mstatus;
+				unsigned mpp = (unsigned)((s >> 11) & 3);
+				s = (s & ~kMIE) | ((s & kMPIE) ? kMIE : 0);
+				s &= ~(3ULL << 11);
+				s |= kMPIE;
+				if (mpp != 3)
+					s &= ~kMPRV;
+				csr.mstatus = s;
+				set_priv(mpp);
+				jump(csr.mepc);
+				return kOk;
+			}
+			if (insn == 0x10200073)
+			{
+				if (priv == 0)
+					return illegal(raw);
+				uint64_t s = csr.mstatus;
+				unsigned spp = (s & kSPP) ? 1 : 0;
+				s = (s & ~kSIE) | ((s & kSPIE) ? kSIE : 0);
+				s |= kSPIE;
+				s &= ~(kSPP | kMPRV);
+				csr.mstatus = s;
+				set_priv(spp);
+				jump(csr.sepc);
+				return kOk;
+			}
+			if (insn == 0x10500073)
+			{
+				// WFI: nothing else can happen before the timer fires, so jump
+				// mtime forward instead of spinning through the idle loop.
+				if ((csr.mie & (1ULL << 7)) && clint.mtimecmp > clint.mtime && (csr.mie & mip()) == 0)
+					retire(clint.mtimecmp - clint.mtime);
+				else
+					retire();
+				pc = next;
+				return kRetired;
+			}
+			if ((insn >> 25) == 0x09 && rd == 0)
+			{
+				if (priv == 0)
+					return illegal(raw);
+				flush_tlb();
+				pc = next;
+				return kOk;
+			}
+			return kUnsupported;
+		}
+		if (f3 == 4)
+			return kUnsupported;
+		unsigned addr = insn >> 20;
+		uint64_t src = (f3 & 4) ? rs1 : x[rs1];
+		bool write = (f3 & 3) == 1 || rs1 != 0;
+		uint64_t old = 0;
+		bool counter = addr == 0xc00 || addr == 0xc01 || addr == 0xc02;
+		if (!csr_read(addr, old) || priv < ((addr >> 8) & 3) || (write && (addr >> 10) == 3) ||
+		    (counter && !counter_ok(addr & 3)))
+			return illegal(raw);
+		if (write)
+		{
+			uint64_t v = (f3 & 3) == 1 ? src : (f3 & 3) == 2 ? (old | src) : (old & ~src);
+			csr_write(addr, v);
+		}
+		set_rd(rd, old);
+		pc = next;
+		return kOk;
+	}
+};
+
+#endif
@@ -0,0 +1,185 @@
+// Host-side checks for the ISS fast-forward: runs short hand-assembled
+// programs and compares the architectural state for_each_iss_state hands to
+// the RTL (GPRs, pc, privilege mode and the raw CSR values) with what
+// CSRFile would hold at the same point (CSRFileSpec checks the RTL side of
+// the same values). Exits non-zero if any check fails.
+
+#include <cinttypes>
+#include <cstdio>
+#include <vector>
+
+#include "rv64_iss.h"
+
+static const uint64_t kBase = 0x80000000ULL;
+static const uint64_t kHandler = kBase + 0x100;
+static const uint64_t kSEntry = kBase + 0x200;
+static const uint64_t kSretTest = kBase + 0x300;
+static const uint64_t kSTarget = kBase + 0x400;
+
+static const uint64_t kMIE = 1ULL << 3;
+static const uint64_t kMPIE = 1ULL << 7;
+static const uint64_t kSPIE = 1ULL << 5;
+static const uint64_t kSPP = 1ULL << 8;
+static const uint64_t kMPPS = 1ULL << 11;
+static const uint64_t kMPP = 3ULL << 11;
+
+static const unsigned kMstatus = 0x300, kSstatus = 0x100, kMtvec = 0x305, kMepc = 0x341, kSepc = 0x141;
+
+static uint32_t itype(unsigned op, unsigned f3, unsigned rd, unsigned rs1, int32_t imm)
+{
+	return ((uint32_t)(imm & 0xfff) << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+static uint32_t addi(unsigned rd, unsigned rs1, int32_t imm) { return itype(0x13, 0, rd, rs1, imm); }
+static uint32_t lui(unsigned rd, uint32_t imm20) { return (imm20 << 12) | (rd << 7) | 0x37; }
+static uint32_t auipc(unsigned rd, uint32_t imm20) { return (imm20 << 12) | (rd << 7) | 0x17; }
+static uint32_t csrrw(unsigned rd, unsigned csr, unsigned rs1) { return itype(0x73, 1, rd, rs1, (int32_t)csr); }
+static uint32_t csrrs(unsigned rd, unsigned csr, unsigned rs1) { return itype(0x73, 2, rd, rs1, (int32_t)csr); }
+static const uint32_t kEcall = 0x00000073;
+static const uint32_t kMret = 0x30200073;
+static const uint32_t kSret = 0x10200073;
+
+class Program
+{
+  public:
+	explicit Program(std::vector<uint8_t> &mem) : mem_(mem) {}
+
+	// Places the following instructions at `addr`.
+	Program &at(uint64_t addr)
+	{
+		pc_ = addr;
+		return *this;
+	}
+	Program &emit(uint32_t insn)
+	{
+		for (int i = 0; i < 4; ++i)
+			mem_[pc_ - kBase + i] = (uint8_t)(insn >> (8 * i));
+		pc_ += 4;
+		return *this;
+	}
+	// x<rd> = `target`, from the pc of the auipc.
+	Program &la(unsigned rd, uint64_t target)
+	{
+		int32_t off = (int32_t)(target - pc_);
+		emit(auipc(rd, 0));
+		return emit(addi(rd, rd, off));
+	}
+	uint64_t pc() const { return pc_; }
+
+  private:
+	std::vector<uint8_t> &mem_;
+	uint64_t pc_ = kBase;
+};
+
+static int failures = 0;
+
+static void expect(const char *stage, const char *what, uint64_t got, uint64_t want)
+{
+	if (got == want)
+		return;
+	printf("[iss-test]: %s: %s = 0x%016" PRIx64 ", expected 0x%016" PRIx64 "\n", stage, what, got, want);
+	++failures;
+}
+
+static void run_to(Rv64Iss &iss, const char *stage, uint64_t pc)
+{
+	Rv64Iss::StopReason r = iss.run(64, pc);
+	if (r != Rv64Iss::kStopPc)
+	{
+		printf("[iss-test]: %s: stopped by %s at pc=0x%016" PRIx64 "\n", stage, Rv64Iss::stop_name(r), iss.pc);
+		++failures;
+	}
+}
+
+int main()
+{
+	std::vector<uint8_t> mem(0x1000);
+	Program p(mem);
+
+	// M-mode: GPR arithmetic, mstatus write/read masking, then ECALL.
+	p.at(kBase);
+	p.emit(addi(1, 0, 5));
+	p.emit(addi(2, 1, 7));
+	p.la(5, kHandler);
+	p.emit(csrrw(0, kMtvec, 5));
+	p.emit(addi(6, 0, -1));
+	p.emit(csrrw(0, kMstatus, 6));
+	p.emit(csrrs(7, kMstatus, 0));
+	p.emit(csrrs(8, kSstatus, 0));
+	const uint64_t m_ecall = p.pc();
+	p.emit(kEcall);
+
+	// Trap handler: MRET to S-mode with MPRV set.
+	p.at(kHandler);
+	p.la(5, kSEntry);
+	p.emit(csrrw(0, kMepc, 5));
+	p.emit(lui(6, 0x21));
+	p.emit(addi(6, 6, -0x800)); // MPRV | MPP=S
+	p.emit(csrrw(0, kMstatus, 6));
+	p.emit(kMret);
+
+	// S-mode: read sstatus, then ECALL back to M.
+	p.at(kSEntry);
+	p.emit(csrrs(9, kSstatus, 0));
+	const uint64_t s_ecall = p.pc();
+	p.emit(kEcall);
+
+	// M-mode: SRET to S with MPRV set.
+	p.at(kSretTest);
+	p.la(5, kSTarget);
+	p.emit(csrrw(0, kSepc, 5));
+	p.emit(lui(6, 0x20));
+	p.emit(addi(6, 6, (int32_t)(kSPP | kSPIE))); // MPRV | SPP=S | SPIE
+	p.emit(csrrw(0, kMstatus, 6));
+	p.emit(kSret);
+
+	Rv64Iss iss;
+	iss.sram.mem = mem.data();
+	iss.sram.base = kBase;
+	iss.sram.size = mem.size();
+	iss.pc = kBase;
+
+	const char *stage = "M-mode ECALL";
+	run_to(iss, stage, kHandler);
+	expect(stage, "x1", iss.x[1], 5);
+	expect(stage, "x2", iss.x[2], 12);
+	// Only the implemented fields stick; SXL = UXL = 2 are ORed into reads.
+	expect(stage, "mstatus read", iss.x[7], 0xa000e19aaULL);
+	expect(stage, "sstatus read", iss.x[8], 0x2000c0122ULL);
+	expect(stage, "priv", iss.priv, 3);
+	expect(stage, "mepc", iss.csr.mepc, m_ecall);
+	expect(stage, "mcause", iss.csr.mcause, 11);
+	expect(stage, "mtval", iss.csr.mtval, 0);
+	expect(stage, "mstatus", iss.csr.mstatus, (0xe19aaULL & ~kMIE) | kMPIE | kMPP);
+
+	stage = "MRET to S";
+	run_to(iss, stage, kSEntry);
+	expect(stage, "priv", iss.priv, 1);
+	// MPRV drops on return below M; MIE <- MPIE (0), MPP <- U, MPIE <- 1.
+	expect(stage, "mstatus", iss.csr.mstatus, kMPIE);
+
+	stage = "S-mode ECALL";
+	run_to(iss, stage, kHandler);
+	expect(stage, "sstatus read", iss.x[9], 0x200000000ULL);
+	expect(stage, "priv", iss.priv, 3);
+	expect(stage, "mepc", iss.csr.mepc, s_ecall);
+	expect(stage, "mcause", iss.csr.mcause, 9);
+	expect(stage, "mtval", iss.csr.mtval, 0);
+	// MPIE <- MIE (0), MPP <- S.
+	expect(stage, "mstatus", iss.csr.mstatus, kMPPS);
+
+	stage = "SRET to S";
+	iss.pc = kSretTest;
+	run_to(iss, stage, kSTarget);
+	expect(stage, "priv", iss.priv, 1);
+	// SIE <- SPIE (1), SPIE <- 1, SPP <- U, MPRV dropped.
+	expect(stage, "mstatus", iss.csr.mstatus, kSPIE | (1ULL << 1));
+	expect(stage, "x1", iss.x[1], 5);
+
+	if (failures != 0)
+	{
+		printf("[iss-test]: %d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("[iss-test]: passed\n");
+	return 0;
+}
@@ -2,6 +2,7 @@
 #include <cstring>
 #include <string>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <filesystem>
 #include <elf.h>
 #include <cstdlib>
@@ -9,19 +10,52 @@
 #include <cerrno>
 #include <cinttypes>
 #include <fcntl.h>
+#include <sched.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 #include <vector>
+#include <array>
+#include <deque>
 #include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <csignal>
 #include <verilated.h>
 #if VM_TRACE
+#if VM_TRACE_FST
+#include <verilated_fst_c.h>
+typedef VerilatedFstC WaveFile;
+#else
 #include <verilated_vcd_c.h>
+typedef VerilatedVcdC WaveFile;
+#endif
+#else
+struct WaveFile;
+#endif
+#if ION_SIM_SAVABLE
+#include <verilated_save.h>
+#include <zlib.h>
 #endif
 #include "VSoc.h"
 #include "VSoc___024root.h"
 #include "VSoc_L1Cache.h"
+#if ION_SPARSE_SRAM
+#include "VSoc__Dpi.h"
+#endif
+#include "rv64_iss.h"
+#include "commit_trace.h"
 
 #define RED "\033[31m"
 #define GREEN "\033[32m"
@@ -37,18 +71,35 @@
 
 #define MAX_SIM_CYCLES 10000
 static const char *kPayloadElfPath = "simulator/build/payload/payload.elf";
+#if VM_TRACE_FST
+static const char *kWavePath = "simulator/build/wave.fst";
+#else
 static const char *kWavePath = "simulator/build/wave.vcd";
-vluint64_t sim_time = 0;
+#endif
+// Per thread so the riscv-tests pool can run one model per worker.
+thread_local vluint64_t sim_time = 0;
+static int sim_argc = 0;
+static char **sim_argv = nullptr;
 
 struct SimOptions;
 
 void load_elf(VSoc *dut, const char *path);
 void load_elf_to_regions(VSoc *dut, const char *path, uint64_t sram_base, size_t sram_size);
 void load_blob_to_sram(VSoc *dut, const char *path, uint64_t paddr, uint64_t sram_base, size_t sram_size);
+static void note_sram_write(uint64_t offset, uint64_t len);
+static std::string json_escape(const std::string &in);
+// Headline numbers of one run, for the batch summaries.
+struct SimStats
+{
+	uint64_t cycles = 0;
+	uint64_t retired = 0;
+};
+
 bool run_one_test(const std::string &bin_path,
 				  const std::string &test_name, bool trace_en,
-				  const std::string &expected_uart = "");
-bool run_sim(const SimOptions &opts);
+				  const std::string &expected_uart = "",
+				  SimStats *stats = nullptr);
+bool run_sim(const SimOptions &opts, SimStats *stats = nullptr);
 
 static bool env_enabled(const char *name)
 {
@@ -66,6 +117,12 @@ static uint64_t env_u64(const char *name, uint64_t fallback)
 	return end != value ? parsed : fallback;
 }
 
+static std::string env_string(const char *name)
+{
+	const char *value = std::getenv(name);
+	return value != nullptr ? value : "";
+}
+
 static bool would_block_errno(int err)
 {
 	if (err == EAGAIN)
@@ -77,6 +134,46 @@ static bool would_block_errno(int err)
 	return false;
 }
 
+static void set_nonblock(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags >= 0)
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Non-blocking TCP listener on 127.0.0.1:port for the debug servers; -1 on
+// failure, reported with `what` as the perror prefix.
+static int listen_loopback(int port, const char *what)
+{
+	std::string tag = what;
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		perror((tag + " socket").c_str());
+		return -1;
+	}
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons((uint16_t)port);
+	if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+	{
+		perror((tag + " bind").c_str());
+		close(fd);
+		return -1;
+	}
+	if (listen(fd, 1) != 0)
+	{
+		perror((tag + " listen").c_str());
+		close(fd);
+		return -1;
+	}
+	set_nonblock(fd);
+	return fd;
+}
+
 struct SimOptions
 {
 	std::string elf_path = kPayloadElfPath;
@@ -99,6 +196,76 @@ struct SimOptions
 	bool accept_uart_match = false;
 	bool stop_on_uart_match = false;
 	int jtag_rbb_port = 0;
+	// Verilator context thread count; 0 keeps the count the model was built
+	// with. Only meaningful for binaries verilated with --threads.
+	unsigned sim_threads = (unsigned)env_u64("ION_SIM_THREADS", 0);
+	std::string sim_cpus = env_string("ION_SIM_CPUS");
+	// Checkpoints need a SAVABLE=1 build. The save fires once, at the first of
+	// the cycle or UART milestone that is reached.
+	std::string checkpoint_save = env_string("ION_CHECKPOINT_SAVE");
+	std::string checkpoint_restore = env_string("ION_CHECKPOINT_RESTORE");
+	uint64_t checkpoint_at_cycle = env_u64("ION_CHECKPOINT_AT_CYCLE", UINT64_MAX);
+	std::string checkpoint_at_uart = env_string("ION_CHECKPOINT_AT_UART");
+	bool checkpoint_exit = env_enabled("ION_CHECKPOINT_EXIT");
+	// Snapshot fan-out: boot once, fork one child per manifest entry at the
+	// firmware-to-payload handoff. Jobs default to the host CPU count.
+	std::string fork_manifest = env_string("ION_FORK_MANIFEST");
+	std::string fork_dir = std::getenv("ION_FORK_DIR") != nullptr ? env_string("ION_FORK_DIR") : "simulator/build/fork";
+	unsigned fork_jobs = (unsigned)env_u64("ION_FORK_JOBS", 0);
+	// ISS fast-forward: run the first instructions on the functional model,
+	// then transplant its state into the RTL. Any one limit enables it.
+	uint64_t iss_insns = env_u64("ION_ISS_INSNS", 0);
+	uint64_t iss_until_pc = env_u64("ION_ISS_UNTIL_PC", UINT64_MAX);
+	std::string iss_until_uart = env_string("ION_ISS_UNTIL_UART");
+	// Hand this thread's model to its next run instead of building a new one.
+	bool model_reuse = std::getenv("ION_MODEL_REUSE") == nullptr || env_enabled("ION_MODEL_REUSE");
+	// Jump CLINT time to the next timer deadline while the core idles in WFI
+	// or a store-free polling loop.
+	bool idle_skip = env_enabled("ION_IDLE_SKIP");
+	// Host stdin/socket readiness is checked once per this many cycles, which
+	// bounds the added UART RX and remote-bitbang input latency.
+	uint64_t io_poll_cycles = env_u64("ION_IO_POLL_CYCLES", 1024);
+	// TCP port of the direct DMI server; 0 disables it.
+	int dmi_port = (int)env_u64("ION_DMI_PORT", 0);
+	// UART console: TX bytes reach stdout (and the log file, if any) on a
+	// newline or after this many ms; 0 writes every byte through. The
+	// in-memory copy used for matching keeps only the trailing uart_keep bytes.
+	std::string uart_log = env_string("ION_UART_LOG");
+	uint64_t uart_flush_ms = env_u64("ION_UART_FLUSH_MS", 20);
+	uint64_t uart_keep = env_u64("ION_UART_KEEP", 1 << 20);
+	// More UART text to wait for, `text[@cycle];...`: a UART match needs all
+	// of them plus expected_uart, each by its sim_time deadline if it has one.
+	// Any ION_UART_FAIL text ends the run as failed.
+	std::string uart_milestones = env_string("ION_UART_MILESTONES");
+	std::string uart_fail = env_string("ION_UART_FAIL");
+	// Binary commit trace written on a background thread; decode it with
+	// `make commit-trace-decode`.
+	std::string commit_trace = env_string("ION_COMMIT_TRACE");
+	// Flight recorder: ring of the last flight_events retirements, traps and
+	// CSR writes, dumped on failure, SIGUSR1 or a `dump` probe. 0 disables it.
+	uint64_t flight_events = env_u64("ION_FLIGHT_RECORDER", 65536);
+	std::string flight_out = env_string("ION_FLIGHT_OUT");
+	// Waveform windows for ION_TRACE_WAVE: dump only between start and stop
+	// triggers, optionally with wave_pre sim_time units of history before
+	// the start trigger.
+	std::string wave_path = env_string("ION_WAVE_PATH");
+	std::string wave_start = env_string("ION_WAVE_START");
+	std::string wave_stop = env_string("ION_WAVE_STOP");
+	uint64_t wave_length = env_u64("ION_WAVE_LENGTH", 0);
+	uint64_t wave_pre = env_u64("ION_WAVE_PRE", 0);
+	uint64_t wave_windows = env_u64("ION_WAVE_WINDOWS", 1);
+	// Call-stack profile of the retired PCs, symbolized against the loaded
+	// ELFs plus the ':'-separated profile_symbols ones.
+	bool profile = env_enabled("ION_PROFILE");
+	std::string profile_out = env_string("ION_PROFILE_OUT");
+	std::string profile_symbols = env_string("ION_PROFILE_SYMBOLS");
+	// Per-branch predictor table, written next to the profile.
+	bool branch_profile = env_enabled("ION_BRANCH_PROFILE");
+	// Perf counter time series: one row per perf_interval cycles (0: off).
+	uint64_t perf_interval = env_u64("ION_PERF_INTERVAL", 0);
+	std::string perf_timeline = env_string("ION_PERF_TIMELINE");
+	// Names for the ROI marker ids, `id=name;...`.
+	std::string roi_names = env_string("ION_ROI_NAMES");
 	bool inject_boot_args = false;
 	uint64_t boot_a0 = 0;
 	uint64_t boot_a1 = 0;
@@ -109,6 +276,48 @@ struct SimOptions
 	uint64_t max_cycles = MAX_SIM_CYCLES;
 };
 
+// Parse a taskset-style CPU list ("0-3,8") and pin the simulation thread to
+// it. Verilator worker threads are created when the model is constructed, so
+// they inherit this mask as long as it is applied before `new VSoc`.
+static bool apply_cpu_affinity(const std::string &cpus)
+{
+	if (cpus.empty())
+		return true;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	const char *p = cpus.c_str();
+	while (*p != '\0')
+	{
+		char *end = nullptr;
+		unsigned long first = std::strtoul(p, &end, 0);
+		if (end == p)
+			break;
+		unsigned long last = first;
+		p = end;
+		if (*p == '-')
+		{
+			last = std::strtoul(p + 1, &end, 0);
+			p = end;
+		}
+		for (unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+			CPU_SET(cpu, &set);
+		if (*p == ',')
+			++p;
+	}
+	if (CPU_COUNT(&set) == 0 || *p != '\0')
+	{
+		fprintf(stderr, "invalid ION_SIM_CPUS list: %s\n", cpus.c_str());
+		return false;
+	}
+	if (sched_setaffinity(0, sizeof(set), &set) != 0)
+	{
+		perror("sched_setaffinity");
+		return false;
+	}
+	printf("[sim]: pinned to cpus %s (%d cpus)\n", cpus.c_str(), CPU_COUNT(&set));
+	return true;
+}
+
 static void clear_ext_irq_sources(VSoc *dut)
 {
 	dut->io_ext_irq_sources_0 = 0;
@@ -185,11 +394,461 @@ static void set_ext_irq_source(VSoc *dut, unsigned source, bool value)
 	}
 }
 
+// Fixed-capacity byte FIFO between HostIo handlers and the per-cycle drive
+// paths. Both sides run on the simulation thread.
+class ByteRing
+{
+  public:
+	explicit ByteRing(size_t capacity) : buf_(capacity) {}
+
+	size_t size() const { return tail_ - head_; }
+	size_t space() const { return buf_.size() - size(); }
+	bool empty() const { return head_ == tail_; }
+
+	// Contiguous free run starting at the tail, for read()/recv() to fill.
+	uint8_t *write_ptr(size_t *len)
+	{
+		size_t at = tail_ % buf_.size();
+		*len = std::min(space(), buf_.size() - at);
+		return &buf_[at];
+	}
+
+	void commit(size_t len) { tail_ += len; }
+
+	bool peek(uint8_t *out) const
+	{
+		if (empty())
+			return false;
+		*out = buf_[head_ % buf_.size()];
+		return true;
+	}
+
+	bool pop(uint8_t *out)
+	{
+		if (!peek(out))
+			return false;
+		head_++;
+		return true;
+	}
+
+	void clear() { head_ = tail_ = 0; }
+
+  private:
+	std::vector<uint8_t> buf_;
+	uint64_t head_ = 0;
+	uint64_t tail_ = 0;
+};
+
+// Polls the host descriptors (stdin, remote-bitbang sockets) with one
+// epoll_wait every ION_IO_POLL_CYCLES cycles instead of a read()/recv() per
+// half-cycle. Handlers move whatever is ready into ByteRings; the per-cycle
+// path only pops from those. Level-triggered, so a handler that stops early
+// because its ring is full picks up the rest on the next poll.
+class HostIo
+{
+  public:
+	explicit HostIo(uint64_t interval_cycles)
+	    : interval_(interval_cycles == 0 ? 2 : 2 * interval_cycles)
+	{
+	}
+
+	~HostIo()
+	{
+		if (epfd_ >= 0)
+			close(epfd_);
+	}
+
+	HostIo(const HostIo &) = delete;
+	HostIo &operator=(const HostIo &) = delete;
+
+	bool watch(int fd, std::function<void()> on_ready)
+	{
+		if (epfd_ < 0)
+		{
+			epfd_ = epoll_create1(EPOLL_CLOEXEC);
+			if (epfd_ < 0)
+			{
+				perror("epoll_create1");
+				return false;
+			}
+		}
+		epoll_event ev{};
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) != 0)
+		{
+			perror("epoll_ctl");
+			return false;
+		}
+		handlers_.emplace_back(fd, std::move(on_ready));
+		return true;
+	}
+
+	void unwatch(int fd)
+	{
+		if (epfd_ >= 0)
+			epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+		handlers_.erase(std::remove_if(handlers_.begin(), handlers_.end(),
+		                               [fd](const std::pair<int, std::function<void()>> &h) { return h.first == fd; }),
+		                handlers_.end());
+	}
+
+	// Called every half-cycle; returns straight away between polls.
+	void poll(uint64_t cycle)
+	{
+		last_cycle_ = cycle;
+		if (handlers_.empty() || (cycle < next_poll_ && cycle >= eager_until_))
+			return;
+		next_poll_ = cycle + interval_;
+		epoll_event events[8];
+		int n = epoll_wait(epfd_, events, 8, 0);
+		if (n < 0 && errno != EINTR)
+			perror("epoll_wait");
+		if (n > 0)
+			eager_until_ = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			for (size_t h = 0; h < handlers_.size(); ++h)
+			{
+				if (handlers_[h].first != events[i].data.fd)
+					continue;
+				// Copy: the handler may unwatch (and so erase) itself.
+				std::function<void()> fn = handlers_[h].second;
+				fn();
+				break;
+			}
+		}
+	}
+
+	// A reply went out and the peer is likely to answer right away: poll on
+	// every call until input arrives or one interval has passed.
+	void expect_input() { eager_until_ = last_cycle_ + interval_; }
+
+	// The cycle of the next real poll. An idle skip stops here so host input
+	// keeps its ION_IO_POLL_CYCLES latency bound while the guest sleeps.
+	uint64_t next_poll() const
+	{
+		if (handlers_.empty())
+			return UINT64_MAX;
+		return last_cycle_ < eager_until_ ? last_cycle_ : next_poll_;
+	}
+
+  private:
+	int epfd_ = -1;
+	uint64_t interval_ = 2;
+	uint64_t next_poll_ = 0;
+	uint64_t last_cycle_ = 0;
+	uint64_t eager_until_ = 0;
+	std::vector<std::pair<int, std::function<void()>>> handlers_;
+};
+
+// Writes UART TX bytes into the process's stdout stream, the same stdio
+// buffer the harness's own trace and status lines go through, so the two
+// stay in order and a printk burst costs one write() per line (terminal) or
+// per buffer (pipe) rather than one per character. A flusher thread pushes
+// out whatever is buffered every `flush_ms`. stdout itself is never
+// replaced: ION_TEST_JOBS workers each own a sink and flusher over the one
+// shared stream, where stdio's locking keeps every call whole but TX bytes
+// of concurrent runs interleave. stop() joins the flusher before fork();
+// start() brings it back.
+class ConsoleSink
+{
+  public:
+	ConsoleSink(const std::string &log_path, uint64_t flush_ms) : flush_ms_(flush_ms)
+	{
+		if (!log_path.empty())
+		{
+			log_ = fopen(log_path.c_str(), "ab");
+			if (log_ == nullptr)
+				perror(log_path.c_str());
+		}
+		start();
+	}
+
+	~ConsoleSink()
+	{
+		stop();
+		if (log_ != nullptr)
+			fclose(log_);
+	}
+
+	void put(uint8_t ch)
+	{
+		// The log gets console bytes only, not the harness's own lines.
+		if (log_ != nullptr)
+			fputc(ch, log_);
+		fputc(ch, stdout);
+		if (flush_ms_ == 0)
+			flush();
+	}
+
+	// Returns once everything put() so far has been written.
+	void flush()
+	{
+		fflush(stdout);
+		if (log_ != nullptr)
+			fflush(log_);
+	}
+
+	void start()
+	{
+		std::lock_guard<std::mutex> lock(mu_);
+		if (running_ || flush_ms_ == 0)
+			return;
+		running_ = true;
+		flusher_ = std::thread([this] { run(); });
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mu_);
+			if (running_)
+			{
+				running_ = false;
+				wake_.notify_one();
+			}
+		}
+		if (flusher_.joinable())
+			flusher_.join();
+		flush();
+	}
+
+  private:
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mu_);
+		while (running_)
+		{
+			wake_.wait_for(lock, std::chrono::milliseconds(flush_ms_), [&] { return !running_; });
+			// An fflush() with nothing buffered makes no system call.
+			lock.unlock();
+			flush();
+			lock.lock();
+		}
+	}
+
+	uint64_t flush_ms_;
+	FILE *log_ = nullptr;
+	std::mutex mu_;
+	std::condition_variable wake_;
+	bool running_ = false;
+	std::thread flusher_;
+};
+
+// Aho-Corasick over the TX byte stream: success milestones, failure texts
+// and milestone deadlines are all tracked with one table lookup per byte
+// instead of rescanning the captured output.
+class UartMatcher
+{
+  public:
+	struct Pattern
+	{
+		std::string text;
+		bool failure = false;
+		uint64_t deadline = UINT64_MAX;
+		uint64_t hit_at = UINT64_MAX;
+		bool missed = false;
+	};
+
+	void configure(const SimOptions &opts)
+	{
+		patterns_.clear();
+		if (!opts.expected_uart.empty())
+			add(opts.expected_uart, false, UINT64_MAX);
+		parse(opts.uart_milestones, false);
+		parse(opts.uart_fail, true);
+		build();
+	}
+
+	void feed(uint8_t ch, uint64_t cycle)
+	{
+		state_ = delta_[state_ * 256 + ch];
+		for (uint32_t index : out_[state_])
+		{
+			Pattern &p = patterns_[index];
+			if (p.hit_at != UINT64_MAX)
+				continue;
+			p.hit_at = cycle;
+			if (p.failure && failed_ == nullptr)
+				failed_ = &p;
+			if (!p.failure)
+				--remaining_;
+		}
+	}
+
+	// Replays output captured before the matcher saw it (checkpoint restore,
+	// a fork child's new expectation) as if it arrived at `cycle`.
+	void prime(const std::string &history, uint64_t cycle)
+	{
+		for (char ch : history)
+			feed((uint8_t)ch, cycle);
+	}
+
+	// Every success text seen; false when there are none to wait for.
+	bool satisfied() const { return successes_ != 0 && remaining_ == 0; }
+	bool has_success() const { return successes_ != 0; }
+
+	// The first failure text seen or milestone deadline missed by `cycle`.
+	const Pattern *check(uint64_t cycle)
+	{
+		if (failed_ != nullptr || cycle < next_deadline_)
+			return failed_;
+		next_deadline_ = UINT64_MAX;
+		for (Pattern &p : patterns_)
+		{
+			if (p.failure || p.deadline == UINT64_MAX || p.missed)
+				continue;
+			if (p.hit_at <= p.deadline)
+				continue;
+			if (cycle > p.deadline)
+			{
+				p.missed = true;
+				if (failed_ == nullptr)
+					failed_ = &p;
+			}
+			else
+				next_deadline_ = std::min(next_deadline_, p.deadline + 1);
+		}
+		return failed_;
+	}
+
+	const std::vector<Pattern> &patterns() const { return patterns_; }
+
+	// First cycle at which check() can report a missed deadline.
+	uint64_t next_deadline() const { return failed_ != nullptr ? 0 : next_deadline_; }
+
+	void report() const
+	{
+		for (const Pattern &p : patterns_)
+		{
+			const char *kind = p.failure ? "uart-fail" : "uart-milestone";
+			if (p.hit_at != UINT64_MAX)
+				printf("[%s]: \"%s\" cycle=%" PRIu64 "%s\n", kind, p.text.c_str(), p.hit_at,
+				       p.missed ? " (after deadline)" : "");
+			else if (p.missed)
+				printf("[%s]: \"%s\" missed deadline=%" PRIu64 "\n", kind, p.text.c_str(), p.deadline);
+			else if (!p.failure)
+				printf("[%s]: \"%s\" not seen\n", kind, p.text.c_str());
+		}
+	}
+
+  private:
+	static constexpr uint32_t kNone = UINT32_MAX;
+
+	void add(const std::string &text, bool failure, uint64_t deadline)
+	{
+		Pattern p;
+		p.text = text;
+		p.failure = failure;
+		p.deadline = deadline;
+		patterns_.push_back(p);
+	}
+
+	// `text[@deadline];...`; an '@' not followed by a number is literal text.
+	void parse(const std::string &spec, bool failure)
+	{
+		size_t start = 0;
+		while (start <= spec.size())
+		{
+			size_t end = spec.find(';', start);
+			if (end == std::string::npos)
+				end = spec.size();
+			std::string item = spec.substr(start, end - start);
+			uint64_t deadline = UINT64_MAX;
+			size_t at = item.rfind('@');
+			if (!failure && at != std::string::npos && at + 1 < item.size())
+			{
+				char *tail = nullptr;
+				uint64_t value = strtoull(item.c_str() + at + 1, &tail, 0);
+				if (*tail == '\0')
+				{
+					deadline = value;
+					item.resize(at);
+				}
+			}
+			if (!item.empty())
+				add(item, failure, deadline);
+			start = end + 1;
+		}
+	}
+
+	void build()
+	{
+		delta_.assign(256, kNone);
+		out_.assign(1, {});
+		for (uint32_t i = 0; i < patterns_.size(); ++i)
+		{
+			uint32_t state = 0;
+			for (unsigned char c : patterns_[i].text)
+			{
+				if (delta_[state * 256 + c] == kNone)
+				{
+					delta_[state * 256 + c] = (uint32_t)out_.size();
+					out_.emplace_back();
+					delta_.resize(out_.size() * 256, kNone);
+				}
+				state = delta_[state * 256 + c];
+			}
+			out_[state].push_back(i);
+		}
+
+		// Breadth-first, so a state's fail target is complete before its
+		// children copy edges and outputs from it.
+		std::vector<uint32_t> fail(out_.size(), 0);
+		std::vector<uint32_t> queue;
+		queue.push_back(0);
+		for (size_t head = 0; head < queue.size(); ++head)
+		{
+			uint32_t state = queue[head];
+			for (unsigned c = 0; c < 256; ++c)
+			{
+				uint32_t &next = delta_[state * 256 + c];
+				uint32_t fallback = state == 0 ? 0 : delta_[fail[state] * 256 + c];
+				if (next == kNone)
+				{
+					next = fallback;
+					continue;
+				}
+				fail[next] = fallback;
+				out_[next].insert(out_[next].end(), out_[fallback].begin(), out_[fallback].end());
+				queue.push_back(next);
+			}
+		}
+
+		state_ = 0;
+		failed_ = nullptr;
+		successes_ = 0;
+		next_deadline_ = UINT64_MAX;
+		for (const Pattern &p : patterns_)
+		{
+			if (p.failure)
+				continue;
+			++successes_;
+			if (p.deadline != UINT64_MAX)
+				next_deadline_ = std::min(next_deadline_, p.deadline + 1);
+		}
+		remaining_ = successes_;
+	}
+
+	std::vector<Pattern> patterns_;
+	std::vector<uint32_t> delta_;
+	std::vector<std::vector<uint32_t>> out_;
+	uint32_t state_ = 0;
+	size_t successes_ = 0;
+	size_t remaining_ = 0;
+	uint64_t next_deadline_ = UINT64_MAX;
+	Pattern *failed_ = nullptr;
+};
+
 class UartStdio
 {
   public:
-	explicit UartStdio(bool enable_stdin)
+	UartStdio(bool enable_stdin, HostIo &io, const SimOptions &opts)
 	    : enable_stdin_(enable_stdin),
+	      io_(io),
+	      console_(opts.uart_log, opts.uart_flush_ms),
+	      keep_(opts.uart_keep),
 	      inject_cycle_(env_u64("ION_UART_RX_CYCLE", UINT64_MAX)),
 	      inject_byte_(env_u64("ION_UART_RX_BYTE", 0)),
 	      inject_enabled_(inject_cycle_ != UINT64_MAX)
@@ -199,11 +858,15 @@ class UartStdio
 			old_flags_ = fcntl(STDIN_FILENO, F_GETFL, 0);
 			if (old_flags_ >= 0)
 				fcntl(STDIN_FILENO, F_SETFL, old_flags_ | O_NONBLOCK);
+			stdin_watched_ = io_.watch(STDIN_FILENO, [this] { fill_rx(); });
 		}
+		matcher_.configure(opts);
 	}
 
 	~UartStdio()
 	{
+		if (stdin_watched_)
+			io_.unwatch(STDIN_FILENO);
 		if (enable_stdin_ && old_flags_ >= 0)
 			fcntl(STDIN_FILENO, F_SETFL, old_flags_);
 	}
@@ -219,39 +882,128 @@ class UartStdio
 			injected_ = true;
 			return;
 		}
-		if (!enable_stdin_)
-			return;
-
 		uint8_t ch = 0;
-		ssize_t n = read(STDIN_FILENO, &ch, 1);
-		if (n == 1)
+		if (rx_.pop(&ch))
 		{
 			dut->io_uart_rx_valid = 1;
 			dut->io_uart_rx_byte = ch;
 		}
-		else if (n < 0 && !would_block_errno(errno))
-		{
-			perror("uart stdin read");
-		}
 	}
 
-	void capture_tx(VSoc *dut)
+	bool capture_tx(VSoc *dut)
+	{
+		if (!dut->io_uart_tx)
+			return false;
+		emit((uint8_t)(dut->io_uart_byte & 0xFF));
+		return true;
+	}
+
+	// TX bytes produced outside the model (ISS fast-forward).
+	void emit(uint8_t ch)
 	{
-		if (dut->io_uart_tx)
+		output_.push_back((char)ch);
+		// Trim in halves so the erase is amortised over keep_ bytes.
+		if (keep_ != 0 && output_.size() >= 2 * keep_)
 		{
-			uint8_t ch = (uint8_t)(dut->io_uart_byte & 0xFF);
-			output_.push_back((char)ch);
-			putchar(ch);
-			fflush(stdout);
+			size_t drop = output_.size() - keep_;
+			output_.erase(0, drop);
+			dropped_ += drop;
 		}
+		matcher_.feed(ch, sim_time);
+		if (total() > console_from_)
+			console_.put(ch);
+	}
+
+	UartMatcher &matcher() { return matcher_; }
+
+	// Swap in new expectations and match them against the output so far.
+	void expect(const SimOptions &opts)
+	{
+		matcher_.configure(opts);
+		matcher_.prime(output_, sim_time);
 	}
 
+	// The trailing ION_UART_KEEP bytes of TX output.
 	const std::string &output() const { return output_; }
+	// Bytes transmitted since reset, including those trimmed from output().
+	uint64_t total() const { return dropped_ + output_.size(); }
+	// What is still held of the output from byte `pos` onwards.
+	std::string since(uint64_t pos) const
+	{
+		return pos <= dropped_ ? output_ : output_.substr(std::min<uint64_t>(pos - dropped_, output_.size()));
+	}
+
+	void flush_console() { console_.flush(); }
+	void pause_console() { console_.stop(); }
+	void resume_console() { console_.start(); }
+	// Keep bytes before `total` off the console; a forked replay uses this
+	// for output the original process already showed.
+	void mute_console_until(uint64_t total) { console_from_ = total; }
+
+	// First cycle at which RX input may reach the model: now if stdin bytes
+	// are queued, the ION_UART_RX_CYCLE injection while it is pending.
+	uint64_t next_rx(uint64_t cycle) const
+	{
+		if (!rx_.empty())
+			return cycle;
+		if (inject_enabled_ && !injected_)
+			return std::max(cycle, inject_cycle_);
+		return UINT64_MAX;
+	}
+
+#if ION_SIM_SAVABLE
+	void save(VerilatedSerialize &os) const
+	{
+		uint64_t len = output_.size();
+		os.write(&len, sizeof(len));
+		os.write(output_.data(), len);
+		os.write(&dropped_, sizeof(dropped_));
+		os.write(&injected_, sizeof(injected_));
+	}
+
+	void restore(VerilatedDeserialize &is, uint64_t cycle)
+	{
+		uint64_t len = 0;
+		is.read(&len, sizeof(len));
+		output_.resize(len);
+		is.read(&output_[0], len);
+		is.read(&dropped_, sizeof(dropped_));
+		is.read(&injected_, sizeof(injected_));
+		matcher_.prime(output_, cycle);
+	}
+#endif
 
   private:
+	void fill_rx()
+	{
+		size_t len = 0;
+		uint8_t *dst = rx_.write_ptr(&len);
+		if (len == 0)
+			return;
+		ssize_t n = read(STDIN_FILENO, dst, len);
+		if (n > 0)
+			rx_.commit((size_t)n);
+		else if (n == 0)
+		{
+			// EOF stays readable; stop polling it.
+			io_.unwatch(STDIN_FILENO);
+			stdin_watched_ = false;
+		}
+		else if (!would_block_errno(errno))
+			perror("uart stdin read");
+	}
+
 	bool enable_stdin_ = false;
+	HostIo &io_;
+	bool stdin_watched_ = false;
+	ByteRing rx_{4096};
 	int old_flags_ = -1;
+	ConsoleSink console_;
+	UartMatcher matcher_;
+	uint64_t keep_ = 0;
 	std::string output_;
+	uint64_t dropped_ = 0;
+	uint64_t console_from_ = 0;
 	uint64_t inject_cycle_ = UINT64_MAX;
 	uint64_t inject_byte_ = 0;
 	bool inject_enabled_ = false;
@@ -276,6 +1028,14 @@ class InterruptModel
 			set_ext_irq_source(dut, source, (mask >> source) & 1ULL);
 	}
 
+	// First cycle at which drive() changes the external IRQ lines.
+	uint64_t next_change(const std::string &test_name, uint64_t cycle) const
+	{
+		if ((test_name == "plic" || test_name == "plic_s") && cycle < 80)
+			return 80;
+		return UINT64_MAX;
+	}
+
 	void sample(VSoc *dut, uint64_t cycle)
 	{
 		if (!trace_irq_)
@@ -310,8 +1070,9 @@ class InterruptModel
 class RemoteBitbang
 {
   public:
-	explicit RemoteBitbang(int port, bool cycle_per_command = false)
+	RemoteBitbang(int port, HostIo &io, bool cycle_per_command = false)
 	    : port_(port),
+	      io_(io),
 	      cycle_per_command_(cycle_per_command),
 	      trace_(env_enabled("ION_TRACE_JTAG")),
 	      trace_dmi_(env_enabled("ION_TRACE_DMI")) {}
@@ -320,77 +1081,59 @@ class RemoteBitbang
 	{
 		if (port_ <= 0)
 			return true;
-		listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+		listen_fd_ = listen_loopback(port_, "jtag");
 		if (listen_fd_ < 0)
-		{
-			perror("jtag socket");
-			return false;
-		}
-		int one = 1;
-		setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
-		sockaddr_in addr{};
-		addr.sin_family = AF_INET;
-		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-		addr.sin_port = htons((uint16_t)port_);
-		if (bind(listen_fd_, (sockaddr *)&addr, sizeof(addr)) != 0)
-		{
-			perror("jtag bind");
 			return false;
-		}
-		if (listen(listen_fd_, 1) != 0)
-		{
-			perror("jtag listen");
+		if (!io_.watch(listen_fd_, [this] { accept_client(); }))
 			return false;
-		}
-		set_nonblock(listen_fd_);
 		printf("[jtag]: remote-bitbang listening on 127.0.0.1:%d\n", port_);
 		return true;
 	}
 
 	~RemoteBitbang()
 	{
-		if (client_fd_ >= 0)
-			close(client_fd_);
+		drop_client();
 		if (listen_fd_ >= 0)
+		{
+			io_.unwatch(listen_fd_);
 			close(listen_fd_);
+		}
 	}
 
+	bool connected() const { return client_fd_ >= 0; }
+
+	// Runs queued commands until one needs a SoC edge the TAP has not seen
+	// yet. The TAP registers TCK (tckPrev), so each pin change must be held
+	// across a rising edge before the next one; reads and writes that leave
+	// the pins as they are need no edge. In JTAG-only mode every write steps
+	// its own tick, so up to kBatch commands run per call. TDO replies of
+	// the batch go out in one send.
 	void drive(VSoc *dut)
 	{
-		if (port_ <= 0)
-			return;
-		accept_client();
 		if (client_fd_ < 0)
 			return;
-
-		char ch = 0;
-		ssize_t n = recv(client_fd_, &ch, 1, 0);
-		if (n == 1)
-		{
-			handle(dut, ch);
-			return;
-		}
-		if (n == 0)
+		if (dut->clock)
+			unsampled_ = false;
+		uint8_t ch = 0;
+		for (unsigned n = 0; n < kBatch && rx_.peek(&ch); ++n)
 		{
-			close(client_fd_);
-			client_fd_ = -1;
-			return;
+			if (!cycle_per_command_ && changes_pins(dut, (char)ch))
+			{
+				if (unsampled_)
+					break;
+				unsampled_ = true;
+			}
+			rx_.pop(&ch);
+			handle(dut, (char)ch);
+			if (client_fd_ < 0)
+				return;
 		}
-		if (would_block_errno(errno))
-			return;
-		perror("jtag recv");
-		close(client_fd_);
-		client_fd_ = -1;
+		flush_tdo();
+		if (rx_.empty() && peer_closed_)
+			drop_client();
 	}
 
   private:
-	static void set_nonblock(int fd)
-	{
-		int flags = fcntl(fd, F_GETFL, 0);
-		if (flags >= 0)
-			fcntl(fd, F_SETFL, flags | O_NONBLOCK);
-	}
-
 	void accept_client()
 	{
 		if (client_fd_ >= 0 || listen_fd_ < 0)
@@ -399,6 +1142,18 @@ class RemoteBitbang
 		if (client_fd_ >= 0)
 		{
 			set_nonblock(client_fd_);
+			rx_.clear();
+			tdo_.clear();
+			peer_closed_ = false;
+			commands_ = 0;
+			reads_ = 0;
+			connected_at_ = std::chrono::steady_clock::now();
+			if (!io_.watch(client_fd_, [this] { fill_rx(); }))
+			{
+				close(client_fd_);
+				client_fd_ = -1;
+				return;
+			}
 			printf("[jtag]: remote-bitbang client connected\n");
 		}
 		else if (!would_block_errno(errno))
@@ -407,8 +1162,82 @@ class RemoteBitbang
 		}
 	}
 
+	void fill_rx()
+	{
+		size_t len = 0;
+		uint8_t *dst = rx_.write_ptr(&len);
+		if (len == 0)
+			return;
+		ssize_t n = recv(client_fd_, dst, len, 0);
+		if (n > 0)
+		{
+			rx_.commit((size_t)n);
+			return;
+		}
+		if (n < 0 && would_block_errno(errno))
+			return;
+		if (n < 0)
+			perror("jtag recv");
+		// Run the commands already queued before closing the connection.
+		io_.unwatch(client_fd_);
+		peer_closed_ = true;
+	}
+
+	void drop_client()
+	{
+		if (client_fd_ < 0)
+			return;
+		flush_tdo();
+		if (!peer_closed_)
+			io_.unwatch(client_fd_);
+		close(client_fd_);
+		client_fd_ = -1;
+		peer_closed_ = false;
+		rx_.clear();
+		tdo_.clear();
+		double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - connected_at_).count();
+		printf("[jtag]: remote-bitbang client closed: commands=%" PRIu64 " reads=%" PRIu64 " wall_s=%.3f kcmd_per_s=%.1f\n",
+		       commands_, reads_, secs, secs > 0.0 ? (double)commands_ / secs / 1000.0 : 0.0);
+	}
+
+	bool changes_pins(VSoc *dut, char ch) const
+	{
+		if (ch >= '0' && ch <= '7')
+		{
+			unsigned value = (unsigned)(ch - '0');
+			return dut->io_jtag_tck != ((value >> 2) & 1) || dut->io_jtag_tms != ((value >> 1) & 1) ||
+			       dut->io_jtag_tdi != (value & 1);
+		}
+		if (ch == 't' || ch == 'u')
+			return dut->io_jtag_tck != 0 || dut->io_jtag_tms != 1 || dut->io_jtag_tdi != 0;
+		return false;
+	}
+
+	void flush_tdo()
+	{
+		while (!tdo_.empty())
+		{
+			ssize_t n = send(client_fd_, tdo_.data(), tdo_.size(), MSG_NOSIGNAL);
+			if (n > 0)
+			{
+				tdo_.erase(0, (size_t)n);
+				if (tdo_.empty())
+					io_.expect_input();
+				continue;
+			}
+			// Full socket buffer: the rest goes out with the next batch.
+			if (n < 0 && !would_block_errno(errno) && errno != EINTR)
+			{
+				perror("jtag send");
+				tdo_.clear();
+			}
+			return;
+		}
+	}
+
 	void handle(VSoc *dut, char ch)
 	{
+		commands_++;
 		if (ch >= '0' && ch <= '7')
 		{
 			unsigned value = (unsigned)(ch - '0');
@@ -425,7 +1254,8 @@ class RemoteBitbang
 		{
 			dut->eval();
 			char tdo = dut->io_jtag_tdo ? '1' : '0';
-			(void)send(client_fd_, &tdo, 1, MSG_NOSIGNAL);
+			tdo_.push_back(tdo);
+			reads_++;
 			if (trace_)
 				printf("[jtag-rbb] read tdo=%c\n", tdo);
 		}
@@ -444,14 +1274,22 @@ class RemoteBitbang
 		}
 		else if (ch == 'Q')
 		{
-			close(client_fd_);
-			client_fd_ = -1;
+			drop_client();
 		}
 	}
 
 	int port_ = 0;
+	HostIo &io_;
 	int listen_fd_ = -1;
 	int client_fd_ = -1;
+	bool peer_closed_ = false;
+	bool unsampled_ = false;
+	ByteRing rx_{65536};
+	std::string tdo_;
+	uint64_t commands_ = 0;
+	uint64_t reads_ = 0;
+	std::chrono::steady_clock::time_point connected_at_;
+	static const unsigned kBatch = 4096;
 	bool cycle_per_command_ = false;
 	bool trace_ = false;
 	bool trace_dmi_ = false;
@@ -498,6 +1336,343 @@ class RemoteBitbang
 	}
 };
 
+// ION_DMI_PORT: line-oriented TCP server that drives the SoC's simulation
+// DMI port (io_dmi_req_*) directly, one DMI access per SoC cycle, instead of
+// ~40 remote-bitbang commands per access. Requests and replies are one line
+// each; numbers are C literals (0x.. or decimal):
+//   r ADDR            -> DATA OP
+//   w ADDR DATA       -> OP
+//   mr PADDR COUNT    -> COUNT 32-bit words read over system bus access
+//   mw PADDR WORD...  -> ok
+//   reg REGNO         -> 64-bit abstract register read (hart must be halted)
+//   q                 -> close
+// Failures reply "err <reason>". Commands run to completion inside drive(),
+// stepping the clock themselves like RemoteBitbang in JTAG-only mode.
+class DmiServer
+{
+  public:
+	DmiServer(int port, HostIo &io) : port_(port), io_(io) {}
+
+	~DmiServer()
+	{
+		drop_client();
+		if (listen_fd_ >= 0)
+		{
+			io_.unwatch(listen_fd_);
+			close(listen_fd_);
+		}
+	}
+
+	bool init()
+	{
+		if (port_ <= 0)
+			return true;
+		listen_fd_ = listen_loopback(port_, "dmi");
+		if (listen_fd_ < 0)
+			return false;
+		if (!io_.watch(listen_fd_, [this] { accept_client(); }))
+			return false;
+		printf("[dmi]: DMI server listening on 127.0.0.1:%d\n", port_);
+		return true;
+	}
+
+	bool connected() const { return client_fd_ >= 0; }
+
+	// Runs every complete request line that is queued. Only called with the
+	// clock low, so each DMI access is one posedge/negedge pair.
+	void drive(VSoc *dut)
+	{
+		if (client_fd_ < 0 || dut->clock)
+			return;
+		uint8_t ch = 0;
+		while (client_fd_ >= 0 && rx_.pop(&ch))
+		{
+			if (ch == '\r')
+				continue;
+			if (ch != '\n')
+			{
+				line_.push_back((char)ch);
+				continue;
+			}
+			std::string reply;
+			bool quit = execute(dut, line_, &reply);
+			line_.clear();
+			if (quit)
+			{
+				drop_client();
+				return;
+			}
+			reply.push_back('\n');
+			(void)send(client_fd_, reply.data(), reply.size(), MSG_NOSIGNAL);
+			io_.expect_input();
+		}
+		if (client_fd_ >= 0 && rx_.empty() && peer_closed_)
+			drop_client();
+	}
+
+  private:
+	static const unsigned kBusyRetries = 1000;
+	static const unsigned kSbaWordsMax = 65536;
+
+	void accept_client()
+	{
+		if (client_fd_ >= 0)
+			return;
+		client_fd_ = accept(listen_fd_, nullptr, nullptr);
+		if (client_fd_ < 0)
+		{
+			if (!would_block_errno(errno))
+				perror("dmi accept");
+			return;
+		}
+		set_nonblock(client_fd_);
+		int one = 1;
+		setsockopt(client_fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		rx_.clear();
+		line_.clear();
+		peer_closed_ = false;
+		accesses_ = 0;
+		if (!io_.watch(client_fd_, [this] { fill_rx(); }))
+		{
+			close(client_fd_);
+			client_fd_ = -1;
+			return;
+		}
+		printf("[dmi]: client connected\n");
+	}
+
+	void fill_rx()
+	{
+		size_t len = 0;
+		uint8_t *dst = rx_.write_ptr(&len);
+		if (len == 0)
+			return;
+		ssize_t n = recv(client_fd_, dst, len, 0);
+		if (n > 0)
+		{
+			rx_.commit((size_t)n);
+			return;
+		}
+		if (n < 0 && would_block_errno(errno))
+			return;
+		if (n < 0)
+			perror("dmi recv");
+		io_.unwatch(client_fd_);
+		peer_closed_ = true;
+	}
+
+	void drop_client()
+	{
+		if (client_fd_ < 0)
+			return;
+		if (!peer_closed_)
+			io_.unwatch(client_fd_);
+		close(client_fd_);
+		client_fd_ = -1;
+		peer_closed_ = false;
+		rx_.clear();
+		printf("[dmi]: client closed after %" PRIu64 " DMI accesses\n", accesses_);
+	}
+
+	static void tick(VSoc *dut)
+	{
+		dut->clock = 1;
+		dut->eval();
+		dut->io_dmi_req_valid = 0;
+		dut->clock = 0;
+		dut->eval();
+		sim_time += 2;
+	}
+
+	// One DMI access, repeated while the DM answers busy. Returns the final
+	// response op (0 success, 2 failed, 3 still busy).
+	unsigned access(VSoc *dut, bool write, uint32_t addr, uint32_t wdata, uint32_t *rdata)
+	{
+		unsigned op = 3;
+		for (unsigned attempt = 0; attempt < kBusyRetries && op == 3; ++attempt)
+		{
+			dut->io_dmi_req_valid = 1;
+			dut->io_dmi_req_write = write;
+			dut->io_dmi_req_addr = addr;
+			dut->io_dmi_req_wdata = wdata;
+			dut->eval();
+			if (rdata != nullptr)
+				*rdata = (uint32_t)dut->io_dmi_resp_rdata;
+			tick(dut);
+			op = (unsigned)dut->io_dmi_resp_op;
+			accesses_++;
+		}
+		return op;
+	}
+
+	bool write_reg(VSoc *dut, uint32_t addr, uint32_t data) { return access(dut, true, addr, data, nullptr) == 0; }
+
+	bool read_reg(VSoc *dut, uint32_t addr, uint32_t *data) { return access(dut, false, addr, 0, data) == 0; }
+
+	// Waits for sbcs.sbbusy to clear; false on timeout or a sticky SBA error.
+	bool sba_idle(VSoc *dut, uint32_t *sbcs)
+	{
+		for (unsigned i = 0; i < kBusyRetries; ++i)
+		{
+			if (!read_reg(dut, 0x38, sbcs))
+				return false;
+			if ((*sbcs & (1u << 21)) == 0)
+				return (*sbcs & 0x00407000) == 0;
+		}
+		return false;
+	}
+
+	bool sba_read(VSoc *dut, uint64_t paddr, uint64_t count, std::string *reply)
+	{
+		uint32_t sbcs = 0;
+		// Clear sticky errors; 32-bit, autoincrement, read on address and data.
+		if (!write_reg(dut, 0x38, 0x00407000 | 0x00158000) || !write_reg(dut, 0x3a, (uint32_t)(paddr >> 32)) ||
+		    !write_reg(dut, 0x39, (uint32_t)paddr))
+			return false;
+		char word[16];
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			uint32_t data = 0;
+			if (!sba_idle(dut, &sbcs) || !read_reg(dut, 0x3c, &data))
+				return false;
+			snprintf(word, sizeof(word), "%s0x%08x", i == 0 ? "" : " ", data);
+			reply->append(word);
+		}
+		return sba_idle(dut, &sbcs);
+	}
+
+	bool sba_write(VSoc *dut, uint64_t paddr, const std::vector<uint32_t> &words)
+	{
+		uint32_t sbcs = 0;
+		if (!write_reg(dut, 0x38, 0x00407000 | 0x00050000) || !write_reg(dut, 0x3a, (uint32_t)(paddr >> 32)) ||
+		    !write_reg(dut, 0x39, (uint32_t)paddr))
+			return false;
+		for (uint32_t w : words)
+		{
+			if (!write_reg(dut, 0x3c, w) || !sba_idle(dut, &sbcs))
+				return false;
+		}
+		return true;
+	}
+
+	// Access-register abstract command, 64-bit transfer out of data0/data1.
+	bool read_abstract(VSoc *dut, uint32_t regno, uint64_t *value, std::string *reason)
+	{
+		uint32_t abstractcs = 0;
+		if (!write_reg(dut, 0x17, (3u << 20) | (1u << 17) | (regno & 0xffff)))
+		{
+			*reason = "busy";
+			return false;
+		}
+		for (unsigned i = 0; i < kBusyRetries; ++i)
+		{
+			if (!read_reg(dut, 0x16, &abstractcs))
+				break;
+			if ((abstractcs & (1u << 12)) == 0)
+				break;
+		}
+		unsigned cmderr = (abstractcs >> 8) & 7;
+		if ((abstractcs & (1u << 12)) != 0 || cmderr != 0)
+		{
+			char buf[32];
+			snprintf(buf, sizeof(buf), "cmderr=%u", cmderr);
+			*reason = buf;
+			write_reg(dut, 0x16, 0x700);
+			return false;
+		}
+		uint32_t lo = 0, hi = 0;
+		if (!read_reg(dut, 0x04, &lo) || !read_reg(dut, 0x05, &hi))
+		{
+			*reason = "busy";
+			return false;
+		}
+		*value = ((uint64_t)hi << 32) | lo;
+		return true;
+	}
+
+	// Returns true when the client asked to close the connection.
+	bool execute(VSoc *dut, const std::string &line, std::string *reply)
+	{
+		std::vector<uint64_t> args;
+		char cmd[8] = {0};
+		const char *p = line.c_str();
+		int used = 0;
+		if (sscanf(p, "%7s%n", cmd, &used) != 1)
+		{
+			*reply = "err empty";
+			return false;
+		}
+		p += used;
+		while (*p != '\0')
+		{
+			char *end = nullptr;
+			uint64_t v = std::strtoull(p, &end, 0);
+			if (end == p)
+			{
+				while (*p == ' ' || *p == '\t')
+					++p;
+				if (*p == '\0')
+					break;
+				*reply = "err bad number";
+				return false;
+			}
+			args.push_back(v);
+			p = end;
+		}
+
+		char buf[48];
+		const std::string c = cmd;
+		if (c == "q")
+			return true;
+		if (c == "r" && args.size() == 1)
+		{
+			uint32_t data = 0;
+			unsigned op = access(dut, false, (uint32_t)args[0] & 0x7f, 0, &data);
+			snprintf(buf, sizeof(buf), "0x%08x %u", data, op);
+			*reply = buf;
+		}
+		else if (c == "w" && args.size() == 2)
+		{
+			snprintf(buf, sizeof(buf), "%u", access(dut, true, (uint32_t)args[0] & 0x7f, (uint32_t)args[1], nullptr));
+			*reply = buf;
+		}
+		else if (c == "mr" && args.size() == 2 && args[1] > 0 && args[1] <= kSbaWordsMax)
+		{
+			if (!sba_read(dut, args[0], args[1], reply))
+				*reply = "err sba";
+		}
+		else if (c == "mw" && args.size() >= 2 && args.size() - 1 <= kSbaWordsMax)
+		{
+			std::vector<uint32_t> words(args.begin() + 1, args.end());
+			*reply = sba_write(dut, args[0], words) ? "ok" : "err sba";
+		}
+		else if (c == "reg" && args.size() == 1)
+		{
+			uint64_t value = 0;
+			std::string reason;
+			if (read_abstract(dut, (uint32_t)args[0], &value, &reason))
+			{
+				snprintf(buf, sizeof(buf), "0x%016" PRIx64, value);
+				*reply = buf;
+			}
+			else
+				*reply = "err " + reason;
+		}
+		else
+			*reply = "err bad request";
+		return false;
+	}
+
+	int port_ = 0;
+	HostIo &io_;
+	int listen_fd_ = -1;
+	int client_fd_ = -1;
+	bool peer_closed_ = false;
+	ByteRing rx_{1 << 20};
+	std::string line_;
+	uint64_t accesses_ = 0;
+};
+
 class FlashImage
 {
   public:
@@ -539,48 +1714,3261 @@ class FlashImage
 	std::vector<uint8_t> data_;
 };
 
-int main(int argc, char **argv, char **env)
+// Boot-flow milestones the pass/fail checks depend on. Kept together so a
+// checkpoint restores them along with the model.
+struct BootProgress
 {
-	(void)env;
-	Verilated::commandArgs(argc, argv);
-	printf("\n\n");
-	bool all_pass = true;
-	if (env_enabled("ION_JTAG_ONLY"))
+	bool saw_rom_pc = false;
+	bool saw_sram_pc = false;
+	bool saw_payload_pc = false;
+};
+
+// End-of-run performance counters sampled from the io_debug_* perf port on
+// every rising edge. Plain data so checkpoints can store it verbatim.
+struct PerfCounters
+{
+	uint64_t cycles = 0;
+	uint64_t retired = 0;
+	uint64_t stall_cycles = 0;
+	uint64_t ifetch_stall_cycles = 0;
+	uint64_t ifetch_only_stall_cycles = 0;
+	uint64_t ifetch_lsu_overlap_cycles = 0;
+	uint64_t frontend_starved_cycles = 0;
+	uint64_t frontend_queue_full_cycles = 0;
+	uint64_t frontend_queue_empty_cycles = 0;
+	uint64_t lsu_stall_cycles = 0;
+	uint64_t lsu_load_stall_cycles = 0;
+	uint64_t lsu_store_stall_cycles = 0;
+	uint64_t lsu_mmio_stall_cycles = 0;
+	uint64_t lsu_atomic_stall_cycles = 0;
+	uint64_t lsu_fence_stall_cycles = 0;
+	uint64_t decode_load_use_cycles = 0;
+	uint64_t lsu_load_only_cycles = 0;
+	uint64_t lsu_store_only_cycles = 0;
+	uint64_t lsu_fence_only_cycles = 0;
+	uint64_t branch_count = 0;
+	uint64_t branch_taken = 0;
+	uint64_t branch_redirect = 0;
+	uint64_t branch_pred_taken = 0;
+	uint64_t branch_pred_correct = 0;
+	// Cycles jumped over by ION_IDLE_SKIP; never part of `cycles`.
+	uint64_t idle_skips = 0;
+	uint64_t skipped_cycles = 0;
+
+	void note_skip(uint64_t delta)
 	{
-		SimOptions opts;
-		opts.test_name = "jtag";
-		opts.trace_wave = env_enabled("ION_TRACE_WAVE");
-		opts.direct_elf_load = !env_enabled("ION_BOOTROM_ONLY");
-		opts.uart_stdin = env_enabled("ION_UART_STDIN");
-		opts.trace_irq = env_enabled("ION_TRACE_IRQ");
-		opts.trace_dmi = env_enabled("ION_TRACE_DMI");
-		opts.perf_report = env_enabled("ION_PERF");
-		opts.jtag_only = true;
-		opts.jtag_rbb_port = (int)env_u64("ION_JTAG_RBB_PORT", 0);
-		opts.max_cycles = env_u64("ION_MAX_CYCLES", 0);
-		const char *flash = std::getenv("ION_FLASH_IMAGE");
-		if (flash != nullptr)
-			opts.flash_image = flash;
-		return run_sim(opts) ? 0 : 1;
+		idle_skips++;
+		skipped_cycles += delta;
 	}
-	else if (argc < 2)
+
+	void sample(VSoc *dut)
 	{
-		// 默认测试 payload (假设无后缀)
-		all_pass &= run_one_test(kPayloadElfPath, "payload", env_enabled("ION_TRACE_WAVE"), "S!!P");
+		cycles++;
+		retired += dut->io_debug_retire ? 1 : 0;
+		stall_cycles += dut->io_debug_stall ? 1 : 0;
+		ifetch_stall_cycles += dut->io_debug_ifetchStall ? 1 : 0;
+		lsu_stall_cycles += dut->io_debug_lsuStall ? 1 : 0;
+		ifetch_only_stall_cycles += (dut->io_debug_ifetchStall && !dut->io_debug_lsuStall) ? 1 : 0;
+		ifetch_lsu_overlap_cycles += (dut->io_debug_ifetchStall && dut->io_debug_lsuStall) ? 1 : 0;
+		frontend_starved_cycles += dut->io_debug_frontendStarved ? 1 : 0;
+		frontend_queue_full_cycles += dut->io_debug_frontendQueueFull ? 1 : 0;
+		frontend_queue_empty_cycles += dut->io_debug_frontendQueueEmpty ? 1 : 0;
+		lsu_load_stall_cycles += dut->io_debug_lsuLoadStall ? 1 : 0;
+		lsu_store_stall_cycles += dut->io_debug_lsuStoreStall ? 1 : 0;
+		lsu_mmio_stall_cycles += dut->io_debug_lsuMmioStall ? 1 : 0;
+		lsu_atomic_stall_cycles += dut->io_debug_lsuAtomicStall ? 1 : 0;
+		lsu_fence_stall_cycles += dut->io_debug_lsuFenceStall ? 1 : 0;
+		decode_load_use_cycles += dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_decodeUsesPending ? 1 : 0;
+		lsu_load_only_cycles += (dut->io_debug_lsuLoadStall && !dut->io_debug_lsuStoreStall && !dut->io_debug_lsuFenceStall) ? 1 : 0;
+		lsu_store_only_cycles += (dut->io_debug_lsuStoreStall && !dut->io_debug_lsuLoadStall && !dut->io_debug_lsuFenceStall) ? 1 : 0;
+		lsu_fence_only_cycles += (dut->io_debug_lsuFenceStall && !dut->io_debug_lsuLoadStall && !dut->io_debug_lsuStoreStall) ? 1 : 0;
+		branch_count += dut->io_debug_branchValid ? 1 : 0;
+		branch_taken += dut->io_debug_branchTaken ? 1 : 0;
+		branch_redirect += dut->io_debug_branchRedirect ? 1 : 0;
+		branch_pred_taken += dut->io_debug_branchPredTaken ? 1 : 0;
+		branch_pred_correct += dut->io_debug_branchPredCorrect ? 1 : 0;
 	}
-	else if (std::string(argv[1]) == "--payload")
+
+	// Every counter with its field name, in declaration order.
+	template <typename Fn> void for_each(Fn &&fn) const
 	{
-		std::string name = (argc > 2) ? argv[2] : "payload";
-		std::string expected_uart = (argc > 3) ? argv[3] : "";
-		std::string elf_path = (argc > 4) ? argv[4] : kPayloadElfPath;
-		all_pass &= run_one_test(elf_path, name, env_enabled("ION_TRACE_WAVE"), expected_uart);
+		fn("cycles", cycles);
+		fn("retired", retired);
+		fn("stall_cycles", stall_cycles);
+		fn("ifetch_stall_cycles", ifetch_stall_cycles);
+		fn("ifetch_only_stall_cycles", ifetch_only_stall_cycles);
+		fn("ifetch_lsu_overlap_cycles", ifetch_lsu_overlap_cycles);
+		fn("frontend_starved_cycles", frontend_starved_cycles);
+		fn("frontend_queue_full_cycles", frontend_queue_full_cycles);
+		fn("frontend_queue_empty_cycles", frontend_queue_empty_cycles);
+		fn("lsu_stall_cycles", lsu_stall_cycles);
+		fn("lsu_load_stall_cycles", lsu_load_stall_cycles);
+		fn("lsu_store_stall_cycles", lsu_store_stall_cycles);
+		fn("lsu_mmio_stall_cycles", lsu_mmio_stall_cycles);
+		fn("lsu_atomic_stall_cycles", lsu_atomic_stall_cycles);
+		fn("lsu_fence_stall_cycles", lsu_fence_stall_cycles);
+		fn("decode_load_use_cycles", decode_load_use_cycles);
+		fn("lsu_load_only_cycles", lsu_load_only_cycles);
+		fn("lsu_store_only_cycles", lsu_store_only_cycles);
+		fn("lsu_fence_only_cycles", lsu_fence_only_cycles);
+		fn("branch_count", branch_count);
+		fn("branch_taken", branch_taken);
+		fn("branch_redirect", branch_redirect);
+		fn("branch_pred_taken", branch_pred_taken);
+		fn("branch_pred_correct", branch_pred_correct);
+		fn("idle_skips", idle_skips);
+		fn("skipped_cycles", skipped_cycles);
 	}
-	else if (std::string(argv[1]) == "--payload-firmware")
+
+	// `region` labels the lines of a ROI report: [perf:<region>].
+	void report(const std::string &region = "") const
 	{
-		std::string name = (argc > 2) ? argv[2] : "payload";
-		std::string expected_uart = (argc > 3) ? argv[3] : "";
-		std::string elf_path = (argc > 4) ? argv[4] : kPayloadElfPath;
-		SimOptions opts;
+		const std::string sfx = region.empty() ? "" : ":" + region;
+		double ipc = cycles == 0 ? 0.0 : (double)retired / (double)cycles;
+		double stall_pct = cycles == 0 ? 0.0 : (100.0 * (double)stall_cycles / (double)cycles);
+		double ifetch_pct = cycles == 0 ? 0.0 : (100.0 * (double)ifetch_stall_cycles / (double)cycles);
+		double lsu_pct = cycles == 0 ? 0.0 : (100.0 * (double)lsu_stall_cycles / (double)cycles);
+		double branch_rate = retired == 0 ? 0.0 : (100.0 * (double)branch_count / (double)retired);
+		double branch_taken_pct = branch_count == 0 ? 0.0 : (100.0 * (double)branch_taken / (double)branch_count);
+		double branch_redirect_pct = branch_count == 0 ? 0.0 : (100.0 * (double)branch_redirect / (double)branch_count);
+		double branch_pred_taken_pct = branch_count == 0 ? 0.0 : (100.0 * (double)branch_pred_taken / (double)branch_count);
+		double branch_pred_correct_pct = branch_count == 0 ? 0.0 : (100.0 * (double)branch_pred_correct / (double)branch_count);
+		printf("[perf%s]: cycles=%" PRIu64 " retired=%" PRIu64 " ipc=%.4f stall_cycles=%" PRIu64 " stall_pct=%.2f ifetch_stall=%" PRIu64 " ifetch_pct=%.2f lsu_stall=%" PRIu64 " lsu_pct=%.2f\n",
+		       sfx.c_str(),
+		       cycles,
+		       retired,
+		       ipc,
+		       stall_cycles,
+		       stall_pct,
+		       ifetch_stall_cycles,
+		       ifetch_pct,
+		       lsu_stall_cycles,
+		       lsu_pct);
+		printf("[perf-branch%s]: branches=%" PRIu64 " branch_rate=%.2f taken=%" PRIu64 " taken_pct=%.2f redirects=%" PRIu64 " redirect_pct=%.2f pred_taken=%" PRIu64 " pred_taken_pct=%.2f pred_correct=%" PRIu64 " pred_correct_pct=%.2f\n",
+		       sfx.c_str(),
+		       branch_count,
+		       branch_rate,
+		       branch_taken,
+		       branch_taken_pct,
+		       branch_redirect,
+		       branch_redirect_pct,
+		       branch_pred_taken,
+		       branch_pred_taken_pct,
+		       branch_pred_correct,
+		       branch_pred_correct_pct);
+		printf("[perf-lsu%s]: load=%" PRIu64 " store=%" PRIu64 " mmio=%" PRIu64 " atomic=%" PRIu64 " fence=%" PRIu64 "\n",
+		       sfx.c_str(),
+		       lsu_load_stall_cycles,
+		       lsu_store_stall_cycles,
+		       lsu_mmio_stall_cycles,
+		       lsu_atomic_stall_cycles,
+		       lsu_fence_stall_cycles);
+		printf("[perf-stall-detail%s]: decode_load_use=%" PRIu64 " lsu_load_only=%" PRIu64 " lsu_store_only=%" PRIu64 " lsu_fence_only=%" PRIu64 "\n",
+		       sfx.c_str(),
+		       decode_load_use_cycles,
+		       lsu_load_only_cycles,
+		       lsu_store_only_cycles,
+		       lsu_fence_only_cycles);
+		printf("[perf-overlap%s]: ifetch_only=%" PRIu64 " ifetch_lsu_overlap=%" PRIu64 "\n",
+		       sfx.c_str(),
+		       ifetch_only_stall_cycles,
+		       ifetch_lsu_overlap_cycles);
+		printf("[perf-frontend%s]: starved=%" PRIu64 " queue_full=%" PRIu64 " queue_empty=%" PRIu64 "\n",
+		       sfx.c_str(),
+		       frontend_starved_cycles,
+		       frontend_queue_full_cycles,
+		       frontend_queue_empty_cycles);
+		if (idle_skips != 0)
+		{
+			uint64_t total = cycles + skipped_cycles;
+			printf("[perf-idle%s]: skips=%" PRIu64 " skipped_cycles=%" PRIu64 " skipped_pct=%.2f\n",
+			       sfx.c_str(),
+			       idle_skips,
+			       skipped_cycles,
+			       total == 0 ? 0.0 : (100.0 * (double)skipped_cycles / (double)total));
+		}
+	}
+};
+
+// ION_PERF_INTERVAL: every that many cycles, one row with the PerfCounters
+// deltas, the architectural counters and the simulation speed, so boot
+// phases that the end-of-run summary averages together can be told apart.
+// Boot milestones and UART pattern hits go into the same file as event rows.
+// A `.json`/`.jsonl` path gets one JSON object per line instead of CSV.
+class PerfTimeline
+{
+  public:
+	~PerfTimeline()
+	{
+		if (file_ != nullptr)
+			fclose(file_);
+	}
+
+	bool open(const SimOptions &opts, const PerfCounters &perf)
+	{
+		if (opts.perf_interval == 0)
+			return true;
+		path_ = !opts.perf_timeline.empty() ? opts.perf_timeline : "simulator/build/perf-" + opts.test_name + ".csv";
+		file_ = fopen(path_.c_str(), "w");
+		if (file_ == nullptr)
+		{
+			perror(path_.c_str());
+			return false;
+		}
+		std::string ext = std::filesystem::path(path_).extension().string();
+		json_ = ext == ".json" || ext == ".jsonl";
+		interval_ = opts.perf_interval;
+		next_ = perf.cycles + interval_;
+		prev_ = perf;
+		start_ = last_wall_ = std::chrono::steady_clock::now();
+		if (!json_)
+		{
+			fprintf(file_, "kind,sim_time,wall_ms,khz,ipc");
+			perf.for_each([&](const char *name, uint64_t) { fprintf(file_, ",%s", name); });
+			fprintf(file_, ",mcycle,minstret");
+			for (unsigned i = 0; i < kHpmCounters; ++i)
+				fprintf(file_, ",mhpmcounter%u", i + 3);
+			fprintf(file_, ",event\n");
+		}
+		return true;
+	}
+
+	bool enabled() const { return file_ != nullptr; }
+	bool due(const PerfCounters &perf) const { return perf.cycles >= next_; }
+
+	void sample(VSoc *dut, const PerfCounters &perf, uint64_t cycle)
+	{
+		auto now = std::chrono::steady_clock::now();
+		double wall_ms = std::chrono::duration<double, std::milli>(now - start_).count();
+		double interval_ms = std::chrono::duration<double, std::milli>(now - last_wall_).count();
+		uint64_t cycles = perf.cycles - prev_.cycles;
+		uint64_t retired = perf.retired - prev_.retired;
+		double khz = interval_ms <= 0.0 ? 0.0 : (double)cycles / interval_ms;
+		double ipc = cycles == 0 ? 0.0 : (double)retired / (double)cycles;
+
+		std::vector<uint64_t> before;
+		prev_.for_each([&](const char *, uint64_t v) { before.push_back(v); });
+		size_t i = 0;
+		if (json_)
+		{
+			fprintf(file_, "{\"kind\":\"sample\",\"sim_time\":%" PRIu64 ",\"wall_ms\":%.3f,\"khz\":%.3f,\"ipc\":%.4f",
+			        cycle, wall_ms, khz, ipc);
+			perf.for_each([&](const char *name, uint64_t v) { fprintf(file_, ",\"%s\":%" PRIu64, name, v - before[i++]); });
+		}
+		else
+		{
+			fprintf(file_, "sample,%" PRIu64 ",%.3f,%.3f,%.4f", cycle, wall_ms, khz, ipc);
+			perf.for_each([&](const char *, uint64_t v) { fprintf(file_, ",%" PRIu64, v - before[i++]); });
+		}
+		auto *r = dut->rootp;
+		uint64_t arch[2 + kHpmCounters] = {
+			r->SimTop__DOT__core__DOT__csr__DOT__mcycle,
+			r->SimTop__DOT__core__DOT__csr__DOT__minstret,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_0,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_1,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_2,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_3,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_4,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_5,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_6,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_7,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_8,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_9,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_10,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_11,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_12,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_13,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_14,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_15,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_16,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_17,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_18,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_19,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_20,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_21,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_22,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_23,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_24,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_25,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_26,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_27,
+			r->SimTop__DOT__core__DOT__csr__DOT__mhpmcounter_28,
+		};
+		for (unsigned k = 0; k < 2 + kHpmCounters; ++k)
+		{
+			if (!json_)
+				fprintf(file_, ",%" PRIu64, arch[k]);
+			else if (k < 2)
+				fprintf(file_, ",\"%s\":%" PRIu64, k == 0 ? "mcycle" : "minstret", arch[k]);
+			else
+				fprintf(file_, ",\"mhpmcounter%u\":%" PRIu64, k + 1, arch[k]);
+		}
+		fprintf(file_, json_ ? "}\n" : ",\n");
+		samples_++;
+		prev_ = perf;
+		last_wall_ = now;
+		next_ = perf.cycles + interval_;
+	}
+
+	void mark(uint64_t cycle, const std::string &event)
+	{
+		if (file_ == nullptr)
+			return;
+		double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+		if (json_)
+		{
+			fprintf(file_, "{\"kind\":\"event\",\"sim_time\":%" PRIu64 ",\"wall_ms\":%.3f,\"event\":\"%s\"}\n", cycle,
+			        wall_ms, json_escape(event).c_str());
+			return;
+		}
+		std::string quoted;
+		for (char c : event)
+			quoted += c == '"' ? "\"\"" : std::string(1, c);
+		fprintf(file_, "event,%" PRIu64 ",%.3f", cycle, wall_ms);
+		for (size_t i = 0; i < columns(); ++i)
+			fputc(',', file_);
+		fprintf(file_, ",\"%s\"\n", quoted.c_str());
+	}
+
+	// Marks the UART patterns hit since the last call.
+	void uart(const UartMatcher &matcher, uint64_t cycle)
+	{
+		const std::vector<UartMatcher::Pattern> &patterns = matcher.patterns();
+		if (uart_seen_.size() != patterns.size())
+			uart_seen_.assign(patterns.size(), false);
+		for (size_t i = 0; i < patterns.size(); ++i)
+		{
+			if (uart_seen_[i] || patterns[i].hit_at == UINT64_MAX)
+				continue;
+			uart_seen_[i] = true;
+			mark(cycle, std::string(patterns[i].failure ? "uart-fail " : "uart ") + patterns[i].text);
+		}
+	}
+
+	// The last, partial interval.
+	void finish(VSoc *dut, const PerfCounters &perf, uint64_t cycle)
+	{
+		if (file_ == nullptr)
+			return;
+		if (perf.cycles != prev_.cycles)
+			sample(dut, perf, cycle);
+		fclose(file_);
+		file_ = nullptr;
+		printf("[perf-timeline]: %" PRIu64 " samples every %" PRIu64 " cycles written to %s\n", samples_, interval_,
+		       path_.c_str());
+	}
+
+  private:
+	static const unsigned kHpmCounters = 29;
+
+	// CSV columns between wall_ms and event.
+	size_t columns() const
+	{
+		size_t n = 0;
+		prev_.for_each([&](const char *, uint64_t) { n++; });
+		return 2 + n + 2 + kHpmCounters;
+	}
+
+	FILE *file_ = nullptr;
+	std::string path_;
+	bool json_ = false;
+	uint64_t interval_ = 0;
+	uint64_t next_ = UINT64_MAX;
+	uint64_t samples_ = 0;
+	PerfCounters prev_;
+	std::chrono::steady_clock::time_point start_;
+	std::chrono::steady_clock::time_point last_wall_;
+	std::vector<bool> uart_seen_;
+};
+
+// Region-of-interest markers: a payload brackets the code it wants measured
+// with `slti x0, x0, op << 8 | id` hints (simulator/payloads/ion_roi.h),
+// which are NOPs to the core, the ISS and the difftest reference. When one
+// retires, region `id` starts, stops, resets or snapshots its own
+// PerfCounters; regions may nest or overlap. ION_ROI_NAMES (`id=name;...`)
+// names them in the report, which comes after the whole-run [perf] lines.
+class RoiRegions
+{
+  public:
+	bool open(const SimOptions &opts)
+	{
+		if (!opts.perf_report)
+			return true;
+		regions_.resize(kRegions);
+		for (unsigned id = 0; id < kRegions; ++id)
+			regions_[id].name = "roi" + std::to_string(id);
+		const std::string &spec = opts.roi_names;
+		for (size_t start = 0; start < spec.size();)
+		{
+			size_t end = spec.find(';', start);
+			if (end == std::string::npos)
+				end = spec.size();
+			std::string item = spec.substr(start, end - start);
+			size_t eq = item.find('=');
+			char *tail = nullptr;
+			uint64_t id = eq == std::string::npos ? kRegions : strtoull(item.c_str(), &tail, 0);
+			if (eq == std::string::npos || tail != item.c_str() + eq || id >= kRegions || eq + 1 == item.size())
+			{
+				fprintf(stderr, "[roi]: bad ION_ROI_NAMES entry '%s' (want id=name, id < %u)\n", item.c_str(), kRegions);
+				return false;
+			}
+			regions_[id].name = item.substr(eq + 1);
+			start = end + 1;
+		}
+		enabled_ = true;
+		return true;
+	}
+
+	bool enabled() const { return enabled_; }
+
+	// Rising edge. The marker's own cycle counts toward a region it stops but
+	// not toward one it starts.
+	void sample(VSoc *dut, PerfTimeline &timeline, uint64_t cycle)
+	{
+		for (uint8_t id : active_)
+			regions_[id].counters.sample(dut);
+		if (!dut->io_debug_retire)
+			return;
+		uint32_t instr = (uint32_t)dut->io_debug_commitInstr;
+		if ((instr & 0xfffff) != kMarker)
+			return;
+		unsigned op = instr >> 28;
+		uint8_t id = (uint8_t)(instr >> 20);
+		Region &r = regions_[id];
+		switch (op)
+		{
+		case kStart:
+			if (r.active)
+				return;
+			r.active = true;
+			r.used = true;
+			r.entries++;
+			active_.push_back(id);
+			timeline.mark(cycle, "roi-start:" + r.name);
+			break;
+		case kStop:
+			if (!r.active)
+				return;
+			r.active = false;
+			active_.erase(std::find(active_.begin(), active_.end(), id));
+			timeline.mark(cycle, "roi-stop:" + r.name);
+			break;
+		case kReset:
+			r.counters = PerfCounters();
+			r.entries = r.active ? 1 : 0;
+			timeline.mark(cycle, "roi-reset:" + r.name);
+			break;
+		case kSnapshot:
+			r.used = true;
+			r.counters.report(r.name + "@" + std::to_string(cycle));
+			timeline.mark(cycle, "roi-snapshot:" + r.name);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void note_skip(uint64_t delta)
+	{
+		for (uint8_t id : active_)
+			regions_[id].counters.note_skip(delta);
+	}
+
+	void report() const
+	{
+		for (const Region &r : regions_)
+		{
+			if (!r.used)
+				continue;
+			printf("[roi]: %s entered %" PRIu64 " time(s)%s\n", r.name.c_str(), r.entries,
+			       r.active ? ", still open at the end of the run" : "");
+			r.counters.report(r.name);
+		}
+	}
+
+  private:
+	// slti x0, x0, imm: opcode OP-IMM, funct3 2, rd and rs1 zero.
+	static const uint32_t kMarker = 0x02013;
+	static const unsigned kRegions = 256;
+
+	enum Op : unsigned
+	{
+		kStart = 1,
+		kStop = 2,
+		kReset = 3,
+		kSnapshot = 4,
+	};
+
+	struct Region
+	{
+		std::string name;
+		PerfCounters counters;
+		uint64_t entries = 0;
+		bool active = false;
+		bool used = false;
+	};
+
+	bool enabled_ = false;
+	std::vector<Region> regions_;
+	std::vector<uint8_t> active_;
+};
+
+// ION_IDLE_SKIP: watches the commit port for a core that is only waiting for
+// time to pass, then advances the CLINT and the CSR clocks straight to
+// mtimecmp. Idle means a retired WFI (a NOP in this core), or a loop of at
+// most kMaxLoop retirements that repeats its PCs and results exactly except
+// for loads and time/cycle reads, and retires no store, AMO or CSR write.
+// With no input pending nothing but the clock can change what such a loop
+// sees, so the jump only shortens the wait for the timer interrupt.
+class IdleSkipper
+{
+  public:
+	static const unsigned kMaxLoop = 16;
+	static const uint64_t kMinSkip = 64;
+
+	// Called on a rising edge that retired an instruction.
+	void observe(VSoc *dut)
+	{
+		uint32_t instr = (uint32_t)dut->io_debug_commitInstr;
+		Retire &e = ring_[head_ % kRing];
+		e.pc = dut->io_debug_commitPc;
+		e.wdata = dut->io_debug_commitWen ? (uint64_t)dut->io_debug_commitWdata : 0;
+		e.kind = classify(instr);
+		head_++;
+		wfi_ = e.kind == kWfi;
+	}
+
+	// True when the last retirements form an idle window.
+	bool idle() const
+	{
+		if (wfi_)
+			return true;
+		if (head_ < 2)
+			return false;
+		const Retire &last = at(0);
+		for (unsigned period = 1; period <= kMaxLoop && 2 * period <= head_; ++period)
+		{
+			if (at(period).pc != last.pc)
+				continue;
+			for (unsigned i = 0; i < period; ++i)
+			{
+				const Retire &a = at(i);
+				const Retire &b = at(i + period);
+				if (a.kind == kSideEffect || b.kind == kSideEffect || a.pc != b.pc)
+					return false;
+				if (a.kind != kVolatile && a.wdata != b.wdata)
+					return false;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	// Jumps at most `budget` cycles towards the timer deadline, leaving one
+	// cycle for the model to raise MTIP itself. Returns the cycles skipped.
+	uint64_t skip(VSoc *dut, uint64_t budget)
+	{
+		auto *r = dut->rootp;
+		uint64_t mtime = r->SimTop__DOT__clint__DOT__mtime;
+		uint64_t mtimecmp = r->SimTop__DOT__clint__DOT__mtimecmp;
+		uint64_t mie = dut->io_debug_csr_snapshot_mie;
+		if (mtimecmp == 0 || mtimecmp <= mtime + kMinSkip || ((mie >> 7) & 1) == 0 ||
+		    (dut->io_debug_csr_snapshot_mip & mie) != 0 || r->SimTop__DOT__clint__DOT__msip != 0)
+			return 0;
+		uint64_t delta = std::min(mtimecmp - mtime - 1, budget);
+		if (delta < kMinSkip)
+			return 0;
+		r->SimTop__DOT__clint__DOT__mtime = mtime + delta;
+		r->SimTop__DOT__core__DOT__csr__DOT__timeCounter += delta;
+		if ((r->SimTop__DOT__core__DOT__csr__DOT__mcountinhibit & 1) == 0)
+			r->SimTop__DOT__core__DOT__csr__DOT__mcycle += delta;
+		head_ = 0;
+		wfi_ = false;
+		return delta;
+	}
+
+  private:
+	enum Kind : uint8_t
+	{
+		kPure,
+		kVolatile,
+		kWfi,
+		kSideEffect
+	};
+
+	struct Retire
+	{
+		uint64_t pc;
+		uint64_t wdata;
+		Kind kind;
+	};
+
+	static const unsigned kRing = 2 * kMaxLoop;
+
+	const Retire &at(unsigned back) const { return ring_[(head_ - 1 - back) % kRing]; }
+
+	static Kind classify(uint32_t instr)
+	{
+		if ((instr & 3) != 3)
+		{
+			unsigned quadrant = instr & 3;
+			unsigned funct3 = (instr >> 13) & 7;
+			if (quadrant == 2 && (instr & 0xffff) == 0x9002)
+				return kSideEffect; // c.ebreak
+			if (quadrant != 1 && funct3 >= 5)
+				return kSideEffect; // c.fsd/c.sw/c.sd and their sp forms
+			if (quadrant != 1 && funct3 >= 1 && funct3 <= 3)
+				return kVolatile;
+			return kPure;
+		}
+		switch (instr & 0x7f)
+		{
+		case 0x03: // load
+		case 0x07: // fp load
+			return kVolatile;
+		case 0x23: // store
+		case 0x27: // fp store
+		case 0x2f: // AMO, LR/SC
+			return kSideEffect;
+		case 0x73:
+		{
+			if (instr == 0x10500073)
+				return kWfi;
+			unsigned funct3 = (instr >> 12) & 7;
+			unsigned rs1 = (instr >> 15) & 0x1f;
+			unsigned csr = instr >> 20;
+			// csrr of cycle/time/mcycle: the only CSR reads the jump changes.
+			if ((funct3 == 2 || funct3 == 3) && rs1 == 0 && (csr == 0xc00 || csr == 0xc01 || csr == 0xb00))
+				return kVolatile;
+			if ((funct3 == 2 || funct3 == 3 || funct3 == 6 || funct3 == 7) && rs1 == 0)
+				return kPure;
+			return kSideEffect;
+		}
+		default:
+			return kPure;
+		}
+	}
+
+	Retire ring_[kRing] = {};
+	uint64_t head_ = 0;
+	bool wfi_ = false;
+};
+
+// Turns the commit and arch-event debug ports into CommitRecords on a rising
+// edge: at most one retirement, then at most one trap.
+class CommitPort
+{
+  public:
+	unsigned sample(VSoc *dut, uint64_t cycle, CommitRecord *out)
+	{
+		unsigned n = 0;
+		uint8_t priv = (uint8_t)dut->io_debug_csr_snapshot_privilegeMode;
+		if (dut->io_debug_retire)
+		{
+			CommitRecord &rec = out[n++];
+			rec = CommitRecord();
+			rec.cycle = cycle;
+			rec.pc = dut->io_debug_commitPc;
+			rec.instr = (uint32_t)dut->io_debug_commitInstr;
+			rec.priv = priv;
+			if (dut->io_debug_commitWen && dut->io_debug_commitWdest != 0)
+			{
+				rec.flags |= CommitRecord::kWen;
+				rec.rd = (uint8_t)dut->io_debug_commitWdest;
+				rec.wdata = dut->io_debug_commitWdata;
+			}
+			if (dut->io_debug_commitSkip)
+				rec.flags |= CommitRecord::kSkip;
+			// The LSU hands its access to the commit port with the instruction:
+			// the virtual address and the data at the access size, also for
+			// stores still in the store buffer and loads it forwarded.
+			uint8_t mem = mem_kind(rec.instr);
+			if (mem != 0 && dut->io_debug_commitMemValid)
+			{
+				rec.flags |= mem;
+				rec.mem_addr = dut->io_debug_commitMemVaddr;
+				rec.mem_data = dut->io_debug_commitMemData;
+			}
+		}
+		if (dut->io_debug_arch_event_valid)
+		{
+			CommitRecord &rec = out[n++];
+			rec = CommitRecord();
+			rec.cycle = cycle;
+			rec.pc = dut->io_debug_arch_event_pc;
+			rec.instr = (uint32_t)dut->io_debug_arch_event_instr;
+			rec.cause = dut->io_debug_arch_event_cause;
+			rec.priv = priv;
+			rec.flags = CommitRecord::kTrap | (dut->io_debug_arch_event_interrupt ? CommitRecord::kInterrupt : 0);
+		}
+		return n;
+	}
+
+  private:
+	// kLoad/kStore for memory-access opcodes (AMOs are both), else 0.
+	static uint8_t mem_kind(uint32_t instr)
+	{
+		if ((instr & 3) != 3)
+		{
+			unsigned quadrant = instr & 3;
+			unsigned funct3 = (instr >> 13) & 7;
+			if (quadrant == 1)
+				return 0;
+			if (funct3 == 2 || funct3 == 3)
+				return CommitRecord::kLoad; // c.lw/c.ld and the sp forms
+			if (funct3 == 6 || funct3 == 7)
+				return CommitRecord::kStore; // c.sw/c.sd and the sp forms
+			return 0;
+		}
+		switch (instr & 0x7f)
+		{
+		case 0x03:
+			return CommitRecord::kLoad;
+		case 0x23:
+			return CommitRecord::kStore;
+		case 0x2f:
+			if ((instr >> 27) == 0x02)
+				return CommitRecord::kLoad; // lr
+			if ((instr >> 27) == 0x03)
+				return CommitRecord::kStore; // sc
+			return CommitRecord::kLoad | CommitRecord::kStore;
+		default:
+			return 0;
+		}
+	}
+};
+
+// ION_COMMIT_TRACE: every CommitPort record, written to a file. The
+// simulation thread only fills fixed-size chunks; a writer thread encodes
+// them (commit_trace.h) and writes the file. A full chunk queue stalls the
+// simulation rather than dropping records.
+class CommitTraceWriter
+{
+  public:
+	~CommitTraceWriter() { close(); }
+
+	bool open(const std::string &path)
+	{
+		file_ = fopen(path.c_str(), "wb");
+		if (file_ == nullptr)
+		{
+			perror(path.c_str());
+			return false;
+		}
+		fwrite(kCommitTraceMagic, 1, sizeof(kCommitTraceMagic), file_);
+		path_ = path;
+		for (auto &chunk : chunks_)
+		{
+			chunk.reserve(kChunk);
+			free_.push_back(&chunk);
+		}
+		fill_ = free_.back();
+		free_.pop_back();
+		running_ = true;
+		writer_ = std::thread([this] { run(); });
+		printf("[commit-trace]: writing %s\n", path.c_str());
+		return true;
+	}
+
+	bool enabled() const { return file_ != nullptr; }
+
+	void push(const CommitRecord &rec)
+	{
+		fill_->push_back(rec);
+		if (fill_->size() < kChunk)
+			return;
+		std::unique_lock<std::mutex> lock(mu_);
+		full_.push_back(fill_);
+		ready_.notify_one();
+		space_.wait(lock, [&] { return !free_.empty(); });
+		fill_ = free_.back();
+		free_.pop_back();
+	}
+
+	void close()
+	{
+		if (file_ == nullptr)
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mu_);
+			if (!fill_->empty())
+				full_.push_back(fill_);
+			fill_ = nullptr;
+			running_ = false;
+		}
+		ready_.notify_one();
+		writer_.join();
+		fclose(file_);
+		file_ = nullptr;
+		printf("[commit-trace]: records=%" PRIu64 " bytes=%" PRIu64 " file=%s\n", records_, bytes_, path_.c_str());
+	}
+
+  private:
+	static const size_t kChunk = 16384;
+	static const size_t kChunks = 8;
+	typedef std::vector<CommitRecord> Chunk;
+
+	void run()
+	{
+		std::string block;
+		std::unique_lock<std::mutex> lock(mu_);
+		for (;;)
+		{
+			ready_.wait(lock, [&] { return !full_.empty() || !running_; });
+			if (full_.empty())
+				break;
+			Chunk *chunk = full_.front();
+			full_.erase(full_.begin());
+			lock.unlock();
+			commit_trace_block(chunk->data(), chunk->size(), block);
+			uint32_t count = (uint32_t)chunk->size();
+			fwrite(block.data(), 1, block.size(), file_);
+			records_ += count;
+			bytes_ += block.size();
+			chunk->clear();
+			lock.lock();
+			free_.push_back(chunk);
+			space_.notify_one();
+		}
+		fflush(file_);
+	}
+
+	FILE *file_ = nullptr;
+	std::string path_;
+	Chunk chunks_[kChunks];
+	Chunk *fill_ = nullptr;
+	std::vector<Chunk *> free_;
+	std::vector<Chunk *> full_;
+	std::mutex mu_;
+	std::condition_variable ready_;
+	std::condition_variable space_;
+	bool running_ = false;
+	std::thread writer_;
+	uint64_t records_ = 0;
+	uint64_t bytes_ = 0;
+};
+
+// Bumped by SIGUSR1; every running FlightRecorder dumps once per bump.
+static std::atomic<unsigned> flight_dump_requests{0};
+
+static void request_flight_dump(int)
+{
+	flight_dump_requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Always-on ring of the last ION_FLIGHT_RECORDER CommitPort records and CSR
+// writes. run_sim dumps it when a run fails, on SIGUSR1, and when a probe
+// with `dump` fires, so a failure can be inspected without a traced rerun.
+class FlightRecorder
+{
+  public:
+	void open(uint64_t events, const std::string &out_path)
+	{
+		if (events == 0)
+			return;
+		size_t size = 1;
+		while (size < events)
+			size <<= 1;
+		ring_.resize(size);
+		mask_ = size - 1;
+		out_path_ = out_path;
+		seen_requests_ = flight_dump_requests.load(std::memory_order_relaxed);
+	}
+
+	bool enabled() const { return !ring_.empty(); }
+
+	void record(const CommitRecord &rec)
+	{
+		Event &e = ring_[head_++ & mask_];
+		e.rec = rec;
+		e.csr_write = false;
+	}
+
+	// CSR writes, and the SIGUSR1 check; call on every rising edge.
+	void sample(VSoc *dut, uint64_t cycle, const std::string &test_name)
+	{
+		auto *r = dut->rootp;
+		if (r->SimTop__DOT__core__DOT__csr__DOT__io_wvalid && r->SimTop__DOT__core__DOT__csr__DOT__io_wwrite)
+		{
+			Event &e = ring_[head_++ & mask_];
+			e.rec = CommitRecord();
+			e.rec.cycle = cycle;
+			e.rec.cause = r->SimTop__DOT__core__DOT__csr__DOT__io_waddr;
+			e.rec.wdata = r->SimTop__DOT__core__DOT__csr__DOT__io_wwdata;
+			e.csr_write = true;
+		}
+		unsigned requests = flight_dump_requests.load(std::memory_order_relaxed);
+		if (requests != seen_requests_)
+		{
+			seen_requests_ = requests;
+			dump("SIGUSR1", test_name);
+		}
+	}
+
+	// Oldest first, one spike --log-commits line per record, each prefixed
+	// with its sim_time; CSR writes get a `csr` line of their own.
+	void dump(const char *reason, const std::string &test_name) const
+	{
+		if (!enabled())
+			return;
+		std::string path = !out_path_.empty() ? out_path_ : "simulator/build/flight-" + test_name + ".log";
+		FILE *f = fopen(path.c_str(), "w");
+		if (f == nullptr)
+		{
+			perror(path.c_str());
+			return;
+		}
+		uint64_t count = std::min<uint64_t>(head_, ring_.size());
+		fprintf(f, "# flight recorder: test=%s reason=%s sim_time=%" PRIu64 " events=%" PRIu64 "\n",
+		        test_name.c_str(), reason, sim_time, count);
+		for (uint64_t i = head_ - count; i < head_; ++i)
+		{
+			const Event &e = ring_[i & mask_];
+			fprintf(f, "%12" PRIu64 " ", e.rec.cycle);
+			if (e.csr_write)
+				fprintf(f, "core   0: csr 0x%03" PRIx64 " <- 0x%016" PRIx64 "\n", e.rec.cause, e.rec.wdata);
+			else
+				print_commit_record(f, e.rec);
+		}
+		fclose(f);
+		printf("[flight]: %s: last %" PRIu64 " events written to %s\n", reason, count, path.c_str());
+	}
+
+  private:
+	struct Event
+	{
+		CommitRecord rec;
+		bool csr_write;
+	};
+
+	std::vector<Event> ring_;
+	uint64_t mask_ = 0;
+	uint64_t head_ = 0;
+	std::string out_path_;
+	unsigned seen_requests_ = 0;
+};
+
+// Probe registry: named accessors into the model, and probes that print (or
+// count) a list of them at rising edges when their triggers fire. The
+// ION_TRACE_* modes are presets; ION_PROBES adds ad-hoc ones. run_sim builds
+// its main loop without any of this when no probe is enabled.
+enum class ProbeFmt : uint8_t
+{
+	kDec,
+	kHex2,
+	kHex3,
+	kHex8,
+	kHex16,
+};
+
+struct ProbeSignal
+{
+	const char *name;
+	ProbeFmt fmt;
+	uint64_t (*read)(VSoc *dut);
+};
+
+template <unsigned N> static uint64_t probe_reg(VSoc *dut)
+{
+	return dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[N];
+}
+
+#define ION_PROBE_SIGNAL(name, fmt, expr) \
+	{name, ProbeFmt::fmt, [](VSoc *dut) -> uint64_t { (void)dut; return (uint64_t)(expr); }}
+
+static const ProbeSignal kProbeSignals[] = {
+	ION_PROBE_SIGNAL("pc", kHex16, dut->io_debug_pc),
+	ION_PROBE_SIGNAL("instr", kHex8, dut->io_debug_instr),
+	ION_PROBE_SIGNAL("sim.startup", kDec, sim_time < 150),
+	{"ra", ProbeFmt::kHex16, probe_reg<1>},
+	{"sp", ProbeFmt::kHex16, probe_reg<2>},
+	{"gp", ProbeFmt::kHex16, probe_reg<3>},
+	{"tp", ProbeFmt::kHex16, probe_reg<4>},
+	{"t0", ProbeFmt::kHex16, probe_reg<5>},
+	{"t1", ProbeFmt::kHex16, probe_reg<6>},
+	{"t2", ProbeFmt::kHex16, probe_reg<7>},
+	{"s0", ProbeFmt::kHex16, probe_reg<8>},
+	{"s1", ProbeFmt::kHex16, probe_reg<9>},
+	{"a0", ProbeFmt::kHex16, probe_reg<10>},
+	{"a1", ProbeFmt::kHex16, probe_reg<11>},
+	{"a2", ProbeFmt::kHex16, probe_reg<12>},
+	{"a3", ProbeFmt::kHex16, probe_reg<13>},
+	{"a4", ProbeFmt::kHex16, probe_reg<14>},
+	{"a5", ProbeFmt::kHex16, probe_reg<15>},
+	{"a6", ProbeFmt::kHex16, probe_reg<16>},
+	{"a7", ProbeFmt::kHex16, probe_reg<17>},
+	{"s2", ProbeFmt::kHex16, probe_reg<18>},
+	{"s3", ProbeFmt::kHex16, probe_reg<19>},
+	{"s4", ProbeFmt::kHex16, probe_reg<20>},
+	{"s5", ProbeFmt::kHex16, probe_reg<21>},
+	{"s6", ProbeFmt::kHex16, probe_reg<22>},
+	{"s7", ProbeFmt::kHex16, probe_reg<23>},
+	{"s8", ProbeFmt::kHex16, probe_reg<24>},
+	{"s9", ProbeFmt::kHex16, probe_reg<25>},
+	{"s10", ProbeFmt::kHex16, probe_reg<26>},
+	{"s11", ProbeFmt::kHex16, probe_reg<27>},
+	{"t3", ProbeFmt::kHex16, probe_reg<28>},
+	{"t4", ProbeFmt::kHex16, probe_reg<29>},
+	{"t5", ProbeFmt::kHex16, probe_reg<30>},
+	{"t6", ProbeFmt::kHex16, probe_reg<31>},
+
+	ION_PROBE_SIGNAL("csr.priv", kDec, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__CurrentPrivLevel),
+	ION_PROBE_SIGNAL("csr.satp", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__satp),
+	ION_PROBE_SIGNAL("csr.mstatus", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mstatus),
+	ION_PROBE_SIGNAL("csr.mie", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mie),
+	ION_PROBE_SIGNAL("csr.mtvec", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mtvec),
+	ION_PROBE_SIGNAL("csr.mepc", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mepc),
+	ION_PROBE_SIGNAL("csr.mcause", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mcause),
+	ION_PROBE_SIGNAL("csr.mtval", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mtval),
+	ION_PROBE_SIGNAL("csr.mscratch", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mscratch),
+	ION_PROBE_SIGNAL("csr.stvec", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__stvec),
+	ION_PROBE_SIGNAL("csr.sepc", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__sepc),
+	ION_PROBE_SIGNAL("csr.scause", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__scause),
+	ION_PROBE_SIGNAL("csr.stval", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__stval),
+	ION_PROBE_SIGNAL("csr.sscratch", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__sscratch),
+	ION_PROBE_SIGNAL("csr.epc_out", kHex16, dut->rootp->SimTop__DOT__core__DOT___csr_io_epc_out),
+	ION_PROBE_SIGNAL("csr.wen", kDec,
+	                 dut->rootp->SimTop__DOT__core__DOT__csr__DOT__io_wvalid &&
+	                     dut->rootp->SimTop__DOT__core__DOT__csr__DOT__io_wwrite),
+	ION_PROBE_SIGNAL("csr.waddr", kHex3, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__io_waddr),
+	ION_PROBE_SIGNAL("csr.wdata", kHex16, dut->rootp->SimTop__DOT__core__DOT__csr__DOT__io_wwdata),
+
+	ION_PROBE_SIGNAL("core.pc_reg", kHex16, dut->rootp->SimTop__DOT__core__DOT__pc__DOT__ProgramCounter),
+	ION_PROBE_SIGNAL("core.trap", kDec, dut->rootp->SimTop__DOT__core__DOT__combined_trap),
+	ION_PROBE_SIGNAL("core.int_pending", kDec, dut->rootp->SimTop__DOT__core__DOT__interruptPending),
+	ION_PROBE_SIGNAL("core.int_fire", kDec, dut->rootp->SimTop__DOT__core__DOT__interrupt_fire),
+	ION_PROBE_SIGNAL("core.has_ret", kDec, dut->rootp->SimTop__DOT__core__DOT__has_ret),
+	ION_PROBE_SIGNAL("core.ret_redirect", kDec, dut->rootp->SimTop__DOT__core__DOT__ret_redirect),
+	ION_PROBE_SIGNAL("core.ret_consumed", kDec, dut->rootp->SimTop__DOT__core__DOT__retConsumed),
+	ION_PROBE_SIGNAL("core.fq_flush", kDec, dut->rootp->SimTop__DOT__core__DOT__frontendQueueFlush),
+	ION_PROBE_SIGNAL("core.decode_stall", kDec, dut->rootp->SimTop__DOT__core__DOT__decodeStall),
+	ION_PROBE_SIGNAL("pc.stall", kDec, dut->rootp->SimTop__DOT__core__DOT__pc__DOT__io_stall),
+	ION_PROBE_SIGNAL("pc.hold", kDec, dut->rootp->SimTop__DOT__core__DOT__pc__DOT__redirectHold),
+	ION_PROBE_SIGNAL("pc.bpu_taken", kDec, dut->rootp->SimTop__DOT__core__DOT__pc__DOT___bpu_io_pred_taken),
+	ION_PROBE_SIGNAL("pc.redirect", kDec, dut->rootp->SimTop__DOT__core__DOT__pc__DOT__redirect),
+
+	ION_PROBE_SIGNAL("if.stall", kDec, dut->rootp->SimTop__DOT__core__DOT___ifetch_io_fetch_stall),
+	ION_PROBE_SIGNAL("if.in_pc", kHex16, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__io_pc),
+	ION_PROBE_SIGNAL("if.state", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__state),
+	ION_PROBE_SIGNAL("if.acc", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__acceptResp),
+	ION_PROBE_SIGNAL("if.req_pc", kHex16, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__reqPc),
+	ION_PROBE_SIGNAL("if.req_pa", kHex16, dut->rootp->SimTop__DOT__core__DOT___ifetch_io_cache_req_bits_addr),
+	ION_PROBE_SIGNAL("if.pc", kHex16, dut->rootp->SimTop__DOT__core__DOT___ifetch_io_pc_out),
+	ION_PROBE_SIGNAL("if.instr", kHex8, dut->rootp->SimTop__DOT__core__DOT___ifetch_io_instr_out),
+	ION_PROBE_SIGNAL("if.len", kDec, dut->rootp->SimTop__DOT__core__DOT___ifetch_io_instr_len),
+	ION_PROBE_SIGNAL("if.pc_step", kDec, dut->rootp->SimTop__DOT__core__DOT___ifetch_io_pc_step_len),
+
+	ION_PROBE_SIGNAL("id.v", kDec, dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_valid_out),
+	ION_PROBE_SIGNAL("id.rd", kDec, dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_rd),
+	ION_PROBE_SIGNAL("id.w", kDec, dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_ctrl_reg_write),
+	ION_PROBE_SIGNAL("id.op1", kHex16, dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_op1),
+	ION_PROBE_SIGNAL("id.op2", kHex16, dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_op2),
+	ION_PROBE_SIGNAL("id.issue", kDec, dut->rootp->SimTop__DOT__core__DOT__issueIdToAlu),
+	ION_PROBE_SIGNAL("id.issued", kDec, dut->rootp->SimTop__DOT__core__DOT__idIssuedValid),
+	ION_PROBE_SIGNAL("id.issued_pc", kHex16, dut->rootp->SimTop__DOT__core__DOT__idIssuedPc),
+
+	ION_PROBE_SIGNAL("alu.v", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_valid_out_r),
+	ION_PROBE_SIGNAL("alu.rd", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_rd_r),
+	ION_PROBE_SIGNAL("alu.w", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_reg_write_r),
+	ION_PROBE_SIGNAL("alu.mem_v", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_mem_valid_r),
+	ION_PROBE_SIGNAL("alu.mem_op", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_mem_op_r),
+	ION_PROBE_SIGNAL("alu.res", kHex16, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_result_r),
+	ION_PROBE_SIGNAL("alu.pc", kHex16, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_pc_out_r),
+	ION_PROBE_SIGNAL("alu.op1", kHex16, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__op1),
+	ION_PROBE_SIGNAL("alu.op2", kHex16, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__op2),
+	ION_PROBE_SIGNAL("alu.br_v", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__branch_valid),
+	ION_PROBE_SIGNAL("alu.br_t", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__branch_taken),
+	ION_PROBE_SIGNAL("alu.br_red", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__branchRedirect),
+	ION_PROBE_SIGNAL("alu.br_info_v", kDec, dut->rootp->SimTop__DOT__core__DOT___alu_io_br_info_valid),
+	ION_PROBE_SIGNAL("alu.br_info_t", kDec, dut->rootp->SimTop__DOT__core__DOT___alu_io_br_info_taken),
+	ION_PROBE_SIGNAL("alu.br_info_red", kDec, dut->rootp->SimTop__DOT__core__DOT___alu_io_br_info_redirect),
+	ION_PROBE_SIGNAL("alu.br_info_pc", kHex16, dut->rootp->SimTop__DOT__core__DOT___alu_io_br_info_pc),
+	ION_PROBE_SIGNAL("alu.br_info_tgt", kHex16, dut->rootp->SimTop__DOT__core__DOT___alu_io_br_info_target),
+	ION_PROBE_SIGNAL("alu.br_r_v", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_br_info_r_valid),
+	ION_PROBE_SIGNAL("alu.br_r_t", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_br_info_r_taken),
+	ION_PROBE_SIGNAL("alu.br_r_red", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_br_info_r_redirect),
+	ION_PROBE_SIGNAL("alu.br_r_pc", kHex16, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_br_info_r_pc),
+	ION_PROBE_SIGNAL("alu.br_r_tgt", kHex16, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_br_info_r_target),
+	ION_PROBE_SIGNAL("alu.exbp_v", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__exBypassValid),
+	ION_PROBE_SIGNAL("alu.exbp_rd", kDec, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__exBypassRd),
+	ION_PROBE_SIGNAL("alu.exbp_data", kHex16, dut->rootp->SimTop__DOT__core__DOT__alu__DOT__exBypassData),
+	ION_PROBE_SIGNAL("fwd.v", kDec, dut->rootp->SimTop__DOT__core__DOT__aluResultFwdValid),
+	ION_PROBE_SIGNAL("fwd.rd", kDec, dut->rootp->SimTop__DOT__core__DOT__aluResultFwdRd),
+	ION_PROBE_SIGNAL("fwd.data", kHex16, dut->rootp->SimTop__DOT__core__DOT__aluResultFwdData),
+	ION_PROBE_SIGNAL("prev.v", kDec, dut->rootp->SimTop__DOT__core__DOT__aluResultPrevValid),
+	ION_PROBE_SIGNAL("prev.rd", kDec, dut->rootp->SimTop__DOT__core__DOT__aluResultPrevRd),
+	ION_PROBE_SIGNAL("prev.data", kHex16, dut->rootp->SimTop__DOT__core__DOT__aluResultPrevData),
+
+	ION_PROBE_SIGNAL("lsu.stall", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_stall_req_0),
+	ION_PROBE_SIGNAL("lsu.load_v", kDec, dut->rootp->SimTop__DOT__core__DOT___lsu_io_load_data_valid),
+	ION_PROBE_SIGNAL("lsu.load_rd", kDec, dut->rootp->SimTop__DOT__core__DOT___lsu_io_load_data_rd),
+	ION_PROBE_SIGNAL("lsu.load", kHex16, dut->rootp->SimTop__DOT__core__DOT___lsu_io_load_data),
+	ION_PROBE_SIGNAL("lsu.v", kDec, dut->rootp->SimTop__DOT__core__DOT___lsu_io_valid_out),
+	ION_PROBE_SIGNAL("lsu.rd", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_reg_rd),
+	ION_PROBE_SIGNAL("lsu.w", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_reg_write),
+	ION_PROBE_SIGNAL("lsu.res", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_result),
+	ION_PROBE_SIGNAL("lsu.pc", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_pc),
+	// lsu.pc while the LSU output is valid, all ones otherwise.
+	ION_PROBE_SIGNAL("lsu.valid_pc", kHex16,
+	                 dut->rootp->SimTop__DOT__core__DOT___lsu_io_valid_out
+	                     ? (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_pc
+	                     : UINT64_MAX),
+	ION_PROBE_SIGNAL("lsu.is_ret", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_trap_is_ret),
+	ION_PROBE_SIGNAL("lsu.ret_type", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_trap_ret_type),
+	ION_PROBE_SIGNAL("lsu.req_v", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_valid),
+	ION_PROBE_SIGNAL("lsu.req_r", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_ready),
+	ION_PROBE_SIGNAL("lsu.req_cmd", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_bits_cmd),
+	ION_PROBE_SIGNAL("lsu.req_addr", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_bits_addr),
+	ION_PROBE_SIGNAL("lsu.req_wdata", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_bits_wdata),
+	ION_PROBE_SIGNAL("lsu.req_mask", kHex2, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_bits_mask),
+	ION_PROBE_SIGNAL("lsu.resp_v", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_resp_valid),
+	ION_PROBE_SIGNAL("lsu.resp_err", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_resp_bits_err),
+	ION_PROBE_SIGNAL("lsu.resp_data", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_resp_bits_rdata),
+
+	ION_PROBE_SIGNAL("atomic.active", kDec,
+	                 dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__raw_atomic_req ||
+	                     dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__new_atomic_req ||
+	                     dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__do_atomic_read_req ||
+	                     dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__do_atomic_write_req ||
+	                     dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicRespValid),
+	ION_PROBE_SIGNAL("atomic.raw", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__raw_atomic_req),
+	ION_PROBE_SIGNAL("atomic.new", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__new_atomic_req),
+	ION_PROBE_SIGNAL("atomic.pend", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicPending),
+	ION_PROBE_SIGNAL("atomic.rd_sent", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicReadSent),
+	ION_PROBE_SIGNAL("atomic.wr_sent", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicWriteSent),
+	ION_PROBE_SIGNAL("atomic.do_wr", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicDoWrite),
+	ION_PROBE_SIGNAL("atomic.resp_v", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicRespValid),
+	ION_PROBE_SIGNAL("atomic.op", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_op),
+	ION_PROBE_SIGNAL("atomic.atom", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_atomic),
+	ION_PROBE_SIGNAL("atomic.size", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_size),
+	ION_PROBE_SIGNAL("atomic.mask", kHex2, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_mask),
+	ION_PROBE_SIGNAL("atomic.vaddr", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_vaddr),
+	ION_PROBE_SIGNAL("atomic.paddr", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_paddr),
+	ION_PROBE_SIGNAL("atomic.awdata", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_wdata),
+	ION_PROBE_SIGNAL("atomic.wrdata", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicWriteData),
+	ION_PROBE_SIGNAL("atomic.old", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicOldData),
+	ION_PROBE_SIGNAL("atomic.resp", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicRespData),
+
+	ION_PROBE_SIGNAL("wb.rd", kDec, dut->rootp->SimTop__DOT__core__DOT___wb_io_reg_wb_rd),
+	ION_PROBE_SIGNAL("wb.w", kDec, dut->rootp->SimTop__DOT__core__DOT___wb_io_reg_wb_reg_write),
+	ION_PROBE_SIGNAL("wb.data", kHex16, dut->rootp->SimTop__DOT__core__DOT___wb_io_reg_wb_data),
+	ION_PROBE_SIGNAL("sb.p", kDec, dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_pending),
+	ION_PROBE_SIGNAL("sb.rd", kDec, dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_pendingRd),
+	ION_PROBE_SIGNAL("sb.new", kDec, dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_newLoadLike),
+	ION_PROBE_SIGNAL("sb.done", kDec, dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_complete),
+	ION_PROBE_SIGNAL("sb.inst", kDec, dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_issued),
+	ION_PROBE_SIGNAL("sb.inst_rd", kDec, dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_issuedRd),
+
+	ION_PROBE_SIGNAL("plic.src1", kDec, dut->rootp->io_ext_irq_sources_1),
+	ION_PROBE_SIGNAL("clint.mtip", kDec,
+	                 dut->rootp->SimTop__DOT__clint__DOT__mtimecmp != 0 &&
+	                     dut->rootp->SimTop__DOT__clint__DOT__mtime >= dut->rootp->SimTop__DOT__clint__DOT__mtimecmp),
+	ION_PROBE_SIGNAL("clint.mtime", kHex16, dut->rootp->SimTop__DOT__clint__DOT__mtime),
+	ION_PROBE_SIGNAL("clint.mtimecmp", kHex16, dut->rootp->SimTop__DOT__clint__DOT__mtimecmp),
+
+	ION_PROBE_SIGNAL("dmi.valid", kDec, dut->rootp->SimTop__DOT__debugModule_io_dmi_valid_REG),
+	ION_PROBE_SIGNAL("dmi.op", kDec, dut->rootp->SimTop__DOT__jtag__DOT__drUpdate & 0x3),
+	ION_PROBE_SIGNAL("dmi.addr", kHex2, (dut->rootp->SimTop__DOT__jtag__DOT__drUpdate >> 34) & 0x7f),
+	ION_PROBE_SIGNAL("dmi.wdata", kHex8, (dut->rootp->SimTop__DOT__jtag__DOT__drUpdate >> 2) & 0xffffffffu),
+	ION_PROBE_SIGNAL("dmi.rdata", kHex8, dut->rootp->SimTop__DOT___debugModule_io_dmi_rdata),
+	ION_PROBE_SIGNAL("dm.dmcontrol", kHex8, dut->rootp->SimTop__DOT__debugModule__DOT__dmcontrol),
+	ION_PROBE_SIGNAL("dm.dmstatus", kHex8, dut->rootp->SimTop__DOT__debugModule__DOT__dmstatus),
+
+#ifdef ION_LINUX_PROFILE
+	ION_PROBE_SIGNAL("if.xp", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__xlatePending),
+	ION_PROBE_SIGNAL("if.xd", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__xlateDone),
+	ION_PROBE_SIGNAL("if.xlate", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__translateFetch),
+	ION_PROBE_SIGNAL("if.issue", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__canIssue),
+	ION_PROBE_SIGNAL("if.start_xlate", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__startTranslation),
+	ION_PROBE_SIGNAL("if.req_v", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__normalFetchReqValid),
+	ION_PROBE_SIGNAL("if.trap_v", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__fetchTrap_valid),
+	ION_PROBE_SIGNAL("if.trap_c", kHex16, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__fetchTrap_cause),
+	ION_PROBE_SIGNAL("if.trap_tval", kHex16, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__fetchTrap_value),
+	ION_PROBE_SIGNAL("if.xlate_rdy", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__translatedReady),
+	ION_PROBE_SIGNAL("if.xlate_pa", kHex16, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__xlatePaddr),
+	ION_PROBE_SIGNAL("iptw.state", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__state),
+	ION_PROBE_SIGNAL("iptw.level", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__level),
+	ION_PROBE_SIGNAL("iptw.req_v", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_req_valid),
+	ION_PROBE_SIGNAL("iptw.req_va", kHex16, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_req_bits_vaddr),
+	ION_PROBE_SIGNAL("iptw.mem_req_v", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_mem_req_valid),
+	ION_PROBE_SIGNAL("iptw.mem_req_r", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_mem_req_ready),
+	ION_PROBE_SIGNAL("iptw.mem_addr", kHex16, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_mem_req_bits_addr),
+	ION_PROBE_SIGNAL("iptw.mem_resp_v", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_mem_resp_valid),
+	ION_PROBE_SIGNAL("iptw.mem_resp_r", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_mem_resp_ready),
+	ION_PROBE_SIGNAL("iptw.resp_v", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_resp_valid),
+	ION_PROBE_SIGNAL("iptw.fault", kDec, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_resp_bits_fault_valid),
+	ION_PROBE_SIGNAL("iptw.table", kHex16, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__tableBase),
+	ION_PROBE_SIGNAL("iptw.reg_va", kHex16, dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__reqReg_vaddr),
+
+	ION_PROBE_SIGNAL("ptw.state", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__state),
+	ION_PROBE_SIGNAL("ptw.level", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__level),
+	ION_PROBE_SIGNAL("ptw.req_v", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_req_valid),
+	ION_PROBE_SIGNAL("ptw.req_va", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_req_bits_vaddr),
+	ION_PROBE_SIGNAL("ptw.reg_va", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__reqReg_vaddr),
+	ION_PROBE_SIGNAL("ptw.satp", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_req_bits_satp),
+	ION_PROBE_SIGNAL("ptw.table", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__tableBase),
+	ION_PROBE_SIGNAL("ptw.mem_req_v", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_req_valid),
+	ION_PROBE_SIGNAL("ptw.mem_req_r", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_req_ready),
+	ION_PROBE_SIGNAL("ptw.mem_addr", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_req_bits_addr),
+	ION_PROBE_SIGNAL("ptw.mem_resp_v", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_resp_valid),
+	ION_PROBE_SIGNAL("ptw.mem_resp_r", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_resp_ready),
+	ION_PROBE_SIGNAL("ptw.mem_err", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_resp_bits_err),
+	ION_PROBE_SIGNAL("ptw.pte", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_resp_bits_rdata),
+	ION_PROBE_SIGNAL("ptw.tr_leaf", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__translator__DOT__io_leaf),
+	ION_PROBE_SIGNAL("ptw.tr_fault", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__translator__DOT__io_fault_valid),
+	ION_PROBE_SIGNAL("ptw.tr_pa", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__translator__DOT__io_paddr),
+	ION_PROBE_SIGNAL("ptw.resp_v", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_valid),
+	ION_PROBE_SIGNAL("ptw.resp_pa", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_bits_paddr),
+	ION_PROBE_SIGNAL("ptw.fault", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_bits_fault_valid),
+	ION_PROBE_SIGNAL("ptw.cause", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_bits_fault_cause),
+	ION_PROBE_SIGNAL("ptw.value", kHex16, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_bits_fault_value),
+	ION_PROBE_SIGNAL("ptw.priv", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__reqReg_priv),
+	ION_PROBE_SIGNAL("ptw.sum", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__reqReg_sum),
+	ION_PROBE_SIGNAL("ptw.mxr", kDec, dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__reqReg_mxr),
+
+	ION_PROBE_SIGNAL("dc.req_v", kDec, dut->rootp->SimTop__DOT__core__DOT___dcacheArbiter_io_cacheReq_valid),
+	ION_PROBE_SIGNAL("dc.req_r", kDec, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheReq_ready),
+	ION_PROBE_SIGNAL("dc.req_fire", kDec, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__cacheReqFire),
+	ION_PROBE_SIGNAL("dc.cmd", kDec, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheReq_bits_cmd),
+	ION_PROBE_SIGNAL("dc.addr", kHex16, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheReq_bits_addr),
+	ION_PROBE_SIGNAL("dc.wdata", kHex16, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheReq_bits_wdata),
+	ION_PROBE_SIGNAL("dc.mask", kHex2, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheReq_bits_mask),
+	ION_PROBE_SIGNAL("dc.ptw_owner", kDec, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__respOwnerPtw),
+	ION_PROBE_SIGNAL("dc.pending", kDec, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__respPending),
+	ION_PROBE_SIGNAL("dc.resp_v", kDec, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_valid),
+	ION_PROBE_SIGNAL("dc.resp_r", kDec, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_ready),
+	ION_PROBE_SIGNAL("dc.resp_fire", kDec,
+	                 dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_valid &&
+	                     dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_ready),
+	ION_PROBE_SIGNAL("dc.resp_err", kDec, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_bits_err),
+	ION_PROBE_SIGNAL("dc.rdata", kHex16, dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_bits_rdata),
+#endif
+};
+
+#undef ION_PROBE_SIGNAL
+
+static const ProbeSignal *find_probe_signal(const std::string &name)
+{
+	for (const ProbeSignal &signal : kProbeSignals)
+	{
+		if (name == signal.name)
+			return &signal;
+	}
+	return nullptr;
+}
+
+// One firing condition of a probe, evaluated on every sample so its edge
+// state stays current. When `values` is set it also needs one of `match` to
+// hold one of them.
+struct ProbeTrigger
+{
+	enum Kind : uint8_t
+	{
+		kAlways,
+		kNonZero,
+		kChange,
+		kRise,
+		kLeave, // value moved from inside [lo, hi] to outside
+	};
+
+	Kind kind = kAlways;
+	const ProbeSignal *signal = nullptr;
+	uint64_t lo = 0;
+	uint64_t hi = UINT64_MAX;
+	std::vector<const ProbeSignal *> match;
+	std::vector<uint64_t> values;
+	uint64_t last = 0;
+	bool primed = false;
+
+	bool step(VSoc *dut, uint64_t *prev)
+	{
+		uint64_t value = signal != nullptr ? signal->read(dut) : 0;
+		bool fire = false;
+		switch (kind)
+		{
+		case kAlways:
+			fire = true;
+			break;
+		case kNonZero:
+			fire = value != 0;
+			break;
+		case kChange:
+			fire = !primed || value != last;
+			break;
+		case kRise:
+			fire = last == 0 && value != 0;
+			break;
+		case kLeave:
+			fire = primed && last >= lo && last <= hi && (value < lo || value > hi);
+			break;
+		}
+		*prev = last;
+		last = value;
+		primed = true;
+		return fire && matches(dut);
+	}
+
+	bool matches(VSoc *dut) const
+	{
+		if (values.empty())
+			return true;
+		for (const ProbeSignal *signal : match)
+		{
+			uint64_t value = signal->read(dut);
+			if (std::find(values.begin(), values.end(), value) != values.end())
+				return true;
+		}
+		return false;
+	}
+};
+
+struct Probe
+{
+	std::string tag;
+	// Printed after the tag, e.g. "[boot-trace 42] trap pc=...".
+	std::string note;
+	std::vector<const ProbeSignal *> fields;
+	// Per-field label overriding the signal name; empty keeps the name.
+	std::vector<std::string> labels;
+	// Fires only while one of these is inside [lo, hi]; empty passes.
+	std::vector<const ProbeSignal *> window;
+	uint64_t lo = 0;
+	uint64_t hi = UINT64_MAX;
+	// Any one firing is enough; none means every sample.
+	std::vector<ProbeTrigger> triggers;
+	bool once = false;
+	bool count_only = false;
+	// Dump the flight recorder when this probe fires.
+	bool dump = false;
+	bool done = false;
+	uint64_t hits = 0;
+};
+
+class ProbeSet
+{
+  public:
+	~ProbeSet()
+	{
+		if (out_ != nullptr)
+			fclose(out_);
+	}
+
+	bool empty() const { return probes_.empty(); }
+
+	bool open(const std::string &path)
+	{
+		if (path.empty())
+			return true;
+		FILE *f = fopen(path.c_str(), "w");
+		if (f == nullptr)
+		{
+			perror(path.c_str());
+			return false;
+		}
+		out_ = f;
+		return true;
+	}
+
+	// Preset builders. Fields are `signal` or `label=signal`, so a preset can
+	// keep the line format its old printf had. An unknown name is reported
+	// and makes ok() false; run_sim refuses to start in that case.
+	Probe &add(const std::string &tag, std::initializer_list<const char *> fields)
+	{
+		probes_.emplace_back();
+		Probe &probe = probes_.back();
+		probe.tag = tag;
+		add_fields(probe, fields);
+		return probe;
+	}
+
+	void add_fields(Probe &probe, std::initializer_list<const char *> fields)
+	{
+		for (const char *field : fields)
+		{
+			const char *eq = strchr(field, '=');
+			const ProbeSignal *signal = must_find(eq != nullptr ? eq + 1 : field);
+			if (signal == nullptr)
+				continue;
+			probe.fields.push_back(signal);
+			probe.labels.push_back(eq != nullptr ? std::string(field, eq - field) : std::string());
+		}
+	}
+
+	void window(Probe &probe, std::initializer_list<const char *> signals, uint64_t lo, uint64_t hi)
+	{
+		for (const char *name : signals)
+		{
+			if (const ProbeSignal *signal = must_find(name))
+				probe.window.push_back(signal);
+		}
+		probe.lo = lo;
+		probe.hi = hi;
+	}
+
+	ProbeTrigger trigger(ProbeTrigger::Kind kind, const char *signal)
+	{
+		ProbeTrigger t;
+		t.kind = kind;
+		t.signal = signal != nullptr ? must_find(signal) : nullptr;
+		return t;
+	}
+
+	void match(ProbeTrigger &t, std::initializer_list<const char *> signals, std::initializer_list<uint64_t> values)
+	{
+		for (const char *name : signals)
+		{
+			if (const ProbeSignal *signal = must_find(name))
+				t.match.push_back(signal);
+		}
+		for (uint64_t value : values)
+		{
+			if (value != 0)
+				t.values.push_back(value);
+		}
+	}
+
+	bool ok() const { return ok_; }
+
+	// ION_PROBES: probes separated by ';', each `tag clause...` with clauses
+	//   fields=sig,...           what to print
+	//   when=sig[:nz|change|rise] trigger (repeatable; default: every cycle)
+	//   leave=sig:lo-hi          trigger when sig leaves the range
+	//   window=sig,...:lo-hi     only while one of sig is in the range
+	//   match=sig,...=v,...      triggers also need a sig equal to a v
+	//   once, count              stop after the first hit; count instead of print
+	//   dump                     also dump the flight recorder
+	bool parse(const std::string &spec)
+	{
+		std::string item;
+		size_t start = 0;
+		while (start <= spec.size())
+		{
+			size_t end = spec.find(';', start);
+			if (end == std::string::npos)
+				end = spec.size();
+			item = spec.substr(start, end - start);
+			start = end + 1;
+			std::vector<std::string> words = split(item, " \t");
+			if (words.empty())
+				continue;
+			if (!parse_probe(words))
+			{
+				fprintf(stderr, "[probe]: bad ION_PROBES entry \"%s\"\n", item.c_str());
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void sample(VSoc *dut)
+	{
+		for (Probe &probe : probes_)
+		{
+			if (probe.done)
+				continue;
+			bool fired = probe.triggers.empty();
+			bool inside = in_window(probe, dut);
+			const ProbeTrigger *left = nullptr;
+			uint64_t left_from = 0;
+			for (ProbeTrigger &t : probe.triggers)
+			{
+				// A change trigger compares against the last value seen
+				// inside the window, not whatever ran outside it.
+				if (!inside && t.kind == ProbeTrigger::kChange)
+					continue;
+				uint64_t prev = 0;
+				if (t.step(dut, &prev))
+				{
+					fired = true;
+					if (t.kind == ProbeTrigger::kLeave)
+					{
+						left = &t;
+						left_from = prev;
+					}
+				}
+			}
+			if (!fired || !inside)
+				continue;
+			++probe.hits;
+			probe.done = probe.once;
+			dump_ |= probe.dump;
+			if (!probe.count_only)
+				emit(probe, dut, left, left_from);
+		}
+	}
+
+	// True once after a sample in which a `dump` probe fired.
+	bool take_dump()
+	{
+		bool dump = dump_;
+		dump_ = false;
+		return dump;
+	}
+
+	void report() const
+	{
+		for (const Probe &probe : probes_)
+		{
+			if (probe.count_only)
+				fprintf(out(), "[probe]: %s hits=%" PRIu64 "\n", probe.tag.c_str(), probe.hits);
+		}
+		fflush(out());
+	}
+
+	static void list()
+	{
+		for (const ProbeSignal &signal : kProbeSignals)
+			printf("[probe-signal]: %s\n", signal.name);
+	}
+
+  private:
+	FILE *out() const { return out_ != nullptr ? out_ : stdout; }
+
+	const ProbeSignal *must_find(const char *name)
+	{
+		const ProbeSignal *signal = find_probe_signal(name);
+		if (signal == nullptr)
+		{
+			fprintf(stderr, "[probe]: unknown signal %s\n", name);
+			ok_ = false;
+		}
+		return signal;
+	}
+
+	static std::vector<std::string> split(const std::string &s, const char *seps)
+	{
+		std::vector<std::string> out;
+		size_t pos = 0;
+		while (pos < s.size())
+		{
+			size_t end = s.find_first_of(seps, pos);
+			if (end == std::string::npos)
+				end = s.size();
+			if (end > pos)
+				out.push_back(s.substr(pos, end - pos));
+			pos = end + 1;
+		}
+		return out;
+	}
+
+	static bool parse_signals(const std::string &list, std::vector<const ProbeSignal *> *out)
+	{
+		for (const std::string &name : split(list, ","))
+		{
+			const ProbeSignal *signal = find_probe_signal(name);
+			if (signal == nullptr)
+			{
+				fprintf(stderr, "[probe]: unknown signal %s (ION_PROBE_LIST=1 lists them)\n", name.c_str());
+				return false;
+			}
+			out->push_back(signal);
+		}
+		return !out->empty();
+	}
+
+	static bool parse_range(const std::string &range, uint64_t *lo, uint64_t *hi)
+	{
+		size_t dash = range.find('-');
+		if (dash == std::string::npos)
+			return false;
+		char *end = nullptr;
+		*lo = strtoull(range.c_str(), &end, 0);
+		if (end != range.c_str() + dash)
+			return false;
+		*hi = strtoull(range.c_str() + dash + 1, &end, 0);
+		return *end == '\0';
+	}
+
+	bool parse_probe(const std::vector<std::string> &words)
+	{
+		Probe probe;
+		probe.tag = words[0];
+		std::vector<const ProbeSignal *> match_signals;
+		std::vector<uint64_t> match_values;
+		for (size_t i = 1; i < words.size(); ++i)
+		{
+			const std::string &word = words[i];
+			size_t eq = word.find('=');
+			std::string key = word.substr(0, eq);
+			std::string value = eq == std::string::npos ? "" : word.substr(eq + 1);
+			if (key == "once")
+				probe.once = true;
+			else if (key == "count")
+				probe.count_only = true;
+			else if (key == "dump")
+				probe.dump = true;
+			else if (key == "fields")
+			{
+				if (!parse_signals(value, &probe.fields))
+					return false;
+			}
+			else if (key == "when")
+			{
+				size_t colon = value.find(':');
+				std::string kind = colon == std::string::npos ? "nz" : value.substr(colon + 1);
+				ProbeTrigger t;
+				t.signal = find_probe_signal(value.substr(0, colon));
+				if (t.signal == nullptr)
+					return false;
+				if (kind == "nz")
+					t.kind = ProbeTrigger::kNonZero;
+				else if (kind == "change")
+					t.kind = ProbeTrigger::kChange;
+				else if (kind == "rise")
+					t.kind = ProbeTrigger::kRise;
+				else
+					return false;
+				probe.triggers.push_back(t);
+			}
+			else if (key == "leave" || key == "window")
+			{
+				size_t colon = value.rfind(':');
+				if (colon == std::string::npos)
+					return false;
+				std::vector<const ProbeSignal *> signals;
+				uint64_t lo = 0;
+				uint64_t hi = 0;
+				if (!parse_signals(value.substr(0, colon), &signals) ||
+				    !parse_range(value.substr(colon + 1), &lo, &hi))
+					return false;
+				if (key == "window")
+				{
+					probe.window = signals;
+					probe.lo = lo;
+					probe.hi = hi;
+					continue;
+				}
+				ProbeTrigger t;
+				t.kind = ProbeTrigger::kLeave;
+				t.signal = signals[0];
+				t.lo = lo;
+				t.hi = hi;
+				probe.triggers.push_back(t);
+			}
+			else if (key == "match")
+			{
+				size_t split_at = value.find('=');
+				if (split_at == std::string::npos ||
+				    !parse_signals(value.substr(0, split_at), &match_signals))
+					return false;
+				for (const std::string &v : split(value.substr(split_at + 1), ","))
+					match_values.push_back(strtoull(v.c_str(), nullptr, 0));
+			}
+			else
+				return false;
+		}
+		if (!match_values.empty())
+		{
+			if (probe.triggers.empty())
+				probe.triggers.push_back(ProbeTrigger());
+			for (ProbeTrigger &t : probe.triggers)
+			{
+				t.match = match_signals;
+				t.values = match_values;
+			}
+		}
+		if (probe.fields.empty() && !probe.count_only)
+			probe.fields.push_back(find_probe_signal("pc"));
+		probes_.push_back(probe);
+		return true;
+	}
+
+	static bool in_window(const Probe &probe, VSoc *dut)
+	{
+		if (probe.window.empty())
+			return true;
+		for (const ProbeSignal *signal : probe.window)
+		{
+			uint64_t value = signal->read(dut);
+			if (value >= probe.lo && value <= probe.hi)
+				return true;
+		}
+		return false;
+	}
+
+	static int format(char *buf, size_t len, const char *name, ProbeFmt fmt, uint64_t value)
+	{
+		switch (fmt)
+		{
+		case ProbeFmt::kDec:
+			return snprintf(buf, len, " %s=%" PRIu64, name, value);
+		case ProbeFmt::kHex2:
+			return snprintf(buf, len, " %s=0x%02" PRIx64, name, value);
+		case ProbeFmt::kHex3:
+			return snprintf(buf, len, " %s=0x%03" PRIx64, name, value);
+		case ProbeFmt::kHex8:
+			return snprintf(buf, len, " %s=0x%08" PRIx64, name, value);
+		case ProbeFmt::kHex16:
+			break;
+		}
+		return snprintf(buf, len, " %s=0x%016" PRIx64, name, value);
+	}
+
+	void emit(const Probe &probe, VSoc *dut, const ProbeTrigger *left, uint64_t left_from)
+	{
+		char line[8192];
+		size_t used = (size_t)snprintf(line, sizeof(line), "[%s %6" PRIu64 "]", probe.tag.c_str(), sim_time);
+		if (!probe.note.empty() && used < sizeof(line))
+			used += (size_t)snprintf(line + used, sizeof(line) - used, " %s", probe.note.c_str());
+		if (left != nullptr && used < sizeof(line))
+		{
+			std::string name = std::string("prev_") + left->signal->name;
+			used += (size_t)format(line + used, sizeof(line) - used, name.c_str(), left->signal->fmt, left_from);
+		}
+		for (size_t i = 0; i < probe.fields.size() && used < sizeof(line); ++i)
+		{
+			const ProbeSignal *signal = probe.fields[i];
+			const char *label = i < probe.labels.size() && !probe.labels[i].empty() ? probe.labels[i].c_str() : signal->name;
+			used += (size_t)format(line + used, sizeof(line) - used, label, signal->fmt, signal->read(dut));
+		}
+		fputs(line, out());
+		fputc('\n', out());
+	}
+
+	std::vector<Probe> probes_;
+	// ION_PROBE_OUT; null follows stdout, which the UART console swaps.
+	FILE *out_ = nullptr;
+	bool dump_ = false;
+	bool ok_ = true;
+};
+
+// The ION_TRACE_* modes as probes, plus whatever ION_PROBES adds.
+static bool setup_probes(ProbeSet &probes, const SimOptions &opts)
+{
+	using T = ProbeTrigger;
+	if (env_enabled("ION_PROBE_LIST"))
+		ProbeSet::list();
+	if (!probes.open(env_string("ION_PROBE_OUT")))
+		return false;
+
+	if (env_enabled("ION_TRACE_MAP_U32"))
+	{
+		Probe &p = probes.add("map-u32", {"pc", "instr", "a0", "a1", "a2", "a3", "a4", "a5", "a6", "t0", "ra"});
+		probes.window(p, {"pc"}, 0x4001ccc0ULL, 0x4001cdb0ULL);
+	}
+	if (env_enabled("ION_TRACE_RET"))
+	{
+		Probe &p = probes.add("ret-trace", {"pc", "instr", "lsu_pc=lsu.pc", "has_ret=core.has_ret",
+		                                    "ret_redirect=core.ret_redirect", "retConsumed=core.ret_consumed",
+		                                    "lsu_valid=lsu.v", "out_is_ret=lsu.is_ret", "ret_type=lsu.ret_type",
+		                                    "epc=csr.epc_out", "mepc=csr.mepc", "sepc=csr.sepc"});
+		probes.window(p, {"pc", "lsu.valid_pc"}, 0x40019590ULL, 0x40019690ULL);
+	}
+	if (env_enabled("ION_TRACE_CSR"))
+	{
+		Probe &p = probes.add("csr-trace", {"pc", "instr", "addr=csr.waddr", "wdata=csr.wdata", "mepc=csr.mepc",
+		                                    "sepc=csr.sepc", "mscratch=csr.mscratch"});
+		T t = probes.trigger(T::kNonZero, "csr.wen");
+		probes.match(t, {"csr.waddr"}, {0x105, 0x140, 0x141, 0x300, 0x305, 0x340, 0x341});
+		p.triggers.push_back(t);
+	}
+	if (env_enabled("ION_TRACE_PC_ESCAPE"))
+	{
+		Probe &p = probes.add("pc-escape", {"pc", "instr", "pc_reg=core.pc_reg", "alu_br_v=alu.br_info_v",
+		                                    "alu_br_t=alu.br_info_t", "alu_br_red=alu.br_info_red",
+		                                    "alu_br_pc=alu.br_info_pc", "alu_br_tgt=alu.br_info_tgt",
+		                                    "alu_r_br_v=alu.br_r_v", "alu_r_br_t=alu.br_r_t",
+		                                    "alu_r_br_red=alu.br_r_red", "alu_r_br_pc=alu.br_r_pc",
+		                                    "alu_r_br_tgt=alu.br_r_tgt", "alu_v=alu.v", "alu_pc=alu.pc",
+		                                    "alu_rd=alu.rd", "alu_w=alu.w", "alu_res=alu.res",
+		                                    "id_issue=id.issue", "id_issued=id.issued", "id_pc=id.issued_pc",
+		                                    "id_rd=id.rd", "id_w=id.w", "id_op1=id.op1", "id_op2=id.op2",
+		                                    "wb_w=wb.w", "wb_rd=wb.rd", "wb_data=wb.data", "ra", "sp", "t0", "a0",
+		                                    "a1", "a2", "a7", "mtvec=csr.mtvec", "mepc=csr.mepc",
+		                                    "mcause=csr.mcause", "mtval=csr.mtval"});
+		T t = probes.trigger(T::kLeave, "pc");
+		t.lo = opts.sram_base;
+		t.hi = opts.sram_base + opts.sram_size - 1;
+		p.triggers.push_back(t);
+		p.once = true;
+		p.dump = true;
+	}
+	if (env_enabled("ION_TRACE_BOOT"))
+	{
+		Probe &p = probes.add("boot-trace", {"pc", "mtvec=csr.mtvec", "mepc=csr.mepc", "mcause=csr.mcause",
+		                                     "stvec=csr.stvec", "sepc=csr.sepc", "scause=csr.scause",
+		                                     "stval=csr.stval", "sscratch=csr.sscratch", "tp", "sp", "ra", "s0",
+		                                     "s1", "a0", "a1", "a2", "a3", "a4", "a5", "s2", "s3", "s4", "s5",
+		                                     "s6", "s7", "s8", "s9", "s10"});
+		p.note = "trap";
+		p.triggers.push_back(probes.trigger(T::kNonZero, "core.trap"));
+	}
+#ifdef ION_LINUX_PROFILE
+	if (env_enabled("ION_TRACE_LSU_PTW"))
+	{
+		Probe &p = probes.add("lsu-ptw-trace", {"pc", "instr", "state=ptw.state", "level=ptw.level",
+		                                        "req_v=ptw.req_v", "req_va=ptw.req_va", "reg_va=ptw.reg_va",
+		                                        "satp=ptw.satp", "table=ptw.table", "mem_req_v=ptw.mem_req_v",
+		                                        "mem_req_r=ptw.mem_req_r", "mem_addr=ptw.mem_addr",
+		                                        "mem_resp_v=ptw.mem_resp_v", "mem_resp_r=ptw.mem_resp_r",
+		                                        "mem_err=ptw.mem_err", "pte=ptw.pte", "tr_leaf=ptw.tr_leaf",
+		                                        "tr_fault=ptw.tr_fault", "tr_pa=ptw.tr_pa", "resp_v=ptw.resp_v",
+		                                        "resp_pa=ptw.resp_pa", "fault=ptw.fault", "cause=ptw.cause",
+		                                        "value=ptw.value", "priv=ptw.priv", "sum=ptw.sum", "mxr=ptw.mxr"});
+		const uint64_t vaddr = env_u64("ION_TRACE_LSU_PTW_VADDR", 0);
+		for (auto [kind, signal] : {std::pair{T::kNonZero, "ptw.req_v"}, std::pair{T::kNonZero, "ptw.resp_v"},
+		                            std::pair{T::kNonZero, "ptw.mem_req_v"}, std::pair{T::kNonZero, "ptw.mem_resp_v"},
+		                            std::pair{T::kChange, "ptw.state"}, std::pair{T::kChange, "ptw.level"}})
+		{
+			T t = probes.trigger(kind, signal);
+			probes.match(t, {"ptw.req_va", "ptw.reg_va", "ptw.value"}, {vaddr});
+			p.triggers.push_back(t);
+		}
+	}
+	if (env_enabled("ION_TRACE_DMEM"))
+	{
+		Probe &p = probes.add("dmem-trace", {"pc", "instr", "req_v=dc.req_v", "req_r=dc.req_r",
+		                                     "req_fire=dc.req_fire", "cmd=dc.cmd", "addr=dc.addr",
+		                                     "wdata=dc.wdata", "mask=dc.mask", "owner_ptw=dc.ptw_owner",
+		                                     "pending=dc.pending", "resp_v=dc.resp_v", "resp_r=dc.resp_r",
+		                                     "resp_fire=dc.resp_fire", "resp_err=dc.resp_err", "rdata=dc.rdata",
+		                                     "lsu_req_addr=lsu.req_addr", "lsu_ptw_req_addr=ptw.mem_addr"});
+		const uint64_t addr = env_u64("ION_TRACE_DMEM_ADDR", 0);
+		probes.window(p, {"pc"}, env_u64("ION_TRACE_DMEM_PC_START", 0), env_u64("ION_TRACE_DMEM_PC_END", UINT64_MAX));
+		T req = probes.trigger(T::kNonZero, "dc.req_v");
+		probes.match(req, {"dc.addr"}, {addr});
+		T resp = probes.trigger(T::kNonZero, "dc.resp_v");
+		probes.match(resp, {"dc.addr", "lsu.req_addr", "ptw.mem_addr"}, {addr});
+		p.triggers.push_back(req);
+		p.triggers.push_back(resp);
+	}
+#endif
+	if (env_enabled("ION_TRACE_ATOMIC"))
+	{
+		Probe &p = probes.add("atomic-trace", {"pc", "instr", "raw=atomic.raw", "new=atomic.new",
+		                                       "pend=atomic.pend", "rd_sent=atomic.rd_sent",
+		                                       "wr_sent=atomic.wr_sent", "do_wr=atomic.do_wr",
+		                                       "resp_v=atomic.resp_v", "op=atomic.op", "atom=atomic.atom",
+		                                       "size=atomic.size", "mask=atomic.mask", "vaddr=atomic.vaddr",
+		                                       "paddr=atomic.paddr", "awdata=atomic.awdata",
+		                                       "wrdata=atomic.wrdata", "old=atomic.old", "resp=atomic.resp",
+		                                       "req_v=lsu.req_v", "req_r=lsu.req_r", "req_cmd=lsu.req_cmd",
+		                                       "req_addr=lsu.req_addr", "req_wdata=lsu.req_wdata",
+		                                       "req_mask=lsu.req_mask", "resp_in=lsu.resp_v",
+		                                       "resp_err=lsu.resp_err", "resp_data=lsu.resp_data", "rs1/a0=a0",
+		                                       "rs2/a3=a3", "s0", "s1", "s2"});
+		T t = probes.trigger(T::kNonZero, "atomic.active");
+		probes.match(t, {"atomic.vaddr", "atomic.paddr", "lsu.req_addr"}, {env_u64("ION_TRACE_ATOMIC_ADDR", 0)});
+		p.triggers.push_back(t);
+	}
+	if (opts.trace_dmi)
+	{
+		Probe &p = probes.add("dmi", {"op=dmi.op", "addr=dmi.addr", "wdata=dmi.wdata", "rdata=dmi.rdata",
+		                              "dmcontrol=dm.dmcontrol", "dmstatus=dm.dmstatus"});
+		p.triggers.push_back(probes.trigger(T::kRise, "dmi.valid"));
+	}
+	// Prints on a PC or timer change (every cycle with ION_TRACE_CPU_EVERY)
+	// inside ION_TRACE_PC_START/END.
+	if (std::getenv("ION_TRACE_CPU") != nullptr)
+	{
+		Probe &p = probes.add("trace", {"pc", "instr", "ra", "t0", "s0", "s1", "s2", "t3", "t4", "t5", "a0", "a1",
+		                                "a2", "a3", "a4", "a5", "a6", "a7", "id_v=id.v", "id_rd=id.rd",
+		                                "id_w=id.w", "id_op1=id.op1", "id_op2=id.op2", "lsu_stall=lsu.stall",
+		                                "load_valid=lsu.load_v", "load_rd=lsu.load_rd", "load=lsu.load",
+		                                "alu_v=alu.v", "alu_rd=alu.rd", "alu_w=alu.w", "alu_mem_v=alu.mem_v",
+		                                "alu_mem_op=alu.mem_op", "alu_res=alu.res", "alu_pc=alu.pc",
+		                                "alu_op1=alu.op1", "alu_op2=alu.op2", "lsu_v=lsu.v", "lsu_rd=lsu.rd",
+		                                "lsu_w=lsu.w", "lsu_res=lsu.res", "wb_rd=wb.rd", "wb_w=wb.w",
+		                                "wb_data=wb.data", "br_v=alu.br_v", "br_t=alu.br_t",
+		                                "br_red=alu.br_red", "exbp_v=alu.exbp_v", "exbp_rd=alu.exbp_rd",
+		                                "exbp_data=alu.exbp_data", "fwd_v=fwd.v", "fwd_rd=fwd.rd",
+		                                "fwd_data=fwd.data", "prev_v=prev.v", "prev_rd=prev.rd",
+		                                "prev_data=prev.data", "fq_flush=core.fq_flush",
+		                                "decode_stall=core.decode_stall", "sb_p=sb.p", "sb_rd=sb.rd",
+		                                "sb_new=sb.new", "sb_done=sb.done", "sb_inst=sb.inst",
+		                                "sb_inst_rd=sb.inst_rd", "pc_stall=pc.stall", "if_stall=if.stall",
+		                                "if_in_pc=if.in_pc", "if_state=if.state", "if_acc=if.acc",
+		                                "if_req_pc=if.req_pc", "if_req_pa=if.req_pa"});
+#ifdef ION_LINUX_PROFILE
+		probes.add_fields(p, {"if_xp=if.xp", "if_xd=if.xd", "if_xlate=if.xlate", "if_issue=if.issue",
+		                      "if_start_xlate=if.start_xlate", "if_req_v=if.req_v", "if_trap_v=if.trap_v",
+		                      "if_trap_c=if.trap_c", "if_trap_tval=if.trap_tval", "ptw_state=iptw.state",
+		                      "ptw_level=iptw.level", "ptw_req_v=iptw.req_v", "ptw_req_va=iptw.req_va",
+		                      "ptw_mem_req_v=iptw.mem_req_v", "ptw_mem_req_r=iptw.mem_req_r",
+		                      "ptw_mem_addr=iptw.mem_addr", "ptw_mem_resp_v=iptw.mem_resp_v",
+		                      "ptw_mem_resp_r=iptw.mem_resp_r", "ptw_resp_v=iptw.resp_v",
+		                      "ptw_fault=iptw.fault", "ptw_table=iptw.table", "ptw_reg_va=iptw.reg_va",
+		                      "dc_ptw_owner=dc.ptw_owner", "dc_pending=dc.pending", "dc_req_fire=dc.req_fire",
+		                      "dc_resp_fire=dc.resp_fire", "if_xlate_rdy=if.xlate_rdy",
+		                      "if_xlate_pa=if.xlate_pa"});
+#endif
+		probes.add_fields(p, {"if_pc=if.pc", "if_instr=if.instr", "if_len=if.len", "pc_step=if.pc_step",
+		                      "pc_hold=pc.hold", "bpu_taken=pc.bpu_taken", "redirect=pc.redirect",
+		                      "int_p=core.int_pending", "int_f=core.int_fire", "trap=core.trap",
+		                      "flush=core.trap", "priv=csr.priv", "satp=csr.satp", "mtvec=csr.mtvec",
+		                      "mepc=csr.mepc", "mcause=csr.mcause", "sepc=csr.sepc", "scause=csr.scause",
+		                      "mtval=csr.mtval", "mstatus=csr.mstatus", "mie=csr.mie", "plic_src1=plic.src1",
+		                      "mtip=clint.mtip", "mtime=clint.mtime", "mtimecmp=clint.mtimecmp"});
+		probes.window(p, {"pc"}, env_u64("ION_TRACE_PC_START", 0), env_u64("ION_TRACE_PC_END", UINT64_MAX));
+		if (!env_enabled("ION_TRACE_CPU_EVERY"))
+		{
+			p.triggers.push_back(probes.trigger(T::kNonZero, "sim.startup"));
+			p.triggers.push_back(probes.trigger(T::kChange, "pc"));
+			p.triggers.push_back(probes.trigger(T::kChange, "clint.mtip"));
+			p.triggers.push_back(probes.trigger(T::kChange, "clint.mtimecmp"));
+		}
+	}
+	return probes.ok() && probes.parse(env_string("ION_PROBES"));
+}
+
+// Points a forked child's stdout/stderr at its own log and detaches stdin.
+static void redirect_child_output(const std::string &log_path)
+{
+	int fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0)
+	{
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+	}
+	int devnull = open("/dev/null", O_RDONLY);
+	if (devnull >= 0)
+	{
+		dup2(devnull, STDIN_FILENO);
+		close(devnull);
+	}
+}
+
+// One booted model, many payload tails. The parent stops at the handoff from
+// SBI firmware to the S-mode payload, before the first payload fetch, and
+// forks a child per variant; each child overwrites the payload (and optionally
+// the DTB) in its copy-on-write SRAM and simulates on. Manifest lines are
+// `name payload.elf|- dtb|- expected uart text`; `-` keeps the booted image.
+struct ForkVariant
+{
+	std::string name;
+	std::string elf_path;
+	std::string dtb_path;
+	std::string expected_uart;
+};
+
+class ForkFanout
+{
+  public:
+	bool load(const std::string &path)
+	{
+		FILE *f = fopen(path.c_str(), "r");
+		if (!f)
+		{
+			perror("fork manifest fopen");
+			return false;
+		}
+		char line[1024];
+		unsigned lineno = 0;
+		while (fgets(line, sizeof(line), f) != nullptr)
+		{
+			++lineno;
+			line[strcspn(line, "\r\n")] = '\0';
+			char name[256], elf[512], dtb[512];
+			int used = 0;
+			if (line[0] == '#' || sscanf(line, " %255s", name) != 1)
+				continue;
+			if (sscanf(line, " %255s %511s %511s %n", name, elf, dtb, &used) != 3)
+			{
+				fprintf(stderr, "%s:%u: expected `name elf|- dtb|- [expected uart]`\n", path.c_str(), lineno);
+				fclose(f);
+				return false;
+			}
+			ForkVariant v;
+			v.name = name;
+			v.elf_path = strcmp(elf, "-") == 0 ? "" : elf;
+			v.dtb_path = strcmp(dtb, "-") == 0 ? "" : dtb;
+			v.expected_uart = line + used;
+			variants_.push_back(v);
+		}
+		fclose(f);
+		if (variants_.empty())
+			fprintf(stderr, "fork manifest %s has no entries\n", path.c_str());
+		return !variants_.empty();
+	}
+
+	// Returns the variant index in a child process. The parent returns -1
+	// once every child has been reaped.
+	int spawn(const std::string &dir, unsigned jobs, uint64_t uart_prefix_len)
+	{
+		std::filesystem::create_directories(dir);
+		dir_ = dir;
+		uart_prefix_len_ = uart_prefix_len;
+		if (jobs == 0)
+			jobs = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+		printf("\n[fork]: forking %zu variants at cycle %" PRIu64 " (jobs=%u, logs in %s)\n",
+		       variants_.size(), sim_time, jobs, dir.c_str());
+		fflush(stdout);
+		fflush(stderr);
+
+		status_.assign(variants_.size(), -1);
+		std::vector<pid_t> pids(variants_.size(), -1);
+		size_t next = 0;
+		unsigned running = 0;
+		while (next < variants_.size() || running > 0)
+		{
+			if (next < variants_.size() && running < jobs)
+			{
+				pid_t pid = fork();
+				if (pid == 0)
+				{
+					enter_child(next);
+					return (int)next;
+				}
+				if (pid < 0)
+				{
+					perror("fork");
+					++next;
+					continue;
+				}
+				pids[next++] = pid;
+				++running;
+				continue;
+			}
+			int status = 0;
+			pid_t done = waitpid(-1, &status, 0);
+			if (done < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				perror("waitpid");
+				break;
+			}
+			for (size_t i = 0; i < pids.size(); ++i)
+			{
+				if (pids[i] == done)
+				{
+					status_[i] = status;
+					--running;
+				}
+			}
+		}
+		return -1;
+	}
+
+	const ForkVariant &variant(int index) const { return variants_[(size_t)index]; }
+
+	// Child side: save the UART output past the shared boot prefix for the
+	// parent and leave without returning into main's test loop.
+	[[noreturn]] void finish_child(int index, UartStdio &uart, bool pass)
+	{
+		uart.pause_console();
+		FILE *f = fopen(uart_path((size_t)index).c_str(), "wb");
+		if (f)
+		{
+			std::string tail = uart.since(uart_prefix_len_);
+			fwrite(tail.data(), 1, tail.size(), f);
+			fclose(f);
+		}
+		fflush(stdout);
+		fflush(stderr);
+		_exit(pass ? 0 : 1);
+	}
+
+	bool report() const
+	{
+		bool all_pass = true;
+		printf("\n--- fork results ---\n");
+		for (size_t i = 0; i < variants_.size(); ++i)
+		{
+			int st = status_[i];
+			bool pass = st >= 0 && WIFEXITED(st) && WEXITSTATUS(st) == 0;
+			all_pass &= pass;
+			std::string uart;
+			FILE *f = fopen(uart_path(i).c_str(), "rb");
+			if (f)
+			{
+				char buf[4096];
+				size_t n;
+				while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+					uart.append(buf, n);
+				fclose(f);
+			}
+			// Children only record what follows the shared boot prefix.
+			std::string tail = uart;
+			if (tail.size() > 4096)
+				tail = "..." + tail.substr(tail.size() - 4096);
+			if (st < 0)
+				printf("[fork %s]: %snot run%s\n", variants_[i].name.c_str(), YELLOW, CEND);
+			else if (WIFSIGNALED(st))
+				printf("[fork %s]: %skilled by signal %d%s log=%s\n", variants_[i].name.c_str(), RED, WTERMSIG(st), CEND,
+				       log_path(i).c_str());
+			else
+				printf("[fork %s]: %s%s%s log=%s\n", variants_[i].name.c_str(), pass ? GREEN : RED,
+				       pass ? "passed" : "failed", CEND, log_path(i).c_str());
+			if (!tail.empty())
+				printf("%s\n", tail.c_str());
+		}
+		printf("[fork]: %s%s%s\n", all_pass ? GREEN : RED, all_pass ? "all variants passed" : "some variants failed", CEND);
+		return all_pass;
+	}
+
+  private:
+	void enter_child(size_t index) { redirect_child_output(log_path(index)); }
+
+	std::string log_path(size_t index) const { return dir_ + "/" + variants_[index].name + ".log"; }
+	std::string uart_path(size_t index) const { return dir_ + "/" + variants_[index].name + ".uart"; }
+
+	std::vector<ForkVariant> variants_;
+	std::vector<int> status_;
+	std::string dir_;
+	uint64_t uart_prefix_len_ = 0;
+};
+
+// ION_TRACE_WAVE windows. Without ION_WAVE_START the whole run is dumped, as
+// before. Otherwise dumping starts when a start trigger fires and stops on a
+// stop trigger or after ION_WAVE_LENGTH sim_time units; at most
+// ION_WAVE_WINDOWS windows are dumped. Triggers are `;`-separated, any one
+// fires:
+//   cycle=N      sim_time has reached N
+//   pc=ADDR      an instruction at ADDR retires
+//   uart=TEXT    the UART output ends with TEXT
+//   trap[=CAUSE] a trap (of that cause) is taken
+// The file is opened at the first dump, so a forked replay (WaveRewind)
+// starts its own trace threads.
+struct WaveTrigger
+{
+	enum Kind : uint8_t
+	{
+		kCycle,
+		kPc,
+		kUart,
+		kTrap,
+	};
+
+	Kind kind = kCycle;
+	uint64_t value = 0; // cycle, pc or cause; UINT64_MAX: any trap
+	std::string text;
+};
+
+class WaveCapture
+{
+  public:
+	bool configure(const SimOptions &opts)
+	{
+#if VM_TRACE
+		enabled_ = opts.trace_wave;
+#endif
+		path_ = opts.wave_path.empty() ? kWavePath : opts.wave_path;
+		length_ = opts.wave_length;
+		windows_left_ = opts.wave_windows;
+		pre_ = opts.wave_pre;
+		if (!parse(opts.wave_start, &start_) || !parse(opts.wave_stop, &stop_))
+			return false;
+		// History before a cycle trigger only needs an earlier start.
+		bool cycles_only = !start_.empty();
+		for (const WaveTrigger &t : start_)
+			cycles_only &= t.kind == WaveTrigger::kCycle;
+		if (cycles_only && pre_ != 0)
+		{
+			for (WaveTrigger &t : start_)
+				t.value = t.value > pre_ ? t.value - pre_ : 0;
+			if (length_ != 0)
+				length_ += pre_;
+			pre_ = 0;
+		}
+		active_ = enabled_ && start_.empty();
+		return true;
+	}
+
+	bool enabled() const { return enabled_; }
+	bool windowed() const { return enabled_ && !start_.empty(); }
+	bool dumping() const { return active_; }
+	// Still waiting for a start trigger.
+	bool waiting() const { return windowed() && !active_ && windows_left_ != 0; }
+	// History WaveRewind has to provide; 0 when no replay is needed.
+	uint64_t rewind_depth() const { return windowed() ? pre_ : 0; }
+
+	void attach(VerilatedContext *contextp, VSoc *dut, WaveFile *tfp)
+	{
+		contextp->traceEverOn(true);
+		dut_ = dut;
+		tfp_ = tfp;
+	}
+
+	void dump(uint64_t t)
+	{
+#if VM_TRACE
+		if (!open_)
+		{
+			dut_->trace(tfp_, 99);
+			tfp_->open(path_.c_str());
+			open_ = true;
+		}
+		tfp_->dump(t);
+#else
+		(void)t;
+#endif
+	}
+
+	void close()
+	{
+#if VM_TRACE
+		if (open_)
+			tfp_->close();
+		open_ = false;
+#endif
+	}
+
+	// Rising edge. True when a start trigger opened a window.
+	bool step(VSoc *dut, uint64_t cycle, bool uart_tx, const std::string &uart_out)
+	{
+		if (!active_)
+		{
+			if (windows_left_ == 0 || !fires(start_, dut, cycle, uart_tx, uart_out))
+				return false;
+			active_ = true;
+			started_at_ = cycle;
+			--windows_left_;
+			printf("[wave]: window opened at sim_time=%" PRIu64 " (%s)\n", cycle, path_.c_str());
+			return true;
+		}
+		if (cycle <= hold_until_)
+			return false;
+		if ((length_ != 0 && cycle >= started_at_ + length_) || fires(stop_, dut, cycle, uart_tx, uart_out))
+		{
+			active_ = false;
+			printf("[wave]: window closed at sim_time=%" PRIu64 "\n", cycle);
+		}
+		return false;
+	}
+
+	// In a WaveRewind replay: dump from here on, with the window counted
+	// from the trigger the original process saw at `trigger_cycle`.
+	void replay_to(uint64_t trigger_cycle)
+	{
+		active_ = true;
+		started_at_ = trigger_cycle;
+		hold_until_ = trigger_cycle;
+		--windows_left_;
+	}
+
+  private:
+	static bool parse(const std::string &spec, std::vector<WaveTrigger> *out)
+	{
+		size_t start = 0;
+		while (start < spec.size())
+		{
+			size_t end = spec.find(';', start);
+			if (end == std::string::npos)
+				end = spec.size();
+			std::string item = spec.substr(start, end - start);
+			start = end + 1;
+			if (item.empty())
+				continue;
+			size_t eq = item.find('=');
+			std::string key = item.substr(0, eq);
+			std::string value = eq == std::string::npos ? "" : item.substr(eq + 1);
+			WaveTrigger t;
+			if (key == "cycle" && !value.empty())
+				t.kind = WaveTrigger::kCycle;
+			else if (key == "pc" && !value.empty())
+				t.kind = WaveTrigger::kPc;
+			else if (key == "uart" && !value.empty())
+				t.kind = WaveTrigger::kUart;
+			else if (key == "trap")
+				t.kind = WaveTrigger::kTrap;
+			else
+			{
+				fprintf(stderr, "[wave]: bad trigger \"%s\"\n", item.c_str());
+				return false;
+			}
+			if (t.kind == WaveTrigger::kUart)
+				t.text = value;
+			else
+				t.value = value.empty() ? UINT64_MAX : strtoull(value.c_str(), nullptr, 0);
+			out->push_back(t);
+		}
+		return true;
+	}
+
+	static bool fires(const std::vector<WaveTrigger> &triggers, VSoc *dut, uint64_t cycle, bool uart_tx,
+	                  const std::string &uart_out)
+	{
+		for (const WaveTrigger &t : triggers)
+		{
+			switch (t.kind)
+			{
+			case WaveTrigger::kCycle:
+				if (cycle >= t.value)
+					return true;
+				break;
+			case WaveTrigger::kPc:
+				if (dut->io_debug_retire && dut->io_debug_commitPc == t.value)
+					return true;
+				break;
+			case WaveTrigger::kUart:
+				if (uart_tx && uart_out.size() >= t.text.size() &&
+				    uart_out.compare(uart_out.size() - t.text.size(), t.text.size(), t.text) == 0)
+					return true;
+				break;
+			case WaveTrigger::kTrap:
+				if (dut->io_debug_arch_event_valid &&
+				    (t.value == UINT64_MAX || (dut->io_debug_arch_event_cause & ~(1ull << 63)) == t.value))
+					return true;
+				break;
+			}
+		}
+		return false;
+	}
+
+	bool enabled_ = false;
+	bool active_ = false;
+	bool open_ = false;
+	std::string path_;
+	std::vector<WaveTrigger> start_;
+	std::vector<WaveTrigger> stop_;
+	uint64_t length_ = 0;
+	uint64_t windows_left_ = 1;
+	uint64_t pre_ = 0;
+	uint64_t started_at_ = 0;
+	uint64_t hold_until_ = 0;
+	VSoc *dut_ = nullptr;
+	WaveFile *tfp_ = nullptr;
+};
+
+// ION_WAVE_PRE history before a start trigger that is not a cycle. While the
+// run waits for the trigger it forks a stopped copy of itself every `depth`
+// sim_time units and keeps the last two. When the trigger fires, the copy
+// taken at least `depth` earlier wakes up, replays from its snapshot with the
+// waveform on and carries the run on; the original waits for it and exits
+// with its status. The copies share memory copy-on-write.
+class WaveRewind
+{
+  public:
+	explicit WaveRewind(uint64_t depth) : depth_(depth) {}
+	~WaveRewind() { discard(); }
+
+	bool enabled() const { return depth_ != 0; }
+	bool due(uint64_t cycle) const { return depth_ != 0 && cycle >= next_; }
+
+	// False in the original process. A copy returns true once woken, with
+	// the trigger cycle and the UART byte count the original had reached.
+	bool snapshot(uint64_t cycle, UartStdio &uart, uint64_t *trigger_cycle, uint64_t *uart_total)
+	{
+		next_ = cycle + depth_;
+		if (snaps_.size() == 2)
+		{
+			release(snaps_.front());
+			snaps_.erase(snaps_.begin());
+		}
+		int fds[2];
+		if (pipe(fds) != 0)
+		{
+			perror("pipe");
+			return false;
+		}
+		// The console flusher thread does not survive fork().
+		uart.pause_console();
+		fflush(nullptr);
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			close(fds[1]);
+			for (const Snapshot &s : snaps_)
+				close(s.fd);
+			snaps_.clear();
+			uint64_t msg[2];
+			size_t got = 0;
+			while (got < sizeof(msg))
+			{
+				ssize_t n = read(fds[0], (char *)msg + got, sizeof(msg) - got);
+				if (n < 0 && errno == EINTR)
+					continue;
+				if (n <= 0)
+					_exit(0); // discarded, or the original is gone
+				got += (size_t)n;
+			}
+			close(fds[0]);
+			*trigger_cycle = msg[0];
+			*uart_total = msg[1];
+			depth_ = 0;
+			uart.resume_console();
+			return true;
+		}
+		uart.resume_console();
+		close(fds[0]);
+		if (pid < 0)
+		{
+			perror("fork");
+			close(fds[1]);
+			return false;
+		}
+		snaps_.push_back({pid, fds[1], cycle});
+		return false;
+	}
+
+	// Original process at the start trigger: wakes the snapshot and exits
+	// with its status. Returns false when there is none.
+	bool hand_over(uint64_t cycle, UartStdio &uart)
+	{
+		if (snaps_.empty())
+			return false;
+		size_t pick = 0;
+		for (size_t i = 0; i < snaps_.size(); ++i)
+		{
+			if (snaps_[i].cycle + depth_ <= cycle)
+				pick = i;
+		}
+		Snapshot s = snaps_[pick];
+		snaps_.erase(snaps_.begin() + (long)pick);
+		discard();
+		printf("[wave]: trigger at sim_time=%" PRIu64 "; replaying from the snapshot at %" PRIu64 " (pid %d)\n",
+		       cycle, s.cycle, (int)s.pid);
+		uart.pause_console();
+		fflush(nullptr);
+		uint64_t msg[2] = {cycle, uart.total()};
+		if (write(s.fd, msg, sizeof(msg)) != (ssize_t)sizeof(msg))
+			perror("wave snapshot wake-up");
+		close(s.fd);
+		int status = 0;
+		while (waitpid(s.pid, &status, 0) < 0 && errno == EINTR)
+		{
+		}
+		_exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+	}
+
+	void discard()
+	{
+		for (const Snapshot &s : snaps_)
+			release(s);
+		snaps_.clear();
+	}
+
+  private:
+	struct Snapshot
+	{
+		pid_t pid;
+		int fd;
+		uint64_t cycle;
+	};
+
+	// Closing the pipe lets the copy exit on its own.
+	static void release(const Snapshot &s)
+	{
+		close(s.fd);
+		while (waitpid(s.pid, nullptr, 0) < 0 && errno == EINTR)
+		{
+		}
+	}
+
+	uint64_t depth_ = 0;
+	uint64_t next_ = 0;
+	std::vector<Snapshot> snaps_;
+};
+
+#if ION_SPARSE_SRAM
+// SoCFeatures.sparseSram: TLRAM's TLRAMSparseBackend calls the DPI-C hooks
+// below instead of owning a Verilated array. Each model gets its own store of
+// 4 KiB pages allocated on first write; pages never written read as zero, so
+// a Linux-profile model costs host memory only for what the run touched. The
+// harness loaders write through the same store.
+class SparseSram
+{
+  public:
+	static const size_t kPage = 4096;
+
+	explicit SparseSram(size_t capacity) : capacity_(capacity), pages_((capacity + kPage - 1) / kPage) {}
+
+	size_t capacity() const { return capacity_; }
+	size_t page_count() const { return pages_.size(); }
+	size_t resident_pages() const { return resident_; }
+
+	// nullptr for a page that was never written.
+	const uint8_t *peek(size_t page) const { return pages_[page].get(); }
+
+	uint8_t *touch(size_t page)
+	{
+		std::unique_ptr<uint8_t[]> &p = pages_[page];
+		if (!p)
+		{
+			p.reset(new uint8_t[kPage]());
+			++resident_;
+		}
+		return p.get();
+	}
+
+	// src == nullptr writes zeros, leaving untouched pages unallocated.
+	void write(uint64_t offset, const uint8_t *src, size_t len)
+	{
+		while (len != 0)
+		{
+			const size_t page = offset / kPage;
+			const size_t in_page = offset % kPage;
+			const size_t n = std::min(len, kPage - in_page);
+			if (src != nullptr)
+			{
+				memcpy(touch(page) + in_page, src, n);
+				src += n;
+			}
+			else if (pages_[page])
+				memset(pages_[page].get() + in_page, 0, n);
+			offset += n;
+			len -= n;
+		}
+	}
+
+	uint64_t read_beat(uint64_t index) const
+	{
+		const uint64_t offset = index * 8;
+		uint64_t value = 0;
+		if (offset < capacity_ && pages_[offset / kPage])
+			memcpy(&value, pages_[offset / kPage].get() + offset % kPage, sizeof(value));
+		return value;
+	}
+
+	void write_beat(uint64_t index, uint64_t data, uint8_t mask)
+	{
+		const uint64_t offset = index * 8;
+		if (offset >= capacity_ || mask == 0)
+			return;
+		uint8_t *p = touch(offset / kPage) + offset % kPage;
+		if (mask == 0xff)
+		{
+			memcpy(p, &data, sizeof(data));
+			return;
+		}
+		for (int i = 0; i < 8; ++i)
+			if ((mask >> i) & 1)
+				p[i] = (uint8_t)(data >> (8 * i));
+	}
+
+	void clear()
+	{
+		for (auto &p : pages_)
+			p.reset();
+		resident_ = 0;
+	}
+
+  private:
+	size_t capacity_;
+	std::vector<std::unique_ptr<uint8_t[]>> pages_;
+	size_t resident_ = 0;
+};
+
+// The store of the model this thread is simulating; defined with ModelCache.
+static SparseSram *model_sram();
+
+// ion_sram_attach runs from the backend's initial block during the model's
+// first eval(). The new store is bound to the backend's scope for the per-beat
+// hooks (which may run on Verilator worker threads) and parked here until
+// ModelCache adopts it.
+thread_local std::unique_ptr<SparseSram> attached_sram;
+static int sparse_sram_key;
+
+extern "C" void ion_sram_attach(long long size_bytes)
+{
+	attached_sram.reset(new SparseSram((size_t)size_bytes));
+	svPutUserData(svGetScope(), &sparse_sram_key, attached_sram.get());
+}
+
+extern "C" long long ion_sram_read(long long index)
+{
+	auto *sram = (SparseSram *)svGetUserData(svGetScope(), &sparse_sram_key);
+	return (long long)sram->read_beat((uint64_t)index);
+}
+
+extern "C" void ion_sram_write(long long index, long long data, char mask)
+{
+	auto *sram = (SparseSram *)svGetUserData(svGetScope(), &sparse_sram_key);
+	sram->write_beat((uint64_t)index, (uint64_t)data, (uint8_t)mask);
+}
+#endif
+
+#if ION_SIM_SAVABLE
+// Checkpoint files wrap Verilator's --savable stream in a small record format:
+// all-zero 4 KiB runs (untouched SRAM) are stored as a length only and the
+// rest is deflated one serializer buffer at a time, so a mostly empty 128 MiB
+// Linux-profile SRAM costs a few hundred KiB on disk.
+static const char kCheckpointMagic[8] = {'I', 'O', 'N', 'C', 'K', 'P', 'T', '1'};
+static const size_t kCheckpointPage = 4096;
+enum : uint8_t
+{
+	kCheckpointZeroRun = 0,
+	kCheckpointDeflate = 1,
+	kCheckpointEnd = 2,
+};
+
+static bool all_zero(const uint8_t *p, size_t len)
+{
+	return len == 0 || (p[0] == 0 && memcmp(p, p + 1, len - 1) == 0);
+}
+
+class CheckpointWriter : public VerilatedSerialize
+{
+  public:
+	~CheckpointWriter() override { close(); }
+
+	bool open(const std::string &path)
+	{
+		file_ = fopen(path.c_str(), "wb");
+		if (!file_)
+		{
+			perror("checkpoint fopen");
+			return false;
+		}
+		m_filename = path;
+		m_isOpen = true;
+		fwrite(kCheckpointMagic, 1, sizeof(kCheckpointMagic), file_);
+		header();
+		return true;
+	}
+
+	void close() override
+	{
+		if (!isOpen())
+			return;
+		trailer();
+		flush();
+		emit_zero_run();
+		uint8_t kind = kCheckpointEnd;
+		fwrite(&kind, 1, 1, file_);
+		ok_ = ok_ && !ferror(file_);
+		fclose(file_);
+		file_ = nullptr;
+		m_isOpen = false;
+	}
+
+	void flush() override
+	{
+		const uint8_t *p = m_bufp;
+		const uint8_t *end = m_cp;
+		while (p < end)
+		{
+			if (end - p >= (ptrdiff_t)kCheckpointPage && all_zero(p, kCheckpointPage))
+			{
+				pending_zero_ += kCheckpointPage;
+				p += kCheckpointPage;
+				continue;
+			}
+			const uint8_t *q = p + std::min(kCheckpointPage, (size_t)(end - p));
+			while (q < end && !(end - q >= (ptrdiff_t)kCheckpointPage && all_zero(q, kCheckpointPage)))
+				q += std::min(kCheckpointPage, (size_t)(end - q));
+			emit_zero_run();
+			emit_deflate(p, (size_t)(q - p));
+			p = q;
+		}
+		m_cp = m_bufp;
+	}
+
+	bool ok() const { return ok_; }
+	uint64_t bytes_written() const { return bytes_written_; }
+
+  private:
+	void put(const void *data, size_t len)
+	{
+		ok_ = ok_ && fwrite(data, 1, len, file_) == len;
+		bytes_written_ += len;
+	}
+
+	void emit_zero_run()
+	{
+		if (pending_zero_ == 0)
+			return;
+		uint8_t kind = kCheckpointZeroRun;
+		put(&kind, 1);
+		put(&pending_zero_, sizeof(pending_zero_));
+		pending_zero_ = 0;
+	}
+
+	void emit_deflate(const uint8_t *data, size_t len)
+	{
+		uLongf comp_len = compressBound((uLong)len);
+		scratch_.resize(comp_len);
+		if (compress2(scratch_.data(), &comp_len, data, (uLong)len, Z_BEST_SPEED) != Z_OK)
+		{
+			ok_ = false;
+			return;
+		}
+		uint8_t kind = kCheckpointDeflate;
+		uint32_t raw32 = (uint32_t)len;
+		uint32_t comp32 = (uint32_t)comp_len;
+		put(&kind, 1);
+		put(&raw32, sizeof(raw32));
+		put(&comp32, sizeof(comp32));
+		put(scratch_.data(), comp_len);
+	}
+
+	FILE *file_ = nullptr;
+	bool ok_ = true;
+	uint64_t pending_zero_ = 0;
+	uint64_t bytes_written_ = sizeof(kCheckpointMagic);
+	std::vector<uint8_t> scratch_;
+};
+
+class CheckpointReader : public VerilatedDeserialize
+{
+  public:
+	~CheckpointReader() override { close(); }
+
+	bool open(const std::string &path)
+	{
+		file_ = fopen(path.c_str(), "rb");
+		if (!file_)
+		{
+			perror("checkpoint fopen");
+			return false;
+		}
+		char magic[sizeof(kCheckpointMagic)] = {};
+		if (fread(magic, 1, sizeof(magic), file_) != sizeof(magic) ||
+		    memcmp(magic, kCheckpointMagic, sizeof(magic)) != 0)
+		{
+			fprintf(stderr, "not an IonSoC checkpoint: %s\n", path.c_str());
+			fclose(file_);
+			file_ = nullptr;
+			return false;
+		}
+		m_filename = path;
+		m_isOpen = true;
+		m_cp = m_bufp;
+		m_endp = m_bufp;
+		header();
+		return true;
+	}
+
+	void close() override
+	{
+		if (!isOpen())
+			return;
+		trailer();
+		fclose(file_);
+		file_ = nullptr;
+		m_isOpen = false;
+	}
+
+	bool ok() const { return ok_; }
+
+  protected:
+	void fill() override
+	{
+		// Same contract as VerilatedRestore::fill: keep unread bytes, then top
+		// the buffer up from the decoded record stream.
+		uint8_t *rp = m_bufp;
+		for (uint8_t *sp = m_cp; sp < m_endp;)
+			*rp++ = *sp++;
+		m_endp = m_bufp + (m_endp - m_cp);
+		m_cp = m_bufp;
+		uint8_t *limit = m_bufp + bufferSize();
+		while (m_endp < limit)
+		{
+			if (zero_left_ == 0 && pending_off_ == pending_.size() && !next_record())
+				break;
+			size_t room = (size_t)(limit - m_endp);
+			if (zero_left_ != 0)
+			{
+				size_t n = (size_t)std::min<uint64_t>(room, zero_left_);
+				memset(m_endp, 0, n);
+				m_endp += n;
+				zero_left_ -= n;
+				continue;
+			}
+			size_t n = std::min(room, pending_.size() - pending_off_);
+			memcpy(m_endp, pending_.data() + pending_off_, n);
+			m_endp += n;
+			pending_off_ += n;
+		}
+	}
+
+  private:
+	bool next_record()
+	{
+		uint8_t kind = kCheckpointEnd;
+		if (fread(&kind, 1, 1, file_) != 1 || kind == kCheckpointEnd)
+			return false;
+		if (kind == kCheckpointZeroRun)
+			return fread(&zero_left_, sizeof(zero_left_), 1, file_) == 1 || fail();
+		if (kind != kCheckpointDeflate)
+			return fail();
+		uint32_t raw32 = 0;
+		uint32_t comp32 = 0;
+		if (fread(&raw32, sizeof(raw32), 1, file_) != 1 || fread(&comp32, sizeof(comp32), 1, file_) != 1)
+			return fail();
+		scratch_.resize(comp32);
+		pending_.resize(raw32);
+		pending_off_ = 0;
+		uLongf raw_len = raw32;
+		if (fread(scratch_.data(), 1, comp32, file_) != comp32 ||
+		    uncompress(pending_.data(), &raw_len, scratch_.data(), comp32) != Z_OK || raw_len != raw32)
+			return fail();
+		return true;
+	}
+
+	bool fail()
+	{
+		ok_ = false;
+		pending_.clear();
+		pending_off_ = 0;
+		zero_left_ = 0;
+		return false;
+	}
+
+	FILE *file_ = nullptr;
+	bool ok_ = true;
+	uint64_t zero_left_ = 0;
+	std::vector<uint8_t> pending_;
+	size_t pending_off_ = 0;
+	std::vector<uint8_t> scratch_;
+};
+
+static bool save_checkpoint(const std::string &path, VSoc *dut, const UartStdio &uart,
+                            const BootProgress &progress, const PerfCounters &perf)
+{
+	auto start = std::chrono::steady_clock::now();
+	CheckpointWriter os;
+	if (!os.open(path))
+		return false;
+	uint64_t cycle = sim_time;
+	os.write(&cycle, sizeof(cycle));
+	uart.save(os);
+	os.write(&progress, sizeof(progress));
+	os.write(&perf, sizeof(perf));
+	os << *dut;
+#if ION_SPARSE_SRAM
+	// The sparse SRAM lives outside the model: append its resident pages.
+	const SparseSram &sram = *model_sram();
+	uint64_t pages = sram.resident_pages();
+	os.write(&pages, sizeof(pages));
+	for (uint64_t page = 0; page < sram.page_count(); ++page)
+	{
+		if (sram.peek(page) == nullptr)
+			continue;
+		os.write(&page, sizeof(page));
+		os.write(sram.peek(page), SparseSram::kPage);
+	}
+#endif
+	os.close();
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (!os.ok())
+	{
+		fprintf(stderr, "[checkpoint]: failed to write %s\n", path.c_str());
+		return false;
+	}
+	printf("\n[checkpoint]: saved %s at cycle %" PRIu64 " (%" PRIu64 " bytes, %.2fs)\n",
+	       path.c_str(), cycle, os.bytes_written(), secs);
+	return true;
+}
+
+static bool load_checkpoint(const std::string &path, VSoc *dut, UartStdio &uart,
+                            BootProgress &progress, PerfCounters &perf)
+{
+	auto start = std::chrono::steady_clock::now();
+	CheckpointReader is;
+	if (!is.open(path))
+		return false;
+	uint64_t cycle = 0;
+	is.read(&cycle, sizeof(cycle));
+	uart.restore(is, cycle);
+	is.read(&progress, sizeof(progress));
+	is.read(&perf, sizeof(perf));
+	is >> *dut;
+#if ION_SPARSE_SRAM
+	SparseSram &sram = *model_sram();
+	sram.clear();
+	uint64_t pages = 0;
+	is.read(&pages, sizeof(pages));
+	for (uint64_t i = 0; i < pages && is.ok(); ++i)
+	{
+		uint64_t page = 0;
+		is.read(&page, sizeof(page));
+		if (page >= sram.page_count())
+		{
+			fprintf(stderr, "[checkpoint]: SRAM page %" PRIu64 " is out of range for this build\n", page);
+			return false;
+		}
+		is.read(sram.touch(page), SparseSram::kPage);
+	}
+#endif
+	is.close();
+	if (!is.ok())
+	{
+		fprintf(stderr, "[checkpoint]: corrupt checkpoint %s\n", path.c_str());
+		return false;
+	}
+	sim_time = cycle;
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("[checkpoint]: restored %s at cycle %" PRIu64 " (%.2fs)\n", path.c_str(), cycle, secs);
+	return true;
+}
+#endif
+
+// One payload of a batch run (riscv-tests sweep or --regress manifest); the
+// result fields are filled in once it has run.
+struct TestJob
+{
+	std::string name;
+	std::string path;
+	std::string expected_uart;
+	std::vector<std::string> env; // VAR=value, applied in the regress child
+	bool trace_wave = false;
+	bool pass = false;
+	SimStats stats;
+	double wall_s = 0.0;
+	std::string log_path;
+};
+
+static std::string xml_escape(const std::string &in)
+{
+	std::string out;
+	for (char c : in)
+	{
+		switch (c)
+		{
+		case '&': out += "&amp;"; break;
+		case '<': out += "&lt;"; break;
+		case '>': out += "&gt;"; break;
+		case '"': out += "&quot;"; break;
+		default: out += c; break;
+		}
+	}
+	return out;
+}
+
+static std::string json_escape(const std::string &in)
+{
+	std::string out;
+	for (char c : in)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+	return out;
+}
+
+static double job_ipc(const TestJob &j)
+{
+	return j.stats.cycles == 0 ? 0.0 : (double)j.stats.retired / (double)j.stats.cycles;
+}
+
+static void write_test_json(const std::string &path, const std::string &suite, const std::vector<TestJob> &jobs,
+                            unsigned workers, double wall_s)
+{
+	FILE *f = fopen(path.c_str(), "w");
+	if (f == nullptr)
+	{
+		perror(path.c_str());
+		return;
+	}
+	size_t passed = std::count_if(jobs.begin(), jobs.end(), [](const TestJob &j) { return j.pass; });
+	fprintf(f, "{\n  \"suite\": \"%s\",\n  \"tests\": %zu,\n  \"passed\": %zu,\n  \"failed\": %zu,\n  \"workers\": %u,\n  \"wall_s\": %.3f,\n  \"results\": [\n",
+	        json_escape(suite).c_str(), jobs.size(), passed, jobs.size() - passed, workers, wall_s);
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		const TestJob &j = jobs[i];
+		fprintf(f, "    {\"name\": \"%s\", \"elf\": \"%s\", \"pass\": %s, \"cycles\": %" PRIu64 ", \"retired\": %" PRIu64
+		           ", \"ipc\": %.4f, \"wall_s\": %.3f}%s\n",
+		        json_escape(j.name).c_str(), json_escape(j.path).c_str(), j.pass ? "true" : "false", j.stats.cycles,
+		        j.stats.retired, job_ipc(j), j.wall_s, i + 1 < jobs.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+	fclose(f);
+}
+
+static void write_test_junit(const std::string &path, const std::string &suite, const std::vector<TestJob> &jobs,
+                             double wall_s)
+{
+	FILE *f = fopen(path.c_str(), "w");
+	if (f == nullptr)
+	{
+		perror(path.c_str());
+		return;
+	}
+	size_t failed = std::count_if(jobs.begin(), jobs.end(), [](const TestJob &j) { return !j.pass; });
+	std::string suite_xml = xml_escape(suite);
+	fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(f, "<testsuite name=\"%s\" tests=\"%zu\" failures=\"%zu\" time=\"%.3f\">\n", suite_xml.c_str(), jobs.size(),
+	        failed, wall_s);
+	for (const TestJob &j : jobs)
+	{
+		fprintf(f, "  <testcase classname=\"%s\" name=\"%s\" time=\"%.3f\">\n", suite_xml.c_str(), xml_escape(j.name).c_str(),
+		        j.wall_s);
+		fprintf(f, "    <properties><property name=\"cycles\" value=\"%" PRIu64 "\"/><property name=\"retired\" value=\"%" PRIu64
+		           "\"/></properties>\n",
+		        j.stats.cycles, j.stats.retired);
+		if (!j.pass)
+			fprintf(f, "    <failure message=\"%s failed after %" PRIu64 " cycles\"/>\n", xml_escape(j.name).c_str(),
+			        j.stats.cycles);
+		fprintf(f, "  </testcase>\n");
+	}
+	fprintf(f, "</testsuite>\n");
+	fclose(f);
+}
+
+// Prints the per-payload table and writes the ION_TEST_JSON / ION_TEST_JUNIT
+// reports. Returns true when every job passed.
+static bool report_test_jobs(const std::string &suite, const std::vector<TestJob> &jobs, unsigned workers, double wall_s)
+{
+	size_t passed = 0;
+	printf("\n--- %s summary ---\n", suite.c_str());
+	for (const TestJob &j : jobs)
+	{
+		passed += j.pass ? 1 : 0;
+		printf("[%s]: %s%s%s cycles=%" PRIu64 " retired=%" PRIu64 " ipc=%.4f wall_s=%.3f%s%s\n", j.name.c_str(),
+		       j.pass ? GREEN : RED, j.pass ? "passed" : "failed", CEND, j.stats.cycles, j.stats.retired, job_ipc(j),
+		       j.wall_s, j.log_path.empty() ? "" : " log=", j.log_path.c_str());
+	}
+	printf("[%s]: %zu/%zu passed, workers=%u wall_s=%.3f\n", suite.c_str(), passed, jobs.size(), workers, wall_s);
+
+	std::string json_path = env_string("ION_TEST_JSON");
+	if (!json_path.empty())
+		write_test_json(json_path, suite, jobs, workers, wall_s);
+	std::string junit_path = env_string("ION_TEST_JUNIT");
+	if (!junit_path.empty())
+		write_test_junit(junit_path, suite, jobs, wall_s);
+	return passed == jobs.size();
+}
+
+// Batch workers share the host; these options would collide between them.
+static unsigned batch_workers(const char *jobs_env, size_t job_count)
+{
+	unsigned workers = (unsigned)env_u64(jobs_env, std::thread::hardware_concurrency());
+	const char *serial_reason = env_enabled("ION_TRACE_WAVE") ? "ION_TRACE_WAVE" :
+	                            env_u64("ION_JTAG_RBB_PORT", 0) != 0 ? "ION_JTAG_RBB_PORT" :
+	                            env_enabled("ION_UART_STDIN") ? "ION_UART_STDIN" :
+	                            !env_string("ION_CHECKPOINT_SAVE").empty() ? "ION_CHECKPOINT_SAVE" :
+	                            !env_string("ION_COMMIT_TRACE").empty() ? "ION_COMMIT_TRACE" :
+	                            !env_string("ION_UART_LOG").empty() ? "ION_UART_LOG" :
+	                            !env_string("ION_FORK_MANIFEST").empty() ? "ION_FORK_MANIFEST" : nullptr;
+	if (serial_reason != nullptr && workers > 1)
+	{
+		printf("[batch]: %s is set; running payloads one at a time\n", serial_reason);
+		workers = 1;
+	}
+	return std::max(1u, std::min(workers, (unsigned)job_count));
+}
+
+// Runs riscv-tests ELFs on ION_TEST_JOBS worker threads (default: one per
+// host CPU). Every run_sim builds its own VerilatedContext and model and
+// sim_time is thread-local; besides the queue index the workers share only
+// the process stdout, which each run's ConsoleSink writes through without
+// replacing. Console output of concurrent tests interleaves; the summary at
+// the end, and the ION_TEST_JSON / ION_TEST_JUNIT reports, are the
+// authoritative result.
+static bool run_test_pool(std::vector<TestJob> &jobs)
+{
+	unsigned workers = batch_workers("ION_TEST_JOBS", jobs.size());
+	const auto wall_start = std::chrono::steady_clock::now();
+	std::atomic<size_t> next{0};
+	auto worker = [&]()
+	{
+		for (size_t i = next.fetch_add(1); i < jobs.size(); i = next.fetch_add(1))
+		{
+			TestJob &job = jobs[i];
+			const auto start = std::chrono::steady_clock::now();
+			job.pass = run_one_test(job.path, job.name, job.trace_wave, "", &job.stats);
+			job.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+	};
+	if (workers == 1)
+		worker();
+	else
+	{
+		std::vector<std::thread> pool;
+		for (unsigned i = 0; i < workers; ++i)
+			pool.emplace_back(worker);
+		for (auto &t : pool)
+			t.join();
+	}
+	double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+	return report_test_jobs("riscv-tests", jobs, workers, wall_s);
+}
+
+// Regress manifest lines: `[VAR=value ...] name payload.elf [expected uart]`.
+// The leading assignments are exported only to that payload's process.
+static bool load_regress_manifest(const std::string &path, std::vector<TestJob> &jobs)
+{
+	FILE *f = fopen(path.c_str(), "r");
+	if (!f)
+	{
+		perror("regress manifest fopen");
+		return false;
+	}
+	char line[1024];
+	unsigned lineno = 0;
+	while (fgets(line, sizeof(line), f) != nullptr)
+	{
+		++lineno;
+		line[strcspn(line, "\r\n")] = '\0';
+		const char *p = line + strspn(line, " \t");
+		if (*p == '#' || *p == '\0')
+			continue;
+		TestJob job;
+		std::vector<std::string> words;
+		while (*p != '\0' && words.size() < 2)
+		{
+			size_t len = strcspn(p, " \t");
+			std::string word(p, len);
+			p += len;
+			p += strspn(p, " \t");
+			if (words.empty() && word.find('=') != std::string::npos)
+				job.env.push_back(word);
+			else
+				words.push_back(word);
+		}
+		if (words.size() != 2)
+		{
+			fprintf(stderr, "%s:%u: expected `[VAR=value ...] name payload.elf [expected uart]`\n", path.c_str(), lineno);
+			fclose(f);
+			return false;
+		}
+		job.name = words[0];
+		job.path = words[1];
+		job.expected_uart = p;
+		jobs.push_back(job);
+	}
+	fclose(f);
+	if (jobs.empty())
+		fprintf(stderr, "regress manifest %s has no entries\n", path.c_str());
+	return !jobs.empty();
+}
+
+// Runs every manifest entry in its own child process, at most ION_REGRESS_JOBS
+// (default: host CPU count) at a time. Processes rather than threads because
+// entries carry their own ION_* environment. Each child logs to
+// ION_REGRESS_DIR/<name>.log and sends its SimStats back over a pipe.
+static bool run_regress(const std::string &manifest)
+{
+	std::vector<TestJob> jobs;
+	if (!load_regress_manifest(manifest, jobs))
+		return false;
+	unsigned workers = batch_workers("ION_REGRESS_JOBS", jobs.size());
+	std::string dir = std::getenv("ION_REGRESS_DIR") != nullptr ? env_string("ION_REGRESS_DIR") : "simulator/build/regress";
+	std::filesystem::create_directories(dir);
+	printf("[regress]: %zu payloads from %s (jobs=%u, logs in %s)\n", jobs.size(), manifest.c_str(), workers, dir.c_str());
+	fflush(stdout);
+	fflush(stderr);
+
+	struct Running
+	{
+		size_t index;
+		int fd;
+		std::chrono::steady_clock::time_point start;
+	};
+	std::vector<std::pair<pid_t, Running>> running;
+	const auto wall_start = std::chrono::steady_clock::now();
+	size_t next = 0;
+	while (next < jobs.size() || !running.empty())
+	{
+		if (next < jobs.size() && running.size() < workers)
+		{
+			TestJob &job = jobs[next];
+			job.log_path = dir + "/" + job.name + ".log";
+			int fds[2];
+			if (pipe(fds) != 0)
+			{
+				perror("pipe");
+				++next;
+				continue;
+			}
+			pid_t pid = fork();
+			if (pid == 0)
+			{
+				close(fds[0]);
+				redirect_child_output(job.log_path);
+				for (const std::string &kv : job.env)
+				{
+					size_t eq = kv.find('=');
+					setenv(kv.substr(0, eq).c_str(), kv.substr(eq + 1).c_str(), 1);
+				}
+				SimStats stats;
+				bool pass = run_one_test(job.path, job.name, env_enabled("ION_TRACE_WAVE"), job.expected_uart, &stats);
+				ssize_t n = write(fds[1], &stats, sizeof(stats));
+				(void)n;
+				fflush(stdout);
+				fflush(stderr);
+				_exit(pass ? 0 : 1);
+			}
+			close(fds[1]);
+			if (pid < 0)
+			{
+				perror("fork");
+				close(fds[0]);
+				++next;
+				continue;
+			}
+			running.push_back({pid, Running{next++, fds[0], std::chrono::steady_clock::now()}});
+			continue;
+		}
+		int status = 0;
+		pid_t done = waitpid(-1, &status, 0);
+		if (done < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("waitpid");
+			break;
+		}
+		for (size_t i = 0; i < running.size(); ++i)
+		{
+			if (running[i].first != done)
+				continue;
+			const Running &r = running[i].second;
+			TestJob &job = jobs[r.index];
+			job.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - r.start).count();
+			job.pass = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+			if (read(r.fd, &job.stats, sizeof(job.stats)) != (ssize_t)sizeof(job.stats))
+				job.stats = SimStats();
+			close(r.fd);
+			printf("[regress]: %s %s%s%s\n", job.name.c_str(), job.pass ? GREEN : RED, job.pass ? "passed" : "failed", CEND);
+			fflush(stdout);
+			running.erase(running.begin() + (long)i);
+			break;
+		}
+	}
+	double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+	std::string suite = std::filesystem::path(manifest).stem().string();
+	return report_test_jobs(suite, jobs, workers, wall_s);
+}
+
+int main(int argc, char **argv, char **env)
+{
+	(void)env;
+	Verilated::commandArgs(argc, argv);
+	sim_argc = argc;
+	sim_argv = argv;
+	signal(SIGUSR1, request_flight_dump);
+	printf("\n\n");
+	bool all_pass = true;
+	if (env_enabled("ION_JTAG_ONLY"))
+	{
+		SimOptions opts;
+		opts.test_name = "jtag";
+		opts.trace_wave = env_enabled("ION_TRACE_WAVE");
+		opts.direct_elf_load = !env_enabled("ION_BOOTROM_ONLY");
+		opts.uart_stdin = env_enabled("ION_UART_STDIN");
+		opts.trace_irq = env_enabled("ION_TRACE_IRQ");
+		opts.trace_dmi = env_enabled("ION_TRACE_DMI");
+		opts.perf_report = env_enabled("ION_PERF");
+		opts.jtag_only = true;
+		opts.jtag_rbb_port = (int)env_u64("ION_JTAG_RBB_PORT", 0);
+		opts.max_cycles = env_u64("ION_MAX_CYCLES", 0);
+		const char *flash = std::getenv("ION_FLASH_IMAGE");
+		if (flash != nullptr)
+			opts.flash_image = flash;
+		return run_sim(opts) ? 0 : 1;
+	}
+	else if (argc < 2)
+	{
+		// 默认测试 payload (假设无后缀)
+		all_pass &= run_one_test(kPayloadElfPath, "payload", env_enabled("ION_TRACE_WAVE"), "S!!P");
+	}
+	else if (std::string(argv[1]) == "--payload")
+	{
+		std::string name = (argc > 2) ? argv[2] : "payload";
+		std::string expected_uart = (argc > 3) ? argv[3] : "";
+		std::string elf_path = (argc > 4) ? argv[4] : kPayloadElfPath;
+		all_pass &= run_one_test(elf_path, name, env_enabled("ION_TRACE_WAVE"), expected_uart);
+	}
+	else if (std::string(argv[1]) == "--regress")
+	{
+		if (argc < 3)
+		{
+			fprintf(stderr, "usage: %s --regress <manifest>\n", argv[0]);
+			return 1;
+		}
+		all_pass &= run_regress(argv[2]);
+	}
+	else if (std::string(argv[1]) == "--payload-firmware")
+	{
+		std::string name = (argc > 2) ? argv[2] : "payload";
+		std::string expected_uart = (argc > 3) ? argv[3] : "";
+		std::string elf_path = (argc > 4) ? argv[4] : kPayloadElfPath;
+		SimOptions opts;
 		opts.elf_path = elf_path;
 		opts.test_name = name;
 		opts.expected_uart = expected_uart;
@@ -598,438 +4986,1576 @@ int main(int argc, char **argv, char **env)
 		opts.sram_size = (size_t)env_u64("ION_SRAM_SIZE", DEFAULT_FIRMWARE_SRAM_SIZE);
 		all_pass &= run_sim(opts);
 	}
-	else if (std::string(argv[1]) == "--rustsbi" || std::string(argv[1]) == "--sbi-firmware")
+	else if (std::string(argv[1]) == "--rustsbi" || std::string(argv[1]) == "--sbi-firmware")
+	{
+		if (argc < 6)
+		{
+			fprintf(stderr, "usage: %s %s <trampoline.elf> <firmware.elf> <payload.elf> <dtb>\n", argv[0], argv[1]);
+			return 1;
+		}
+		SimOptions opts;
+		opts.test_name = std::string(argv[1]) == "--rustsbi" ? "rustsbi" : "sbi-firmware";
+		opts.elf_path = argv[2];
+		opts.second_elf_path = argv[3];
+		opts.third_elf_path = argv[4];
+		opts.dtb_path = argv[5];
+		const char *expected_uart = std::getenv("ION_EXPECT_UART");
+		opts.expected_uart = expected_uart != nullptr ? expected_uart : "IonSoC SBI smoke";
+		opts.trace_wave = env_enabled("ION_TRACE_WAVE");
+		opts.direct_elf_load = true;
+		opts.uart_stdin = env_enabled("ION_UART_STDIN");
+		opts.trace_irq = env_enabled("ION_TRACE_IRQ");
+		opts.trace_dmi = env_enabled("ION_TRACE_DMI");
+		opts.perf_report = env_enabled("ION_PERF");
+		opts.accept_uart_match = env_enabled("ION_ACCEPT_UART_MATCH");
+		opts.stop_on_uart_match = env_enabled("ION_STOP_ON_UART_MATCH");
+		opts.jtag_rbb_port = (int)env_u64("ION_JTAG_RBB_PORT", 0);
+		opts.max_cycles = env_u64("ION_MAX_CYCLES", 8000000);
+		opts.sram_base = env_u64("ION_SRAM_BASE", FIRMWARE_SRAM_BASE);
+		opts.sram_size = (size_t)env_u64("ION_SRAM_SIZE", DEFAULT_FIRMWARE_SRAM_SIZE);
+		opts.dtb_addr = env_u64("ION_DTB_ADDR", opts.sram_base + 0x00f00000);
+		opts.require_sram_entry = true;
+		opts.require_payload_entry = std::getenv("ION_REQUIRE_PAYLOAD_ENTRY") == nullptr ||
+		                             env_enabled("ION_REQUIRE_PAYLOAD_ENTRY");
+		opts.inject_boot_args = true;
+		opts.boot_a0 = env_u64("ION_BOOT_A0", 0);
+		opts.boot_a1 = env_u64("ION_BOOT_A1", opts.dtb_addr);
+		opts.boot_a2 = env_u64("ION_BOOT_A2", opts.sram_base + 0x00100000);
+		all_pass &= run_sim(opts);
+	}
+	else
+	{
+		std::vector<std::string> tests;
+		bool testAll = false;
+
+		for (int i = 1; i < argc; ++i)
+		{
+			if (std::string(argv[i]) == "testAll")
+			{
+				testAll = true;
+				break;
+			}
+			tests.emplace_back(argv[i]);
+		}
+
+		const std::string base_dir = std::getenv("ION_RISCV_TESTS_DIR") != nullptr ?
+		                                 env_string("ION_RISCV_TESTS_DIR") + "/" :
+		                                 "riscv-tests/target/share/riscv-tests/isa/";
+		// const std::string base_dir = "simulator/generated/";
+
+		std::vector<TestJob> jobs;
+		if (testAll)
+		{
+			for (auto &p : std::filesystem::directory_iterator(base_dir))
+			{
+				// 查找无后缀的文件 (ELF)
+				if (p.path().extension() == "")
+				{
+					TestJob job;
+					job.path = p.path().string();
+					job.name = p.path().stem().string();
+					jobs.push_back(job);
+				}
+			}
+			std::sort(jobs.begin(), jobs.end(), [](const TestJob &a, const TestJob &b) { return a.name < b.name; });
+		}
+		else
+		{
+			for (auto &t : tests)
+			{
+				// 构建路径时不再添加 .bin 后缀
+				std::string bin_ui = base_dir + "rv64ui-p-" + t;
+				std::string bin_um = base_dir + "rv64um-p-" + t;
+				std::string bin;
+
+				if (std::filesystem::exists(bin_ui))
+				{
+					bin = bin_ui;
+				}
+				else if (std::filesystem::exists(bin_um))
+				{
+					bin = bin_um;
+				}
+				else
+				{
+					printf("Test binary for %s not found.\n", t.c_str());
+					all_pass = false;
+					continue;
+				}
+
+				TestJob job;
+				job.path = bin;
+				job.name = t;
+				job.trace_wave = env_enabled("ION_TRACE_WAVE");
+				jobs.push_back(job);
+			}
+		}
+		if (!jobs.empty())
+			all_pass &= run_test_pool(jobs);
+	}
+
+	printf("All simulations finished.\n");
+	return all_pass ? 0 : 1;
+}
+
+#if ION_SPARSE_SRAM
+static size_t rtl_sram_capacity_bytes(VSoc *dut)
+{
+	(void)dut;
+	return model_sram()->capacity();
+}
+
+// Copies into SRAM at a byte offset; src == nullptr writes zeros.
+static void store_sram_bytes(VSoc *dut, uint64_t offset, const uint8_t *src, size_t len)
+{
+	(void)dut;
+	model_sram()->write(offset, src, len);
+}
+#else
+static uint8_t *sram_bytes(VSoc *dut)
+{
+	return (uint8_t *)&(dut->rootp->SimTop__DOT__sram__DOT__mem_ext__DOT__Memory[0]);
+}
+
+static size_t rtl_sram_capacity_bytes(VSoc *dut)
+{
+	return sizeof(dut->rootp->SimTop__DOT__sram__DOT__mem_ext__DOT__Memory);
+}
+
+// Copies into SRAM at a byte offset; src == nullptr writes zeros.
+static void store_sram_bytes(VSoc *dut, uint64_t offset, const uint8_t *src, size_t len)
+{
+	if (src != nullptr)
+		memcpy(sram_bytes(dut) + offset, src, len);
+	else
+		memset(sram_bytes(dut) + offset, 0, len);
+}
+#endif
+
+static void write_sram_bytes(VSoc *dut, uint64_t sram_base, size_t sram_size, uint64_t paddr, const uint8_t *src, size_t len)
+{
+	if (paddr < sram_base)
+	{
+		fprintf(stderr, "SRAM write below base: paddr=0x%016" PRIx64 "\n", paddr);
+		exit(1);
+	}
+	uint64_t off = paddr - sram_base;
+	if (off + len > sram_size)
+	{
+		fprintf(stderr, "SRAM write out of range: paddr=0x%016" PRIx64 " len=%zu sram=%zu\n",
+		        paddr, len, sram_size);
+		exit(1);
+	}
+	store_sram_bytes(dut, off, src, len);
+	note_sram_write(off, len);
+}
+
+// Pairs every piece of architectural state the ISS models with its Verilated
+// register, so importing the reset state and transplanting the result back
+// walk the same list. Memory is shared directly and needs no copy.
+#if !ION_SPARSE_SRAM
+template <typename Fn>
+static void for_each_iss_state(VSoc *dut, Rv64Iss &iss, Fn &&fn)
+{
+	auto *r = dut->rootp;
+	for (int i = 1; i < 32; ++i)
+		fn(r->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[i], iss.x[i]);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__CurrentPrivLevel, iss.priv);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mstatus, iss.csr.mstatus);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__medeleg, iss.csr.medeleg);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mideleg, iss.csr.mideleg);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mie, iss.csr.mie);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mtvec, iss.csr.mtvec);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mepc, iss.csr.mepc);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mcause, iss.csr.mcause);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mtval, iss.csr.mtval);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mscratch, iss.csr.mscratch);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__stvec, iss.csr.stvec);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__sepc, iss.csr.sepc);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__scause, iss.csr.scause);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__stval, iss.csr.stval);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__sscratch, iss.csr.sscratch);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__satp, iss.csr.satp);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mcounteren, iss.csr.mcounteren);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__scounteren, iss.csr.scounteren);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__menvcfg, iss.csr.menvcfg);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mcountinhibit, iss.csr.mcountinhibit);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mcycle, iss.csr.mcycle);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__minstret, iss.csr.minstret);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__timeCounter, iss.csr.time);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__pmpcfg0, iss.csr.pmpcfg0);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__pmpaddr_0, iss.csr.pmpaddr[0]);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__pmpaddr_1, iss.csr.pmpaddr[1]);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__pmpaddr_2, iss.csr.pmpaddr[2]);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__pmpaddr_3, iss.csr.pmpaddr[3]);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__pmpaddr_4, iss.csr.pmpaddr[4]);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__pmpaddr_5, iss.csr.pmpaddr[5]);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__pmpaddr_6, iss.csr.pmpaddr[6]);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__pmpaddr_7, iss.csr.pmpaddr[7]);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mnscratch, iss.csr.mnscratch);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mnepc, iss.csr.mnepc);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mncause, iss.csr.mncause);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__mnstatus, iss.csr.mnstatus);
+	fn(r->SimTop__DOT__core__DOT__csr__DOT__ssipSw, iss.csr.ssip_sw);
+	fn(r->SimTop__DOT__clint__DOT__mtime, iss.clint.mtime);
+	fn(r->SimTop__DOT__clint__DOT__mtimecmp, iss.clint.mtimecmp);
+	fn(r->SimTop__DOT__clint__DOT__msip, iss.clint.msip);
+	fn(r->SimTop__DOT__uart__DOT__ier, iss.uart.ier);
+	fn(r->SimTop__DOT__uart__DOT__fcr, iss.uart.fcr);
+	fn(r->SimTop__DOT__uart__DOT__lcr, iss.uart.lcr);
+	fn(r->SimTop__DOT__uart__DOT__mcr, iss.uart.mcr);
+	fn(r->SimTop__DOT__uart__DOT__scr, iss.uart.scr);
+	fn(r->SimTop__DOT__uart__DOT__dll, iss.uart.dll);
+	fn(r->SimTop__DOT__uart__DOT__dlm, iss.uart.dlm);
+	fn(r->SimTop__DOT__plic__DOT__priority_1, iss.plic.priority[1]);
+	fn(r->SimTop__DOT__plic__DOT__priority_2, iss.plic.priority[2]);
+	fn(r->SimTop__DOT__plic__DOT__priority_3, iss.plic.priority[3]);
+	fn(r->SimTop__DOT__plic__DOT__priority_4, iss.plic.priority[4]);
+	fn(r->SimTop__DOT__plic__DOT__priority_5, iss.plic.priority[5]);
+	fn(r->SimTop__DOT__plic__DOT__priority_6, iss.plic.priority[6]);
+	fn(r->SimTop__DOT__plic__DOT__priority_7, iss.plic.priority[7]);
+	fn(r->SimTop__DOT__plic__DOT__priority_8, iss.plic.priority[8]);
+	fn(r->SimTop__DOT__plic__DOT__priority_9, iss.plic.priority[9]);
+	fn(r->SimTop__DOT__plic__DOT__priority_10, iss.plic.priority[10]);
+	fn(r->SimTop__DOT__plic__DOT__priority_11, iss.plic.priority[11]);
+	fn(r->SimTop__DOT__plic__DOT__priority_12, iss.plic.priority[12]);
+	fn(r->SimTop__DOT__plic__DOT__priority_13, iss.plic.priority[13]);
+	fn(r->SimTop__DOT__plic__DOT__priority_14, iss.plic.priority[14]);
+	fn(r->SimTop__DOT__plic__DOT__priority_15, iss.plic.priority[15]);
+	fn(r->SimTop__DOT__plic__DOT__priority_16, iss.plic.priority[16]);
+	fn(r->SimTop__DOT__plic__DOT__priority_17, iss.plic.priority[17]);
+	fn(r->SimTop__DOT__plic__DOT__priority_18, iss.plic.priority[18]);
+	fn(r->SimTop__DOT__plic__DOT__priority_19, iss.plic.priority[19]);
+	fn(r->SimTop__DOT__plic__DOT__priority_20, iss.plic.priority[20]);
+	fn(r->SimTop__DOT__plic__DOT__priority_21, iss.plic.priority[21]);
+	fn(r->SimTop__DOT__plic__DOT__priority_22, iss.plic.priority[22]);
+	fn(r->SimTop__DOT__plic__DOT__priority_23, iss.plic.priority[23]);
+	fn(r->SimTop__DOT__plic__DOT__priority_24, iss.plic.priority[24]);
+	fn(r->SimTop__DOT__plic__DOT__priority_25, iss.plic.priority[25]);
+	fn(r->SimTop__DOT__plic__DOT__priority_26, iss.plic.priority[26]);
+	fn(r->SimTop__DOT__plic__DOT__priority_27, iss.plic.priority[27]);
+	fn(r->SimTop__DOT__plic__DOT__priority_28, iss.plic.priority[28]);
+	fn(r->SimTop__DOT__plic__DOT__priority_29, iss.plic.priority[29]);
+	fn(r->SimTop__DOT__plic__DOT__priority_30, iss.plic.priority[30]);
+	fn(r->SimTop__DOT__plic__DOT__priority_31, iss.plic.priority[31]);
+	fn(r->SimTop__DOT__plic__DOT__enable_0, iss.plic.enable[0]);
+	fn(r->SimTop__DOT__plic__DOT__enable_1, iss.plic.enable[1]);
+	fn(r->SimTop__DOT__plic__DOT__threshold_0, iss.plic.threshold[0]);
+	fn(r->SimTop__DOT__plic__DOT__threshold_1, iss.plic.threshold[1]);
+}
+
+// Runs the functional ISS from the reset vector on the model's own ROM and
+// SRAM arrays, then writes its architectural state back so the next clock
+// edge continues cycle-accurately from the ISS's PC. Must be called after
+// reset is released and before the first post-reset edge.
+static void fast_forward_iss(VSoc *dut, const SimOptions &opts, UartStdio &uart, BootProgress &progress)
+{
+	Rv64Iss iss;
+	for_each_iss_state(dut, iss, [](auto &rtl, auto &model) { model = (std::decay_t<decltype(model)>)rtl; });
+	iss.pc = BROM_BASE;
+	iss.rom.mem = (uint8_t *)&(dut->rootp->SimTop__DOT__brom__DOT__loRom__DOT__mem[0]);
+	iss.rom.base = BROM_BASE;
+	iss.rom.size = std::min((size_t)ROM_SIZE, sizeof(dut->rootp->SimTop__DOT__brom__DOT__loRom__DOT__mem));
+	iss.sram.mem = sram_bytes(dut);
+	iss.sram.base = opts.sram_base;
+	iss.sram.size = std::min(opts.sram_size, rtl_sram_capacity_bytes(dut));
+	iss.on_uart_tx = [&](uint8_t ch)
+	{
+		uart.emit(ch);
+		const std::string &out = uart.output();
+		const std::string &until = opts.iss_until_uart;
+		if (!until.empty() && out.size() >= until.size() &&
+		    out.compare(out.size() - until.size(), until.size(), until) == 0)
+			iss.request_stop();
+	};
+	iss.on_jump = [&](uint64_t target)
+	{
+		if (target >= BROM_BASE && target < BROM_BASE + ROM_SIZE)
+			progress.saw_rom_pc = true;
+		if (target >= opts.sram_base && target < opts.sram_base + opts.sram_size)
+			progress.saw_sram_pc = true;
+		if (opts.inject_boot_args && target >= opts.boot_a2 && target < opts.boot_a2 + 0x10000)
+			progress.saw_payload_pc = true;
+	};
+	progress.saw_rom_pc = true;
+
+	const uint64_t budget = opts.iss_insns != 0 ? opts.iss_insns : UINT64_MAX;
+	const auto start = std::chrono::steady_clock::now();
+	Rv64Iss::StopReason stop = iss.run(budget, opts.iss_until_pc);
+	double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for_each_iss_state(dut, iss, [](auto &rtl, auto &model) { rtl = model; });
+	dut->rootp->SimTop__DOT__core__DOT__pc__DOT__ProgramCounter = iss.pc;
+	dut->rootp->SimTop__DOT__core__DOT__pc__DOT__rst = 0;
+	dut->eval();
+
+	printf("\n[iss]: fast-forwarded %" PRIu64 " insns in %.3fs (%.1f MIPS) stop=%s pc=0x%016" PRIx64 " priv=%u\n",
+	       iss.insns, wall_s, wall_s > 0.0 ? (double)iss.insns / wall_s / 1e6 : 0.0, Rv64Iss::stop_name(stop),
+	       iss.pc, iss.priv);
+	if (stop == Rv64Iss::kStopUnsupported)
+		printf("[iss]: handing insn=0x%08x to the RTL\n", iss.last_insn());
+}
+#endif
+
+void load_elf(VSoc *dut, const char *path)
+{
+	load_elf_to_regions(dut, path, SRAM_BASE, DEFAULT_SRAM_SIZE);
+}
+
+// Read-only mapping of a whole file. The loaders copy segments straight out
+// of it into the Verilated arrays instead of staging them through stdio.
+class MappedFile
+{
+  public:
+	~MappedFile()
+	{
+		if (data_ != nullptr)
+			munmap((void *)data_, size_);
+	}
+
+	bool open(const char *path)
 	{
-		if (argc < 6)
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
 		{
-			fprintf(stderr, "usage: %s %s <trampoline.elf> <firmware.elf> <payload.elf> <dtb>\n", argv[0], argv[1]);
-			return 1;
+			perror(path);
+			return false;
 		}
-		SimOptions opts;
-		opts.test_name = std::string(argv[1]) == "--rustsbi" ? "rustsbi" : "sbi-firmware";
-		opts.elf_path = argv[2];
-		opts.second_elf_path = argv[3];
-		opts.third_elf_path = argv[4];
-		opts.dtb_path = argv[5];
-		const char *expected_uart = std::getenv("ION_EXPECT_UART");
-		opts.expected_uart = expected_uart != nullptr ? expected_uart : "IonSoC SBI smoke";
-		opts.trace_wave = env_enabled("ION_TRACE_WAVE");
-		opts.direct_elf_load = true;
-		opts.uart_stdin = env_enabled("ION_UART_STDIN");
-		opts.trace_irq = env_enabled("ION_TRACE_IRQ");
-		opts.trace_dmi = env_enabled("ION_TRACE_DMI");
-		opts.perf_report = env_enabled("ION_PERF");
-		opts.accept_uart_match = env_enabled("ION_ACCEPT_UART_MATCH");
-		opts.stop_on_uart_match = env_enabled("ION_STOP_ON_UART_MATCH");
-		opts.jtag_rbb_port = (int)env_u64("ION_JTAG_RBB_PORT", 0);
-		opts.max_cycles = env_u64("ION_MAX_CYCLES", 8000000);
-		opts.sram_base = env_u64("ION_SRAM_BASE", FIRMWARE_SRAM_BASE);
-		opts.sram_size = (size_t)env_u64("ION_SRAM_SIZE", DEFAULT_FIRMWARE_SRAM_SIZE);
-		opts.dtb_addr = env_u64("ION_DTB_ADDR", opts.sram_base + 0x00f00000);
-		opts.require_sram_entry = true;
-		opts.require_payload_entry = std::getenv("ION_REQUIRE_PAYLOAD_ENTRY") == nullptr ||
-		                             env_enabled("ION_REQUIRE_PAYLOAD_ENTRY");
-		opts.inject_boot_args = true;
-		opts.boot_a0 = env_u64("ION_BOOT_A0", 0);
-		opts.boot_a1 = env_u64("ION_BOOT_A1", opts.dtb_addr);
-		opts.boot_a2 = env_u64("ION_BOOT_A2", opts.sram_base + 0x00100000);
-		all_pass &= run_sim(opts);
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			perror(path);
+			close(fd);
+			return false;
+		}
+		size_ = (size_t)st.st_size;
+		if (size_ != 0)
+		{
+			void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED)
+			{
+				perror(path);
+				close(fd);
+				return false;
+			}
+			data_ = (const uint8_t *)p;
+			madvise(p, size_, MADV_SEQUENTIAL);
+		}
+		close(fd);
+		return true;
 	}
-	else
+
+	const uint8_t *data() const { return data_; }
+	size_t size() const { return size_; }
+
+  private:
+	const uint8_t *data_ = nullptr;
+	size_t size_ = 0;
+};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void load_elf_to_regions(VSoc *dut, const char *path, uint64_t sram_base, size_t sram_size)
+{
+	const auto start = std::chrono::steady_clock::now();
+	MappedFile file;
+	if (!file.open(path))
+		exit(1);
+	const uint8_t *image = file.data();
+
+	Elf64_Ehdr ehdr64;
+	if (file.size() < sizeof(Elf64_Ehdr))
 	{
-		std::vector<std::string> tests;
-		bool testAll = false;
+		fprintf(stderr, "Read ELF header failed: %s\n", path);
+		exit(1);
+	}
+	memcpy(&ehdr64, image, sizeof(Elf64_Ehdr));
 
-		for (int i = 1; i < argc; ++i)
+	// Check ELF magic
+	if (ehdr64.e_ident[EI_MAG0] != ELFMAG0 || ehdr64.e_ident[EI_MAG1] != ELFMAG1 ||
+		ehdr64.e_ident[EI_MAG2] != ELFMAG2 || ehdr64.e_ident[EI_MAG3] != ELFMAG3)
+	{
+		fprintf(stderr, "Not an ELF file: %s\n", path);
+		exit(1);
+	}
+
+	// Only accept little-endian for now
+	if (ehdr64.e_ident[EI_DATA] != ELFDATA2LSB)
+	{
+		fprintf(stderr, "Unsupported ELF endianness (not little-endian): %s\n", path);
+		exit(1);
+	}
+
+	if (ehdr64.e_ident[EI_CLASS] != ELFCLASS64)
+	{
+		fprintf(stderr, "Unsupported ELF class (not 64-bit): %s\n", path);
+		exit(1);
+	}
+
+	if (ehdr64.e_phoff == 0 || ehdr64.e_phnum == 0)
+	{
+		fprintf(stderr, "No program headers in ELF: %s\n", path);
+		exit(1);
+	}
+
+	if (ehdr64.e_phoff > file.size() ||
+	    (uint64_t)ehdr64.e_phnum * sizeof(Elf64_Phdr) > file.size() - ehdr64.e_phoff)
+	{
+		fprintf(stderr, "Read program headers failed\n");
+		exit(1);
+	}
+
+	// Every ROM copy gets the same bytes. The boot ROM pair reads word i and
+	// i + 1 for a fetch at word i; the TLROM pair only ever indexes even (lo)
+	// and odd (hi) words of its own copy, so a full copy is equivalent to
+	// filling each parity separately.
+	auto *r = dut->rootp;
+	uint8_t *rom_copies[] = {
+		(uint8_t *)&r->SimTop__DOT__brom__DOT__loRom__DOT__mem[0],
+		(uint8_t *)&r->SimTop__DOT__brom__DOT__hiRom__DOT__mem[0],
+		(uint8_t *)&r->SimTop__DOT__tlrom__DOT__loRom__DOT__mem[0],
+		(uint8_t *)&r->SimTop__DOT__tlrom__DOT__hiRom__DOT__mem[0],
+	};
+
+	const size_t rom_bytes_size = std::min((size_t)ROM_SIZE, sizeof(r->SimTop__DOT__brom__DOT__loRom__DOT__mem));
+	const size_t sram_bytes_size = sram_size;
+	uint64_t loaded = 0;
+
+	for (int i = 0; i < (int)ehdr64.e_phnum; ++i)
+	{
+		Elf64_Phdr ph;
+		memcpy(&ph, image + ehdr64.e_phoff + (size_t)i * sizeof(Elf64_Phdr), sizeof(Elf64_Phdr));
+		// debug print
+		printf("PHDR %d: type=%" PRIu32 " vaddr=0x%016" PRIx64 " off=0x%016" PRIx64 " filesz=%" PRIu64 " memsz=%" PRIu64 "\n",
+			   i, (uint32_t)ph.p_type, (uint64_t)ph.p_vaddr, (uint64_t)ph.p_offset, (uint64_t)ph.p_filesz, (uint64_t)ph.p_memsz);
+
+		if (ph.p_type != PT_LOAD)
+			continue;
+
+		uint64_t vaddr = (uint64_t)ph.p_vaddr;
+		uint64_t filesz = (uint64_t)ph.p_filesz;
+		uint64_t memsz = (uint64_t)ph.p_memsz;
+
+		bool to_sram = false;
+		size_t region_bytes = 0;
+		uint64_t offset_in_region = 0;
+		const char *region_name = nullptr;
+
+		if (vaddr >= (uint64_t)BROM_BASE && vaddr < (uint64_t)BROM_BASE + (uint64_t)ROM_SIZE)
 		{
-			if (std::string(argv[i]) == "testAll")
+			region_bytes = rom_bytes_size;
+			offset_in_region = vaddr - (uint64_t)BROM_BASE;
+			region_name = "ROM";
+		}
+		else if (vaddr >= sram_base && vaddr < sram_base + (uint64_t)sram_bytes_size)
+		{
+			to_sram = true;
+			region_bytes = sram_bytes_size;
+			offset_in_region = vaddr - sram_base;
+			region_name = "SRAM";
+			note_sram_write(offset_in_region, memsz);
+		}
+		else
+		{
+			printf("Warning: PT_LOAD at vaddr 0x%016" PRIx64 " (filesz=%" PRIu64 ") outside ROM/SRAM -> skip\n", vaddr, filesz);
+			continue;
+		}
+		// src == nullptr zeroes the range.
+		auto store = [&](uint64_t offset, const uint8_t *src, size_t len)
+		{
+			if (to_sram)
 			{
-				testAll = true;
-				break;
+				store_sram_bytes(dut, offset, src, len);
+				return;
 			}
-			tests.emplace_back(argv[i]);
+			for (uint8_t *rom : rom_copies)
+			{
+				if (src != nullptr)
+					memcpy(rom + offset, src, len);
+				else
+					memset(rom + offset, 0, len);
+			}
+		};
+		if (offset_in_region >= region_bytes)
+		{
+			printf("Warning: PT_LOAD at vaddr 0x%016" PRIx64 " is past the end of %s -> skip\n", vaddr, region_name);
+			continue;
+		}
+
+		// write file bytes to region
+		if (filesz > 0)
+		{
+			if (filesz > region_bytes - offset_in_region)
+			{
+				fprintf(stderr, "Warning: truncating write: offset 0x%016" PRIx64 " filesz %" PRIu64 " -> %zu available\n",
+						offset_in_region, filesz, (size_t)(region_bytes - offset_in_region));
+				filesz = region_bytes - offset_in_region;
+			}
+			if (ph.p_offset > file.size() || filesz > file.size() - ph.p_offset)
+			{
+				uint64_t avail = ph.p_offset < file.size() ? file.size() - ph.p_offset : 0;
+				fprintf(stderr, "Warning: short read in segment copy (%" PRIu64 "/%" PRIu64 ")\n", avail, filesz);
+				filesz = avail;
+			}
+			store(offset_in_region, image + ph.p_offset, (size_t)filesz);
+			loaded += filesz;
+			printf("  -> wrote %" PRIu64 " bytes to %s @ offset 0x%016" PRIx64 "\n", filesz, region_name, offset_in_region);
+		}
+
+		// zero initialize BSS tail (memsz > filesz)
+		if (memsz > filesz)
+		{
+			uint64_t zero_start = offset_in_region + filesz;
+			uint64_t zero_len = memsz - filesz;
+			if (zero_start < region_bytes)
+			{
+				if (zero_start + zero_len > region_bytes)
+				{
+					zero_len = region_bytes - zero_start;
+				}
+				if (zero_len > 0)
+				{
+					store(zero_start, nullptr, (size_t)zero_len);
+					printf("  -> zeroed %" PRIu64 " bytes in %s @ offset 0x%016" PRIx64 "\n", zero_len, region_name, zero_start);
+				}
+			}
+		}
+	}
+
+	printf("[boot]: loaded %s (%" PRIu64 " bytes) in %.3f ms\n", path, loaded, elapsed_ms(start));
+}
+
+// Function symbols from the .symtab of the loaded ELFs, for the profiler.
+// Only FUNC symbols and global/weak NOTYPE ones (assembly entry points) in
+// executable sections are kept; a symbol without a size runs to the next one.
+class ElfSymbols
+{
+  public:
+	static constexpr uint32_t kUnknown = 0;
+
+	ElfSymbols() { names_.push_back({"[unknown]", "", 0}); }
+
+	// The ELFs of the run plus the ':'-separated ION_PROFILE_SYMBOLS list.
+	bool load(const SimOptions &opts)
+	{
+		std::vector<std::string> paths = {opts.elf_path, opts.second_elf_path, opts.third_elf_path};
+		for (size_t start = 0; start < opts.profile_symbols.size();)
+		{
+			size_t end = opts.profile_symbols.find(':', start);
+			if (end == std::string::npos)
+				end = opts.profile_symbols.size();
+			paths.push_back(opts.profile_symbols.substr(start, end - start));
+			start = end + 1;
+		}
+		for (const std::string &path : paths)
+		{
+			if (!path.empty() && !add(path))
+				return false;
+		}
+		finish();
+		return true;
+	}
+
+	bool add(const std::string &path)
+	{
+		MappedFile file;
+		if (!file.open(path.c_str()))
+			return false;
+		const uint8_t *image = file.data();
+		Elf64_Ehdr eh;
+		if (file.size() < sizeof(eh) || memcmp(image, ELFMAG, SELFMAG) != 0 || image[EI_CLASS] != ELFCLASS64)
+		{
+			fprintf(stderr, "[profile]: %s is not a 64-bit ELF\n", path.c_str());
+			return false;
+		}
+		memcpy(&eh, image, sizeof(eh));
+		if (eh.e_shoff == 0 || eh.e_shoff > file.size() ||
+		    (uint64_t)eh.e_shnum * sizeof(Elf64_Shdr) > file.size() - eh.e_shoff)
+		{
+			printf("[profile]: %s has no section headers; its code shows as [unknown]\n", path.c_str());
+			return true;
+		}
+		std::vector<Elf64_Shdr> sh(eh.e_shnum);
+		memcpy(sh.data(), image + eh.e_shoff, sh.size() * sizeof(Elf64_Shdr));
+		auto in_file = [&](const Elf64_Shdr &s) { return s.sh_offset <= file.size() && s.sh_size <= file.size() - s.sh_offset; };
+
+		std::string module = std::filesystem::path(path).filename().string();
+		size_t before = syms_.size();
+		for (const Elf64_Shdr &symtab : sh)
+		{
+			if (symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= sh.size() || !in_file(symtab) ||
+			    !in_file(sh[symtab.sh_link]))
+				continue;
+			const Elf64_Shdr &strtab = sh[symtab.sh_link];
+			const char *strings = (const char *)image + strtab.sh_offset;
+			size_t count = symtab.sh_size / sizeof(Elf64_Sym);
+			for (size_t i = 0; i < count; ++i)
+			{
+				Elf64_Sym s;
+				memcpy(&s, image + symtab.sh_offset + i * sizeof(Elf64_Sym), sizeof(s));
+				unsigned type = ELF64_ST_TYPE(s.st_info);
+				unsigned bind = ELF64_ST_BIND(s.st_info);
+				bool code = type == STT_FUNC || (type == STT_NOTYPE && (bind == STB_GLOBAL || bind == STB_WEAK));
+				if (!code || s.st_shndx == SHN_UNDEF || s.st_shndx >= sh.size() ||
+				    (sh[s.st_shndx].sh_flags & SHF_EXECINSTR) == 0 || s.st_name >= strtab.sh_size)
+					continue;
+				const char *name = strings + s.st_name;
+				size_t len = strnlen(name, strtab.sh_size - s.st_name);
+				if (len == 0)
+					continue;
+				const Elf64_Shdr &section = sh[s.st_shndx];
+				Symbol sym;
+				sym.lo = s.st_value;
+				sym.hi = s.st_size != 0 ? s.st_value + s.st_size : section.sh_addr + section.sh_size;
+				sym.sized = s.st_size != 0;
+				sym.func = type == STT_FUNC;
+				sym.name = (uint32_t)names_.size();
+				names_.push_back({std::string(name, len), module, s.st_value});
+				syms_.push_back(sym);
+			}
+		}
+		printf("[profile]: %zu symbols from %s\n", syms_.size() - before, path.c_str());
+		return true;
+	}
+
+	// Sorts the table; call once after the last add().
+	void finish()
+	{
+		// At one address prefer a sized FUNC over a label.
+		std::sort(syms_.begin(), syms_.end(), [](const Symbol &a, const Symbol &b)
+		          {
+			          if (a.lo != b.lo)
+				          return a.lo < b.lo;
+			          if (a.func != b.func)
+				          return a.func;
+			          return a.sized && !b.sized;
+		          });
+		syms_.erase(std::unique(syms_.begin(), syms_.end(), [](const Symbol &a, const Symbol &b) { return a.lo == b.lo; }),
+		            syms_.end());
+		for (size_t i = 0; i + 1 < syms_.size(); ++i)
+		{
+			if (!syms_[i].sized)
+				syms_[i].hi = std::min(syms_[i].hi, syms_[i + 1].lo);
+		}
+	}
+
+	uint32_t lookup(uint64_t pc) const
+	{
+		if (pc >= last_lo_ && pc < last_hi_)
+			return last_;
+		auto it = std::upper_bound(syms_.begin(), syms_.end(), pc, [](uint64_t v, const Symbol &s) { return v < s.lo; });
+		if (it == syms_.begin() || pc >= (it - 1)->hi)
+			return kUnknown;
+		--it;
+		last_lo_ = it->lo;
+		last_hi_ = it->hi;
+		last_ = it->name;
+		return last_;
+	}
+
+	size_t size() const { return names_.size(); }
+	const std::string &name(uint32_t id) const { return names_[id].name; }
+	const std::string &module(uint32_t id) const { return names_[id].module; }
+	uint64_t start(uint32_t id) const { return names_[id].start; }
+
+  private:
+	struct Symbol
+	{
+		uint64_t lo;
+		uint64_t hi;
+		uint32_t name;
+		bool sized;
+		bool func;
+	};
+
+	struct Name
+	{
+		std::string name;
+		std::string module;
+		uint64_t start;
+	};
+
+	std::vector<Symbol> syms_;
+	std::vector<Name> names_;
+	mutable uint64_t last_lo_ = 1;
+	mutable uint64_t last_hi_ = 0;
+	mutable uint32_t last_ = kUnknown;
+};
+
+// ION_PROFILE: charges every cycle to the next instruction to retire and to
+// the call stack it retires under. The stack is rebuilt from the commit port
+// with the RISC-V return-address-stack hints: jal/jalr linking x1 or x5 is a
+// call, jalr through x1/x5 that does not link is a return, a trap is a call
+// into its handler and mret/sret is a return. A retirement outside the
+// function on top of the stack (a tail call, longjmp or context switch)
+// replaces that frame. Stacks are interned in a tree, so the common case of
+// staying in the same function costs one range check.
+//
+// Separately, every cycle goes into one StallKind bucket of a per-PC CPI
+// stack: a retiring cycle is `base` for the retired PC; any other cycle is
+// charged to the instruction in decode, else the head of the frontend
+// queue, else the fetch PC, under the first stall reason that holds.
+class PcProfiler
+{
+  public:
+	bool open(const SimOptions &opts)
+	{
+		if (!opts.profile)
+			return true;
+		if (!symbols_.load(opts))
+			return false;
+		out_prefix_ = !opts.profile_out.empty() ? opts.profile_out : "simulator/build/profile-" + opts.test_name;
+		nodes_.push_back({0, ElfSymbols::kUnknown, 0, 0, 0});
+		enabled_ = true;
+		return true;
+	}
+
+	bool enabled() const { return enabled_; }
+
+	// Rising edge.
+	void sample(VSoc *dut)
+	{
+		charge_stall(dut);
+		pending_cycles_++;
+		if (dut->io_debug_retire)
+			retire(dut->io_debug_commitPc, (uint32_t)dut->io_debug_commitInstr);
+		if (dut->io_debug_arch_event_valid)
+			push_pending_ = true;
+	}
+
+	// Writes <prefix>.folded (flamegraph.pl input, weighted by cycles) and
+	// <prefix>.txt (per-function table), and prints the top of the table.
+	void report() const
+	{
+		if (!enabled_)
+			return;
+		std::string folded_path = out_prefix_ + ".folded";
+		std::string table_path = out_prefix_ + ".txt";
+		FILE *folded = fopen(folded_path.c_str(), "w");
+		FILE *table = fopen(table_path.c_str(), "w");
+		if (folded == nullptr || table == nullptr)
+		{
+			perror(folded == nullptr ? folded_path.c_str() : table_path.c_str());
+			if (folded != nullptr)
+				fclose(folded);
+			if (table != nullptr)
+				fclose(table);
+			return;
 		}
 
-		const std::string base_dir = "riscv-tests/target/share/riscv-tests/isa/";
-		// const std::string base_dir = "simulator/generated/";
-
-		if (testAll)
+		std::vector<FunctionStats> funcs(symbols_.size());
+		std::vector<uint32_t> seen(symbols_.size(), UINT32_MAX);
+		std::vector<uint32_t> stack;
+		uint64_t total_cycles = 0;
+		uint64_t total_instrs = 0;
+		for (uint32_t id = 1; id < nodes_.size(); ++id)
 		{
-			for (auto &p : std::filesystem::directory_iterator(base_dir))
+			const Node &n = nodes_[id];
+			if (n.cycles == 0 && n.instrs == 0)
+				continue;
+			total_cycles += n.cycles;
+			total_instrs += n.instrs;
+			funcs[n.sym].self_cycles += n.cycles;
+			funcs[n.sym].instrs += n.instrs;
+			stack.clear();
+			for (uint32_t p = id; p != 0; p = nodes_[p].parent)
 			{
-				// 查找无后缀的文件 (ELF)
-				if (p.path().extension() == "")
+				stack.push_back(nodes_[p].sym);
+				// Recursion counts once towards the inclusive total.
+				if (seen[nodes_[p].sym] != id)
 				{
-					std::string bin = p.path().string();
-					std::string name = p.path().stem().string();
-					all_pass &= run_one_test(bin, name, false);
+					seen[nodes_[p].sym] = id;
+					funcs[nodes_[p].sym].total_cycles += n.cycles;
 				}
 			}
+			if (n.cycles == 0)
+				continue;
+			for (size_t i = stack.size(); i-- > 0;)
+				fprintf(folded, "%s%s", symbols_.name(stack[i]).c_str(), i != 0 ? ";" : "");
+			fprintf(folded, " %" PRIu64 "\n", n.cycles);
 		}
-		else
-		{
-			for (auto &t : tests)
-			{
-				// 构建路径时不再添加 .bin 后缀
-				std::string bin_ui = base_dir + "rv64ui-p-" + t;
-				std::string bin_um = base_dir + "rv64um-p-" + t;
-				std::string bin;
-
-				if (std::filesystem::exists(bin_ui))
-				{
-					bin = bin_ui;
-				}
-				else if (std::filesystem::exists(bin_um))
-				{
-					bin = bin_um;
-				}
-				else
-				{
-					printf("Test binary for %s not found.\n", t.c_str());
-					all_pass = false;
-					continue;
-				}
 
-				all_pass &= run_one_test(bin, t, env_enabled("ION_TRACE_WAVE"));
-			}
+		std::vector<uint32_t> order;
+		for (uint32_t sym = 0; sym < funcs.size(); ++sym)
+		{
+			if (funcs[sym].total_cycles != 0 || funcs[sym].instrs != 0)
+				order.push_back(sym);
+		}
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+		          { return funcs[a].self_cycles != funcs[b].self_cycles ? funcs[a].self_cycles > funcs[b].self_cycles : a < b; });
+		auto pct = [&](uint64_t v) { return total_cycles == 0 ? 0.0 : 100.0 * (double)v / (double)total_cycles; };
+		fprintf(table, "# cycles=%" PRIu64 " instructions=%" PRIu64 " stacks=%zu\n", total_cycles, total_instrs,
+		        nodes_.size() - 1);
+		fprintf(table, "%14s %7s %14s %7s %14s %7s  %-40s %s\n", "self_cycles", "self%", "total_cycles", "total%",
+		        "instructions", "cpi", "function", "elf");
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			const FunctionStats &f = funcs[order[i]];
+			double cpi = f.instrs == 0 ? 0.0 : (double)f.self_cycles / (double)f.instrs;
+			fprintf(table, "%14" PRIu64 " %7.2f %14" PRIu64 " %7.2f %14" PRIu64 " %7.2f  %-40s %s\n", f.self_cycles,
+			        pct(f.self_cycles), f.total_cycles, pct(f.total_cycles), f.instrs, cpi,
+			        symbols_.name(order[i]).c_str(), symbols_.module(order[i]).c_str());
+			if (i < 10)
+				printf("[profile]: %6.2f%% self %6.2f%% total cpi=%.2f %s\n", pct(f.self_cycles), pct(f.total_cycles),
+				       cpi, symbols_.name(order[i]).c_str());
 		}
+		fclose(folded);
+		fclose(table);
+		printf("[profile]: %zu functions, %zu stacks; wrote %s and %s\n", order.size(), nodes_.size() - 1,
+		       folded_path.c_str(), table_path.c_str());
+		report_cpi();
 	}
 
-	printf("All simulations finished.\n");
-	return all_pass ? 0 : 1;
-}
+  private:
+	static const uint32_t kMaxDepth = 256;
 
-static uint8_t *sram_bytes(VSoc *dut)
-{
-	return (uint8_t *)&(dut->rootp->SimTop__DOT__sram__DOT__mem_ext__DOT__Memory[0]);
-}
+	enum StallKind
+	{
+		kBase,
+		kIfetch,
+		kFrontend,
+		kLoadUse,
+		kLsuLoad,
+		kLsuStore,
+		kLsuMmio,
+		kLsuAtomic,
+		kLsuFence,
+		kRedirect,
+		kOther,
+		kStallKinds,
+	};
 
-static size_t rtl_sram_capacity_bytes(VSoc *dut)
-{
-	return sizeof(dut->rootp->SimTop__DOT__sram__DOT__mem_ext__DOT__Memory);
-}
+	typedef std::array<uint64_t, kStallKinds> StallCounts;
 
-static void write_sram_bytes(VSoc *dut, uint64_t sram_base, size_t sram_size, uint64_t paddr, const uint8_t *src, size_t len)
-{
-	if (paddr < sram_base)
-	{
-		fprintf(stderr, "SRAM write below base: paddr=0x%016" PRIx64 "\n", paddr);
-		exit(1);
-	}
-	uint64_t off = paddr - sram_base;
-	if (off + len > sram_size)
+	struct Node
 	{
-		fprintf(stderr, "SRAM write out of range: paddr=0x%016" PRIx64 " len=%zu sram=%zu\n",
-		        paddr, len, sram_size);
-		exit(1);
-	}
-	memcpy(sram_bytes(dut) + off, src, len);
-}
-
-void load_elf(VSoc *dut, const char *path)
-{
-	load_elf_to_regions(dut, path, SRAM_BASE, DEFAULT_SRAM_SIZE);
-}
+		uint32_t parent;
+		uint32_t sym;
+		uint32_t depth;
+		uint64_t cycles;
+		uint64_t instrs;
+	};
 
-void load_elf_to_regions(VSoc *dut, const char *path, uint64_t sram_base, size_t sram_size)
-{
-	FILE *f = fopen(path, "rb");
-	if (!f)
+	struct FunctionStats
 	{
-		perror("fopen");
-		exit(1);
-	}
+		uint64_t self_cycles = 0;
+		uint64_t total_cycles = 0;
+		uint64_t instrs = 0;
+	};
 
-	// Read ELF64 header (read max sized header; will validate class)
-	Elf64_Ehdr ehdr64;
-	if (fread(&ehdr64, 1, sizeof(Elf64_Ehdr), f) != sizeof(Elf64_Ehdr))
+	enum Link
 	{
-		fprintf(stderr, "Read ELF header failed: %s\n", path);
-		fclose(f);
-		exit(1);
-	}
+		kNone,
+		kCall,
+		kReturn,
+	};
 
-	// Check ELF magic
-	if (ehdr64.e_ident[EI_MAG0] != ELFMAG0 || ehdr64.e_ident[EI_MAG1] != ELFMAG1 ||
-		ehdr64.e_ident[EI_MAG2] != ELFMAG2 || ehdr64.e_ident[EI_MAG3] != ELFMAG3)
+	static bool link_reg(unsigned r) { return r == 1 || r == 5; }
+
+	static Link link_kind(uint32_t instr)
 	{
-		fprintf(stderr, "Not an ELF file: %s\n", path);
-		fclose(f);
-		exit(1);
+		if ((instr & 3) != 3)
+		{
+			unsigned rs1 = (instr >> 7) & 31;
+			if ((instr & 0xf07f) == 0x8002 && rs1 != 0)
+				return link_reg(rs1) ? kReturn : kNone; // c.jr
+			if ((instr & 0xf07f) == 0x9002 && rs1 != 0)
+				return kCall; // c.jalr
+			return kNone;
+		}
+		unsigned rd = (instr >> 7) & 31;
+		unsigned rs1 = (instr >> 15) & 31;
+		switch (instr & 0x7f)
+		{
+		case 0x6f:
+			return link_reg(rd) ? kCall : kNone;
+		case 0x67:
+			if (link_reg(rd))
+				return kCall;
+			return link_reg(rs1) ? kReturn : kNone;
+		case 0x73:
+			return instr == 0x30200073 || instr == 0x10200073 ? kReturn : kNone; // mret/sret
+		default:
+			return kNone;
+		}
 	}
 
-	// Only accept little-endian for now
-	if (ehdr64.e_ident[EI_DATA] != ELFDATA2LSB)
+	uint32_t child(uint32_t parent, uint32_t sym)
 	{
-		fprintf(stderr, "Unsupported ELF endianness (not little-endian): %s\n", path);
-		fclose(f);
-		exit(1);
+		auto [it, inserted] = children_.try_emplace((uint64_t)parent << 32 | sym, (uint32_t)nodes_.size());
+		if (inserted)
+			nodes_.push_back({parent, sym, nodes_[parent].depth + 1, 0, 0});
+		return it->second;
 	}
 
-	if (ehdr64.e_ident[EI_CLASS] != ELFCLASS64)
+	void retire(uint64_t pc, uint32_t instr)
 	{
-		fprintf(stderr, "Unsupported ELF class (not 64-bit): %s\n", path);
-		fclose(f);
-		exit(1);
+		uint32_t sym = symbols_.lookup(pc);
+		if (push_pending_ && nodes_[node_].depth < kMaxDepth)
+			node_ = child(node_, sym);
+		else if (node_ == 0 || nodes_[node_].sym != sym)
+			node_ = child(nodes_[node_].parent, sym);
+		push_pending_ = false;
+		Node &n = nodes_[node_];
+		n.cycles += pending_cycles_;
+		n.instrs++;
+		pending_cycles_ = 0;
+		switch (link_kind(instr))
+		{
+		case kCall:
+			push_pending_ = true;
+			break;
+		case kReturn:
+			node_ = n.parent;
+			break;
+		case kNone:
+			break;
+		}
 	}
 
-	if (ehdr64.e_phoff == 0 || ehdr64.e_phnum == 0)
+	// Stall reasons in priority order, so a cycle with several is charged
+	// once: LSU backpressure, load-use interlock, an empty decode stage while
+	// the I-cache/ITLB stalls, the refill after a branch redirect, any other
+	// empty frontend, then everything else (traps, fence.i, CSR barriers).
+	void charge_stall(VSoc *dut)
 	{
-		fprintf(stderr, "No program headers in ELF: %s\n", path);
-		fclose(f);
-		exit(1);
+		auto *r = dut->rootp;
+		bool decode_valid = r->SimTop__DOT__core__DOT__idecode__DOT__io_valid_out;
+		uint64_t pc;
+		StallKind kind;
+		if (dut->io_debug_retire)
+		{
+			pc = dut->io_debug_commitPc;
+			kind = kBase;
+			if (redirect_target_valid_ && pc == redirect_target_)
+				redirecting_ = false;
+		}
+		else
+		{
+			if (decode_valid)
+				pc = r->SimTop__DOT__core__DOT__idecode__DOT__io_pc_out;
+			else if (!r->SimTop__DOT__core__DOT__frontendQueue__DOT__io_empty)
+				pc = r->SimTop__DOT__core__DOT__frontendQueue__DOT__io_deq_bits_pc;
+			else
+				pc = dut->io_debug_pc;
+			if (dut->io_debug_lsuStall)
+				kind = dut->io_debug_lsuMmioStall   ? kLsuMmio :
+				       dut->io_debug_lsuAtomicStall ? kLsuAtomic :
+				       dut->io_debug_lsuFenceStall  ? kLsuFence :
+				       dut->io_debug_lsuStoreStall  ? kLsuStore :
+				       dut->io_debug_lsuLoadStall   ? kLsuLoad : kOther;
+			else if (r->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_decodeUsesPending)
+				kind = kLoadUse;
+			else if (dut->io_debug_frontendStarved)
+				kind = kIfetch;
+			else if (redirecting_)
+				kind = kRedirect;
+			else if (!decode_valid && dut->io_debug_frontendQueueEmpty)
+				kind = kFrontend;
+			else
+				kind = kOther;
+		}
+		if (pc != stall_pc_ || stall_counts_ == nullptr)
+		{
+			stall_pc_ = pc;
+			stall_counts_ = &stalls_[pc];
+		}
+		(*stall_counts_)[kind]++;
+
+		// The refill lasts until the first instruction decoded after the
+		// redirect retires.
+		if (dut->io_debug_branchRedirect)
+		{
+			redirecting_ = true;
+			redirect_target_valid_ = false;
+		}
+		else if (redirecting_ && !redirect_target_valid_ && decode_valid)
+		{
+			redirect_target_ = r->SimTop__DOT__core__DOT__idecode__DOT__io_pc_out;
+			redirect_target_valid_ = true;
+		}
+		if (dut->io_debug_arch_event_valid)
+			redirecting_ = false;
 	}
 
-	// Read program headers (Elf64_Phdr)
-	if (fseeko(f, (off_t)ehdr64.e_phoff, SEEK_SET) != 0)
+	// <prefix>.cpi.txt: the CPI stack of every function that retired
+	// something, by total cycles, then the 200 PCs that lost the most cycles.
+	void report_cpi() const
 	{
-		perror("fseeko phoff");
+		static const char *const kNames[kStallKinds] = {"base", "ifetch", "frontend", "load_use", "lsu_load",
+		                                                 "lsu_store", "lsu_mmio", "lsu_atomic", "lsu_fence",
+		                                                 "redirect", "other"};
+		std::string path = out_prefix_ + ".cpi.txt";
+		FILE *f = fopen(path.c_str(), "w");
+		if (f == nullptr)
+		{
+			perror(path.c_str());
+			return;
+		}
+		std::vector<StallCounts> funcs(symbols_.size(), StallCounts{});
+		std::vector<std::pair<uint64_t, const StallCounts *>> pcs;
+		StallCounts total{};
+		for (const auto &[pc, counts] : stalls_)
+		{
+			StallCounts &func = funcs[symbols_.lookup(pc)];
+			for (unsigned k = 0; k < kStallKinds; ++k)
+			{
+				func[k] += counts[k];
+				total[k] += counts[k];
+			}
+			pcs.push_back({pc, &counts});
+		}
+		auto sum = [](const StallCounts &c)
+		{
+			uint64_t n = 0;
+			for (uint64_t v : c)
+				n += v;
+			return n;
+		};
+		// Cycles per retired instruction of the function, by reason.
+		auto print_stack = [&](const StallCounts &c)
+		{
+			for (unsigned k = 0; k < kStallKinds; ++k)
+				fprintf(f, " %10.3f", c[kBase] == 0 ? 0.0 : (double)c[k] / (double)c[kBase]);
+		};
+		// Raw cycles by reason: a PC can stall in decode and be flushed.
+		auto print_cycles = [&](const StallCounts &c)
+		{
+			for (unsigned k = 0; k < kStallKinds; ++k)
+				fprintf(f, " %10" PRIu64, c[k]);
+		};
+		auto print_header = [&](const char *what)
+		{
+			fprintf(f, "%14s %14s %10s", "cycles", "instructions", "cpi");
+			for (const char *name : kNames)
+				fprintf(f, " %10s", name);
+			fprintf(f, "  %s\n", what);
+		};
+
+		uint64_t total_cycles = sum(total);
+		fprintf(f, "# cpi stack: cycles=%" PRIu64 " instructions=%" PRIu64 "\n", total_cycles, total[kBase]);
+		print_header("function");
+		std::vector<uint32_t> order;
+		for (uint32_t sym = 0; sym < funcs.size(); ++sym)
+		{
+			if (funcs[sym][kBase] != 0)
+				order.push_back(sym);
+		}
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sum(funcs[a]) > sum(funcs[b]); });
+		for (uint32_t sym : order)
+		{
+			const StallCounts &c = funcs[sym];
+			fprintf(f, "%14" PRIu64 " %14" PRIu64 " %10.3f", sum(c), c[kBase], (double)sum(c) / (double)c[kBase]);
+			print_stack(c);
+			fprintf(f, "  %s\n", symbols_.name(sym).c_str());
+		}
+
+		// Lost cycles are everything but base.
+		std::sort(pcs.begin(), pcs.end(), [&](const auto &a, const auto &b)
+		          {
+			          uint64_t la = sum(*a.second) - (*a.second)[kBase];
+			          uint64_t lb = sum(*b.second) - (*b.second)[kBase];
+			          return la != lb ? la > lb : a.first < b.first;
+		          });
+		fprintf(f, "\n# stalled PCs, cycles by reason\n");
+		print_header("pc");
+		for (size_t i = 0; i < pcs.size() && i < 200; ++i)
+		{
+			const StallCounts &c = *pcs[i].second;
+			if (sum(c) == c[kBase])
+				break;
+			fprintf(f, "%14" PRIu64 " %14" PRIu64 " %10.3f", sum(c), c[kBase],
+			        c[kBase] == 0 ? 0.0 : (double)sum(c) / (double)c[kBase]);
+			print_cycles(c);
+			uint32_t sym = symbols_.lookup(pcs[i].first);
+			if (sym == ElfSymbols::kUnknown)
+				fprintf(f, "  0x%016" PRIx64 "\n", pcs[i].first);
+			else
+				fprintf(f, "  0x%016" PRIx64 " %s+0x%" PRIx64 "\n", pcs[i].first, symbols_.name(sym).c_str(),
+				        pcs[i].first - symbols_.start(sym));
+		}
 		fclose(f);
-		exit(1);
+
+		printf("[profile-cpi]: cpi=%.3f", total[kBase] == 0 ? 0.0 : (double)total_cycles / (double)total[kBase]);
+		for (unsigned k = 0; k < kStallKinds; ++k)
+			printf(" %s=%.3f", kNames[k], total[kBase] == 0 ? 0.0 : (double)total[k] / (double)total[kBase]);
+		printf("\n[profile-cpi]: wrote %s\n", path.c_str());
 	}
-	Elf64_Phdr *phdrs = new Elf64_Phdr[ehdr64.e_phnum];
-	if (fread(phdrs, sizeof(Elf64_Phdr), ehdr64.e_phnum, f) != (size_t)ehdr64.e_phnum)
+
+	bool enabled_ = false;
+	ElfSymbols symbols_;
+	std::string out_prefix_;
+	// Node 0 is the root; its children are the outermost frames.
+	std::vector<Node> nodes_;
+	std::unordered_map<uint64_t, uint32_t> children_;
+	uint32_t node_ = 0;
+	uint64_t pending_cycles_ = 0;
+	bool push_pending_ = false;
+	std::unordered_map<uint64_t, StallCounts> stalls_;
+	uint64_t stall_pc_ = 0;
+	StallCounts *stall_counts_ = nullptr;
+	bool redirecting_ = false;
+	bool redirect_target_valid_ = false;
+	uint64_t redirect_target_ = 0;
+};
+
+// ION_BRANCH_PROFILE: per-branch-PC predictor statistics from the branch
+// resolution port. The BTB hit and predicted direction of each instruction's
+// fetch travel down the pipeline with it to the resolving branch
+// (io_debug_branchPredHit/PredTaken), so a redirect is blamed on a BTB miss,
+// a wrong direction or a wrong target of that very fetch. It costs the cycles
+// from the redirect to the first retirement after the branch's own, less the
+// one cycle a correct prediction would have taken.
+class BranchProfiler
+{
+  public:
+	bool open(const SimOptions &opts)
 	{
-		fprintf(stderr, "Read program headers failed\n");
-		delete[] phdrs;
-		fclose(f);
-		exit(1);
+		if (!opts.branch_profile)
+			return true;
+		if (!symbols_.load(opts))
+			return false;
+		path_ = (!opts.profile_out.empty() ? opts.profile_out : "simulator/build/profile-" + opts.test_name) +
+		        ".branches.txt";
+		enabled_ = true;
+		return true;
 	}
 
-	// memory pointers: treat DUT mem[] as word array but provide byte view
-	// 原代码使用 32-bit word pointers；这里保留相同写法（假设目标内存为 32-bit word 存储）
-	uint32_t *brom_lo_words = (uint32_t *)&(dut->rootp->SimTop__DOT__brom__DOT__loRom__DOT__mem[0]);
-	uint32_t *brom_hi_words = (uint32_t *)&(dut->rootp->SimTop__DOT__brom__DOT__hiRom__DOT__mem[0]);
-	uint32_t *tlrom_lo_words = (uint32_t *)&(dut->rootp->SimTop__DOT__tlrom__DOT__loRom__DOT__mem[0]);
-	uint32_t *tlrom_hi_words = (uint32_t *)&(dut->rootp->SimTop__DOT__tlrom__DOT__hiRom__DOT__mem[0]);
-	uint32_t *sram_words = (uint32_t *)sram_bytes(dut);
-	std::vector<uint8_t> brom_image(ROM_SIZE, 0);
-	uint8_t *brom_bytes = brom_image.data();
-	uint8_t *sram_bytes = (uint8_t *)sram_words;
+	bool enabled() const { return enabled_; }
 
-	const size_t rom_bytes_size = (size_t)ROM_SIZE;
-	const size_t sram_bytes_size = sram_size;
+	// Rising edge.
+	void sample(VSoc *dut)
+	{
+		cycles_++;
+		if (dut->io_debug_retire)
+			retire(dut->io_debug_commitPc, (uint32_t)dut->io_debug_commitInstr);
+		if (dut->io_debug_arch_event_valid)
+		{
+			resolved_.clear();
+			penalty_ = nullptr;
+		}
+		if (dut->io_debug_branchValid)
+			resolve(dut);
+	}
 
-	// Helper lambda: safe write (reads from file and writes into target_bytes at byte offset)
-	auto write_bytes_to_region = [&](uint8_t *target_bytes, size_t region_bytes,
-									 uint64_t offset_byte, uint64_t file_off, uint64_t filesz)
+	void report() const
 	{
-		if (filesz == 0)
+		if (!enabled_)
+			return;
+		FILE *f = fopen(path_.c_str(), "w");
+		if (f == nullptr)
+		{
+			perror(path_.c_str());
 			return;
-		// clamp
-		if ((uint64_t)offset_byte + (uint64_t)filesz > region_bytes)
-		{
-			size_t can = (offset_byte < region_bytes) ? (region_bytes - offset_byte) : 0;
-			fprintf(stderr, "Warning: truncating write: offset 0x%016" PRIx64 " filesz %" PRIu64 " -> %zu available\n",
-					offset_byte, filesz, can);
-			filesz = (uint64_t)can;
-			if (filesz == 0)
-				return;
 		}
-
-		// If both offset and size are 4-byte aligned, do word writes for performance/endianness clarity
-		if ((offset_byte % 4 == 0) && (filesz % 4 == 0))
+		std::vector<std::pair<uint64_t, const Branch *>> order;
+		std::unordered_map<uint64_t, unsigned> sets;
+		Branch total;
+		Branch kinds[kKinds];
+		for (const auto &[pc, b] : branches_)
 		{
-			size_t word_idx = offset_byte / 4;
-			size_t words = filesz / 4;
-			// seek file
-			if (fseeko(f, (off_t)file_off, SEEK_SET) != 0)
-			{
-				perror("fseeko file_off");
-				return;
-			}
-			for (size_t w = 0; w < words; ++w)
+			order.push_back({pc, &b});
+			sets[btb_index(pc)]++;
+			for (Branch *sum : {&total, &kinds[b.kind]})
 			{
-				uint8_t buf[4];
-				size_t r = fread(buf, 1, 4, f);
-				if (r != 4)
-				{
-					fprintf(stderr, "Warning: short read in word copy (%zu/%zu)\n", r, (size_t)4);
-					break;
-				}
-				// little-endian assemble
-				uint32_t word = (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
-				// write to target words (assume target_bytes is word-addressable as uint32_t array)
-				((uint32_t *)target_bytes)[word_idx + w] = word;
+				sum->execs += b.execs;
+				sum->taken += b.taken;
+				sum->btb_miss += b.btb_miss;
+				sum->mispredicts += b.mispredicts;
+				sum->direction += b.direction;
+				sum->target += b.target;
+				sum->cost += b.cost;
 			}
 		}
-		else
+		std::sort(order.begin(), order.end(), [](const auto &a, const auto &b)
+		          {
+			          if (a.second->cost != b.second->cost)
+				          return a.second->cost > b.second->cost;
+			          if (a.second->mispredicts != b.second->mispredicts)
+				          return a.second->mispredicts > b.second->mispredicts;
+			          return a.first < b.first;
+		          });
+		unsigned shared_sets = 0;
+		for (const auto &[index, n] : sets)
+			shared_sets += n > 1 ? 1 : 0;
+
+		static const char *const kNames[kKinds] = {"cond", "jump", "call", "return", "indirect"};
+		auto pct = [](uint64_t n, uint64_t d) { return d == 0 ? 0.0 : 100.0 * (double)n / (double)d; };
+		fprintf(f, "# branches=%zu executions=%" PRIu64 " mispredicts=%" PRIu64 " (%.2f%%) cost=%" PRIu64
+		           " cycles; btb sets shared by several branches=%u of %u\n",
+		        branches_.size(), total.execs, total.mispredicts, pct(total.mispredicts, total.execs), total.cost,
+		        shared_sets, kBtbEntries);
+		fprintf(f, "# %-8s %12s %8s %12s %8s %10s %10s %10s %12s\n", "kind", "executions", "taken%", "mispredicts",
+		        "miss%", "btb_miss", "direction", "target", "cost");
+		for (unsigned k = 0; k < kKinds; ++k)
 		{
-			// unaligned or non-word-sized: do byte-wise copy
-			if (fseeko(f, (off_t)file_off, SEEK_SET) != 0)
-			{
-				perror("fseeko file_off");
-				return;
-			}
-			size_t to_copy = (size_t)filesz;
-			size_t dest = (size_t)offset_byte;
-			const size_t CHUNK = 1024;
-			uint8_t tmp[CHUNK];
-			while (to_copy > 0)
-			{
-				size_t c = (to_copy > CHUNK) ? CHUNK : to_copy;
-				size_t r = fread(tmp, 1, c, f);
-				if (r == 0)
-					break;
-				memcpy(target_bytes + dest, tmp, r);
-				dest += r;
-				to_copy -= r;
-			}
+			const Branch &b = kinds[k];
+			fprintf(f, "# %-8s %12" PRIu64 " %8.2f %12" PRIu64 " %8.2f %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+			           " %12" PRIu64 "\n",
+			        kNames[k], b.execs, pct(b.taken, b.execs), b.mispredicts, pct(b.mispredicts, b.execs),
+			        b.btb_miss, b.direction, b.target, b.cost);
+		}
+		fprintf(f, "%12s %12s %12s %8s %10s %10s %10s %6s %-8s %-18s %s\n", "cost", "mispredicts", "executions",
+		        "taken%", "btb_miss", "direction", "target", "alias", "kind", "pc", "symbol");
+		for (const auto &[pc, bp] : order)
+		{
+			const Branch &b = *bp;
+			uint32_t sym = symbols_.lookup(pc);
+			fprintf(f, "%12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %8.2f %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+			           " %6u %-8s 0x%016" PRIx64,
+			        b.cost, b.mispredicts, b.execs, pct(b.taken, b.execs), b.btb_miss, b.direction, b.target,
+			        sets.at(btb_index(pc)) - 1, kNames[b.kind], pc);
+			if (sym != ElfSymbols::kUnknown)
+				fprintf(f, " %s+0x%" PRIx64, symbols_.name(sym).c_str(), pc - symbols_.start(sym));
+			fputc('\n', f);
 		}
+		fclose(f);
+		printf("[branch-profile]: %zu branches, %" PRIu64 " of %" PRIu64 " mispredicted (%.2f%%), %" PRIu64
+		       " cycles lost; written to %s\n",
+		       branches_.size(), total.mispredicts, total.execs, pct(total.mispredicts, total.execs), total.cost,
+		       path_.c_str());
+	}
+
+  private:
+	// BranchPredictor(512) in PC.scala: direct mapped on pc[9:1].
+	static const unsigned kBtbEntries = 512;
+
+	enum Kind : uint8_t
+	{
+		kCond,
+		kJump,
+		kCall,
+		kReturn,
+		kIndirect,
+		kKinds,
+	};
+
+	struct Branch
+	{
+		uint64_t execs = 0;
+		uint64_t taken = 0;
+		uint64_t btb_miss = 0;
+		uint64_t mispredicts = 0;
+		uint64_t direction = 0;
+		uint64_t target = 0;
+		uint64_t cost = 0;
+		Kind kind = kCond;
 	};
 
-	auto mirror_rom_to_rtl = [&](uint64_t offset_byte, uint64_t filesz)
+	static unsigned btb_index(uint64_t pc) { return (unsigned)(pc >> 1) & (kBtbEntries - 1); }
+
+	static bool link_reg(unsigned r) { return r == 1 || r == 5; }
+
+	static Kind kind_of(uint32_t instr)
 	{
-		uint64_t end = offset_byte + filesz;
-		if (end > rom_bytes_size)
+		if ((instr & 3) != 3)
 		{
-			end = rom_bytes_size;
+			unsigned funct3 = (instr >> 13) & 7;
+			unsigned rs1 = (instr >> 7) & 31;
+			if ((instr & 3) == 1)
+				return funct3 == 5 ? kJump : kCond; // c.j, c.beqz/c.bnez
+			if ((instr & 0xf07f) == 0x9002)
+				return kCall; // c.jalr
+			return link_reg(rs1) ? kReturn : kIndirect; // c.jr
 		}
-		for (uint64_t byte = offset_byte; byte < end; byte += 4)
+		unsigned rd = (instr >> 7) & 31;
+		unsigned rs1 = (instr >> 15) & 31;
+		switch (instr & 0x7f)
 		{
-			uint32_t word = ((uint32_t *)brom_bytes)[byte / 4];
-			uint64_t word_idx = byte / 4;
-			brom_lo_words[word_idx] = word;
-			brom_hi_words[word_idx] = word;
-			if ((word_idx & 1) == 0)
-			{
-				tlrom_lo_words[word_idx] = word;
-			}
+		case 0x6f:
+			return link_reg(rd) ? kCall : kJump;
+		case 0x67:
+			if (link_reg(rd))
+				return kCall;
+			return link_reg(rs1) ? kReturn : kIndirect;
+		default:
+			return kCond;
+		}
+	}
+
+	void resolve(VSoc *dut)
+	{
+		auto *r = dut->rootp;
+		uint64_t pc = r->SimTop__DOT__core__DOT__pc__DOT__io_br_info_pc;
+		bool taken = dut->io_debug_branchTaken;
+		Branch &b = branches_[pc];
+		b.execs++;
+		b.taken += taken ? 1 : 0;
+		if (dut->io_debug_branchRedirect)
+		{
+			// The BTB lookup made when this branch was fetched travels down
+			// the pipeline with it, so re-fetches cannot mix up predictions.
+			b.mispredicts++;
+			if (!dut->io_debug_branchPredHit)
+				b.btb_miss++;
+			else if ((bool)dut->io_debug_branchPredTaken != taken)
+				b.direction++;
 			else
-			{
-				tlrom_hi_words[word_idx] = word;
-			}
+				b.target++;
+			penalty_ = &b;
+			penalty_pc_ = pc;
+			penalty_from_ = cycles_;
+			penalty_branch_retired_ = false;
 		}
-	};
+		// The kind comes from the instruction when it retires; the core
+		// retires branches in the order it resolves them.
+		if (resolved_.size() == kResolved)
+			resolved_.pop_front();
+		resolved_.push_back(pc);
+	}
 
-	// Iterate program headers
-	for (int i = 0; i < (int)ehdr64.e_phnum; ++i)
+	void retire(uint64_t pc, uint32_t instr)
 	{
-		Elf64_Phdr &ph = phdrs[i];
-		// debug print
-		printf("PHDR %d: type=%" PRIu32 " vaddr=0x%016" PRIx64 " off=0x%016" PRIx64 " filesz=%" PRIu64 " memsz=%" PRIu64 "\n",
-			   i, (uint32_t)ph.p_type, (uint64_t)ph.p_vaddr, (uint64_t)ph.p_offset, (uint64_t)ph.p_filesz, (uint64_t)ph.p_memsz);
+		if (!resolved_.empty() && resolved_.front() == pc)
+		{
+			branches_[pc].kind = kind_of(instr);
+			resolved_.pop_front();
+		}
+		if (penalty_ == nullptr)
+			return;
+		if (!penalty_branch_retired_)
+		{
+			penalty_branch_retired_ = pc == penalty_pc_;
+			return;
+		}
+		uint64_t lost = cycles_ - penalty_from_;
+		penalty_->cost += lost > 0 ? lost - 1 : 0;
+		penalty_ = nullptr;
+	}
 
-		if (ph.p_type != PT_LOAD)
-			continue;
+	static const unsigned kResolved = 4;
 
-		uint64_t vaddr = (uint64_t)ph.p_vaddr;
-		uint64_t filesz = (uint64_t)ph.p_filesz;
-		uint64_t memsz = (uint64_t)ph.p_memsz;
+	bool enabled_ = false;
+	ElfSymbols symbols_;
+	std::string path_;
+	std::unordered_map<uint64_t, Branch> branches_;
+	std::deque<uint64_t> resolved_;
+	uint64_t cycles_ = 0;
+	Branch *penalty_ = nullptr;
+	uint64_t penalty_pc_ = 0;
+	uint64_t penalty_from_ = 0;
+	bool penalty_branch_retired_ = false;
+};
 
-		uint8_t *target_bytes = nullptr;
-		size_t region_bytes = 0;
-		uint64_t offset_in_region = 0;
-		const char *region_name = nullptr;
+void load_blob_to_sram(VSoc *dut, const char *path, uint64_t paddr, uint64_t sram_base, size_t sram_size)
+{
+	const auto start = std::chrono::steady_clock::now();
+	MappedFile file;
+	if (!file.open(path))
+		exit(1);
+	write_sram_bytes(dut, sram_base, sram_size, paddr, file.data(), file.size());
+	printf("[boot]: loaded blob %s -> SRAM 0x%016" PRIx64 " (%zu bytes) in %.3f ms\n", path, paddr, file.size(), elapsed_ms(start));
+}
 
-		if (vaddr >= (uint64_t)BROM_BASE && vaddr < (uint64_t)BROM_BASE + (uint64_t)ROM_SIZE)
-		{
-			target_bytes = brom_bytes;
-			region_bytes = rom_bytes_size;
-			offset_in_region = vaddr - (uint64_t)BROM_BASE;
-			region_name = "ROM";
-		}
-		else if (vaddr >= sram_base && vaddr < sram_base + (uint64_t)sram_bytes_size)
+static void check_sram_capacity(VSoc *dut, size_t sram_size)
+{
+	size_t rtl_capacity = rtl_sram_capacity_bytes(dut);
+	if (sram_size > rtl_capacity)
+	{
+		fprintf(stderr, "Requested SRAM size 0x%zx exceeds RTL SRAM capacity 0x%zx. Rebuild the matching Verilator profile.\n",
+		        sram_size, rtl_capacity);
+		exit(1);
+	}
+}
+
+void ram_init(VSoc *dut, size_t sram_size = DEFAULT_SRAM_SIZE)
+{
+	check_sram_capacity(dut, sram_size);
+#if ION_SPARSE_SRAM
+	model_sram()->clear();
+#else
+	const size_t WORDS = sram_size / 8; // Memory is 64-bit wide
+	for (size_t i = 0; i < WORDS; ++i)
+	{
+		dut->rootp->SimTop__DOT__sram__DOT__mem_ext__DOT__Memory[i] = 0x0;
+	}
+#endif
+}
+
+// Model reuse (ION_MODEL_REUSE, on unless set to 0): each thread keeps its
+// last VerilatedContext and VSoc and hands them to the next run_sim, so a
+// batch pays model construction and the full SRAM clear once per worker
+// instead of once per test. A reused model is put back by hand before the
+// reset sequence: the ROM arrays from the copy taken after their initial
+// blocks first ran, the register file zeroed, and only the SRAM pages written
+// since the previous run cleared. SRAM writes are collected from the harness
+// loaders and, every cycle, from the SRAM TileLink A (Put) and C (Release)
+// ports. Registers without a reset value keep what the previous run left in
+// them, as they would across a warm reset. SPARSE_SRAM builds skip the write
+// tracking and simply drop every SparseSram page.
+class ModelCache
+{
+  public:
+	static const size_t kPage = 4096;
+
+	~ModelCache() { discard(); }
+
+	// A model that cannot be handed on (VCD, checkpoint restore, fork fan-out)
+	// is built fresh and dropped again by release().
+	VSoc *acquire(bool reusable, unsigned threads)
+	{
+		if (!reusable || !dut_ || threads != threads_)
 		{
-			target_bytes = sram_bytes;
-			region_bytes = sram_bytes_size;
-			offset_in_region = vaddr - sram_base;
-			region_name = "SRAM";
+			discard();
+			context_.reset(new VerilatedContext);
+			context_->commandArgs(sim_argc, sim_argv);
+			if (threads != 0)
+				context_->threads(threads);
+			dut_.reset(new VSoc(context_.get()));
+			threads_ = threads;
 		}
-		else
+		keep_ = reusable;
+		return dut_.get();
+	}
+
+	VerilatedContext *context() { return context_.get(); }
+	bool tracking() const
+	{
+#if ION_SPARSE_SRAM
+		return false;
+#else
+		return keep_;
+#endif
+	}
+
+#if ION_SPARSE_SRAM
+	SparseSram *sram()
+	{
+		if (!sram_)
+			sram_ = std::move(attached_sram);
+		if (!sram_)
 		{
-			printf("Warning: PT_LOAD at vaddr 0x%016" PRIx64 " (filesz=%" PRIu64 ") outside ROM/SRAM -> skip\n", vaddr, filesz);
-			continue;
+			fprintf(stderr, "SPARSE_SRAM build, but the SRAM backend never called ion_sram_attach\n");
+			exit(1);
 		}
+		return sram_.get();
+	}
+#endif
 
-		// write file bytes to region
-		if (filesz > 0)
+	// Stands in for ram_init. Must run after the first eval() so a fresh
+	// model's ROM copy includes what the initial blocks loaded.
+	void clear_memories(VSoc *dut, size_t sram_size)
+	{
+		auto *r = dut->rootp;
+		std::vector<uint32_t *> roms = {
+			(uint32_t *)&r->SimTop__DOT__brom__DOT__loRom__DOT__mem[0],
+			(uint32_t *)&r->SimTop__DOT__brom__DOT__hiRom__DOT__mem[0],
+			(uint32_t *)&r->SimTop__DOT__tlrom__DOT__loRom__DOT__mem[0],
+			(uint32_t *)&r->SimTop__DOT__tlrom__DOT__hiRom__DOT__mem[0],
+		};
+		const size_t rom_bytes = sizeof(r->SimTop__DOT__brom__DOT__loRom__DOT__mem);
+		const size_t capacity = rtl_sram_capacity_bytes(dut);
+		if (!keep_ || dirty_.empty())
 		{
-			write_bytes_to_region(target_bytes, region_bytes, offset_in_region, ph.p_offset, filesz);
-			if (target_bytes == brom_bytes)
-			{
-				mirror_rom_to_rtl(offset_in_region, filesz);
-			}
-			printf("  -> wrote %" PRIu64 " bytes to %s @ offset 0x%016" PRIx64 "\n", filesz, region_name, offset_in_region);
+			ram_init(dut, sram_size);
+			rom_copy_.resize(roms.size() * rom_bytes / sizeof(uint32_t));
+			for (size_t i = 0; i < roms.size(); ++i)
+				memcpy(&rom_copy_[i * rom_bytes / sizeof(uint32_t)], roms[i], rom_bytes);
+			dirty_.assign((capacity + kPage - 1) / kPage, 0);
+			return;
 		}
 
-		// zero initialize BSS tail (memsz > filesz)
-		if (memsz > filesz)
+		check_sram_capacity(dut, sram_size);
+		for (size_t i = 0; i < roms.size(); ++i)
+			memcpy(roms[i], &rom_copy_[i * rom_bytes / sizeof(uint32_t)], rom_bytes);
+		memset(&r->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[0], 0,
+		       sizeof(r->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory));
+#if ION_SPARSE_SRAM
+		const size_t released = sram()->resident_pages();
+		sram()->clear();
+		printf("[sim]: reusing model; released %zu SRAM pages\n", released);
+#else
+		size_t cleared = 0;
+		for (size_t page = 0; page < dirty_.size(); ++page)
 		{
-			uint64_t zero_start = offset_in_region + filesz;
-			uint64_t zero_len = memsz - filesz;
-			if (zero_start < region_bytes)
-			{
-				if (zero_start + zero_len > region_bytes)
-				{
-					zero_len = region_bytes - zero_start;
-				}
-				if (zero_len > 0)
-				{
-					memset(target_bytes + (size_t)zero_start, 0, (size_t)zero_len);
-					printf("  -> zeroed %" PRIu64 " bytes in %s @ offset 0x%016" PRIx64 "\n", zero_len, region_name, zero_start);
-				}
-			}
+			if (!dirty_[page])
+				continue;
+			const size_t off = page * kPage;
+			memset(sram_bytes(dut) + off, 0, std::min(kPage, capacity - off));
+			dirty_[page] = 0;
+			++cleared;
 		}
+		printf("[sim]: reusing model; cleared %zu of %zu SRAM pages\n", cleared, dirty_.size());
+#endif
 	}
 
-	delete[] phdrs;
-	fclose(f);
-}
-
-void load_blob_to_sram(VSoc *dut, const char *path, uint64_t paddr, uint64_t sram_base, size_t sram_size)
-{
-	FILE *f = fopen(path, "rb");
-	if (!f)
+	void note_sram_write(uint64_t offset, uint64_t len)
 	{
-		perror("blob fopen");
-		exit(1);
+		if (!keep_ || dirty_.empty() || len == 0)
+			return;
+		const uint64_t capacity = (uint64_t)dirty_.size() * kPage;
+		if (offset >= capacity || len > capacity - offset)
+		{
+			std::fill(dirty_.begin(), dirty_.end(), 1);
+			return;
+		}
+		for (uint64_t page = offset / kPage; page <= (offset + len - 1) / kPage; ++page)
+			dirty_[page] = 1;
 	}
-	if (fseek(f, 0, SEEK_END) != 0)
+
+	// Call once per cycle; the ports carry one 8-byte beat per handshake.
+	void sample_bus_writes(VSoc *dut, uint64_t sram_base)
 	{
-		perror("blob fseek");
-		fclose(f);
-		exit(1);
+		auto *r = dut->rootp;
+		if (r->SimTop__DOT__sram__DOT__io_tl_a_valid && r->SimTop__DOT__sram__DOT__io_tl_a_ready &&
+		    r->SimTop__DOT__sram__DOT__io_tl_a_bits_opcode <= 1)
+			note_sram_write((uint64_t)r->SimTop__DOT__sram__DOT__io_tl_a_bits_address - sram_base, 8);
+		if (r->SimTop__DOT__sram__DOT__io_tl_c_valid && r->SimTop__DOT__sram__DOT__io_tl_c_ready)
+			note_sram_write((uint64_t)r->SimTop__DOT__sram__DOT__io_tl_c_bits_address - sram_base, 8);
 	}
-	long size = ftell(f);
-	if (size < 0)
+
+	void release()
 	{
-		perror("blob ftell");
-		fclose(f);
-		exit(1);
+		if (!keep_)
+			discard();
 	}
-	rewind(f);
-	std::vector<uint8_t> data((size_t)size);
-	if (!data.empty() && fread(data.data(), 1, data.size(), f) != data.size())
+
+  private:
+	void discard()
 	{
-		fprintf(stderr, "short blob read: %s\n", path);
-		fclose(f);
-		exit(1);
+		if (dut_)
+			dut_->final();
+		dut_.reset();
+		context_.reset();
+#if ION_SPARSE_SRAM
+		sram_.reset();
+#endif
+		rom_copy_.clear();
+		dirty_.clear();
 	}
-	fclose(f);
-	write_sram_bytes(dut, sram_base, sram_size, paddr, data.data(), data.size());
-	printf("[boot]: loaded blob %s -> SRAM 0x%016" PRIx64 " (%zu bytes)\n", path, paddr, data.size());
+
+	std::unique_ptr<VerilatedContext> context_;
+	std::unique_ptr<VSoc> dut_;
+	unsigned threads_ = 0;
+	bool keep_ = false;
+	std::vector<uint32_t> rom_copy_;
+	std::vector<uint8_t> dirty_;
+#if ION_SPARSE_SRAM
+	std::unique_ptr<SparseSram> sram_;
+#endif
+};
+
+thread_local ModelCache model_cache;
+
+#if ION_SPARSE_SRAM
+static SparseSram *model_sram()
+{
+	return model_cache.sram();
 }
+#endif
 
-void ram_init(VSoc *dut, size_t sram_size = DEFAULT_SRAM_SIZE)
+static void note_sram_write(uint64_t offset, uint64_t len)
 {
-	size_t rtl_capacity = rtl_sram_capacity_bytes(dut);
-	if (sram_size > rtl_capacity)
-	{
-		fprintf(stderr, "Requested SRAM size 0x%zx exceeds RTL SRAM capacity 0x%zx. Rebuild the matching Verilator profile.\n",
-		        sram_size, rtl_capacity);
-		exit(1);
-	}
-	const size_t WORDS = sram_size / 8; // Memory is 64-bit wide
-	for (size_t i = 0; i < WORDS; ++i)
-	{
-		dut->rootp->SimTop__DOT__sram__DOT__mem_ext__DOT__Memory[i] = 0x0;
-	}
+	model_cache.note_sram_write(offset, len);
 }
 
 bool run_one_test(const std::string &bin_path,
 				  const std::string &test_name, bool trace_en,
-				  const std::string &expected_uart)
+				  const std::string &expected_uart,
+				  SimStats *stats)
 {
 	SimOptions opts;
 	opts.elf_path = bin_path;
@@ -1050,16 +6576,40 @@ bool run_one_test(const std::string &bin_path,
 	const char *flash = std::getenv("ION_FLASH_IMAGE");
 	if (flash != nullptr)
 		opts.flash_image = flash;
-	return run_sim(opts);
+	return run_sim(opts, stats);
 }
 
-bool run_sim(const SimOptions &opts)
+bool run_sim(const SimOptions &sim_opts, SimStats *stats)
 {
-	VSoc *dut = new VSoc;
+	// Forked children rename the test and swap the expected UART text.
+	SimOptions opts = sim_opts;
+	if (!apply_cpu_affinity(opts.sim_cpus))
+		return false;
+	const bool restoring = !opts.checkpoint_restore.empty();
+#if !ION_SIM_SAVABLE
+	if (restoring)
+	{
+		fprintf(stderr, "ION_CHECKPOINT_RESTORE needs a SAVABLE=1 build\n");
+		return false;
+	}
+	if (!opts.checkpoint_save.empty())
+		printf("[checkpoint]: ION_CHECKPOINT_SAVE requested, but this binary was built without SAVABLE=1; checkpoint disabled.\n");
+#endif
+	// Each thread owns its context so the thread pool size (and the PGO
+	// profile written on teardown by --prof-pgo builds) is scoped to the
+	// simulations that thread runs.
+	const bool reusable = opts.model_reuse && !opts.trace_wave && !restoring && opts.fork_manifest.empty();
+	const auto model_start = std::chrono::steady_clock::now();
+	VSoc *dut = model_cache.acquire(reusable, opts.sim_threads);
+	const double model_ms = elapsed_ms(model_start);
+	const auto load_start = std::chrono::steady_clock::now();
+	VerilatedContext *contextp = model_cache.context();
+	if (dut->threads() > 1 || opts.sim_threads != 0)
+		printf("[sim]: verilator model threads=%u context threads=%u\n", dut->threads(), contextp->threads());
 #if VM_TRACE
-	VerilatedVcdC *tfp = new VerilatedVcdC;
+	WaveFile *tfp = new WaveFile;
 #else
-	void *tfp = nullptr;
+	WaveFile *tfp = nullptr;
 	if (opts.trace_wave)
 		printf("[trace]: ION_TRACE_WAVE requested, but this binary was built without TRACE=1; VCD disabled.\n");
 #endif
@@ -1074,22 +6624,30 @@ bool run_sim(const SimOptions &opts)
 	dut->io_jtag_tms = 1;
 	dut->io_jtag_tck = 0;
 	dut->io_jtag_tdi = 0;
+	dut->io_dmi_req_valid = 0;
 	// Run Verilator initial blocks before preloading memories; ROM initial
 	// blocks clear their arrays and would otherwise wipe harness-loaded ELFs.
 	dut->eval();
 
-	ram_init(dut, opts.sram_size);
+	BootProgress progress;
+	PerfCounters perf;
+	if (!restoring)
+		model_cache.clear_memories(dut, opts.sram_size);
 
 	FlashImage flash;
 	if (!flash.load(opts.flash_image))
 	{
-		delete dut;
+		model_cache.release();
 #if VM_TRACE
 		delete tfp;
 #endif
 		return false;
 	}
-	if (opts.direct_elf_load)
+	if (restoring)
+	{
+		// Memory images come from the checkpoint below.
+	}
+	else if (opts.direct_elf_load)
 	{
 		load_elf_to_regions(dut, opts.elf_path.c_str(), opts.sram_base, opts.sram_size);
 		if (!opts.second_elf_path.empty())
@@ -1112,50 +6670,126 @@ bool run_sim(const SimOptions &opts)
 	dut->io_jtag_tck = 0;
 	dut->io_jtag_tdi = 0;
 
-	if (opts.trace_wave)
+	WaveCapture wave;
+	if (!wave.configure(opts))
 	{
+		model_cache.release();
 #if VM_TRACE
-		Verilated::traceEverOn(true);
-		dut->trace(tfp, 99);
-		tfp->open(kWavePath);
+		delete tfp;
 #endif
+		return false;
 	}
+	if (opts.trace_wave)
+		wave.attach(contextp, dut, tfp);
 	else
-		Verilated::traceEverOn(false);
+		contextp->traceEverOn(false);
 
 	dut->clock = 0;
 	dut->reset = 1;
 
-	UartStdio uart(opts.uart_stdin);
+	HostIo host_io(opts.io_poll_cycles);
+	UartStdio uart(opts.uart_stdin, host_io, opts);
 	InterruptModel irq(opts.trace_irq);
-	RemoteBitbang jtag(opts.jtag_rbb_port, opts.jtag_only);
-	if (!jtag.init())
+	RemoteBitbang jtag(opts.jtag_rbb_port, host_io, opts.jtag_only);
+	DmiServer dmi(opts.dmi_port, host_io);
+	if (!jtag.init() || !dmi.init())
+	{
+		model_cache.release();
+#if VM_TRACE
+		delete tfp;
+#endif
+		return false;
+	}
+
+#if ION_SIM_SAVABLE
+	if (restoring && !load_checkpoint(opts.checkpoint_restore, dut, uart, progress, perf))
+	{
+		model_cache.release();
+#if VM_TRACE
+		delete tfp;
+#endif
+		return false;
+	}
+#endif
+
+	// A restored model is already past the point the ISS would cover.
+	const bool use_iss = !restoring && (opts.iss_insns != 0 || opts.iss_until_pc != UINT64_MAX || !opts.iss_until_uart.empty());
+#if ION_SPARSE_SRAM
+	if (use_iss)
 	{
-		delete dut;
+		fprintf(stderr, "ION_ISS_* needs the flat SRAM array; this binary was built with SPARSE_SRAM=1\n");
+		model_cache.release();
 #if VM_TRACE
 		delete tfp;
 #endif
 		return false;
 	}
+#endif
+
+	ForkFanout fanout;
+	bool fork_pending = false;
+	bool fork_parent = false;
+	int fork_index = -1;
+	if (!opts.fork_manifest.empty())
+	{
+		// Children must not share a VCD, a JTAG socket or stdin, and fork()
+		// does not carry Verilator's worker threads across.
+		const char *why = opts.trace_wave ? "ION_TRACE_WAVE" :
+		                  opts.jtag_rbb_port != 0 ? "ION_JTAG_RBB_PORT" :
+		                  opts.uart_stdin ? "ION_UART_STDIN" :
+		                  !opts.commit_trace.empty() ? "ION_COMMIT_TRACE" :
+		                  dut->threads() > 1 ? "a multi-threaded model" :
+		                  use_iss ? "ISS fast-forward (ION_ISS_*)" :
+		                  !opts.inject_boot_args ? "a run without an SBI payload handoff" : nullptr;
+		if (why != nullptr || !fanout.load(opts.fork_manifest))
+		{
+			if (why != nullptr)
+				fprintf(stderr, "ION_FORK_MANIFEST cannot be combined with %s\n", why);
+			model_cache.release();
+#if VM_TRACE
+			delete tfp;
+#endif
+			return false;
+		}
+		fork_pending = true;
+	}
+	WaveRewind rewind(wave.rewind_depth());
+	if (rewind.enabled())
+	{
+		// The replay re-runs the history, so its inputs must be reproducible.
+		const char *why = opts.jtag_rbb_port != 0 ? "ION_JTAG_RBB_PORT" :
+		                  opts.dmi_port != 0 ? "ION_DMI_PORT" :
+		                  opts.uart_stdin ? "ION_UART_STDIN" :
+		                  !opts.commit_trace.empty() ? "ION_COMMIT_TRACE" :
+		                  !opts.fork_manifest.empty() ? "ION_FORK_MANIFEST" :
+		                  dut->threads() > 1 ? "a multi-threaded model" : nullptr;
+		if (why != nullptr)
+		{
+			fprintf(stderr, "ION_WAVE_PRE cannot be combined with %s\n", why);
+			model_cache.release();
+#if VM_TRACE
+			delete tfp;
+#endif
+			return false;
+		}
+	}
 
-	for (int i = 0; i < 6; ++i)
+	for (int i = 0; i < 6 && !restoring; ++i)
 	{
+		host_io.poll(sim_time);
 		irq.drive(dut, opts.test_name, sim_time);
 		uart.drive_rx(dut, sim_time);
 		jtag.drive(dut);
+		dmi.drive(dut);
 		dut->clock ^= 1;
 		dut->eval();
-		if (opts.trace_wave)
-#if VM_TRACE
-			tfp->dump(sim_time);
-#else
-			(void)tfp;
-#endif
+		if (wave.dumping())
+			wave.dump(sim_time);
 		sim_time++;
 	}
 
 	dut->reset = 0;
-	if (opts.inject_boot_args)
+	if (opts.inject_boot_args && !restoring)
 	{
 		dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[10] = opts.boot_a0;
 		dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[11] = opts.boot_a1;
@@ -1166,709 +6800,318 @@ bool run_sim(const SimOptions &opts)
 		       opts.boot_a0, opts.boot_a1, opts.boot_a2);
 	}
 
+	const double load_ms = elapsed_ms(load_start);
 	printf("\n--- UART output ---\n");
+	if (use_iss)
+	{
+#if !ION_SPARSE_SRAM
+		fast_forward_iss(dut, opts, uart, progress);
+		// The ISS stores straight into the SRAM array, behind the bus ports.
+		note_sram_write(0, rtl_sram_capacity_bytes(dut));
+#endif
+	}
+	const bool track_sram = model_cache.tracking();
+	const auto wall_start = std::chrono::steady_clock::now();
+	const uint64_t sim_time_start = sim_time;
 	bool saw_exit = false;
 	bool stopped_on_payload_entry = false;
 	bool stopped_on_uart_match = false;
-	bool trace_cpu = std::getenv("ION_TRACE_CPU") != nullptr;
-	bool trace_cpu_every = env_enabled("ION_TRACE_CPU_EVERY");
-	bool trace_pc_escape = env_enabled("ION_TRACE_PC_ESCAPE");
-	bool trace_map_u32 = env_enabled("ION_TRACE_MAP_U32");
-	bool trace_ret = env_enabled("ION_TRACE_RET");
-	bool trace_csr = env_enabled("ION_TRACE_CSR");
-	bool trace_atomic = env_enabled("ION_TRACE_ATOMIC");
-	bool trace_lsu_ptw = env_enabled("ION_TRACE_LSU_PTW");
-	bool trace_dmem = env_enabled("ION_TRACE_DMEM");
 	bool disable_exit_check = env_enabled("ION_DISABLE_EXIT_CHECK");
 	bool stop_on_payload_entry = opts.stop_on_payload_entry || env_enabled("ION_STOP_ON_PAYLOAD_ENTRY");
-	uint64_t trace_pc_start = env_u64("ION_TRACE_PC_START", 0);
-	uint64_t trace_pc_end = env_u64("ION_TRACE_PC_END", UINT64_MAX);
-	uint64_t trace_atomic_addr = env_u64("ION_TRACE_ATOMIC_ADDR", 0);
-	uint64_t trace_lsu_ptw_vaddr = env_u64("ION_TRACE_LSU_PTW_VADDR", 0);
-	uint64_t trace_dmem_addr = env_u64("ION_TRACE_DMEM_ADDR", 0);
-	uint64_t trace_dmem_pc_start = env_u64("ION_TRACE_DMEM_PC_START", 0);
-	uint64_t trace_dmem_pc_end = env_u64("ION_TRACE_DMEM_PC_END", UINT64_MAX);
 	bool trace_boot = env_enabled("ION_TRACE_BOOT");
-	bool saw_rom_pc = false;
-	bool saw_sram_pc = false;
-	bool saw_payload_pc = false;
-	bool saw_pc_escape = false;
-	uint64_t last_pc = UINT64_MAX;
-	uint64_t prev_pc = UINT64_MAX;
-	bool prev_pc_valid = false;
-	uint64_t last_mtimecmp = UINT64_MAX;
-	uint8_t last_mtip = 0xff;
-	uint8_t last_dmi_valid = 0;
-	uint8_t last_lsu_ptw_state = 0xff;
-	uint8_t last_lsu_ptw_level = 0xff;
-	uint64_t perf_cycles = 0;
-	uint64_t perf_retired = 0;
-	uint64_t perf_stall_cycles = 0;
-	uint64_t perf_ifetch_stall_cycles = 0;
-	uint64_t perf_ifetch_only_stall_cycles = 0;
-	uint64_t perf_ifetch_lsu_overlap_cycles = 0;
-	uint64_t perf_frontend_starved_cycles = 0;
-	uint64_t perf_frontend_queue_full_cycles = 0;
-	uint64_t perf_frontend_queue_empty_cycles = 0;
-	uint64_t perf_lsu_stall_cycles = 0;
-	uint64_t perf_lsu_load_stall_cycles = 0;
-	uint64_t perf_lsu_store_stall_cycles = 0;
-	uint64_t perf_lsu_mmio_stall_cycles = 0;
-	uint64_t perf_lsu_atomic_stall_cycles = 0;
-	uint64_t perf_lsu_fence_stall_cycles = 0;
-	uint64_t perf_decode_load_use_cycles = 0;
-	uint64_t perf_lsu_load_only_cycles = 0;
-	uint64_t perf_lsu_store_only_cycles = 0;
-	uint64_t perf_lsu_fence_only_cycles = 0;
-	uint64_t perf_branch_count = 0;
-	uint64_t perf_branch_taken = 0;
-	uint64_t perf_branch_redirect = 0;
-	uint64_t perf_branch_pred_taken = 0;
-	uint64_t perf_branch_pred_correct = 0;
-
-	while (opts.max_cycles == 0 || sim_time < opts.max_cycles)
+	bool checkpoint_pending = !opts.checkpoint_save.empty();
+	bool stopped_on_checkpoint = false;
+	ProbeSet probes;
+	if (!setup_probes(probes, opts))
 	{
-		irq.drive(dut, opts.test_name, sim_time);
-		uart.drive_rx(dut, sim_time);
-		jtag.drive(dut);
-
-		dut->clock ^= 1;
-		dut->eval();
-		if (opts.trace_wave)
+		model_cache.release();
 #if VM_TRACE
-			tfp->dump(sim_time);
-#else
-			(void)tfp;
+		delete tfp;
 #endif
+		return false;
+	}
+	CommitTraceWriter commit_trace;
+	if (!opts.commit_trace.empty() && !commit_trace.open(opts.commit_trace))
+	{
+		model_cache.release();
+#if VM_TRACE
+		delete tfp;
+#endif
+		return false;
+	}
+	PerfTimeline timeline;
+	RoiRegions roi;
+	if (!timeline.open(opts, perf) || !roi.open(opts))
+	{
+		model_cache.release();
+#if VM_TRACE
+		delete tfp;
+#endif
+		return false;
+	}
+	const bool sample_perf = opts.perf_report || timeline.enabled();
+	PcProfiler profiler;
+	BranchProfiler branches;
+	if (!profiler.open(opts) || !branches.open(opts))
+	{
+		model_cache.release();
+#if VM_TRACE
+		delete tfp;
+#endif
+		return false;
+	}
+	CommitPort commit_port;
+	FlightRecorder flight;
+	flight.open(opts.flight_events, opts.flight_out);
+	const bool sample_commits = flight.enabled() || commit_trace.enabled();
+	IdleSkipper idle;
+	uint64_t idle_skipped = 0;
+	if (opts.idle_skip)
+		printf("[idle]: skipping WFI and timer-poll windows to mtimecmp\n");
 
-		uint64_t cur_mtimecmp = last_mtimecmp;
-		uint8_t cur_mtip = last_mtip;
-		bool trace_state_change = false;
-		if (trace_cpu)
-		{
-			cur_mtimecmp = dut->rootp->SimTop__DOT__clint__DOT__mtimecmp;
-			cur_mtip = (dut->rootp->SimTop__DOT__clint__DOT__mtimecmp != 0) &&
-					   (dut->rootp->SimTop__DOT__clint__DOT__mtime >= dut->rootp->SimTop__DOT__clint__DOT__mtimecmp);
-			trace_state_change = cur_mtip != last_mtip || cur_mtimecmp != last_mtimecmp;
-		}
-		uint64_t pc_now = dut->io_debug_pc;
-		if (opts.perf_report && dut->clock)
-		{
-			perf_cycles++;
-			perf_retired += dut->io_debug_retire ? 1 : 0;
-			perf_stall_cycles += dut->io_debug_stall ? 1 : 0;
-			perf_ifetch_stall_cycles += dut->io_debug_ifetchStall ? 1 : 0;
-			perf_lsu_stall_cycles += dut->io_debug_lsuStall ? 1 : 0;
-			perf_ifetch_only_stall_cycles += (dut->io_debug_ifetchStall && !dut->io_debug_lsuStall) ? 1 : 0;
-			perf_ifetch_lsu_overlap_cycles += (dut->io_debug_ifetchStall && dut->io_debug_lsuStall) ? 1 : 0;
-			perf_frontend_starved_cycles += dut->io_debug_frontendStarved ? 1 : 0;
-			perf_frontend_queue_full_cycles += dut->io_debug_frontendQueueFull ? 1 : 0;
-			perf_frontend_queue_empty_cycles += dut->io_debug_frontendQueueEmpty ? 1 : 0;
-			perf_lsu_load_stall_cycles += dut->io_debug_lsuLoadStall ? 1 : 0;
-			perf_lsu_store_stall_cycles += dut->io_debug_lsuStoreStall ? 1 : 0;
-			perf_lsu_mmio_stall_cycles += dut->io_debug_lsuMmioStall ? 1 : 0;
-			perf_lsu_atomic_stall_cycles += dut->io_debug_lsuAtomicStall ? 1 : 0;
-			perf_lsu_fence_stall_cycles += dut->io_debug_lsuFenceStall ? 1 : 0;
-			perf_decode_load_use_cycles += dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_decodeUsesPending ? 1 : 0;
-			perf_lsu_load_only_cycles += (dut->io_debug_lsuLoadStall && !dut->io_debug_lsuStoreStall && !dut->io_debug_lsuFenceStall) ? 1 : 0;
-			perf_lsu_store_only_cycles += (dut->io_debug_lsuStoreStall && !dut->io_debug_lsuLoadStall && !dut->io_debug_lsuFenceStall) ? 1 : 0;
-			perf_lsu_fence_only_cycles += (dut->io_debug_lsuFenceStall && !dut->io_debug_lsuLoadStall && !dut->io_debug_lsuStoreStall) ? 1 : 0;
-			perf_branch_count += dut->io_debug_branchValid ? 1 : 0;
-			perf_branch_taken += dut->io_debug_branchTaken ? 1 : 0;
-			perf_branch_redirect += dut->io_debug_branchRedirect ? 1 : 0;
-			perf_branch_pred_taken += dut->io_debug_branchPredTaken ? 1 : 0;
-			perf_branch_pred_correct += dut->io_debug_branchPredCorrect ? 1 : 0;
-		}
-
-		if (dut->clock)
+	// Built twice: the copy used when no probe is enabled has no probe code.
+	auto run_loop = [&](auto probes_on)
+	{
+		while (opts.max_cycles == 0 || sim_time < opts.max_cycles)
 		{
-			if (trace_map_u32 && pc_now >= 0x4001ccc0ULL && pc_now <= 0x4001cdb0ULL)
-			{
-				auto &regs = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory;
-				printf("[map-u32 %6" PRIu64 "] pc=0x%016" PRIx64 " instr=0x%08x"
-				       " a0=0x%016" PRIx64 " a1=0x%016" PRIx64 " a2=0x%016" PRIx64
-				       " a3=0x%016" PRIx64 " a4=0x%016" PRIx64 " a5=0x%016" PRIx64
-				       " a6=0x%016" PRIx64 " t0=0x%016" PRIx64 " ra=0x%016" PRIx64 "\n",
-				       sim_time,
-				       pc_now,
-				       (uint32_t)dut->io_debug_instr,
-				       (uint64_t)regs[10],
-				       (uint64_t)regs[11],
-				       (uint64_t)regs[12],
-				       (uint64_t)regs[13],
-				       (uint64_t)regs[14],
-				       (uint64_t)regs[15],
-				       (uint64_t)regs[16],
-				       (uint64_t)regs[5],
-				       (uint64_t)regs[1]);
-			}
-			if (trace_ret)
-			{
-				uint64_t lsu_pc = dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_pc;
-				bool trace_ret_window = pc_now >= 0x40019590ULL && pc_now <= 0x40019690ULL;
-				bool trace_ret_lsu_window = lsu_pc >= 0x40019590ULL && lsu_pc <= 0x40019690ULL;
-				if (trace_ret_window || (trace_ret_lsu_window && dut->rootp->SimTop__DOT__core__DOT___lsu_io_valid_out))
+			host_io.poll(sim_time);
+			irq.drive(dut, opts.test_name, sim_time);
+			uart.drive_rx(dut, sim_time);
+			jtag.drive(dut);
+			dmi.drive(dut);
+
+			dut->clock ^= 1;
+			dut->eval();
+			if (wave.dumping())
+				wave.dump(sim_time);
+
+			uint64_t pc_now = dut->io_debug_pc;
+			if (sample_perf && dut->clock)
+			{
+				perf.sample(dut);
+				if (timeline.due(perf))
+					timeline.sample(dut, perf, sim_time);
+			}
+			if (roi.enabled() && dut->clock)
+				roi.sample(dut, timeline, sim_time);
+			if (profiler.enabled() && dut->clock)
+				profiler.sample(dut);
+			if (branches.enabled() && dut->clock)
+				branches.sample(dut);
+			if (sample_commits && dut->clock)
+			{
+				CommitRecord recs[2];
+				unsigned n = commit_port.sample(dut, sim_time, recs);
+				for (unsigned i = 0; i < n; ++i)
 				{
-					printf("[ret-trace %6" PRIu64 "] pc=0x%016" PRIx64 " instr=0x%08x lsu_pc=0x%016" PRIx64
-					       " has_ret=%u ret_redirect=%u retConsumed=%u lsu_valid=%u out_is_ret=%u ret_type=%u"
-					       " epc=0x%016" PRIx64 " mepc=0x%016" PRIx64 " sepc=0x%016" PRIx64 "\n",
-					       sim_time,
-					       pc_now,
-					       (uint32_t)dut->io_debug_instr,
-					       lsu_pc,
-					       (unsigned)dut->rootp->SimTop__DOT__core__DOT__has_ret,
-					       (unsigned)dut->rootp->SimTop__DOT__core__DOT__ret_redirect,
-					       (unsigned)dut->rootp->SimTop__DOT__core__DOT__retConsumed,
-					       (unsigned)dut->rootp->SimTop__DOT__core__DOT___lsu_io_valid_out,
-					       (unsigned)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_trap_is_ret,
-					       (unsigned)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_trap_ret_type,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT___csr_io_epc_out,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mepc,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__sepc);
+					if (flight.enabled())
+						flight.record(recs[i]);
+					if (commit_trace.enabled())
+						commit_trace.push(recs[i]);
 				}
+				if (flight.enabled())
+					flight.sample(dut, sim_time, opts.test_name);
 			}
-			if (trace_csr && dut->rootp->SimTop__DOT__core__DOT__csr__DOT__io_wvalid &&
-			    dut->rootp->SimTop__DOT__core__DOT__csr__DOT__io_wwrite)
+			if (track_sram && dut->clock)
+				model_cache.sample_bus_writes(dut, opts.sram_base);
+			if (opts.idle_skip && dut->clock && dut->io_debug_retire)
 			{
-				uint32_t csr_addr = dut->rootp->SimTop__DOT__core__DOT__csr__DOT__io_waddr;
-				if (csr_addr == 0x105 || csr_addr == 0x140 || csr_addr == 0x141 ||
-				    csr_addr == 0x300 || csr_addr == 0x305 || csr_addr == 0x340 || csr_addr == 0x341)
+				idle.observe(dut);
+				if (idle.idle() && !jtag.connected() && !dmi.connected())
 				{
-					printf("[csr-trace %6" PRIu64 "] pc=0x%016" PRIx64 " instr=0x%08x"
-					       " addr=0x%03x wdata=0x%016" PRIx64
-					       " mepc=0x%016" PRIx64 " sepc=0x%016" PRIx64 " mscratch=0x%016" PRIx64 "\n",
-					       sim_time,
-					       pc_now,
-					       (uint32_t)dut->io_debug_instr,
-					       csr_addr,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__io_wwdata,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mepc,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__sepc,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mscratch);
+					// Stop short of the next cycle that feeds the model input.
+					uint64_t horizon = std::min(uart.next_rx(sim_time), irq.next_change(opts.test_name, sim_time));
+					horizon = std::min(horizon, host_io.next_poll());
+					horizon = std::min(horizon, uart.matcher().next_deadline());
+					if (checkpoint_pending)
+						horizon = std::min(horizon, opts.checkpoint_at_cycle);
+					if (opts.max_cycles != 0)
+						horizon = std::min(horizon, opts.max_cycles);
+					uint64_t skipped = horizon > sim_time ? idle.skip(dut, (horizon - sim_time) / 2) : 0;
+					if (skipped != 0)
+					{
+						sim_time += 2 * skipped;
+						idle_skipped += skipped;
+						perf.note_skip(skipped);
+						roi.note_skip(skipped);
+					}
 				}
 			}
 
-			bool prev_in_sram = prev_pc_valid && prev_pc >= opts.sram_base && prev_pc < opts.sram_base + opts.sram_size;
-			bool pc_in_sram = pc_now >= opts.sram_base && pc_now < opts.sram_base + opts.sram_size;
-			if (trace_pc_escape && !saw_pc_escape && prev_in_sram && !pc_in_sram)
-			{
-				saw_pc_escape = true;
-				uint64_t ra = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[1];
-				uint64_t sp = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[2];
-				uint64_t t0 = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[5];
-				uint64_t a0_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[10];
-				uint64_t a1_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[11];
-				uint64_t a2_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[12];
-				uint64_t a7_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[17];
-				printf("[pc-escape %6" PRIu64 "] prev_pc=0x%016" PRIx64 " pc=0x%016" PRIx64
-				       " instr=0x%08x pc_reg=0x%016" PRIx64
-				       " alu_br_v=%u alu_br_t=%u alu_br_red=%u alu_br_pc=0x%016" PRIx64 " alu_br_tgt=0x%016" PRIx64
-				       " alu_r_br_v=%u alu_r_br_t=%u alu_r_br_red=%u alu_r_br_pc=0x%016" PRIx64 " alu_r_br_tgt=0x%016" PRIx64
-				       " alu_v=%u alu_pc=0x%016" PRIx64 " alu_rd=%u alu_w=%u alu_res=0x%016" PRIx64
-				       " id_issue=%u id_issued=%u id_pc=0x%016" PRIx64 " id_rd=%u id_w=%u id_op1=0x%016" PRIx64 " id_op2=0x%016" PRIx64
-				       " wb_w=%u wb_rd=%u wb_data=0x%016" PRIx64
-				       " ra=0x%016" PRIx64 " sp=0x%016" PRIx64 " t0=0x%016" PRIx64
-				       " a0=0x%016" PRIx64 " a1=0x%016" PRIx64 " a2=0x%016" PRIx64 " a7=0x%016" PRIx64
-				       " mtvec=0x%016" PRIx64 " mepc=0x%016" PRIx64 " mcause=0x%016" PRIx64 " mtval=0x%016" PRIx64 "\n",
-				       sim_time,
-				       prev_pc,
-				       pc_now,
-				       (uint32_t)dut->io_debug_instr,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__pc__DOT__ProgramCounter,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT___alu_io_br_info_valid,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT___alu_io_br_info_taken,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT___alu_io_br_info_redirect,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT___alu_io_br_info_pc,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT___alu_io_br_info_target,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_br_info_r_valid,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_br_info_r_taken,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_br_info_r_redirect,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_br_info_r_pc,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_br_info_r_target,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_valid_out_r,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_pc_out_r,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_rd_r,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_reg_write_r,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_result_r,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__issueIdToAlu,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__idIssuedValid,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__idIssuedPc,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_rd,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_ctrl_reg_write,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_op1,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_op2,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT___wb_io_reg_wb_reg_write,
-				       (uint32_t)dut->rootp->SimTop__DOT__core__DOT___wb_io_reg_wb_rd,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT___wb_io_reg_wb_data,
-				       ra,
-				       sp,
-				       t0,
-				       a0_trace,
-				       a1_trace,
-				       a2_trace,
-				       a7_trace,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mtvec,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mepc,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mcause,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mtval);
-			}
-			prev_pc = pc_now;
-			prev_pc_valid = true;
-
-			if (!saw_rom_pc && pc_now >= BROM_BASE && pc_now < BROM_BASE + ROM_SIZE)
-			{
-				saw_rom_pc = true;
-				if (trace_boot)
-					printf("[boot-trace %6" PRIu64 "] entered ROM pc=0x%016" PRIx64 "\n", sim_time, pc_now);
-			}
-			if (!saw_sram_pc && pc_now >= opts.sram_base && pc_now < opts.sram_base + opts.sram_size)
-			{
-				saw_sram_pc = true;
-				if (trace_boot)
-					printf("[boot-trace %6" PRIu64 "] entered SRAM pc=0x%016" PRIx64 "\n", sim_time, pc_now);
-			}
-			if (!saw_payload_pc && pc_now >= opts.boot_a2 && pc_now < opts.boot_a2 + 0x10000)
-			{
-				saw_payload_pc = true;
-				if (trace_boot)
-					printf("[boot-trace %6" PRIu64 "] entered payload pc=0x%016" PRIx64 "\n", sim_time, pc_now);
-				if (stop_on_payload_entry)
+			if (dut->clock)
+			{
+				if (!progress.saw_rom_pc && pc_now >= BROM_BASE && pc_now < BROM_BASE + ROM_SIZE)
 				{
-					stopped_on_payload_entry = true;
-					saw_exit = true;
-					sim_time++;
-					break;
+					progress.saw_rom_pc = true;
+					if (trace_boot)
+						printf("[boot-trace %6" PRIu64 "] entered ROM pc=0x%016" PRIx64 "\n", sim_time, pc_now);
+					timeline.mark(sim_time, "rom-entry");
 				}
-			}
-			if (trace_boot && dut->rootp->SimTop__DOT__core__DOT__combined_trap)
-			{
-					printf("[boot-trace %6" PRIu64 "] trap pc=0x%016" PRIx64 " mtvec=0x%016" PRIx64
-					       " mepc=0x%016" PRIx64 " mcause=0x%016" PRIx64
-					       " stvec=0x%016" PRIx64 " sepc=0x%016" PRIx64
-					       " scause=0x%016" PRIx64 " stval=0x%016" PRIx64
-					       " sscratch=0x%016" PRIx64 " tp=0x%016" PRIx64 " sp=0x%016" PRIx64
-					       " ra=0x%016" PRIx64 " s0=0x%016" PRIx64 " s1=0x%016" PRIx64
-					       " a0=0x%016" PRIx64 " a1=0x%016" PRIx64 " a2=0x%016" PRIx64
-					       " a3=0x%016" PRIx64 " a4=0x%016" PRIx64 " a5=0x%016" PRIx64
-					       " s2=0x%016" PRIx64 " s3=0x%016" PRIx64 " s4=0x%016" PRIx64
-					       " s5=0x%016" PRIx64 " s6=0x%016" PRIx64 " s7=0x%016" PRIx64
-					       " s8=0x%016" PRIx64 " s9=0x%016" PRIx64 " s10=0x%016" PRIx64 "\n",
-					       sim_time,
-					       pc_now,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mtvec,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mepc,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mcause,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__stvec,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__sepc,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__scause,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__stval,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__sscratch,
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[4],
-				       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[2],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[1],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[8],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[9],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[10],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[11],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[12],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[13],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[14],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[15],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[18],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[19],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[20],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[21],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[22],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[23],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[24],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[25],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[26]);
-				}
-#ifdef ION_LINUX_PROFILE
-				if (trace_lsu_ptw)
+				if (!progress.saw_sram_pc && pc_now >= opts.sram_base && pc_now < opts.sram_base + opts.sram_size)
 				{
-				const uint64_t req_vaddr = (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_req_bits_vaddr;
-				const uint64_t reg_vaddr = (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__reqReg_vaddr;
-				const uint64_t fault_value = (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_bits_fault_value;
-				const uint8_t state = dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__state;
-				const uint8_t level = dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__level;
-				const bool target_match = trace_lsu_ptw_vaddr == 0 ||
-				                          trace_lsu_ptw_vaddr == req_vaddr ||
-				                          trace_lsu_ptw_vaddr == reg_vaddr ||
-				                          trace_lsu_ptw_vaddr == fault_value;
-				const bool event =
-				    dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_req_valid ||
-				    dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_valid ||
-				    dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_req_valid ||
-				    dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_resp_valid ||
-				    state != last_lsu_ptw_state ||
-				    level != last_lsu_ptw_level;
-				if (target_match && event)
+					progress.saw_sram_pc = true;
+					if (trace_boot)
+						printf("[boot-trace %6" PRIu64 "] entered SRAM pc=0x%016" PRIx64 "\n", sim_time, pc_now);
+					timeline.mark(sim_time, "sram-entry");
+				}
+				if (!progress.saw_payload_pc && pc_now >= opts.boot_a2 && pc_now < opts.boot_a2 + 0x10000)
 				{
-					printf("[lsu-ptw-trace %6" PRIu64 "] pc=0x%016" PRIx64 " instr=0x%08x"
-					       " state=%u level=%u req_v=%u req_va=0x%016" PRIx64
-					       " reg_va=0x%016" PRIx64 " satp=0x%016" PRIx64
-					       " table=0x%016" PRIx64 " mem_req_v=%u mem_req_r=%u mem_addr=0x%016" PRIx64
-					       " mem_resp_v=%u mem_resp_r=%u mem_err=%u pte=0x%016" PRIx64
-					       " tr_leaf=%u tr_fault=%u tr_pa=0x%016" PRIx64
-					       " resp_v=%u resp_pa=0x%016" PRIx64 " fault=%u cause=0x%016" PRIx64
-					       " value=0x%016" PRIx64 " priv=%u sum=%u mxr=%u\n",
-					       sim_time,
-					       (uint64_t)dut->io_debug_pc,
-					       (uint32_t)dut->io_debug_instr,
-					       (uint32_t)state,
-					       (uint32_t)level,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_req_valid,
-					       req_vaddr,
-					       reg_vaddr,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_req_bits_satp,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__tableBase,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_req_valid,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_req_ready,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_req_bits_addr,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_resp_valid,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_resp_ready,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_resp_bits_err,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_resp_bits_rdata,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__translator__DOT__io_leaf,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__translator__DOT__io_fault_valid,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__translator__DOT__io_paddr,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_valid,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_bits_paddr,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_bits_fault_valid,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_resp_bits_fault_cause,
-					       fault_value,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__reqReg_priv,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__reqReg_sum,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__reqReg_mxr);
+					progress.saw_payload_pc = true;
+					if (trace_boot)
+						printf("[boot-trace %6" PRIu64 "] entered payload pc=0x%016" PRIx64 "\n", sim_time, pc_now);
+					timeline.mark(sim_time, "payload-entry");
+					if (stop_on_payload_entry)
+					{
+						stopped_on_payload_entry = true;
+						saw_exit = true;
+						sim_time++;
+						break;
+					}
 				}
-				last_lsu_ptw_state = state;
-				last_lsu_ptw_level = level;
 			}
-				if (trace_dmem)
-				{
-				const uint64_t req_addr = (uint64_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheReq_bits_addr;
-				const bool pc_match = pc_now >= trace_dmem_pc_start && pc_now <= trace_dmem_pc_end;
-				const bool req_match = trace_dmem_addr == 0 || trace_dmem_addr == req_addr;
-				const bool resp_match = trace_dmem_addr == 0 || req_match ||
-				                        trace_dmem_addr == (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_bits_addr ||
-				                        trace_dmem_addr == (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_req_bits_addr;
-				const bool req_event =
-				    pc_match && dut->rootp->SimTop__DOT__core__DOT___dcacheArbiter_io_cacheReq_valid && req_match;
-				const bool resp_event =
-				    pc_match && dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_valid && resp_match;
-				if (req_event || resp_event)
+
+			if constexpr (decltype(probes_on)::value)
+			{
+				if (dut->clock)
 				{
-					printf("[dmem-trace %6" PRIu64 "] pc=0x%016" PRIx64 " instr=0x%08x"
-					       " req_v=%u req_r=%u req_fire=%u cmd=%u addr=0x%016" PRIx64
-					       " wdata=0x%016" PRIx64 " mask=0x%02x owner_ptw=%u pending=%u"
-					       " resp_v=%u resp_r=%u resp_fire=%u resp_err=%u rdata=0x%016" PRIx64
-					       " lsu_req_addr=0x%016" PRIx64 " lsu_ptw_req_addr=0x%016" PRIx64 "\n",
-					       sim_time,
-					       (uint64_t)dut->io_debug_pc,
-					       (uint32_t)dut->io_debug_instr,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT___dcacheArbiter_io_cacheReq_valid,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheReq_ready,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__cacheReqFire,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheReq_bits_cmd,
-					       req_addr,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheReq_bits_wdata,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheReq_bits_mask,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__respOwnerPtw,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__respPending,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_valid,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_ready,
-					       (uint32_t)(dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_valid &&
-					                  dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_ready),
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_bits_err,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_bits_rdata,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_bits_addr,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__ptw__DOT__io_mem_req_bits_addr);
-					}
+					probes.sample(dut);
+					if (probes.take_dump())
+						flight.dump("probe", opts.test_name);
 				}
-#endif
-				if (trace_atomic)
-			{
-				const uint64_t atomic_vaddr = (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_vaddr;
-				const uint64_t atomic_paddr = (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_paddr;
-				const uint64_t req_addr = (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_bits_addr;
-				const bool target_match = trace_atomic_addr == 0 ||
-				                          trace_atomic_addr == atomic_vaddr ||
-				                          trace_atomic_addr == atomic_paddr ||
-				                          trace_atomic_addr == req_addr;
-				const bool atomic_active =
-				    dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__raw_atomic_req ||
-				    dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__new_atomic_req ||
-				    dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__do_atomic_read_req ||
-				    dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__do_atomic_write_req ||
-				    dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicRespValid;
-				if (atomic_active && target_match)
+			}
+			irq.sample(dut, sim_time);
+
+			bool uart_tx = dut->clock && uart.capture_tx(dut);
+			if (uart_tx && timeline.enabled())
+				timeline.uart(uart.matcher(), sim_time);
+			if (wave.windowed() && dut->clock)
+			{
+				uint64_t trigger = 0;
+				uint64_t uart_total = 0;
+				if (wave.waiting() && rewind.due(sim_time) && rewind.snapshot(sim_time, uart, &trigger, &uart_total))
 				{
-					printf("[atomic-trace %6" PRIu64 "] pc=0x%016" PRIx64 " instr=0x%08x"
-					       " raw=%u new=%u pend=%u rd_sent=%u wr_sent=%u do_wr=%u resp_v=%u"
-					       " op=%u atom=%u size=%u mask=0x%02x"
-					       " vaddr=0x%016" PRIx64 " paddr=0x%016" PRIx64
-					       " awdata=0x%016" PRIx64 " wrdata=0x%016" PRIx64
-					       " old=0x%016" PRIx64 " resp=0x%016" PRIx64
-					       " req_v=%u req_r=%u req_cmd=%u req_addr=0x%016" PRIx64
-					       " req_wdata=0x%016" PRIx64 " req_mask=0x%02x resp_in=%u resp_err=%u resp_data=0x%016" PRIx64
-					       " rs1/a0=0x%016" PRIx64 " rs2/a3=0x%016" PRIx64 " s0=0x%016" PRIx64
-					       " s1=0x%016" PRIx64 " s2=0x%016" PRIx64 "\n",
-					       sim_time,
-					       pc_now,
-					       (uint32_t)dut->io_debug_instr,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__raw_atomic_req,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__new_atomic_req,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicPending,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicReadSent,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicWriteSent,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicDoWrite,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicRespValid,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_op,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_atomic,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_size,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_mask,
-					       atomic_vaddr,
-					       atomic_paddr,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicAccess_wdata,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicWriteData,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicOldData,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__atomicRespData,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_valid,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_ready,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_bits_cmd,
-					       req_addr,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_bits_wdata,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_req_bits_mask,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_resp_valid,
-					       (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_resp_bits_err,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_dcache_resp_bits_rdata,
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[10],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[13],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[8],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[9],
-					       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[18]);
+					printf("[wave]: replaying from sim_time=%" PRIu64 " up to the trigger at %" PRIu64 "\n", sim_time, trigger);
+					uart.mute_console_until(uart_total);
+					wave.replay_to(trigger);
 				}
+				if (wave.step(dut, sim_time, uart_tx, uart.output()))
+					rewind.hand_over(sim_time, uart);
+			}
+			if (uart_tx && opts.stop_on_uart_match && uart.matcher().satisfied())
+			{
+				stopped_on_uart_match = true;
+				saw_exit = true;
+				sim_time++;
+				break;
+			}
+			if ((uart_tx || sim_time >= uart.matcher().next_deadline()) && uart.matcher().check(sim_time) != nullptr)
+			{
+				sim_time++;
+				break;
 			}
-		}
 
-		bool trace_pc_match = pc_now >= trace_pc_start && pc_now <= trace_pc_end;
-		if (trace_cpu && trace_pc_match && dut->clock && (trace_cpu_every || sim_time < 150 || dut->io_debug_pc != last_pc || trace_state_change))
-		{
-			last_pc = pc_now;
-			last_mtimecmp = cur_mtimecmp;
-			last_mtip = cur_mtip;
-			uint64_t ra = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[1];
-			uint64_t t0 = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[5];
-			uint64_t s0 = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[8];
-			uint64_t s1 = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[9];
-			uint64_t s2 = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[18];
-			uint64_t t3 = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[28];
-			uint64_t t4 = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[29];
-			uint64_t t5 = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[30];
-			uint64_t a0_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[10];
-			uint64_t a1_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[11];
-			uint64_t a2_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[12];
-			uint64_t a3_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[13];
-			uint64_t a4_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[14];
-			uint64_t a5_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[15];
-			uint64_t a6_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[16];
-			uint64_t a7_trace = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[17];
-			printf("[trace %6" PRIu64 "] pc=0x%016" PRIx64 " instr=0x%08x ra=0x%016" PRIx64 " t0=0x%016" PRIx64 " s0=0x%016" PRIx64 " s1=0x%016" PRIx64 " s2=0x%016" PRIx64 " t3=0x%016" PRIx64 " t4=0x%016" PRIx64 " t5=0x%016" PRIx64 " a0=0x%016" PRIx64 " a1=0x%016" PRIx64 " a2=0x%016" PRIx64 " a3=0x%016" PRIx64 " a4=0x%016" PRIx64 " a5=0x%016" PRIx64 " a6=0x%016" PRIx64 " a7=0x%016" PRIx64
-				   " id_v=%u id_rd=%u id_w=%u id_op1=0x%016" PRIx64 " id_op2=0x%016" PRIx64
-				   " lsu_stall=%u load_valid=%u load_rd=%u load=0x%016" PRIx64 " alu_v=%u alu_rd=%u alu_w=%u alu_mem_v=%u alu_mem_op=%u alu_res=0x%016" PRIx64 " alu_pc=0x%016" PRIx64 " alu_op1=0x%016" PRIx64 " alu_op2=0x%016" PRIx64
-				   " lsu_v=%u lsu_rd=%u lsu_w=%u lsu_res=0x%016" PRIx64 " wb_rd=%u wb_w=%u wb_data=0x%016" PRIx64
-				   " br_v=%u br_t=%u br_red=%u exbp_v=%u exbp_rd=%u exbp_data=0x%016" PRIx64
-				   " fwd_v=%u fwd_rd=%u fwd_data=0x%016" PRIx64 " prev_v=%u prev_rd=%u prev_data=0x%016" PRIx64
-				   " fq_flush=%u decode_stall=%u"
-				   " sb_p=%u sb_rd=%u sb_new=%u sb_done=%u sb_inst=%u sb_inst_rd=%u"
-				   " pc_stall=%u if_stall=%u if_in_pc=0x%016" PRIx64
-					   " if_state=%u if_acc=%u if_req_pc=0x%016" PRIx64 " if_req_pa=0x%016" PRIx64
-#ifdef ION_LINUX_PROFILE
-					   " if_xp=%u if_xd=%u if_xlate=%u if_issue=%u if_start_xlate=%u if_req_v=%u"
-					   " if_trap_v=%u if_trap_c=0x%016" PRIx64 " if_trap_tval=0x%016" PRIx64
-					   " ptw_state=%u ptw_level=%u ptw_req_v=%u ptw_req_va=0x%016" PRIx64
-				   " ptw_mem_req_v=%u ptw_mem_req_r=%u ptw_mem_addr=0x%016" PRIx64
-				   " ptw_mem_resp_v=%u ptw_mem_resp_r=%u ptw_resp_v=%u ptw_fault=%u"
-					   " ptw_table=0x%016" PRIx64 " ptw_reg_va=0x%016" PRIx64
-					   " dc_ptw_owner=%u dc_pending=%u dc_req_fire=%u dc_resp_fire=%u"
-					   " if_xlate_rdy=%u if_xlate_pa=0x%016" PRIx64
-#endif
-					   " if_pc=0x%016" PRIx64 " if_instr=0x%08x if_len=%u pc_step=%u pc_hold=%u bpu_taken=%u"
-				   " redirect=%u int_p=%u int_f=%u trap=%u flush=%u priv=%u satp=0x%016" PRIx64
-				   " mtvec=0x%016" PRIx64 " mepc=0x%016" PRIx64 " mcause=0x%016" PRIx64
-				   " sepc=0x%016" PRIx64 " scause=0x%016" PRIx64 " mtval=0x%016" PRIx64
-				   " mstatus=0x%016" PRIx64 " mie=0x%016" PRIx64 " plic_src1=%u mtip=%u mtime=0x%016" PRIx64 " mtimecmp=0x%016" PRIx64 "\n",
-				   sim_time,
-				   (uint64_t)dut->io_debug_pc,
-				   (uint32_t)dut->io_debug_instr,
-				   ra,
-				   t0,
-				   s0,
-				   s1,
-				   s2,
-				   t3,
-				   t4,
-				   t5,
-				   a0_trace,
-				   a1_trace,
-				   a2_trace,
-				   a3_trace,
-				   a4_trace,
-				   a5_trace,
-				   a6_trace,
-				   a7_trace,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_valid_out,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_rd,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_ctrl_reg_write,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_op1,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__idecode__DOT__io_decoded_out_op2,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__io_stall_req_0,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT___lsu_io_load_data_valid,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT___lsu_io_load_data_rd,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT___lsu_io_load_data,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_valid_out_r,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_rd_r,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_reg_write_r,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_mem_valid_r,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_mem_op_r,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_alu_out_result_r,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__io_pc_out_r,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__op1,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__op2,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT___lsu_io_valid_out,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_reg_rd,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_reg_write,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__lsu__DOT__out_result,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT___wb_io_reg_wb_rd,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT___wb_io_reg_wb_reg_write,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT___wb_io_reg_wb_data,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__branch_valid,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__branch_taken,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__branchRedirect,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__exBypassValid,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__exBypassRd,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__alu__DOT__exBypassData,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__aluResultFwdValid,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__aluResultFwdRd,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__aluResultFwdData,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__aluResultPrevValid,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__aluResultPrevRd,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__aluResultPrevData,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__frontendQueueFlush,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__decodeStall,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_pending,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_pendingRd,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_newLoadLike,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_complete,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_issued,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__loadScoreboard__DOT__io_issuedRd,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__pc__DOT__io_stall,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT___ifetch_io_fetch_stall,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__io_pc,
-					   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__state,
-					   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__acceptResp,
-					   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__reqPc,
-					   (uint64_t)dut->rootp->SimTop__DOT__core__DOT___ifetch_io_cache_req_bits_addr,
-#ifdef ION_LINUX_PROFILE
-					   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__xlatePending,
-					   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__xlateDone,
-					   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__translateFetch,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__canIssue,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__startTranslation,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__normalFetchReqValid,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__fetchTrap_valid,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__fetchTrap_cause,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__fetchTrap_value,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__state,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__level,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_req_valid,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_req_bits_vaddr,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_mem_req_valid,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_mem_req_ready,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_mem_req_bits_addr,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_mem_resp_valid,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_mem_resp_ready,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_resp_valid,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__io_resp_bits_fault_valid,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__tableBase,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__ptw__DOT__reqReg_vaddr,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__respOwnerPtw,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__respPending,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__cacheReqFire,
-				   (uint32_t)(dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_valid &&
-				              dut->rootp->SimTop__DOT__core__DOT__dcacheArbiter__DOT__io_cacheResp_ready),
-					   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__translatedReady,
-					   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__ifetch__DOT__xlatePaddr,
-#endif
-					   (uint64_t)dut->rootp->SimTop__DOT__core__DOT___ifetch_io_pc_out,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT___ifetch_io_instr_out,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT___ifetch_io_instr_len,
-					   (uint32_t)dut->rootp->SimTop__DOT__core__DOT___ifetch_io_pc_step_len,
-					   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__pc__DOT__redirectHold,
-					   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__pc__DOT___bpu_io_pred_taken,
-					   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__pc__DOT__redirect,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__interruptPending,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__interrupt_fire,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__combined_trap,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__combined_trap,
-				   (uint32_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__CurrentPrivLevel,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__satp,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mtvec,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mepc,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mcause,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__sepc,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__scause,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mtval,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mstatus,
-				   (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mie,
-				   (uint32_t)dut->rootp->io_ext_irq_sources_1,
-				   (uint32_t)cur_mtip,
-				   (uint64_t)dut->rootp->SimTop__DOT__clint__DOT__mtime,
-				   cur_mtimecmp);
-		}
-		irq.sample(dut, sim_time);
-		if (opts.trace_dmi)
-		{
-			uint8_t dmi_valid = dut->rootp->SimTop__DOT__debugModule_io_dmi_valid_REG;
-			if (dmi_valid && !last_dmi_valid)
-			{
-				uint64_t dr = dut->rootp->SimTop__DOT__jtag__DOT__drUpdate;
-				unsigned op = dr & 0x3;
-				unsigned addr = (dr >> 34) & 0x7f;
-				uint32_t wdata = (uint32_t)((dr >> 2) & 0xffffffffu);
-				uint32_t rdata = dut->rootp->SimTop__DOT___debugModule_io_dmi_rdata;
-				uint32_t dmcontrol = dut->rootp->SimTop__DOT__debugModule__DOT__dmcontrol;
-				uint32_t dmstatus = dut->rootp->SimTop__DOT__debugModule__DOT__dmstatus;
-				printf("[dmi %6" PRIu64 "] op=%u addr=0x%02x wdata=0x%08x rdata=0x%08x dmcontrol=0x%08x dmstatus=0x%08x\n",
-				       sim_time, op, addr, wdata, rdata, dmcontrol, dmstatus);
-			}
-			last_dmi_valid = dmi_valid;
-		}
+			if (!opts.jtag_only && !disable_exit_check && dut->clock &&
+			    dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[17] == 93)
+			{
+				saw_exit = true;
+				sim_time++;
+				break;
+			}
 
-		if (dut->clock)
-			uart.capture_tx(dut);
-		if (opts.stop_on_uart_match && !opts.expected_uart.empty() &&
-		    uart.output().find(opts.expected_uart) != std::string::npos)
-		{
-			stopped_on_uart_match = true;
-			saw_exit = true;
 			sim_time++;
-			break;
-		}
 
-		if (!opts.jtag_only && !disable_exit_check && dut->clock &&
-		    dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[17] == 93)
-		{
-			saw_exit = true;
-			sim_time++;
-			break;
+#if ION_SIM_SAVABLE
+			if (checkpoint_pending &&
+			    (sim_time >= opts.checkpoint_at_cycle ||
+			     (uart_tx && !opts.checkpoint_at_uart.empty() && uart.output().size() >= opts.checkpoint_at_uart.size() &&
+			      uart.output().compare(uart.output().size() - opts.checkpoint_at_uart.size(),
+			                            opts.checkpoint_at_uart.size(), opts.checkpoint_at_uart) == 0)))
+			{
+				checkpoint_pending = false;
+				bool saved = save_checkpoint(opts.checkpoint_save, dut, uart, progress, perf);
+				if (opts.checkpoint_exit)
+				{
+					stopped_on_checkpoint = saved;
+					break;
+				}
+			}
+#else
+			(void)uart_tx;
+			(void)checkpoint_pending;
+#endif
+
+			// Fork on the xRET that leaves the firmware for the payload: the
+			// frontend has not fetched from the payload yet, so each child can
+			// replace it in SRAM before the next edge.
+			if (fork_pending && dut->clock && dut->rootp->SimTop__DOT__core__DOT__ret_redirect)
+			{
+				uint64_t target = dut->rootp->SimTop__DOT__core__DOT___csr_io_epc_out;
+				if (target >= opts.boot_a2 && target < opts.boot_a2 + 0x10000)
+				{
+					fork_pending = false;
+					// The console flusher does not survive fork(); flush it first
+					// so the children do not repeat buffered output.
+					uart.pause_console();
+					fork_index = fanout.spawn(opts.fork_dir, opts.fork_jobs, uart.total());
+					uart.resume_console();
+					if (fork_index < 0)
+					{
+						fork_parent = true;
+						break;
+					}
+					const ForkVariant &variant = fanout.variant(fork_index);
+					opts.test_name = variant.name;
+					if (!variant.expected_uart.empty())
+					{
+						opts.expected_uart = variant.expected_uart;
+						uart.expect(opts);
+					}
+					if (!variant.elf_path.empty())
+						load_elf_to_regions(dut, variant.elf_path.c_str(), opts.sram_base, opts.sram_size);
+					if (!variant.dtb_path.empty())
+						load_blob_to_sram(dut, variant.dtb_path.c_str(), opts.dtb_addr, opts.sram_base, opts.sram_size);
+					printf("[fork]: %s continues from cycle %" PRIu64 " pid=%d\n", opts.test_name.c_str(), sim_time, (int)getpid());
+				}
+			}
 		}
+	};
+	if (probes.empty())
+		run_loop(std::false_type{});
+	else
+		run_loop(std::true_type{});
 
-		sim_time++;
+	uart.flush_console();
+	commit_trace.close();
+	if (fork_parent)
+	{
+		bool all_pass = fanout.report();
+		model_cache.release();
+#if VM_TRACE
+		delete tfp;
+#endif
+		return all_pass;
 	}
+	if (fork_pending)
+		printf("\n[fork]: payload handoff never reached; no variants were run\n");
+#if ION_SIM_SAVABLE
+	if (checkpoint_pending)
+		printf("\n[checkpoint]: milestone not reached; %s was not written\n", opts.checkpoint_save.c_str());
+#endif
 
 	printf("\n--- UART output end ---\n");
+	{
+		double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+		uint64_t clock_cycles = (sim_time - sim_time_start) / 2 - idle_skipped;
+		printf("[sim-speed]: clock_cycles=%" PRIu64 " wall_s=%.3f khz=%.2f threads=%u\n",
+		       clock_cycles, wall_s, wall_s > 0.0 ? (double)clock_cycles / wall_s / 1000.0 : 0.0, dut->threads());
+		if (opts.idle_skip)
+			printf("[idle]: skipped_cycles=%" PRIu64 "\n", idle_skipped);
+		// Construction is ~0 for a reused model; load covers reset and
+		// image loading up to the first simulated cycle.
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		printf("[sim-host]: model_ms=%.3f load_ms=%.3f max_rss_kb=%ld\n", model_ms, load_ms, usage.ru_maxrss);
+	}
 
 	int gp = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[3];
 	int a0 = dut->rootp->SimTop__DOT__core__DOT__register__DOT__regFile_ext__DOT__Memory[10];
@@ -2029,69 +7272,32 @@ bool run_sim(const SimOptions &opts)
 		}
 	}
 
-	bool uart_pass = opts.expected_uart.empty() || (uart.output().find(opts.expected_uart) != std::string::npos);
-	bool boot_flow_pass = (!opts.require_sram_entry || saw_sram_pc) &&
-	                      (!opts.require_payload_entry || saw_payload_pc);
+	const UartMatcher::Pattern *uart_fail = uart.matcher().check(sim_time);
+	bool uart_pass = (!uart.matcher().has_success() || uart.matcher().satisfied()) && uart_fail == nullptr;
+	bool boot_flow_pass = (!opts.require_sram_entry || progress.saw_sram_pc) &&
+	                      (!opts.require_payload_entry || progress.saw_payload_pc);
 	bool pass = opts.jtag_only ? true :
-	                          (stopped_on_payload_entry && boot_flow_pass) ||
+	                          stopped_on_checkpoint ||
+	                              (stopped_on_payload_entry && boot_flow_pass) ||
 	                              (opts.accept_uart_match && uart_pass && boot_flow_pass) ||
 	                              (saw_exit && a7 == 93 && a0 == 0 && uart_pass && boot_flow_pass);
+	pass = pass && !fork_pending && uart_fail == nullptr;
+	timeline.finish(dut, perf, sim_time);
 	if (opts.perf_report)
-	{
-		double ipc = perf_cycles == 0 ? 0.0 : (double)perf_retired / (double)perf_cycles;
-		double stall_pct = perf_cycles == 0 ? 0.0 : (100.0 * (double)perf_stall_cycles / (double)perf_cycles);
-		double ifetch_pct = perf_cycles == 0 ? 0.0 : (100.0 * (double)perf_ifetch_stall_cycles / (double)perf_cycles);
-		double lsu_pct = perf_cycles == 0 ? 0.0 : (100.0 * (double)perf_lsu_stall_cycles / (double)perf_cycles);
-		double branch_rate = perf_retired == 0 ? 0.0 : (100.0 * (double)perf_branch_count / (double)perf_retired);
-		double branch_taken_pct = perf_branch_count == 0 ? 0.0 : (100.0 * (double)perf_branch_taken / (double)perf_branch_count);
-		double branch_redirect_pct = perf_branch_count == 0 ? 0.0 : (100.0 * (double)perf_branch_redirect / (double)perf_branch_count);
-		double branch_pred_taken_pct = perf_branch_count == 0 ? 0.0 : (100.0 * (double)perf_branch_pred_taken / (double)perf_branch_count);
-		double branch_pred_correct_pct = perf_branch_count == 0 ? 0.0 : (100.0 * (double)perf_branch_pred_correct / (double)perf_branch_count);
-		printf("[perf]: cycles=%" PRIu64 " retired=%" PRIu64 " ipc=%.4f stall_cycles=%" PRIu64 " stall_pct=%.2f ifetch_stall=%" PRIu64 " ifetch_pct=%.2f lsu_stall=%" PRIu64 " lsu_pct=%.2f\n",
-		       perf_cycles,
-		       perf_retired,
-		       ipc,
-		       perf_stall_cycles,
-		       stall_pct,
-		       perf_ifetch_stall_cycles,
-		       ifetch_pct,
-		       perf_lsu_stall_cycles,
-		       lsu_pct);
-		printf("[perf-branch]: branches=%" PRIu64 " branch_rate=%.2f taken=%" PRIu64 " taken_pct=%.2f redirects=%" PRIu64 " redirect_pct=%.2f pred_taken=%" PRIu64 " pred_taken_pct=%.2f pred_correct=%" PRIu64 " pred_correct_pct=%.2f\n",
-		       perf_branch_count,
-		       branch_rate,
-		       perf_branch_taken,
-		       branch_taken_pct,
-		       perf_branch_redirect,
-		       branch_redirect_pct,
-		       perf_branch_pred_taken,
-		       branch_pred_taken_pct,
-		       perf_branch_pred_correct,
-		       branch_pred_correct_pct);
-		printf("[perf-lsu]: load=%" PRIu64 " store=%" PRIu64 " mmio=%" PRIu64 " atomic=%" PRIu64 " fence=%" PRIu64 "\n",
-		       perf_lsu_load_stall_cycles,
-		       perf_lsu_store_stall_cycles,
-		       perf_lsu_mmio_stall_cycles,
-		       perf_lsu_atomic_stall_cycles,
-		       perf_lsu_fence_stall_cycles);
-		printf("[perf-stall-detail]: decode_load_use=%" PRIu64 " lsu_load_only=%" PRIu64 " lsu_store_only=%" PRIu64 " lsu_fence_only=%" PRIu64 "\n",
-		       perf_decode_load_use_cycles,
-		       perf_lsu_load_only_cycles,
-		       perf_lsu_store_only_cycles,
-		       perf_lsu_fence_only_cycles);
-		printf("[perf-overlap]: ifetch_only=%" PRIu64 " ifetch_lsu_overlap=%" PRIu64 "\n",
-		       perf_ifetch_only_stall_cycles,
-		       perf_ifetch_lsu_overlap_cycles);
-		printf("[perf-frontend]: starved=%" PRIu64 " queue_full=%" PRIu64 " queue_empty=%" PRIu64 "\n",
-		       perf_frontend_starved_cycles,
-		       perf_frontend_queue_full_cycles,
-		       perf_frontend_queue_empty_cycles);
-	}
+		perf.report();
+	roi.report();
+	profiler.report();
+	branches.report();
+	if (!opts.uart_milestones.empty() || !opts.uart_fail.empty())
+		uart.matcher().report();
 
 	if (opts.jtag_only)
 		printf("[%s]: JTAG server active on port %d%s\n", opts.test_name.c_str(), opts.jtag_rbb_port, CEND);
 	else if (pass)
 		printf("[%s]: gp=%d, a7=%d, a0=%d, test %spassed%s\n", opts.test_name.c_str(), gp, a7, a0, GREEN, CEND);
+	else if (uart_fail != nullptr)
+		printf("[%s]: gp=%d, a7=%d, a0=%d, uart %s \"%s\", test %sfailed%s\n", opts.test_name.c_str(), gp, a7, a0,
+		       uart_fail->failure ? "failure text" : "milestone missed", uart_fail->text.c_str(), RED, CEND);
 	else if (stopped_on_uart_match)
 		printf("[%s]: gp=%d, a7=%d, a0=%d, uart milestone reached, test %sfailed%s\n", opts.test_name.c_str(), gp, a7, a0, RED, CEND);
 	else if (a7 == 93)
@@ -2105,8 +7311,8 @@ bool run_sim(const SimOptions &opts)
 		       saw_exit ? 1 : 0,
 		       uart_pass ? 1 : 0,
 		       boot_flow_pass ? 1 : 0,
-		       saw_sram_pc ? 1 : 0,
-		       saw_payload_pc ? 1 : 0,
+		       progress.saw_sram_pc ? 1 : 0,
+		       progress.saw_payload_pc ? 1 : 0,
 		       opts.expected_uart.c_str());
 		printf("[sim-fail]: cycles=%" PRIu64 " pc=0x%016" PRIx64 " instr=0x%08x mtvec=0x%016" PRIx64
 		       " mepc=0x%016" PRIx64 " mcause=0x%016" PRIx64 " mtval=0x%016" PRIx64 "\n",
@@ -2117,18 +7323,21 @@ bool run_sim(const SimOptions &opts)
 		       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mepc,
 		       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mcause,
 		       (uint64_t)dut->rootp->SimTop__DOT__core__DOT__csr__DOT__mtval);
+		flight.dump(sim_time >= opts.max_cycles && opts.max_cycles != 0 ? "max-cycles" : "fail", opts.test_name);
 	}
 
-	if (opts.trace_wave)
-#if VM_TRACE
-		tfp->close();
-#else
-		(void)tfp;
-#endif
-	dut->final();
-	delete dut;
+	const uint64_t dut_minstret = dut->rootp->SimTop__DOT__core__DOT__csr__DOT__minstret;
+	wave.close();
+	model_cache.release();
 #if VM_TRACE
 	delete tfp;
 #endif
+	if (fork_index >= 0)
+		fanout.finish_child(fork_index, uart, pass);
+	if (stats != nullptr)
+	{
+		stats->cycles = sim_time / 2 - perf.skipped_cycles;
+		stats->retired = dut_minstret;
+	}
 	return pass;
 }
@@ -0,0 +1,28 @@
+#ifndef ION_ROI_H
+#define ION_ROI_H
+
+// Region-of-interest markers for the Verilator harness (ION_PERF=1). Each is
+// `slti x0, x0, op << 8 | id`, a NOP everywhere else, so payloads keep them
+// in difftest and hardware builds. id is 0..255; ION_ROI_NAMES names it.
+
+#define ION_ROI_OP_START 1
+#define ION_ROI_OP_STOP 2
+#define ION_ROI_OP_RESET 3
+#define ION_ROI_OP_SNAPSHOT 4
+
+#ifdef __ASSEMBLER__
+
+#define ION_ROI(op, id) slti x0, x0, ((op) << 8) | ((id) & 0xff)
+
+#else
+
+#define ION_ROI(op, id) __asm__ volatile("slti x0, x0, %0" ::"i"(((op) << 8) | ((id) & 0xff)) : "memory")
+
+#endif
+
+#define ION_ROI_START(id) ION_ROI(ION_ROI_OP_START, id)
+#define ION_ROI_STOP(id) ION_ROI(ION_ROI_OP_STOP, id)
+#define ION_ROI_RESET(id) ION_ROI(ION_ROI_OP_RESET, id)
+#define ION_ROI_SNAPSHOT(id) ION_ROI(ION_ROI_OP_SNAPSHOT, id)
+
+#endif
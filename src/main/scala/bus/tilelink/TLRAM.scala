@@ -4,7 +4,64 @@ import chisel3._
 import chisel3.util._
 import chisel3.util.experimental.loadMemoryFromFileInline
 
-class TLRAM(params: TLParams, sizeBytes: Int, base: BigInt = 0, initFile: String = "") extends Module {
+// Simulation-only backing store for TLRAM(sparse = true). The array lives in
+// the C++ harness as 4 KiB pages allocated on first write; reads and writes
+// are one 64-bit beat per call, indexed by beat. `ion_sram_attach` runs from
+// an initial block so the harness can bind a store to this instance's scope.
+class TLRAMSparseBackend(sizeBytes: Int) extends BlackBox(Map("SIZE_BYTES" -> sizeBytes)) with HasBlackBoxInline {
+    val io = IO(new Bundle {
+        val clock = Input(Clock())
+        val ren   = Input(Bool())
+        val raddr = Input(UInt(64.W))
+        val rdata = Output(UInt(64.W))
+        val wen   = Input(Bool())
+        val waddr = Input(UInt(64.W))
+        val wdata = Input(UInt(64.W))
+        val wmask = Input(UInt(8.W))
+    })
+
+    setInline(
+        "TLRAMSparseBackend.sv",
+        """
+module TLRAMSparseBackend #(
+    parameter longint SIZE_BYTES = 0
+)(
+    input  logic        clock,
+    input  logic        ren,
+    input  logic [63:0] raddr,
+    output logic [63:0] rdata,
+    input  logic        wen,
+    input  logic [63:0] waddr,
+    input  logic [63:0] wdata,
+    input  logic [7:0]  wmask
+);
+
+import "DPI-C" context function void ion_sram_attach(input longint size_bytes);
+import "DPI-C" context function longint ion_sram_read(input longint index);
+import "DPI-C" context function void ion_sram_write(input longint index, input longint data, input byte mask);
+
+initial begin
+    ion_sram_attach(SIZE_BYTES);
+end
+
+always @(posedge clock) begin
+    if (ren) begin
+        rdata <= ion_sram_read(raddr);
+    end
+    if (wen) begin
+        ion_sram_write(waddr, wdata, wmask);
+    end
+end
+
+endmodule
+"""
+    )
+}
+
+// `sparse` swaps the SyncReadMem for TLRAMSparseBackend so large simulated
+// SRAMs only cost host memory for the pages software actually touches. The
+// TileLink side and the one-cycle read latency are the same for both.
+class TLRAM(params: TLParams, sizeBytes: Int, base: BigInt = 0, initFile: String = "", sparse: Boolean = false) extends Module {
     val io = IO(new Bundle {
         val tl = Flipped(new TLBundle(params))
     })
@@ -18,12 +75,10 @@ class TLRAM(params: TLParams, sizeBytes: Int, base: BigInt = 0, initFile: String
     private val offsetBits = log2Ceil(beatBytes)
 
     require(sizeBytes % beatBytes == 0, s"sizeBytes must be multiple of $beatBytes bytes")
+    require(!sparse || params.dataWidth == 64, "sparse TLRAM backend moves 64-bit beats")
+    require(!sparse || initFile.isEmpty, "sparse TLRAM is loaded by the harness, not from an init file")
 
     val depth = sizeBytes / beatBytes
-    val mem   = SyncReadMem(depth, Vec(beatBytes, UInt(8.W)))
-    if (initFile.nonEmpty) {
-        loadMemoryFromFileInline(mem, initFile)
-    }
 
     val req_queue = Queue(io.tl.a, 2)
     val rel_queue = Queue(io.tl.c, 2)
@@ -71,13 +126,29 @@ class TLRAM(params: TLParams, sizeBytes: Int, base: BigInt = 0, initFile: String
 
     val req_fire = take_request
     val rel_fire = take_release
-    val mem_rdata = mem.read(addr_idx, req_fire && is_read)
-
-    when(req_fire && is_write) {
-        mem.write(addr_idx, wdata_vec, mask_vec)
-    }
-    when(rel_fire && rel_has_data) {
-        mem.write(rel_addr_idx, rel_data_vec, rel_mask_vec)
+    val mem_rdata = if (sparse) {
+        val backing = Module(new TLRAMSparseBackend(sizeBytes))
+        // A and C are never taken in the same cycle, so one write port serves both.
+        backing.io.clock := clock
+        backing.io.ren   := req_fire && is_read
+        backing.io.raddr := addr_idx
+        backing.io.wen   := (req_fire && is_write) || (rel_fire && rel_has_data)
+        backing.io.waddr := Mux(req_fire, addr_idx, rel_addr_idx)
+        backing.io.wdata := Mux(req_fire, wdata_vec.asUInt, rel_data_vec.asUInt)
+        backing.io.wmask := Mux(req_fire, mask_vec.asUInt, rel_mask_vec.asUInt)
+        backing.io.rdata
+    } else {
+        val mem = SyncReadMem(depth, Vec(beatBytes, UInt(8.W)))
+        if (initFile.nonEmpty) {
+            loadMemoryFromFileInline(mem, initFile)
+        }
+        when(req_fire && is_write) {
+            mem.write(addr_idx, wdata_vec, mask_vec)
+        }
+        when(rel_fire && rel_has_data) {
+            mem.write(rel_addr_idx, rel_data_vec, rel_mask_vec)
+        }
+        mem.read(addr_idx, req_fire && is_read).asUInt
     }
 
     when(req_fire) {
@@ -111,7 +182,7 @@ class TLRAM(params: TLParams, sizeBytes: Int, base: BigInt = 0, initFile: String
         resp_param  := Mux(req_is_release, 0.U, TLOpcode.responseParamForA(req_opcode, req_param))
         // D-channel data keeps the requested byte lanes in their natural beat
         // positions. LSU/cache clients perform size and address-based extraction.
-        resp_data   := Mux(req_is_read && !req_denied, mem_rdata.asUInt, 0.U)
+        resp_data   := Mux(req_is_read && !req_denied, mem_rdata, 0.U)
         req_valid   := false.B
     }
 
@@ -54,6 +54,9 @@ case class SoCFeatures(
     frontendQueueEntries: Int = 4,
     sramBase: BigInt = MemoryBases.DefaultSramBase,
     sramSizeBytes: Int = MemorySizes.DefaultSramSize,
+    // Simulation-only: back SRAM with the harness's DPI-C page store instead
+    // of a Verilated array, so host memory tracks the pages software touches.
+    sparseSram: Boolean = false,
     uart: Boolean = true,
     clint: Boolean = true,
     interruptController: InterruptControllerKind.Value = InterruptControllerKind.PLIC
@@ -103,6 +106,10 @@ object SoCProfiles {
         sramSizeBytes = MemorySizes.LinuxBootSramSize
     )
 
+    // Same platform as LinuxBootPLIC, with the 128 MiB SRAM allocated by the
+    // harness on first touch. Meant for running many Linux instances per host.
+    val LinuxBootSparse: SoCFeatures = LinuxBootPLIC.copy(sparseSram = true)
+
     val ModernAIA: SoCFeatures = LinuxBootPLIC.copy(interruptController = InterruptControllerKind.AIA)
 
     val CoherentMulticorePreview: SoCFeatures = LinuxBootPLIC.copy(coherentCaches = true)
@@ -52,6 +52,7 @@ class Core(
         val debug_branch_valid = Output(Bool())
         val debug_branch_taken = Output(Bool())
         val debug_branch_redirect = Output(Bool())
+        val debug_branch_pred_hit = Output(Bool())
         val debug_branch_pred_taken = Output(Bool())
         val debug_branch_pred_correct = Output(Bool())
         val debug_commit_pc = Output(UInt(XLEN.W))
@@ -61,6 +62,9 @@ class Core(
         val debug_commit_wdest = Output(UInt(5.W))
         val debug_commit_wdata = Output(UInt(XLEN.W))
         val debug_commit_skip = Output(Bool())
+        val debug_commit_mem_valid = Output(Bool())
+        val debug_commit_mem_vaddr = Output(UInt(XLEN.W))
+        val debug_commit_mem_data = Output(UInt(XLEN.W))
         val debug_arch_event_valid = Output(Bool())
         val debug_arch_event_interrupt = Output(Bool())
         val debug_arch_event_cause = Output(UInt(XLEN.W))
@@ -507,6 +511,9 @@ class Core(
     io.debug_commit_wdest := wb.io.reg_wb.rd
     io.debug_commit_wdata := wb.io.reg_wb.data
     io.debug_commit_skip := wb.io.commit_skip
+    io.debug_commit_mem_valid := wb.io.commit_mem_valid
+    io.debug_commit_mem_vaddr := wb.io.commit_mem_vaddr
+    io.debug_commit_mem_data := wb.io.commit_mem_data
     val archEventCause = Mux(
         has_pipeline_trap,
         lsu.io.trap_info_out.cause,
@@ -542,6 +549,9 @@ class Core(
     io.debug_branch_valid := alu.io.br_info.valid
     io.debug_branch_taken := alu.io.br_info.taken
     io.debug_branch_redirect := alu.io.br_info.redirect
+    // The BTB hit travels with the instruction like pred_taken; the ALU has
+    // no use for it, so it is taken straight from the decode output.
+    io.debug_branch_pred_hit := alu.io.br_info.valid && idecode.io.pred_hit_out
     io.debug_branch_pred_taken := alu.io.br_info.valid && alu.io.pred_taken_in
     io.debug_branch_pred_correct := alu.io.br_info.valid && alu.io.pred_taken_in && alu.io.br_info.taken && !alu.io.br_info.redirect
     // CSR
@@ -604,6 +614,7 @@ class Core(
     ifetch.io.pc            := pc.io.pc_out
     ifetch.io.instr_in      := io.instr
     ifetch.io.mem_cfg       := csr.io.mem_cfg_out
+    ifetch.io.pred_hit_in   := pc.io.pred_hit
     ifetch.io.pred_taken_in := pc.io.pred_taken
     ifetch.io.pred_target_in := pc.io.pred_target
     ifetch.io.redirect      := pc.io.redirect
@@ -614,6 +625,7 @@ class Core(
     fetchEntry.pc := ifetch.io.pc_out
     fetchEntry.instr := ifetch.io.instr_out
     fetchEntry.instrLen := ifetch.io.instr_len
+    fetchEntry.predHit := ifetch.io.pred_hit_out
     fetchEntry.predTaken := ifetch.io.pred_taken_out
     fetchEntry.predTarget := ifetch.io.pred_target_out
 
@@ -646,6 +658,7 @@ class Core(
     idecode.io.instr_in      := decodeEntry.instr
     idecode.io.instr_len_in  := decodeEntry.instrLen
     idecode.io.priv          := csr.io.mem_cfg_out.priv
+    idecode.io.pred_hit_in   := decodeEntry.predHit
     idecode.io.pred_taken_in := decodeEntry.predTaken
     idecode.io.pred_target_in := decodeEntry.predTarget
     val aluBypassValid = alu.io.valid_out && alu.io.alu_out.reg_write && alu.io.alu_out.rd =/= 0.U &&
@@ -16,6 +16,7 @@ class PC(XLEN: Int, RESET_VECTOR: BigInt) extends Module {
 
         val fetch_en   = Output(Bool())
         val pc_out     = Output(UInt(XLEN.W))
+        val pred_hit   = Output(Bool())
         val pred_taken = Output(Bool())
         val pred_target = Output(UInt(XLEN.W))
         val redirect   = Output(Bool())
@@ -48,6 +49,7 @@ class PC(XLEN: Int, RESET_VECTOR: BigInt) extends Module {
     }
 
     io.pc_out     := ProgramCounter
+    io.pred_hit   := bpu.io.pred_valid
     io.pred_taken := bpu.io.pred_taken
     io.pred_target := bpu.io.pred_target
     io.redirect   := redirect
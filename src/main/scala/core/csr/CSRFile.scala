@@ -19,6 +19,8 @@ object MStatus {
         val MPRV = 17
         val SUM  = 18
         val MXR  = 19
+        val UXL  = 32
+        val SXL  = 34
 
 	    def setMIE(mstatus: UInt, enable: Bool): UInt = {
 	        val mask = (BigInt(1) << MIE).U(mstatus.getWidth.W)
@@ -33,6 +35,7 @@ object MStatus {
 	        (mstatus & ~mask) | ((level & 3.U) << MPP)
 	    }
         def getMPP(mstatus: UInt): UInt = mstatus(MPP + 1, MPP)
+	    def clearMPRV(mstatus: UInt): UInt = mstatus & ~(BigInt(1) << MPRV).U(mstatus.getWidth.W)
 }
 
 object SStatus {
@@ -282,6 +285,17 @@ class CSRFile(
         bitMask(InterruptCauseCode.SupervisorSoft) |
             bitMask(InterruptCauseCode.SupervisorTimer) |
             bitMask(InterruptCauseCode.SupervisorExt)
+    // Only the privilege-stack and memory-privilege fields are implemented;
+    // FS/XS/SD and TVM/TW/TSR read as zero. SXL/UXL are not stored: with
+    // S/U-mode on RV64 they always read 2, which the views below OR in.
+    val mstatusXlenFields =
+        if (XLEN == 64 && enabledExt.contains(Extension.S))
+            ((BigInt(2) << MStatus.SXL) | (BigInt(2) << MStatus.UXL)).U(XLEN.W)
+        else 0.U(XLEN.W)
+    val writableMstatusMask =
+        bitMask(MStatus.MIE) | bitMask(MStatus.MPIE) | (BigInt(3) << MStatus.MPP).U(XLEN.W) |
+            bitMask(SStatus.SIE) | bitMask(SStatus.SPIE) | bitMask(SStatus.SPP) |
+            bitMask(MStatus.MPRV) | bitMask(MStatus.SUM) | bitMask(MStatus.MXR)
     val writableMieMask =
         supervisorInterruptMask |
             bitMask(InterruptCauseCode.MachineSoft) |
@@ -302,7 +316,8 @@ class CSRFile(
     val sstatus =
         (mstatus & (bitMask(SStatus.SIE) | bitMask(SStatus.SPIE) | bitMask(SStatus.SPP))) |
             (mstatus & (bitMask(13) | bitMask(14) | bitMask(15) | bitMask(18) | bitMask(19))) |
-            (mstatus & (bitMask(63)))
+            (mstatus & (bitMask(63))) |
+            (mstatusXlenFields & (BigInt(3) << MStatus.UXL).U(XLEN.W))
     val sie = mie & mideleg & supervisorInterruptMask
     val sip = mip & mideleg & supervisorInterruptMask
 
@@ -319,7 +334,7 @@ class CSRFile(
         CSR.MARCHID    -> 0.U(XLEN.W),
         CSR.MIMPID     -> 0.U(XLEN.W),
         CSR.MHARTID    -> hartID.U(XLEN.W),
-        CSR.MSTATUS    -> mstatus,
+        CSR.MSTATUS    -> (mstatus | mstatusXlenFields),
         CSR.MISA       -> misa_val_with_s,
         CSR.MEDELEG    -> medeleg,
         CSR.MIDELEG    -> mideleg,
@@ -459,7 +474,7 @@ class CSRFile(
     when(writeEnable) {
         switch(writeAddr) {
             is(CSR.MSTATUS) {
-                mstatus := writeData
+                mstatus := writeData & writableMstatusMask
             }
             is(CSR.SSTATUS) {
                 val sMask = bitMask(SStatus.SIE) | bitMask(SStatus.SPIE) | bitMask(SStatus.SPP) |
@@ -601,6 +616,13 @@ class CSRFile(
         Mux(io.trap_cause(XLEN - 1), (mideleg & trapCauseBit) =/= 0.U, (medeleg & trapCauseBit) =/= 0.U)
     val requestedTrapVector = Mux(trapToSupervisor, trapVector(stvec, io.trap_cause), trapVector(mtvec, io.trap_cause))
 
+    // xRET results, shared by the update below and the commit snapshot.
+    // Returning below M-mode drops MPRV so later M-mode loads are not
+    // silently translated with the old MPP.
+    val sretMstatus = MStatus.clearMPRV(SStatus.setSPP(SStatus.setSPIE(SStatus.setSIE(mstatus, mstatus(SStatus.SPIE)), true.B), PrivilegeLevel.User))
+    val mretStack = MStatus.setMPIE(MStatus.setMPP(MStatus.setMIE(mstatus, mstatus(MStatus.MPIE)), 0.U), true.B)
+    val mretMstatus = Mux(MStatus.getMPP(mstatus) === PrivilegeLevel.Machine, mretStack, MStatus.clearMPRV(mretStack))
+
     // 处理中断和异常
     when(io.trap_valid) {
         when(trapToSupervisor) {
@@ -622,10 +644,10 @@ class CSRFile(
         }
     }.elsewhen(io.is_ret) {
         when(io.ret_type === TrapReturnType.SRET && supervisorEnabled) {
-            mstatus := SStatus.setSPP(SStatus.setSPIE(SStatus.setSIE(mstatus, mstatus(SStatus.SPIE)), true.B), PrivilegeLevel.User)
+            mstatus := sretMstatus
             CurrentPrivLevel := Mux(mstatus(SStatus.SPP), PrivilegeLevel.Supervisor, PrivilegeLevel.User)
         }.otherwise {
-            mstatus := MStatus.setMPIE(MStatus.setMPP(MStatus.setMIE(mstatus, mstatus(MStatus.MPIE)), 0.U), true.B)
+            mstatus := mretMstatus
             CurrentPrivLevel := MStatus.getMPP(mstatus)
         }
     }
@@ -653,13 +675,9 @@ class CSRFile(
     val snapshotSret = io.is_ret && io.ret_type === TrapReturnType.SRET && supervisorEnabled
     val snapshotMstatus = Mux(
         io.is_ret,
-        Mux(
-            snapshotSret,
-            SStatus.setSPP(SStatus.setSPIE(SStatus.setSIE(mstatus, mstatus(SStatus.SPIE)), true.B), PrivilegeLevel.User),
-            MStatus.setMPIE(MStatus.setMPP(MStatus.setMIE(mstatus, mstatus(MStatus.MPIE)), 0.U), true.B)
-        ),
+        Mux(snapshotSret, sretMstatus, mretMstatus),
         mstatus
-    )
+    ) | mstatusXlenFields
     val snapshotPriv = Mux(
         io.is_ret,
         Mux(snapshotSret, Mux(mstatus(SStatus.SPP), PrivilegeLevel.Supervisor, PrivilegeLevel.User), MStatus.getMPP(mstatus)),
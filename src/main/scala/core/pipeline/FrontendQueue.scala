@@ -7,6 +7,7 @@ class FrontendQueueEntry(XLEN: Int) extends Bundle {
     val pc          = UInt(XLEN.W)
     val instr       = UInt(32.W)
     val instrLen    = UInt(2.W)
+    val predHit     = Bool()
     val predTaken   = Bool()
     val predTarget  = UInt(XLEN.W)
 }
@@ -18,6 +18,7 @@ class InstrDecode(XLEN: Int = 64, enabledExt: Set[Extension.Value] = Config.enab
         val instr_in      = Input(UInt(32.W))
         val instr_len_in  = Input(UInt(2.W))
         val priv          = Input(UInt(2.W))
+        val pred_hit_in   = Input(Bool())
         val pred_taken_in = Input(Bool())
         val pred_target_in = Input(UInt(XLEN.W))
         val redirect      = Input(Bool())
@@ -31,6 +32,7 @@ class InstrDecode(XLEN: Int = 64, enabledExt: Set[Extension.Value] = Config.enab
         val valid_out      = Output(Bool())
         val decoded_out    = Output(new DecodedInstr(XLEN))
         val pc_out         = Output(UInt(XLEN.W))
+        val pred_hit_out   = Output(Bool())
         val pred_taken_out = Output(Bool())
         val pred_target_out = Output(UInt(XLEN.W))
         val trap_info      = Output(new TrapInfo(XLEN))
@@ -230,7 +232,8 @@ class InstrDecode(XLEN: Int = 64, enabledExt: Set[Extension.Value] = Config.enab
         ),
         0.U
     )
-    trap_info.value := io.instr_in
+    // ECALL reports tval = 0; illegal instructions report their encoding.
+    trap_info.value := Mux(branch_type === BranchType.ECALL, 0.U, io.instr_in)
     trap_info.is_ret := valid && (branch_type === BranchType.MRET || branch_type === BranchType.SRET || branch_type === BranchType.MNRET)
     trap_info.ret_type := MuxLookup(branch_type, TrapReturnType.None)(
         Seq(
@@ -243,6 +246,7 @@ class InstrDecode(XLEN: Int = 64, enabledExt: Set[Extension.Value] = Config.enab
     val validOutReg = RegInit(false.B)
     val decodedOutReg = RegInit(defaultDecoded)
     val pcOutReg = RegInit(0.U(XLEN.W))
+    val predHitOutReg = RegInit(false.B)
     val predTakenOutReg = RegInit(false.B)
     val predTargetOutReg = RegInit(0.U(XLEN.W))
     val trapInfoReg = RegInit(0.U.asTypeOf(io.trap_info))
@@ -251,6 +255,7 @@ class InstrDecode(XLEN: Int = 64, enabledExt: Set[Extension.Value] = Config.enab
         validOutReg := false.B
         decodedOutReg := defaultDecoded
         pcOutReg := 0.U
+        predHitOutReg := false.B
         predTakenOutReg := false.B
         predTargetOutReg := 0.U
         trapInfoReg := 0.U.asTypeOf(io.trap_info)
@@ -258,6 +263,7 @@ class InstrDecode(XLEN: Int = 64, enabledExt: Set[Extension.Value] = Config.enab
         validOutReg := valid
         decodedOutReg := Mux(valid, decoded, defaultDecoded)
         pcOutReg := io.pc_in
+        predHitOutReg := io.pred_hit_in
         predTakenOutReg := io.pred_taken_in
         predTargetOutReg := io.pred_target_in
         trapInfoReg := trap_info
@@ -266,6 +272,7 @@ class InstrDecode(XLEN: Int = 64, enabledExt: Set[Extension.Value] = Config.enab
     io.valid_out := validOutReg
     io.decoded_out := decodedOutReg
     io.pc_out := pcOutReg
+    io.pred_hit_out := predHitOutReg
     io.pred_taken_out := predTakenOutReg
     io.pred_target_out := predTargetOutReg
     io.trap_info := trapInfoReg
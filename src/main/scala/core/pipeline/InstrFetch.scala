@@ -13,6 +13,7 @@ class InstrFetch(XLEN: Int, useCache: Boolean = false, useCompressed: Boolean =
     val io = IO(new Bundle {
         val pc            = Input(UInt(XLEN.W))
         val instr_in      = Input(UInt(64.W))
+        val pred_hit_in   = Input(Bool())
         val pred_taken_in = Input(Bool())
         val pred_target_in = Input(UInt(XLEN.W))
         val redirect      = Input(Bool())
@@ -25,6 +26,7 @@ class InstrFetch(XLEN: Int, useCache: Boolean = false, useCompressed: Boolean =
         val instr_out      = Output(UInt(32.W))
         val instr_len      = Output(UInt(2.W))
         val pc_step_len    = Output(UInt(2.W))
+        val pred_hit_out   = Output(Bool())
         val pred_taken_out = Output(Bool())
         val pred_target_out = Output(UInt(XLEN.W))
         val fetch_stall    = Output(Bool())
@@ -89,6 +91,7 @@ class InstrFetch(XLEN: Int, useCache: Boolean = false, useCompressed: Boolean =
     io.pc_out         := RegEnable(io.pc, 0.U, directUpdate)
     io.instr_out      := RegEnable(directInstr, 0.U, directUpdate)
     io.instr_len      := RegEnable(directLen, 0.U, directUpdate)
+    io.pred_hit_out   := RegEnable(io.pred_hit_in, false.B, directUpdate)
     io.pred_taken_out := RegEnable(io.pred_taken_in, false.B, directUpdate)
     io.pred_target_out := RegEnable(io.pred_target_in, 0.U, directUpdate)
 
@@ -98,6 +101,7 @@ class InstrFetch(XLEN: Int, useCache: Boolean = false, useCompressed: Boolean =
         val reqPc = RegInit(0.U(XLEN.W))
         val reqPhysPc = RegInit(0.U(XLEN.W))
         val prefetchPc = RegInit(0.U(XLEN.W))
+        val reqPredHit = RegInit(false.B)
         val reqPredTaken = RegInit(false.B)
         val reqPredTarget = RegInit(0.U(XLEN.W))
         val dropResp = RegInit(false.B)
@@ -118,6 +122,7 @@ class InstrFetch(XLEN: Int, useCache: Boolean = false, useCompressed: Boolean =
         val xlateDone = RegInit(false.B)
         val xlateVaddr = RegInit(0.U(XLEN.W))
         val xlatePaddr = RegInit(0.U(XLEN.W))
+        val xlatePredHit = RegInit(false.B)
         val xlatePredTaken = RegInit(false.B)
         val xlatePredTarget = RegInit(0.U(XLEN.W))
         val fetchTrap = RegInit(0.U.asTypeOf(new TrapInfo(XLEN)))
@@ -168,6 +173,7 @@ class InstrFetch(XLEN: Int, useCache: Boolean = false, useCompressed: Boolean =
             xlateDone := false.B
             xlateVaddr := io.pc
             xlatePaddr := 0.U
+            xlatePredHit := io.pred_hit_in
             xlatePredTaken := io.pred_taken_in
             xlatePredTarget := io.pred_target_in
         }.elsewhen(xlatePending && ptw.io.resp.fire) {
@@ -204,6 +210,7 @@ class InstrFetch(XLEN: Int, useCache: Boolean = false, useCompressed: Boolean =
         when(canIssue) {
             reqPc := io.pc
             reqPhysPc := Mux(translatedReady, xlatePaddr, io.pc)
+            reqPredHit := Mux(translatedReady, xlatePredHit, io.pred_hit_in)
             reqPredTaken := Mux(translatedReady, xlatePredTaken, io.pred_taken_in)
             reqPredTarget := Mux(translatedReady, xlatePredTarget, io.pred_target_in)
             dropResp := false.B
@@ -381,6 +388,11 @@ class InstrFetch(XLEN: Int, useCache: Boolean = false, useCompressed: Boolean =
         io.pc_out := Mux(canServeBuffered, io.pc, acceptedPc)
         io.instr_out := Mux(canServeBuffered, bufferedExpanded._1, acceptedInstr)
         io.instr_len := Mux(canServeBuffered, bufferedExpanded._2, acceptedLen)
+        io.pred_hit_out := Mux(
+            canServeBuffered,
+            io.pred_hit_in,
+            Mux(acceptPrefetchResp, io.pred_hit_in, reqPredHit)
+        )
         io.pred_taken_out := Mux(
             canServeBuffered,
             io.pred_taken_in,
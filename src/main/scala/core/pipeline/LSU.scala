@@ -93,6 +93,15 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
         (rawData >> shiftBits)(XLEN - 1, 0)
     }
 
+    private def accessSizedData(value: UInt, size: UInt): UInt =
+        MuxLookup(size, value)(
+            Seq(
+                0.U -> Cat(0.U((XLEN - 8).W), value(7, 0)),
+                1.U -> Cat(0.U((XLEN - 16).W), value(15, 0)),
+                2.U -> Cat(0.U((XLEN - 32).W), value(31, 0))
+            )
+        )
+
     private def formatAtomicReadData(rawData: UInt, access: MemoryAccessInfo): UInt = {
         val shifted = shiftedData(rawData, access)
         Mux(access.size === 2.U, Cat(Fill(XLEN - 32, shifted(31)), shifted(31, 0)), shifted)
@@ -278,6 +287,9 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
     val loadWbSlotInstr = RegInit(0.U(32.W))
     val loadWbSlotInstrLen = RegInit(0.U(2.W))
     val loadWbSlotDiffSkip = RegInit(false.B)
+    val loadWbSlotMemValid = RegInit(false.B)
+    val loadWbSlotMemVaddr = RegInit(0.U(XLEN.W))
+    val loadWbSlotMemData = RegInit(0.U(XLEN.W))
     val sameConsumedInput = inputConsumed &&
         consumedPc === io.pc_in &&
         consumedOp === memAccess.op &&
@@ -294,6 +306,8 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
     val splitStoreData = RegInit(0.U(XLEN.W))
     val splitStoreMask = RegInit(0.U((XLEN / 8).W))
     val splitStoreSize = RegInit(0.U(3.W))
+    val splitStoreMemVaddr = RegInit(0.U(XLEN.W))
+    val splitStoreMemData = RegInit(0.U(XLEN.W))
     val splitStoreRetireValid = RegInit(false.B)
     val splitStoreRetirePc = RegInit(0.U(XLEN.W))
     val splitStoreRetireInstr = RegInit(0.U(32.W))
@@ -344,6 +358,8 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
         splitStoreData := storeHighData
         splitStoreMask := storeHighMask
         splitStoreSize := memAccess.size
+        splitStoreMemVaddr := memAccess.vaddr
+        splitStoreMemData := accessSizedData(io.alu_out.result, memAccess.size)
     }
 
     when(storeEnqFire && split_cache_store) {
@@ -814,6 +830,9 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
 	        loadWbSlotInstr := io.alu_out.instr
 	        loadWbSlotInstrLen := io.alu_out.instr_len
 	        loadWbSlotDiffSkip := false.B
+	        loadWbSlotMemValid := true.B
+	        loadWbSlotMemVaddr := memAccess.vaddr
+	        loadWbSlotMemData := accessSizedData(formatLoadData(storeBuffer.io.search_data, memAccess), memAccess.size)
 	    }.elsewhen(is_load_resp && !is_cache_resp_err) {
 	        loadWbSlotValid := true.B
 	        loadWbSlotRd := loadRespRd
@@ -823,6 +842,9 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
         loadWbSlotInstr := loadRespInstr
         loadWbSlotInstrLen := loadRespInstrLen
         loadWbSlotDiffSkip := false.B
+        loadWbSlotMemValid := true.B
+        loadWbSlotMemVaddr := loadRespAccess.vaddr
+        loadWbSlotMemData := accessSizedData(cacheRespLoadData, loadRespAccess.size)
     }.elsewhen(is_mmio_load_resp && !is_mmio_resp_err) {
         loadWbSlotValid := true.B
         loadWbSlotRd := mmioRd
@@ -832,6 +854,9 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
         loadWbSlotInstr := mmioInstr
         loadWbSlotInstrLen := mmioInstrLen
         loadWbSlotDiffSkip := true.B
+        loadWbSlotMemValid := true.B
+        loadWbSlotMemVaddr := mmioAccess.vaddr
+        loadWbSlotMemData := accessSizedData(formatLoadData(io.mmio.resp_data, mmioAccess), mmioAccess.size)
     }.elsewhen(is_mmio_store_resp && !is_mmio_resp_err) {
         loadWbSlotValid := true.B
         loadWbSlotRd := 0.U
@@ -841,6 +866,9 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
         loadWbSlotInstr := mmioInstr
         loadWbSlotInstrLen := mmioInstrLen
         loadWbSlotDiffSkip := true.B
+        loadWbSlotMemValid := true.B
+        loadWbSlotMemVaddr := mmioAccess.vaddr
+        loadWbSlotMemData := accessSizedData(shiftedData(mmioAccess.wdata, mmioAccess), mmioAccess.size)
     }.elsewhen(is_atomic_resp && !atomicRespErr) {
         loadWbSlotValid := true.B
         loadWbSlotRd := atomicRd
@@ -850,6 +878,17 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
         loadWbSlotInstr := atomicInstr
         loadWbSlotInstrLen := atomicInstrLen
         loadWbSlotDiffSkip := false.B
+        loadWbSlotMemValid := true.B
+        loadWbSlotMemVaddr := atomicAccess.vaddr
+        // LR reports the value read; SC and AMOs the value they store.
+        loadWbSlotMemData := accessSizedData(
+            Mux(
+                atomicAccess.op === MemOpType.LR,
+                atomicRespData,
+                shiftedData(Mux(atomicAccess.op === MemOpType.SC, atomicAccess.wdata, atomicWriteData), atomicAccess)
+            ),
+            atomicAccess.size
+        )
     }
     val stall_valid      = RegInit(false.B)
     val stall_wb_data    = RegInit(0.U(XLEN.W))
@@ -961,6 +1000,15 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
     val out_pc        = RegEnable(io.pc_in, 0.U, update_en)
     val out_instr     = RegEnable(io.alu_out.instr, 0.U, update_en)
     val out_instr_len = RegEnable(io.alu_out.instr_len, 0.U, update_en)
+    // Stores that went into the store buffer and loads it forwarded retire
+    // here; nothing on the D-cache port belongs to them at this point.
+    val out_mem_valid = RegEnable(normalStageValid && ((is_store && !is_device && !split_cache_store) || load_hit_sb), false.B, update_en)
+    val out_mem_vaddr = RegEnable(memAccess.vaddr, 0.U, update_en)
+    val out_mem_data  = RegEnable(
+        accessSizedData(Mux(is_store, io.alu_out.result, formatLoadData(storeBuffer.io.search_data, memAccess)), memAccess.size),
+        0.U,
+        update_en
+    )
 
 	    val normalValidOut = RegNext(
 	        (normalStageValid && writeback_en && !is_load_resp && !slotRespValid || normalLoadDataValid) &&
@@ -974,6 +1022,9 @@ class LSU(XLEN: Int = 64, features: SoCFeatures = Config.features) extends Modul
     io.mem_out.reg_write := Mux(loadWbSlotValid, loadWbSlotRegWrite, Mux(fenceRetireValid || splitStoreRetireValid, false.B, Mux(normalLoadDataValid, response_reg_write, out_reg_write)))
     io.mem_out.result    := Mux(loadWbSlotValid, loadWbSlotData, Mux(fenceRetireValid || splitStoreRetireValid, 0.U, Mux(normalLoadDataValid, load_data, out_result)))
     io.mem_out.diff_skip := loadWbSlotValid && loadWbSlotDiffSkip
+    io.mem_out.mem_valid := Mux(loadWbSlotValid, loadWbSlotMemValid, Mux(fenceRetireValid, false.B, splitStoreRetireValid || out_mem_valid))
+    io.mem_out.mem_vaddr := Mux(loadWbSlotValid, loadWbSlotMemVaddr, Mux(splitStoreRetireValid, splitStoreMemVaddr, out_mem_vaddr))
+    io.mem_out.mem_data  := Mux(loadWbSlotValid, loadWbSlotMemData, Mux(splitStoreRetireValid, splitStoreMemData, out_mem_data))
     io.pc_out            := Mux(loadWbSlotValid, loadWbSlotPc, Mux(fenceRetireValid, fenceRetirePc, Mux(splitStoreRetireValid, splitStoreRetirePc, out_pc)))
     io.trap_info_out     := out_trap
 
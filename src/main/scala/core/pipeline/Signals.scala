@@ -150,6 +150,11 @@ class MemOut(XLEN: Int) extends Bundle {
     val rd        = UInt(5.W)
     val reg_write = Bool()
     val diff_skip = Bool()
+    // The access this instruction made, for the commit debug port: virtual
+    // address and the data read or written, zero-extended from its size.
+    val mem_valid = Bool()
+    val mem_vaddr = UInt(XLEN.W)
+    val mem_data  = UInt(XLEN.W)
 }
 
 class RegWrite(XLEN: Int) extends Bundle {
@@ -14,6 +14,9 @@ class WirteBack(XLEN: Int = 64) extends Module {
         val commit_instr = Output(UInt(32.W))
         val commit_instr_len = Output(UInt(2.W))
         val commit_skip = Output(Bool())
+        val commit_mem_valid = Output(Bool())
+        val commit_mem_vaddr = Output(UInt(XLEN.W))
+        val commit_mem_data = Output(UInt(XLEN.W))
     })
 
     io.reg_wb.reg_write := Mux(io.reg_wb.rd === 0.U, false.B, io.mem_in.reg_write && io.valid_in && !io.trap_info.valid)
@@ -22,4 +25,7 @@ class WirteBack(XLEN: Int = 64) extends Module {
     io.commit_instr     := Mux(io.valid_in && !io.trap_info.valid, io.mem_in.instr, 0.U)
     io.commit_instr_len := Mux(io.valid_in && !io.trap_info.valid, io.mem_in.instr_len, 0.U)
     io.commit_skip      := io.valid_in && !io.trap_info.valid && io.mem_in.diff_skip
+    io.commit_mem_valid := io.valid_in && !io.trap_info.valid && io.mem_in.mem_valid
+    io.commit_mem_vaddr := io.mem_in.mem_vaddr
+    io.commit_mem_data  := io.mem_in.mem_data
 }
@@ -20,6 +20,7 @@ class DebugIO extends Bundle {
     val branchValid = Output(Bool())
     val branchTaken = Output(Bool())
     val branchRedirect = Output(Bool())
+    val branchPredHit = Output(Bool())
     val branchPredTaken = Output(Bool())
     val branchPredCorrect = Output(Bool())
     val commitPc = Output(UInt(64.W))
@@ -29,6 +30,9 @@ class DebugIO extends Bundle {
     val commitWdest = Output(UInt(5.W))
     val commitWdata = Output(UInt(64.W))
     val commitSkip = Output(Bool())
+    val commitMemValid = Output(Bool())
+    val commitMemVaddr = Output(UInt(64.W))
+    val commitMemData = Output(UInt(64.W))
 }
 
 class DebugCacheControl extends Bundle {
@@ -47,6 +47,15 @@ class IonSoC(
         val jtag_tck = Input(Bool())
         val jtag_tdi = Input(Bool())
         val jtag_tdo = Output(Bool())
+        // Simulation DMI port: the Verilator harness DMI server injects whole
+        // DMI requests here instead of shifting them through the TAP. Tie
+        // dmi_req_valid low when the JTAG pins are the only debug transport.
+        val dmi_req_valid = Input(Bool())
+        val dmi_req_write = Input(Bool())
+        val dmi_req_addr = Input(UInt(7.W))
+        val dmi_req_wdata = Input(UInt(32.W))
+        val dmi_resp_rdata = Output(UInt(32.W))
+        val dmi_resp_op = Output(UInt(2.W))
         val debug_arch_event_valid = Output(Bool())
         val debug_arch_event_interrupt = Output(Bool())
         val debug_arch_event_cause = Output(UInt(Config.XLEN.W))
@@ -58,7 +67,7 @@ class IonSoC(
 
     val core  = Module(new Core(Config.XLEN, hartID = 0, features, enabledExt))
     val brom  = Module(new BROM(Config.XLEN, Config.romDepth, Config.romInit))
-    val sram  = Module(new TLRAM(deviceParams, features.sramSizeBytes, features.sramBase, sramInitFile))
+    val sram  = Module(new TLRAM(deviceParams, features.sramSizeBytes, features.sramBase, sramInitFile, features.sparseSram))
     val debugModule = Module(new DebugModule(deviceParams, dbusParams))
     val tlrom = Module(new TLROM(deviceParams))
     val uart  = if (features.uart) Some(Module(new UartTx(deviceParams))) else None
@@ -97,10 +106,12 @@ class IonSoC(
     jtag.io.jtag.tdi := io.jtag_tdi
     io.jtag_tdo := jtag.io.jtag.tdo
     jtag.io.dr_in := Cat(0.U(30.W), debugModule.io.dmi_rdata, debugModule.io.dmi_resp_op)
-    debugModule.io.dmi_valid := RegNext(jtag.io.update_dr, false.B)
-    debugModule.io.dmi_write := jtag.io.dr_out(1, 0) === 2.U
-    debugModule.io.dmi_addr  := jtag.io.dr_out(40, 34)
-    debugModule.io.dmi_wdata := jtag.io.dr_out(33, 2)
+    debugModule.io.dmi_valid := RegNext(jtag.io.update_dr, false.B) || io.dmi_req_valid
+    debugModule.io.dmi_write := Mux(io.dmi_req_valid, io.dmi_req_write, jtag.io.dr_out(1, 0) === 2.U)
+    debugModule.io.dmi_addr  := Mux(io.dmi_req_valid, io.dmi_req_addr, jtag.io.dr_out(40, 34))
+    debugModule.io.dmi_wdata := Mux(io.dmi_req_valid, io.dmi_req_wdata, jtag.io.dr_out(33, 2))
+    io.dmi_resp_rdata := debugModule.io.dmi_rdata
+    io.dmi_resp_op := debugModule.io.dmi_resp_op
     debugModule.io.hart_halted := core.io.debug_halted
     debugModule.io.hart_pc := core.io.pc
     debugModule.io.gpr_rdata := core.io.debug_gpr_rdata
@@ -179,6 +190,7 @@ class IonSoC(
     io.debug.branchValid := core.io.debug_branch_valid
     io.debug.branchTaken := core.io.debug_branch_taken
     io.debug.branchRedirect := core.io.debug_branch_redirect
+    io.debug.branchPredHit := core.io.debug_branch_pred_hit
     io.debug.branchPredTaken := core.io.debug_branch_pred_taken
     io.debug.branchPredCorrect := core.io.debug_branch_pred_correct
     io.debug.commitPc := core.io.debug_commit_pc
@@ -188,6 +200,9 @@ class IonSoC(
     io.debug.commitWdest := core.io.debug_commit_wdest
     io.debug.commitWdata := core.io.debug_commit_wdata
     io.debug.commitSkip := core.io.debug_commit_skip
+    io.debug.commitMemValid := core.io.debug_commit_mem_valid
+    io.debug.commitMemVaddr := core.io.debug_commit_mem_vaddr
+    io.debug.commitMemData := core.io.debug_commit_mem_data
     io.debug_arch_event_valid := core.io.debug_arch_event_valid
     io.debug_arch_event_interrupt := core.io.debug_arch_event_interrupt
     io.debug_arch_event_cause := core.io.debug_arch_event_cause
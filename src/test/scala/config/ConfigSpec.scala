@@ -42,6 +42,9 @@ class ConfigSpec extends AnyFunSuite {
         assert(SoCProfiles.LinuxBootPLIC.mmu)
         assert(SoCProfiles.LinuxBootPLIC.iCache)
         assert(SoCProfiles.LinuxBootPLIC.dCache)
+        assert(!SoCProfiles.LinuxBootPLIC.sparseSram)
+        assert(SoCProfiles.LinuxBootSparse.sparseSram)
+        assert(SoCProfiles.LinuxBootSparse.copy(sparseSram = false) == SoCProfiles.LinuxBootPLIC)
         assert(!Config.mmioRegionsFor(SoCProfiles.ModernAIA).map(_.name).contains("plic"))
         assert(SoCProfiles.ModernAIA.mmu)
     }
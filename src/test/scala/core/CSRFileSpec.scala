@@ -16,6 +16,7 @@ class CSRFileSpec extends AnyFunSuite with ChiselSim {
     private val mstatusSum = BigInt(1) << 18
     private val mstatusMxr = BigInt(1) << 19
     private val mstatusMppS = BigInt(1) << 11
+    private val sstatusUxl = BigInt(2) << 32
 
     private def init(dut: CSRFile): Unit = {
         dut.io.valid.poke(false.B)
@@ -420,7 +421,7 @@ class CSRFileSpec extends AnyFunSuite with ChiselSim {
             dut.io.mem_cfg_out.mxr.expect(true.B)
             dut.io.mem_cfg_out.sum.expect(false.B)
             dut.io.addr.poke(CSR.SSTATUS)
-            dut.io.rdata.expect(mstatusMxr.U)
+            dut.io.rdata.expect((mstatusMxr | sstatusUxl).U)
 
             writeCsr(dut, CSR.MSTATUS, mstatusMprv | mstatusMppS | mstatusMxr | mstatusSum)
             dut.io.mem_cfg_out.priv.expect(PrivilegeLevel.Machine)
@@ -431,6 +432,34 @@ class CSRFileSpec extends AnyFunSuite with ChiselSim {
         }
     }
 
+    test("CSRFile masks unimplemented mstatus fields, reads SXL/UXL as 2 and clears MPRV on return below M-mode") {
+        simulate(new CSRFile(xlen, hartID = 0)) { dut =>
+            init(dut)
+
+            // SXL = UXL = 2 (RV64) survive a write of zero as well as all ones.
+            writeCsr(dut, CSR.MSTATUS, (BigInt(1) << 64) - 1)
+            assert(readCsr(dut, CSR.MSTATUS) == BigInt("a000e19aa", 16))
+            writeCsr(dut, CSR.MSTATUS, 0)
+            assert(readCsr(dut, CSR.MSTATUS) == BigInt("a00000000", 16))
+            assert(readCsr(dut, CSR.SSTATUS) == sstatusUxl)
+
+            writeCsr(dut, CSR.MSTATUS, mstatusMprv | (BigInt(3) << 11))
+            takeRet(dut)
+            dut.io.mem_cfg_out.priv.expect(PrivilegeLevel.Machine)
+            dut.io.mem_cfg_out.mprv.expect(true.B)
+
+            writeCsr(dut, CSR.MSTATUS, mstatusMprv | mstatusMppS)
+            // The commit snapshot shows the post-MRET mstatus in the same cycle.
+            dut.io.ret_type.poke(TrapReturnType.MRET)
+            dut.io.is_ret.poke(true.B)
+            assert((dut.io.state_snapshot.mstatus.peek().litValue & mstatusMprv) == 0)
+            dut.io.state_snapshot.privilegeMode.expect(PrivilegeLevel.Supervisor)
+            takeRet(dut)
+            dut.io.mem_cfg_out.priv.expect(PrivilegeLevel.Supervisor)
+            dut.io.mem_cfg_out.mprv.expect(false.B)
+        }
+    }
+
     test("CSRFile counts retire and selected HPM events") {
         simulate(new CSRFile(xlen, hartID = 0)) { dut =>
             init(dut)
@@ -12,6 +12,7 @@ class FrontendQueueSpec extends AnyFunSuite with ChiselSim {
         dut.io.enq.bits.pc.poke(0.U)
         dut.io.enq.bits.instr.poke(0.U)
         dut.io.enq.bits.instrLen.poke(0.U)
+        dut.io.enq.bits.predHit.poke(false.B)
         dut.io.enq.bits.predTaken.poke(false.B)
         dut.io.enq.bits.predTarget.poke(0.U)
         dut.io.deq.ready.poke(false.B)
@@ -22,6 +23,7 @@ class FrontendQueueSpec extends AnyFunSuite with ChiselSim {
         dut.io.enq.bits.pc.poke(pc.U)
         dut.io.enq.bits.instr.poke(instr.U)
         dut.io.enq.bits.instrLen.poke(0.U)
+        dut.io.enq.bits.predHit.poke(false.B)
         dut.io.enq.bits.predTaken.poke(false.B)
         dut.io.enq.bits.predTarget.poke(0.U)
     }
@@ -14,6 +14,7 @@ class InstrDecodeSpec extends AnyFunSuite with ChiselSim {
         dut.io.instr_in.poke("h00000013".U)
         dut.io.instr_len_in.poke(0.U)
         dut.io.priv.poke(PrivilegeLevel.Machine)
+        dut.io.pred_hit_in.poke(false.B)
         dut.io.pred_taken_in.poke(false.B)
         dut.io.pred_target_in.poke(0.U)
         dut.io.redirect.poke(false.B)
@@ -49,6 +50,7 @@ class InstrDecodeSpec extends AnyFunSuite with ChiselSim {
             dut.clock.step()
             dut.io.trap_info.valid.expect(true.B)
             dut.io.trap_info.cause.expect(MCause.EcallFromMMode)
+            dut.io.trap_info.value.expect(0.U)
 
             dut.io.priv.poke(PrivilegeLevel.Supervisor)
             dut.clock.step()
@@ -19,6 +19,7 @@ class InstrFetchSpec extends AnyFunSuite with ChiselSim {
     private def init(dut: InstrFetch): Unit = {
         dut.io.pc.poke("h80000000".U)
         dut.io.instr_in.poke("h0000000000000013".U)
+        dut.io.pred_hit_in.poke(false.B)
         dut.io.pred_taken_in.poke(false.B)
         dut.io.pred_target_in.poke(0.U)
         dut.io.redirect.poke(false.B)
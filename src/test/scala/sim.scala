@@ -28,6 +28,9 @@ class SimTopFirmware extends IonSoC(SoCProfiles.LinuxCapablePLIC, ISAProfiles.RV
 class SimTopLinux extends IonSoC(SoCProfiles.LinuxBootPLIC, ISAProfiles.RV64IMACB) {
     override def desiredName: String = "SimTop"
 }
+class SimTopLinuxSparse extends IonSoC(SoCProfiles.LinuxBootSparse, ISAProfiles.RV64IMACB) {
+    override def desiredName: String = "SimTop"
+}
 
 object EmitHelper {
     def emit(top: => RawModule, targetDir: String = "build/rtl"): Unit = {
@@ -59,6 +62,10 @@ object LinuxTopMain extends App {
     EmitHelper.emit(new SimTopLinux, "build/rtl-linux")
 }
 
+object LinuxSparseTopMain extends App {
+    EmitHelper.emit(new SimTopLinuxSparse, "build/rtl-linux-sparse")
+}
+
 object DeviceTreeMain extends App {
     val output = Path.of(args.headOption.getOrElse("simulator/build/ionsoc.dts"))
     val profile = args.lift(1).getOrElse("firmware")
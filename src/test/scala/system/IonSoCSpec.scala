@@ -18,6 +18,10 @@ class IonSoCSpec extends AnyFunSuite with ChiselSim {
         dut.io.jtag_tms.poke(true)
         dut.io.jtag_tck.poke(false)
         dut.io.jtag_tdi.poke(false)
+        dut.io.dmi_req_valid.poke(false)
+        dut.io.dmi_req_write.poke(false)
+        dut.io.dmi_req_addr.poke(0)
+        dut.io.dmi_req_wdata.poke(0)
     }
 
     test("IonSoC elaborates with instruction cache enabled") {
@@ -67,6 +71,39 @@ class IonSoCSpec extends AnyFunSuite with ChiselSim {
         }
     }
 
+    test("Simulation DMI port halts the core without the TAP") {
+        simulate(new IonSoC(SoCFeatures(iCache = false))) { dut =>
+            tieOffExternalInterrupts(dut)
+            dut.clock.step(4)
+
+            portDmiWrite(dut, DebugModuleMap.DMControl, BigInt("80000001", 16))
+            val haltedPc = waitStablePc(dut)
+            dut.clock.step(8)
+            dut.io.debug.pc.expect(haltedPc.U)
+            assert((portDmiRead(dut, DebugModuleMap.DMStatus) & (1 << 9)) != 0, "dmstatus.allhalted not set")
+        }
+    }
+
+    private def portDmiWrite(dut: IonSoC, addr: Int, data: BigInt): Unit = {
+        dut.io.dmi_req_valid.poke(true)
+        dut.io.dmi_req_write.poke(true)
+        dut.io.dmi_req_addr.poke(addr)
+        dut.io.dmi_req_wdata.poke(data)
+        dut.clock.step()
+        dut.io.dmi_req_valid.poke(false)
+        dut.io.dmi_resp_op.expect(0)
+    }
+
+    private def portDmiRead(dut: IonSoC, addr: Int): BigInt = {
+        dut.io.dmi_req_valid.poke(true)
+        dut.io.dmi_req_write.poke(false)
+        dut.io.dmi_req_addr.poke(addr)
+        val data = dut.io.dmi_resp_rdata.peek().litValue
+        dut.clock.step()
+        dut.io.dmi_req_valid.poke(false)
+        data
+    }
+
     private def pulseTck(dut: IonSoC, tms: Boolean, tdi: Boolean = false): Boolean = {
         dut.io.jtag_tms.poke(tms.B)
         dut.io.jtag_tdi.poke(tdi.B)